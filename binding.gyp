@@ -1,10 +1,28 @@
 {
+  "variables": {
+    "enable_lto%": "false",
+    "use_libjpeg%": "false",
+    "enable_neon%": "false"
+  },
   "targets": [
     {
       "target_name": "libraw_addon",
       "sources": [
         "src/addon.cpp",
-        "src/libraw_wrapper.cpp"
+        "src/libraw_processor.cpp",
+        "src/libraw_wrapper.cpp",
+        "src/band_writer.cpp",
+        "src/bayer_stream.cpp",
+        "src/calibration.cpp",
+        "src/deadline_watchdog.cpp",
+        "src/job_scheduler.cpp",
+        "src/jpeg_preview.cpp",
+        "src/metrics.cpp",
+        "src/png_writer.cpp",
+        "src/raw_disk_cache.cpp",
+        "src/shared_cache.cpp",
+        "src/simd_kernels.cpp",
+        "src/tile_pyramid.cpp"
       ],
       "include_dirs": [
         "<!@(node -p \"require('node-addon-api').include\")",
@@ -23,6 +41,13 @@
         "USE_LCMS2"
       ],
       "conditions": [
+        ["enable_neon=='true'", {
+          "defines": ["LIBRAW_ENABLE_NEON"]
+        }],
+        ["use_libjpeg=='true'", {
+          "defines": ["USE_LIBJPEG"],
+          "libraries": ["-ljpeg"]
+        }],
         ["OS=='win'", {
           "libraries": [
             "<(module_root_dir)/deps/LibRaw-Source/LibRaw-0.21.4/build/win32/lib/libraw.a",
@@ -45,6 +70,11 @@
         }],
         ["OS=='mac'", {
           "conditions": [
+            ["enable_lto=='true'", {
+              "xcode_settings": {
+                "LLVM_LTO": "YES_THIN"
+              }
+            }],
             ["target_arch=='arm64'", {
               "libraries": [
                 "<(module_root_dir)/deps/LibRaw-Source/LibRaw-0.21.4/build/darwin-arm64/lib/libraw.a",
@@ -61,6 +91,10 @@
         ["OS=='linux'", {
           "cflags": ["-fPIC"],
           "conditions": [
+            ["enable_lto=='true'", {
+              "cflags": ["-flto=auto"],
+              "ldflags": ["-flto=auto"]
+            }],
             ["target_arch=='arm64'", {
               "libraries": [
                 "<(module_root_dir)/deps/LibRaw-Source/LibRaw-0.21.4/build/linux-arm64/lib/libraw.a",
@@ -2631,10 +2631,14 @@ void LibRaw::crxLoadDecodeLoop(void *img, int nPlanes)
   for (int32_t plane = 0; plane < nPlanes; ++plane)
     if (results[plane])
       derror();
+  checkCancel();
 #else
   for (int32_t plane = 0; plane < nPlanes; ++plane)
+  {
+    checkCancel();
     if (crxDecodePlane(img, plane))
       derror();
+  }
 #endif
 }
 
@@ -2702,10 +2706,19 @@ void LibRaw::crxLoadRaw()
 	  hdrBuf.data(), hdr.mdatHdrSize))
     throw LIBRAW_EXCEPTION_IO_CORRUPT;
 
-  crxLoadDecodeLoop(&img, hdr.nPlanes);
+  try
+  {
+    crxLoadDecodeLoop(&img, hdr.nPlanes);
 
-  if (img.encType == 3)
-    crxLoadFinalizeLoopE3(&img, img.planeHeight);
+    if (img.encType == 3)
+      crxLoadFinalizeLoopE3(&img, img.planeHeight);
+  }
+  catch (...)
+  {
+    // plane buffers are not owned by the memory manager: free before unwinding
+    crxFreeImageData(&img);
+    throw;
+  }
 
   crxFreeImageData(&img);
 }
@@ -1155,9 +1155,15 @@ void LibRaw::fuji_decode_loop(fuji_compressed_params *common_info, int count, IN
 #endif
   for (cur_block = 0; cur_block < count; cur_block++)
   {
+#ifndef LIBRAW_USE_OPENMP
+    checkCancel();
+#endif
     fuji_decode_strip(common_info, cur_block, raw_block_offsets[cur_block], block_sizes[cur_block],
                       q_bases ? q_bases + cur_block * lineStep : 0);
   }
+#ifdef LIBRAW_USE_OPENMP
+  checkCancel();
+#endif
 }
 
 void LibRaw::parse_fuji_compressed_header()
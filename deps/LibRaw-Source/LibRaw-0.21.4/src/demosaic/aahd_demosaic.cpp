@@ -47,6 +47,13 @@ struct AAHD
   static float gammaLUT[0x10000];
   float yuv_cam[3][3];
   LibRaw &libraw;
+  /* Set by LibRaw::aahd_interpolate() to reach the protected checkCancel() */
+  void (*cancel_check)(LibRaw &);
+  inline void check_cancel()
+  {
+    if (cancel_check)
+      cancel_check(libraw);
+  }
   enum
   {
     HVSH = 1,
@@ -126,7 +133,7 @@ const float AAHD::yuv_coeff[3][3] = {
 
 float AAHD::gammaLUT[0x10000] = {-1.f};
 
-AAHD::AAHD(LibRaw &_libraw) : libraw(_libraw)
+AAHD::AAHD(LibRaw &_libraw) : libraw(_libraw), cancel_check(0)
 {
   nr_height = libraw.imgdata.sizes.iheight + nr_margin * 2;
   nr_width = libraw.imgdata.sizes.iwidth + nr_margin * 2;
@@ -352,6 +359,7 @@ void AAHD::evaluate_ahd()
    * Lab */
   for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
+    check_cancel();
     int moff = nr_offset(i + nr_margin, nr_margin);
     for (int j = 0; j < libraw.imgdata.sizes.iwidth; j++, ++moff)
     {
@@ -403,6 +411,7 @@ void AAHD::evaluate_ahd()
   }
   for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
+    check_cancel();
     int moff = nr_offset(i + nr_margin, nr_margin);
     for (int j = 0; j < libraw.imgdata.sizes.iwidth; j++, ++moff)
     {
@@ -576,6 +585,7 @@ void AAHD::make_ahd_greens()
 {
   for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
+    check_cancel();
     make_ahd_gline(i);
   }
 }
@@ -695,10 +705,12 @@ void AAHD::make_ahd_rb()
 {
   for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
+    check_cancel();
     make_ahd_rb_hv(i);
   }
   for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
+    check_cancel();
     make_ahd_rb_last(i);
   }
 }
@@ -771,11 +783,17 @@ AAHD::~AAHD() { free(rgb_ahd[0]); }
 void LibRaw::aahd_interpolate()
 {
   AAHD aahd(*this);
+  aahd.cancel_check = [](LibRaw &self) { self.checkCancel(); };
   aahd.hide_hots();
+  checkCancel();
   aahd.make_ahd_greens();
+  checkCancel();
   aahd.make_ahd_rb();
+  checkCancel();
   aahd.evaluate_ahd();
+  checkCancel();
   aahd.refine_hv_dirs();
+  checkCancel();
   //	aahd.illustrate_dirs();
   aahd.combine_image();
 }
@@ -321,6 +321,11 @@ void LibRaw::ahd_interpolate()
                 if (rr)
                     terminate_flag = 1;
             }
+#ifdef LIBRAW_USE_OPENMP
+        if (0 == omp_get_thread_num())
+#endif
+            if (_exitflag)
+                terminate_flag = 1;
 
 #if defined(LIBRAW_USE_OPENMP)
         char* buffer = buffers[omp_get_thread_num()];
@@ -351,5 +356,8 @@ void LibRaw::ahd_interpolate()
     free_omp_buffers(buffers, buffer_count);
 
     if (terminate_flag)
+    {
+        clearCancelFlag();
         throw LIBRAW_EXCEPTION_CANCELLED_BY_CALLBACK;
+    }
 }
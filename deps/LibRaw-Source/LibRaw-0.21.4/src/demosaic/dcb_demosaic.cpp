@@ -816,6 +816,7 @@ void LibRaw::fbdd(int noiserd)
     // dcb_color_full(image2);
     dcb_color_full();
     fbdd_correction();
+    checkCancel();
 
     dcb_color();
     rgb_to_lch(image2);
@@ -850,9 +851,11 @@ void LibRaw::dcb(int iterations, int dcb_enhance)
 
   dcb_hor(image2);
   dcb_color2(image2);
+  checkCancel();
 
   dcb_ver(image3);
   dcb_color3(image3);
+  checkCancel();
 
   dcb_decide(image2, image3);
 
@@ -862,6 +865,7 @@ void LibRaw::dcb(int iterations, int dcb_enhance)
 
   while (i <= iterations)
   {
+    checkCancel();
     dcb_nyquist();
     dcb_nyquist();
     dcb_nyquist();
@@ -870,11 +874,13 @@ void LibRaw::dcb(int iterations, int dcb_enhance)
     i++;
   }
 
+  checkCancel();
   dcb_color();
   dcb_pp();
 
   dcb_map();
   dcb_correction2();
+  checkCancel();
 
   dcb_map();
   dcb_correction();
@@ -891,6 +897,7 @@ void LibRaw::dcb(int iterations, int dcb_enhance)
 
   if (dcb_enhance)
   {
+    checkCancel();
     dcb_refinement();
     // dcb_color_full(image2);
     dcb_color_full();
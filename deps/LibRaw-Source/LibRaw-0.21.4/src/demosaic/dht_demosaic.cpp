@@ -37,6 +37,19 @@ struct DHT
   ushort channel_maximum[3];
   float channel_minimum[3];
   LibRaw &libraw;
+  /*
+   * Set by LibRaw::dht_interpolate() to reach the protected checkCancel().
+   * Rows run inside OpenMP regions in OpenMP builds, where throwing is not
+   * allowed, so there it is only checked between phases.
+   */
+  void (*cancel_check)(LibRaw &);
+  inline void check_cancel()
+  {
+#ifndef LIBRAW_USE_OPENMP
+    if (cancel_check)
+      cancel_check(libraw);
+#endif
+  }
   enum
   {
     HVSH = 1,
@@ -213,7 +226,7 @@ typedef float float3[3];
  * получился 0 при округлении, иначе проблема при интерпретации синих и красных.
  *
  */
-DHT::DHT(LibRaw &_libraw) : libraw(_libraw)
+DHT::DHT(LibRaw &_libraw) : libraw(_libraw), cancel_check(0)
 {
   nr_height = libraw.imgdata.sizes.iheight + nr_topmargin * 2;
   nr_width = libraw.imgdata.sizes.iwidth + nr_leftmargin * 2;
@@ -427,6 +440,7 @@ void DHT::make_diag_dirs()
 #endif
   for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
+    check_cancel();
     make_diag_dline(i);
   }
 //#if defined(LIBRAW_USE_OPENMP)
@@ -446,6 +460,7 @@ void DHT::make_diag_dirs()
 #endif
   for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
+    check_cancel();
     refine_idiag_dirs(i);
   }
 }
@@ -457,6 +472,7 @@ void DHT::make_hv_dirs()
 #endif
   for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
+    check_cancel();
     make_hv_dline(i);
   }
 #if defined(LIBRAW_USE_OPENMP)
@@ -464,6 +480,7 @@ void DHT::make_hv_dirs()
 #endif
   for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
+    check_cancel();
     refine_hv_dirs(i, i & 1);
   }
 #if defined(LIBRAW_USE_OPENMP)
@@ -471,6 +488,7 @@ void DHT::make_hv_dirs()
 #endif
   for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
+    check_cancel();
     refine_hv_dirs(i, (i & 1) ^ 1);
   }
 #if defined(LIBRAW_USE_OPENMP)
@@ -693,6 +711,7 @@ void DHT::make_greens()
 #endif
   for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
+    check_cancel();
     make_gline(i);
   }
 }
@@ -960,6 +979,7 @@ void DHT::make_rb()
 #endif
   for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
+    check_cancel();
     make_rbdiag(i);
   }
 #if defined(LIBRAW_USE_OPENMP)
@@ -968,6 +988,7 @@ void DHT::make_rb()
 #endif
   for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
+    check_cancel();
     make_rbhv(i);
   }
 }
@@ -1021,13 +1042,19 @@ void LibRaw::dht_interpolate()
 		return;
 	}
   DHT dht(*this);
+  dht.cancel_check = [](LibRaw &self) { self.checkCancel(); };
   dht.hide_hots();
+  checkCancel();
   dht.make_hv_dirs();
+  checkCancel();
   //	dht.illustrate_dirs();
   dht.make_greens();
+  checkCancel();
   dht.make_diag_dirs();
+  checkCancel();
   //	dht.illustrate_dirs();
   dht.make_rb();
+  checkCancel();
   dht.restore_hots();
   dht.copy_to_image();
 }
@@ -107,6 +107,7 @@ void LibRaw::lin_interpolate_loop(int *code, int size)
   int row;
   for (row = 1; row < height - 1; row++)
   {
+    checkCancel();
     int col, *ip;
     ushort *pix;
     for (col = 1; col < width - 1; col++)
@@ -266,6 +267,7 @@ void LibRaw::vng_interpolate()
     brow[row] = brow[4] + row * width;
   for (row = 2; row < height - 2; row++)
   { /* Do VNG interpolation */
+    checkCancel();
     if (!((row - 2) % 256))
       RUN_CALLBACK(LIBRAW_PROGRESS_INTERPOLATE, (row - 2) / 256 + 1,
                    ((height - 3) / 256) + 1);
@@ -375,6 +377,7 @@ void LibRaw::ppg_interpolate()
       pix[0][1] = ULIM(guess[i] >> 2, pix[d][1], pix[-d][1]);
     }
   /*  Calculate red and blue for each green pixel:		*/
+  checkCancel();
   RUN_CALLBACK(LIBRAW_PROGRESS_INTERPOLATE, 1, 3);
 #ifdef LIBRAW_USE_OPENMP
 #pragma omp parallel for default(shared) private(guess, diff, row, col, d, c,  \
@@ -394,6 +397,7 @@ void LibRaw::ppg_interpolate()
       }
     }
   /*  Calculate blue for red pixels and vice versa:		*/
+  checkCancel();
   RUN_CALLBACK(LIBRAW_PROGRESS_INTERPOLATE, 2, 3);
 #ifdef LIBRAW_USE_OPENMP
 #pragma omp parallel for default(shared) private(guess, diff, row, col, d, c,  \
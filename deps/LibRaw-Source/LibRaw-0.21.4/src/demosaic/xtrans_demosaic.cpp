@@ -173,12 +173,18 @@ void LibRaw::xtrans_interpolate(int passes)
 
   size_t buffer_size = LIBRAW_AHD_TILE * LIBRAW_AHD_TILE * (ndir * 11 + 6);
   char** buffers = malloc_omp_buffers(buffer_count, buffer_size);
+  int terminate_flag = 0;
 
 #if defined(LIBRAW_USE_OPENMP)
-# pragma omp parallel for schedule(dynamic) default(none) firstprivate(buffers, allhex, passes, sgrow, sgcol, ndir) shared(dir) 
+# pragma omp parallel for schedule(dynamic) default(none) firstprivate(buffers, allhex, passes, sgrow, sgcol, ndir) shared(dir, terminate_flag) 
 #endif
     for (int top = 3; top < height - 19; top += LIBRAW_AHD_TILE - 16)
     {
+        /* cannot throw inside the parallel region: skip remaining tiles */
+        if (_exitflag)
+            terminate_flag = 1;
+        if (terminate_flag)
+            continue;
 #if defined(LIBRAW_USE_OPENMP)
         char* buffer = buffers[omp_get_thread_num()];
 #else
@@ -429,6 +435,12 @@ void LibRaw::xtrans_interpolate(int passes)
 
     free_omp_buffers(buffers, buffer_count);
 
+    if (terminate_flag)
+    {
+        clearCancelFlag();
+        throw LIBRAW_EXCEPTION_CANCELLED_BY_CALLBACK;
+    }
+
     border_interpolate(8);
 }
 #undef fcol
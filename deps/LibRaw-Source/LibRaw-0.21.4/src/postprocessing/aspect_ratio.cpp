@@ -43,6 +43,8 @@ void LibRaw::fuji_rotate()
   RUN_CALLBACK(LIBRAW_PROGRESS_FUJI_ROTATE, 0, 2);
 
   for (row = 0; row < high; row++)
+  {
+    checkCancel();
     for (col = 0; col < wide; col++)
     {
       ur = r = fuji_width + (row - col) * step;
@@ -57,6 +59,7 @@ void LibRaw::fuji_rotate()
             (pix[0][i] * (1 - fc) + pix[1][i] * fc) * (1 - fr) +
             (pix[width][i] * (1 - fc) + pix[width + 1][i] * fc) * fr;
     }
+  }
 
   free(image);
   width = wide;
@@ -211,8 +211,16 @@ int LibRaw::copy_mem_image(void *scan0, int stride, int bgr)
   cstep = flip_index(0, 1) - soff;
   rstep = flip_index(1, 0) - flip_index(0, S.width);
 
+  int ret = 0;
   for (row = 0; row < S.height; row++, soff += rstep)
   {
+    /* public entry point: report cancellation as an error code */
+    if (_exitflag)
+    {
+      clearCancelFlag();
+      ret = LIBRAW_CANCELLED_BY_CALLBACK;
+      break;
+    }
     uchar *bufp = ((uchar *)scan0) + row * stride;
     ppm2 = (ushort *)(ppm = bufp);
     // keep trivial decisions in the outer loop for speed
@@ -251,7 +259,7 @@ int LibRaw::copy_mem_image(void *scan0, int stride, int bgr)
   S.width = s_width;
   S.height = s_hwight;
 
-  return 0;
+  return ret;
 }
 #undef FORBGR
 #undef FORRGB
@@ -280,7 +288,14 @@ libraw_processed_image_t *LibRaw::dcraw_make_mem_image(int *errcode)
   ret->colors = colors;
   ret->bits = bps;
   ret->data_size = ds;
-  copy_mem_image(ret->data, stride, 0);
+  int rc = copy_mem_image(ret->data, stride, 0);
+  if (rc != LIBRAW_SUCCESS)
+  {
+    ::free(ret);
+    if (errcode)
+      *errcode = rc;
+    return NULL;
+  }
 
   return ret;
 }
@@ -57,6 +57,7 @@ void LibRaw::wavelet_denoise()
       fimg[i] = 256 * sqrt((double)(image[i][c] << scale));
     for (hpass = lev = 0; lev < 5; lev++)
     {
+      checkCancel();
       lpass = size * ((lev & 1) + 1);
       for (row = 0; row < iheight; row++)
       {
@@ -197,6 +198,7 @@ void LibRaw::wavelet_denoise()
     }
     free(temp);
   } /* end omp parallel */
+  checkCancel();
   /* the following loops are hard to parallelize, no idea yes,
    * problem is wlast which is carrying dependency
    * second part should be easier, but did not yet get it right.
@@ -255,6 +257,7 @@ void LibRaw::median_filter()
     RUN_CALLBACK(LIBRAW_PROGRESS_MEDIAN_FILTER, pass - 1, med_passes);
     for (c = 0; c < 3; c += 2)
     {
+      checkCancel();
       for (pix = image; pix < image + width * height; pix++)
         pix[0][3] = pix[0][c];
       for (pix = image + width; pix < image + width * (height - 1); pix++)
@@ -340,6 +343,7 @@ void LibRaw::recover_highlights()
   FORC(unsigned(colors)) if (c != kc)
   {
     RUN_CALLBACK(LIBRAW_PROGRESS_HIGHLIGHTS, c - 1, colors - 1);
+    checkCancel();
     memset(map, 0, high * wide * sizeof *map);
     for (mrow = 0; mrow < high; mrow++)
       for (mcol = 0; mcol < wide; mcol++)
@@ -100,6 +100,7 @@ void LibRaw::convert_to_rgb_loop(float out_cam[3][4])
   {
     for (img = imgdata.image[0], row = 0; row < S.height; row++)
     {
+      checkCancel();
       for (col = 0; col < S.width; col++, img += 4)
       {
         out[0] = out_cam[0][0] * img[0] + out_cam[0][1] * img[1] +
@@ -121,6 +122,7 @@ void LibRaw::convert_to_rgb_loop(float out_cam[3][4])
   {
     for (img = imgdata.image[0], row = 0; row < S.height; row++)
     {
+      checkCancel();
       for (col = 0; col < S.width; col++, img += 4)
       {
         out[0] = out_cam[0][0] * img[0] + out_cam[0][1] * img[1] +
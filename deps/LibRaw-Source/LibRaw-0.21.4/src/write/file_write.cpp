@@ -226,6 +226,7 @@ void LibRaw::write_ppm_tiff()
         rstep = flip_index(1, 0) - flip_index(0, width);
         for (row = 0; row < height; row++, soff += rstep)
         {
+            checkCancel();
             for (col = 0; col < width; col++, soff += cstep)
                 if (output_bps == 8)
                     FORCC ppm[col * colors + c] = curve[image[soff][c]] >> 8;
@@ -236,6 +237,10 @@ void LibRaw::write_ppm_tiff()
             fwrite(ppm.data(), colors * output_bps / 8, width, ofp);
         }
     }
+    catch (const LibRaw_exceptions &)
+    {
+      throw; // keep cancellation distinct from allocation failures
+    }
     catch (...)
     {
       throw LIBRAW_EXCEPTION_ALLOC; // rethrow
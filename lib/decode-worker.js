@@ -0,0 +1,145 @@
+const { parentPort } = require("worker_threads");
+const LibRaw = require("./index.js");
+
+/**
+ * LibRawWorkerPool 的工作线程入口
+ *
+ * 每个 worker 拥有独立的 Node 环境和插件实例数据，
+ * 在其中顺序执行主线程分派的解码任务，并通过 transferList
+ * 把输出缓冲区的 ArrayBuffer 零拷贝移交回主线程。
+ */
+
+// 输出操作到 LibRaw 方法的映射
+const BUFFER_OPERATIONS = {
+  jpeg: "createJPEGBuffer",
+  png: "createPNGBuffer",
+  tiff: "createTIFFBuffer",
+  webp: "createWebPBuffer",
+  avif: "createAVIFBuffer",
+  ppm: "createPPMBuffer",
+  thumbnail: "createThumbnailJPEGBuffer",
+};
+
+/**
+ * 把 Buffer 转换为可移交的 ArrayBuffer
+ * 如果 Buffer 只是共享 ArrayBuffer 的一个切片，则复制出独立的 ArrayBuffer，
+ * 避免把不属于该结果的内存一起移交
+ * @param {Buffer} buffer - 输出缓冲区
+ * @returns {ArrayBuffer} - 可安全移交的 ArrayBuffer
+ */
+function toTransferable(buffer) {
+  if (
+    buffer.byteOffset === 0 &&
+    buffer.byteLength === buffer.buffer.byteLength
+  ) {
+    return buffer.buffer;
+  }
+  const copy = new ArrayBuffer(buffer.byteLength);
+  new Uint8Array(copy).set(buffer);
+  return copy;
+}
+
+async function runJob(job) {
+  const processor = new LibRaw();
+
+  try {
+    if (job.priority) {
+      await processor.setPriority(job.priority);
+    }
+
+    // 截止时间覆盖加载、解包、处理和编码的整个任务
+    if (job.deadline > 0) {
+      await processor.setDeadline(job.deadline);
+    }
+
+    // 共享缓存：相同的渲染在所有 worker 之间只执行一次
+    if (job.cache && typeof job.input === "string" && job.operation !== "metadata") {
+      const output = await processor.renderCached(job.input, {
+        operation: job.operation || "memoryImage",
+        params: job.params,
+        options: job.options,
+        calibration: job.calibration,
+      });
+      const field = output.data ? "data" : "buffer";
+      const transferable = toTransferable(output[field]);
+      return {
+        result: { ...output, [field]: transferable },
+        transferList: [transferable],
+      };
+    }
+
+    if (typeof job.input === "string") {
+      await processor.loadFile(job.input);
+    } else {
+      // ArrayBuffer（已移交）或 Uint8Array（结构化克隆）均直接包装，不再复制
+      const input =
+        job.input instanceof ArrayBuffer
+          ? Buffer.from(job.input)
+          : Buffer.from(
+              job.input.buffer,
+              job.input.byteOffset,
+              job.input.byteLength
+            );
+      await processor.loadBuffer(input);
+    }
+
+    if (job.params) {
+      await processor.setOutputParams(job.params);
+    }
+
+    // 校准数据按路径登记在进程级注册表中，各 worker 共享同一份
+    if (job.calibration) {
+      await processor.setCalibration(job.calibration);
+    }
+
+    const operation = job.operation || "memoryImage";
+
+    if (operation === "metadata") {
+      return {
+        result: {
+          metadata: await processor.getMetadata(),
+          size: await processor.getImageSize(),
+        },
+        transferList: [],
+      };
+    }
+
+    if (operation === "memoryImage") {
+      await processor.processImage();
+      const image = await processor.createMemoryImage();
+      const data = toTransferable(image.data);
+      return {
+        result: { ...image, data },
+        transferList: [data],
+      };
+    }
+
+    const method = BUFFER_OPERATIONS[operation];
+    if (!method) {
+      throw new Error(`Unknown worker operation: ${operation}`);
+    }
+
+    const output = await processor[method](job.options || {});
+    const buffer = toTransferable(output.buffer);
+    return {
+      result: { ...output, buffer },
+      transferList: [buffer],
+    };
+  } finally {
+    await processor.close();
+  }
+}
+
+parentPort.on("message", async (message) => {
+  const { id, job } = message;
+
+  try {
+    const { result, transferList } = await runJob(job);
+    parentPort.postMessage({ id, result }, transferList);
+  } catch (error) {
+    parentPort.postMessage({
+      id,
+      error: { message: error.message, stack: error.stack, code: error.code },
+    });
+  }
+});
@@ -62,6 +62,88 @@ declare module "libraw" {
     whiteLevel: number;
   }
 
+  export interface LibRawUnpackOptions {
+    /**
+     * Keep every Nth CFA quad (2x2 block) in both directions, 1-16 (default 1).
+     * Uncompressed and Sony ARW2 files decode only the kept rows; other Bayer
+     * formats are decoded in full and reduced afterwards
+     */
+    subsample?: number;
+  }
+
+  export interface LibRawAllFramesOptions {
+    /**
+     * Open Pentax pixel-shift files with LIBRAW_RAWOPTIONS_PENTAX_PS_ALLFRAMES and
+     * append the combined four-channel frame after the four shots (default false)
+     */
+    combine?: boolean;
+  }
+
+  export interface LibRawFrameInfo {
+    index: number;
+    /** Visible size */
+    width: number;
+    height: number;
+    /** Raw buffer size including margins */
+    rawWidth: number;
+    rawHeight: number;
+    /** Samples per pixel in the raw buffer: 1 (CFA), 3 or 4 */
+    channels: number;
+    colors: number;
+    /** Whether this frame is the native combination of the other shots */
+    combined: boolean;
+  }
+
+  export interface LibRawAllFrames {
+    count: number;
+    /** Frame held by the instance after loading */
+    current: number;
+    /** Index of the combined frame (Sinar 4-shot, Pentax pixel shift), null if none */
+    combined: number | null;
+    frames: LibRawFrameInfo[];
+  }
+
+  export interface LibRawSubsampleInfo {
+    /** Subsample factor applied by the last load or unpack (1 = full resolution) */
+    factor: number;
+    /** Whether only the kept rows were decoded from the file */
+    inDecoder: boolean;
+    /** Reduced visible width */
+    width: number;
+    /** Reduced visible height */
+    height: number;
+  }
+
+  export interface LibRawStreamedOptions {
+    /** Output format (default "tiff"); TIFF keeps output_bps, JPEG is always 8-bit and needs libjpeg (see hasNativeJpeg()) */
+    format?: "tiff" | "jpeg";
+    /** Visible rows per band, rounded up to a multiple of 16 (default 256) */
+    bandRows?: number;
+    /** JPEG quality 1-100 (default 90) */
+    quality?: number;
+  }
+
+  export interface LibRawStreamedResult {
+    /** Output width (not rotated; orientation is stored in the file) */
+    width: number;
+    /** Output height */
+    height: number;
+    /** Number of bands processed */
+    bands: number;
+    /** Visible rows per band after rounding */
+    bandRows: number;
+    /** Extra rows processed above and below each band */
+    haloRows: number;
+    /** Whether raw rows were decoded per band instead of unpacking the whole file */
+    rowDecoder: boolean;
+    /** Whether the auto-bright white point came from a half-size pass */
+    whiteEstimated: boolean;
+    /** Largest per-band working set (image, raw rows and output rows) in bytes */
+    bandBytes: number;
+    /** Size of the written file in bytes */
+    bytesWritten: number;
+  }
+
   export interface LibRawImageSize {
     /** Processed image width */
     width: number;
@@ -146,6 +228,111 @@ declare module "libraw" {
     output_tiff?: boolean;
   }
 
+  export interface LibRawPreviewImage {
+    /** Output width in pixels (after orientation) */
+    width: number;
+    /** Output height in pixels (after orientation) */
+    height: number;
+    /** Always 3 (RGB) */
+    colors: number;
+    /** Always 8 */
+    bits: number;
+    /** Size of the embedded preview that was decoded */
+    sourceWidth: number;
+    sourceHeight: number;
+    /** DCT scaling denominator used while decoding (1, 2, 4 or 8) */
+    scaleDenom: number;
+    /** Orientation applied, in LibRaw flip encoding (0 when not rotated) */
+    flip: number;
+    /** Packed 8-bit RGB pixels */
+    data: Buffer;
+  }
+
+  export type LibRawPNGFilter = "none" | "sub" | "up" | "average" | "paeth" | "adaptive";
+
+  export interface LibRawNativePNGOptions {
+    /** Sample depth; defaults to output_bps */
+    bits?: 8 | 16;
+    /** zlib compression level (0-9, default 6) */
+    compressionLevel?: number;
+    /** Row filter; default "adaptive", or "none" at compression level 0 */
+    filter?: LibRawPNGFilter;
+    /** Compression threads (1-8); defaults to the CPU count, at most 8 */
+    threads?: number;
+  }
+
+  export interface LibRawPNGImage {
+    /** Complete PNG file */
+    data: Buffer;
+    width: number;
+    height: number;
+    /** 3 (RGB) or 1 (grayscale) */
+    colors: number;
+    bits: number;
+    /** Name of the embedded output color space profile, null for raw color */
+    iccProfile: string | null;
+    /** Independently compressed segments (one IDAT each) */
+    segments: number;
+    threads: number;
+    /** Number of rows encoded with each filter type */
+    filterRows: { none: number; sub: number; up: number; average: number; paeth: number };
+  }
+
+  export interface LibRawTile {
+    /** Deep Zoom level: 0 is 1x1, the last level is the full image */
+    level: number;
+    col: number;
+    row: number;
+    /** Pixel rectangle of the tile within its level, including overlap */
+    x: number;
+    y: number;
+    width: number;
+    height: number;
+    /** Encoded JPEG or PNG tile */
+    data: Buffer;
+  }
+
+  export interface LibRawTilePyramidOptions {
+    /** Output directory for <name>.dzi and <name>_files/<level>/<col>_<row>.<ext> */
+    directory?: string;
+    /** Base name of the .dzi file and tile directory (default "image") */
+    name?: string;
+    /** Called synchronously for each tile as soon as it is encoded */
+    onTile?: (tile: LibRawTile) => void;
+    /** Tile edge length without overlap (16-4096, default 256) */
+    tileSize?: number;
+    /** Pixels added to each interior tile edge (0-tileSize, default 0) */
+    overlap?: number;
+    /** Tile format (default "jpeg", or "png" when the addon was built without libjpeg) */
+    format?: "jpeg" | "png";
+    /** JPEG quality (1-100, default 90) */
+    quality?: number;
+    /** PNG zlib compression level (0-9, default 6) */
+    compressionLevel?: number;
+    /** Encoding threads (1-8); defaults to the CPU count, at most 8 */
+    threads?: number;
+  }
+
+  export interface LibRawTilePyramidResult {
+    width: number;
+    height: number;
+    /** Number of levels; the full image is level levels - 1 */
+    levels: number;
+    tiles: number;
+    /** Total encoded tile bytes */
+    bytes: number;
+    threads: number;
+    format: "jpeg" | "png";
+    tileSize: number;
+    overlap: number;
+    /** Deep Zoom descriptor XML */
+    dzi: string;
+    /** Path of the written .dzi file, null without directory */
+    dziPath: string | null;
+    /** Directory holding the level subdirectories, null without directory */
+    tileDirectory: string | null;
+  }
+
   export interface LibRawImageData {
     /** Image type (1=JPEG, 3=PPM/TIFF) */
     type: number;
@@ -264,6 +451,10 @@ declare module "libraw" {
     compressionLevel?: number;
     /** Use progressive PNG */
     progressive?: boolean;
+    /** Sample depth (native encoder only) */
+    bits?: 8 | 16;
+    /** Row filter (native encoder only) */
+    filter?: LibRawPNGFilter;
   }
 
   export interface LibRawTIFFOptions extends LibRawImageConversionOptions {
@@ -378,21 +569,491 @@ declare module "libraw" {
     };
   }
 
+  export interface LibRawRenderCacheOptions {
+    /** Enable the re-render cache */
+    enabled: boolean;
+    /** Allow a per-channel white balance correction on the cached image (default true) */
+    approximateWhiteBalance?: boolean;
+  }
+
+  export interface LibRawRenderCacheInfo {
+    /** Whether the cache is enabled */
+    enabled: boolean;
+    /** Whether a demosaiced image is currently cached */
+    valid: boolean;
+    /** Bytes held by the cached image */
+    bytes: number;
+    /** Stage reused by the last processImage() call */
+    lastReuse: "none" | "output" | "whiteBalance";
+  }
+
+  export interface LibRawMemoryEstimateOptions {
+    /** Demosaic quality (same as user_qual) */
+    quality?: number;
+    /** Half-size output */
+    halfSize?: boolean;
+    /** Output bits per sample (8 or 16) */
+    outputBps?: number;
+  }
+
+  export interface LibRawMemoryEstimate {
+    /** raw_alloc allocated by unpack() */
+    raw: number;
+    /** Decoder temporary buffers (floating point DNG and similar) */
+    decoder: number;
+    /** 4-channel image allocated by raw2image_ex() */
+    image: number;
+    /** Histogram */
+    histogram: number;
+    /** Peak demosaic / denoise / rotation scratch */
+    scratch: number;
+    /** Re-render cache */
+    cache: number;
+    /** Memory image produced by dcraw_make_mem_image() */
+    output: number;
+    /** Estimated peak, including the copy returned to JavaScript */
+    peak: number;
+  }
+
+  export class LibRawMemoryBudget {
+    /**
+     * Admission counter for estimated memory
+     * @param limit Budget in bytes, or 'auto' for half of the currently free memory
+     */
+    constructor(limit: number | "auto");
+
+    readonly limit: number;
+
+    /** Try to reserve bytes without waiting */
+    tryAcquire(bytes: number): boolean;
+
+    /** Reserve bytes, waiting until they fit in the budget */
+    acquire(bytes: number): Promise<void>;
+
+    /** Return previously reserved bytes */
+    release(bytes: number): void;
+
+    getStats(): { limit: number; inUse: number; active: number; waiting: number };
+  }
+
+  export interface LibRawCacheOptions {
+    /** Byte budget of the rendered output cache (0 disables) */
+    outputBudget?: number;
+    /** Byte budget of the unpacked raw data cache (0 disables) */
+    rawBudget?: number;
+    /** Existing directory for the compressed on-disk raw cache (null disables) */
+    rawCacheDir?: string | null;
+    /** Formats written to disk: CR3, Fuji compressed and Phase One IIQ only (default), or every cacheable format */
+    rawCacheDecoders?: "expensive" | "all";
+    /** Byte limit for cache files in rawCacheDir; oldest files (by modification time) are removed first. 0 (default) means no limit */
+    rawCacheBudget?: number;
+  }
+
+  export interface LibRawCacheTierStats {
+    entries: number;
+    bytes: number;
+    budget: number;
+    hits: number;
+    misses: number;
+    /** Requests served by waiting for an identical in-flight render on another thread */
+    waits: number;
+    evictions: number;
+    /** Results larger than the whole budget, returned but not stored */
+    rejected: number;
+  }
+
+  export interface LibRawDiskCacheStats {
+    directory: string | null;
+    decoders: "expensive" | "all";
+    /** Byte limit for the directory, 0 means no limit */
+    budget: number;
+    /** Bytes of cache files in the directory */
+    bytes: number;
+    hits: number;
+    misses: number;
+    writes: number;
+    /** Failed writes and corrupt files (treated as misses) */
+    errors: number;
+    /** Files removed to stay within the budget */
+    evictions: number;
+    bytesRead: number;
+    bytesWritten: number;
+  }
+
+  export interface LibRawCacheStats {
+    output: LibRawCacheTierStats;
+    raw: LibRawCacheTierStats;
+    disk: LibRawDiskCacheStats;
+  }
+
+  export interface LibRawRenderRequest {
+    /** 'memoryImage' or a WorkerPool encode operation (default 'memoryImage') */
+    operation?: Exclude<LibRawWorkerJob["operation"], "metadata">;
+    /** Output parameters passed to setOutputParams() */
+    params?: LibRawOutputParams;
+    /** Options passed to the matching create*Buffer() method */
+    options?: object;
+    /** Calibration passed to setCalibration() (path-only) */
+    calibration?: LibRawCalibrationOptions;
+    /** Maximum time to wait for an identical render on another thread, in ms (default 60000) */
+    timeout?: number;
+  }
+
+  export interface LibRawWorkerJob {
+    /** RAW file path or buffer containing RAW data */
+    input: string | Buffer;
+    /** Operation to run in the worker (default 'memoryImage') */
+    operation?:
+      | "memoryImage"
+      | "metadata"
+      | "jpeg"
+      | "png"
+      | "tiff"
+      | "webp"
+      | "avif"
+      | "ppm"
+      | "thumbnail";
+    /** Output parameters passed to setOutputParams() */
+    params?: LibRawOutputParams;
+    /** Calibration passed to setCalibration(); path-only calibrations are loaded once per process */
+    calibration?: LibRawCalibrationOptions;
+    /** Serve the job through renderCached() and the process-wide cache (file path input only) */
+    cache?: boolean;
+    /** Options passed to the matching create*Buffer() method */
+    options?: object;
+    /** Transfer the input buffer to the worker instead of copying it */
+    transferInput?: boolean;
+    /** Estimated peak memory in bytes; estimated automatically when the pool has a memory budget */
+    memoryEstimate?: number;
+    /** Deadline in milliseconds, counted from when a worker starts the job */
+    deadline?: number;
+    /** Scheduling lane (default 'normal') */
+    priority?: LibRawPriority;
+  }
+
+  export type LibRawPriority = "interactive" | "normal" | "background";
+
+  export interface LibRawLatencySummary {
+    avg: number;
+    p50: number;
+    p95: number;
+    max: number;
+  }
+
+  export interface LibRawWorkerLaneStats {
+    /** Maximum concurrent jobs in this lane */
+    limit: number;
+    queued: number;
+    running: number;
+    completed: number;
+    failed: number;
+    /** Time spent queued, over recent jobs */
+    waitMs: LibRawLatencySummary;
+    /** Time from dispatch to completion, over recent jobs */
+    runMs: LibRawLatencySummary;
+  }
+
+  export interface LibRawSchedulerLaneStats {
+    /** Native calls currently running in this lane */
+    active: number;
+    /** Jobs currently paused at a stage boundary */
+    paused: number;
+    calls: number;
+    preemptions: number;
+    pausedMs: number;
+  }
+
+  export interface LibRawMetricValue {
+    labels: Record<string, string>;
+    value: number;
+    /** Sample name when it differs from the family name (_bucket, _sum, _count) */
+    metricName?: string;
+  }
+
+  /** One metric family, shaped like prom-client's getMetricsAsJSON() entries */
+  export interface LibRawMetricFamily {
+    name: string;
+    help: string;
+    type: "counter" | "gauge" | "histogram";
+    values: LibRawMetricValue[];
+  }
+
+  export interface LibRawMetricHistogram {
+    /** Per-bucket counts (not cumulative); the last bucket is +Inf */
+    buckets: number[];
+    count: number;
+    /** Seconds */
+    sum: number;
+  }
+
+  export type LibRawMetricStage = "unpack" | "process" | "stream" | "preview" | "png" | "tiles";
+
+  /** Native counter snapshot returned by getMetrics({ format: "raw" }) */
+  export interface LibRawMetricsSnapshot {
+    /** Upper bounds in seconds of the finite histogram buckets */
+    bucketBounds: number[];
+    decoders: Array<{ decoder: string; files: number; bytes: number }>;
+    stages: Record<LibRawMetricStage, LibRawMetricHistogram & { pixels: number }>;
+    /** Non-zero error counts keyed by LibRaw error code name */
+    errors: Record<string, number>;
+    cancellations: { deadline: number; other: number };
+    queueWait: Record<"scheduler" | "pool", Record<LibRawPriority, LibRawMetricHistogram>>;
+    memory: { allocations: number; allocatedBytes: number; liveBytes: number; peakBytes: number };
+  }
+
+  export type LibRawSimdLevel = "scalar" | "sse4.1" | "avx2" | "neon";
+
+  export interface LibRawSimdInfo {
+    /** Instruction set used by the dispatched kernels (LIBRAW_SIMD can lower it) */
+    level: LibRawSimdLevel;
+    /** Highest instruction set supported by this CPU */
+    detected: LibRawSimdLevel;
+  }
+
+  export interface LibRawRawDataOptions {
+    /** 'planes' splits a Bayer mosaic into black-subtracted R, G1, G2, B planes */
+    split?: "none" | "planes";
+    /** Return an owned copy instead of a view over the LibRaw buffer */
+    copy?: boolean;
+  }
+
+  export interface LibRawRawData {
+    /** Raw samples; a view over LibRaw memory unless copied or split */
+    data: Uint16Array | Float32Array;
+    type: "uint16" | "float32";
+    /** 'mosaic' (one sample per pixel), 'interleaved' (3/4 samples per pixel) or 'planes' */
+    layout: "mosaic" | "interleaved" | "planes";
+    /** Plane order for layout 'planes' */
+    planes?: ["R", "G1", "G2", "B"];
+    /** Full raw frame size, or plane size for layout 'planes' */
+    width: number;
+    height: number;
+    channels: number;
+    /** Elements per row, including padding */
+    stride: number;
+    /** Visible area inside the raw frame (not present for layout 'planes') */
+    margins?: { top: number; left: number; width: number; height: number };
+    /** CFA layout relative to the top-left corner of the visible area */
+    cfa: {
+      filters: number;
+      /** Color names indexed by CFA color index, e.g. 'RGBG' */
+      colors: string;
+      /** 2x2 Bayer pattern such as 'RGGB', null for other layouts */
+      pattern: string | null;
+      /** 6x6 color indices for X-Trans sensors */
+      xtrans?: number[][];
+    };
+    blackLevel: number;
+    /** Per-color black offsets added to blackLevel */
+    channelBlack: [number, number, number, number];
+    /** Repeating black pattern added on top of the per-color levels */
+    blackPattern: { rows: number; cols: number; values: number[] } | null;
+    whiteLevel: number;
+    /** Whether black levels were already subtracted from data */
+    blackSubtracted: boolean;
+    /** False when the data was copied */
+    zeroCopy: boolean;
+  }
+
+  export class LibRawWorkerPool {
+    /**
+     * Create a pool of worker_threads that decode RAW files in parallel
+     * @param options Pool options
+     */
+    constructor(options?: {
+      size?: number;
+      memoryBudget?: number | "auto" | LibRawMemoryBudget;
+      /** Per-lane concurrency limits; background defaults to size - 1 */
+      laneLimits?: Partial<Record<LibRawPriority, number>>;
+    });
+
+    /** Number of workers */
+    readonly size: number;
+
+    /**
+     * Run a job on the next idle worker; output buffers are transferred back without copying
+     * @param job Job description
+     */
+    run(job: LibRawWorkerJob): Promise<any>;
+
+    /**
+     * Get pool statistics
+     */
+    getStats(): {
+      size: number;
+      busy: number;
+      queued: number;
+      lanes: Record<LibRawPriority, LibRawWorkerLaneStats>;
+      memory?: { limit: number; inUse: number; active: number; waiting: number };
+    };
+
+    /**
+     * Reject queued jobs and terminate all workers
+     */
+    close(): Promise<void>;
+  }
+
+  export interface LibRawCalibrationOptions {
+    /** 16-bit PGM path or buffer (as used by dcraw -K), or raw values of the visible area */
+    darkFrame?: string | Buffer | { data: Uint16Array; width: number; height: number };
+    /** dcraw-style .badpixels file ("col row time" per line) or a list of points */
+    badPixels?: string | Array<[number, number] | [number, number, number] | { x: number; y: number; time?: number }>;
+    /** Equalize the two green channels before white balance */
+    greenMatching?: boolean;
+    /** Registry key; in-memory data is only shared when a key is given */
+    key?: string;
+    /** Threads used to apply the calibration row-parallel (default 1) */
+    threads?: number;
+  }
+
+  export interface LibRawCalibrationInfo {
+    /** Registry key, null for unregistered in-memory data */
+    key: string | null;
+    darkFrame: { width: number; height: number } | null;
+    badPixels: number;
+    greenMatching: boolean;
+    bytes: number;
+  }
+
+  export type LibRawBayerPattern = "RGGB" | "BGGR" | "GRBG" | "GBRG";
+
+  export type LibRawDemosaic = "half" | "linear" | "vng" | "ppg" | "ahd" | "dcb";
+
+  export interface LibRawBayerStreamOptions {
+    /** Raw frame width including margins */
+    width: number;
+    /** Raw frame height including margins */
+    height: number;
+    /** Masked margins; their pixels are used to measure black per frame */
+    margins?: { left?: number; top?: number; right?: number; bottom?: number };
+    /** CFA layout of the top-left pixel (default 'RGGB') */
+    pattern?: LibRawBayerPattern;
+    /** LibRaw open_bayer otherflags (big-endian 16-bit, tight 10-bit packing) */
+    flags?: number;
+    /** Unused low bits per sample */
+    unusedBits?: number;
+    blackLevel?: number;
+    /** Defaults to the full range of the sample bit depth */
+    whiteLevel?: number;
+    /** Camera RGB to sRGB, 3x3 nested or 9 numbers in row order */
+    colorMatrix?: number[] | number[][];
+    /** White balance multipliers [R, G, B, G2] */
+    whiteBalance?: number[];
+    /** Demosaic method (default 'linear'); 'half' outputs half-size without interpolation */
+    demosaic?: LibRawDemosaic;
+    /** Output bits per sample (default 8) */
+    outputBps?: 8 | 16;
+    /** Output curve [power, slope] */
+    gamma?: [number, number];
+    bright?: number;
+    /** Number of preallocated output buffers (default 3) */
+    ringSize?: number;
+  }
+
+  export interface LibRawBayerFrame {
+    /** RGB output; owned by the ring and overwritten after ringSize frames */
+    data: Buffer;
+    width: number;
+    height: number;
+    colors: 3;
+    bits: 8 | 16;
+    /** Zero-based frame counter */
+    sequence: number;
+    /** Ring slot holding data */
+    slot: number;
+    /** Black level used for this frame */
+    blackLevel: number;
+    processingMs: number;
+  }
+
+  export interface LibRawBayerStreamStats {
+    frames: number;
+    /** Expected frame length in bytes, 0 before the first frame */
+    frameLength: number;
+    width: number;
+    height: number;
+    ringSize: number;
+    ringBytes: number;
+    lastMs: number;
+    averageMs: number;
+    closed: boolean;
+  }
+
+  export class LibRawBayerStream {
+    constructor(options: LibRawBayerStreamOptions);
+
+    /**
+     * Decode and render one headerless Bayer frame; every frame must have
+     * the same length as the first
+     */
+    processFrame(frame: Buffer): Promise<LibRawBayerFrame>;
+
+    getStats(): LibRawBayerStreamStats;
+
+    /** Free LibRaw buffers and the output ring */
+    close(): Promise<boolean>;
+  }
+
   export class LibRaw {
     constructor();
 
+    /** Streaming processor for fixed-format headerless Bayer frames */
+    static BayerStream: typeof LibRawBayerStream;
+
+    /** Worker thread pool for parallel decoding */
+    static WorkerPool: typeof LibRawWorkerPool;
+
+    /** Memory budget used for admission control */
+    static MemoryBudget: typeof LibRawMemoryBudget;
+
     // ============== FILE OPERATIONS ==============
     /**
      * Load RAW image from file
      * @param filename Path to RAW image file
+     * @param options Optional subsampled unpack for previews
      */
-    loadFile(filename: string): Promise<boolean>;
+    loadFile(filename: string, options?: LibRawUnpackOptions): Promise<boolean>;
 
     /**
      * Load RAW image from buffer
      * @param buffer Binary data buffer containing RAW image
+     * @param options Optional subsampled unpack for previews
+     */
+    loadBuffer(buffer: Buffer, options?: LibRawUnpackOptions): Promise<boolean>;
+
+    /**
+     * Unpack the raw data of a file opened with openFile()/openBuffer()
+     * @param options Optional subsampled unpack for previews
+     */
+    unpack(options?: LibRawUnpackOptions): Promise<boolean>;
+
+    /**
+     * Open a file or buffer and decode every frame (raw_count shots, multi-frame
+     * DNG, Sinar 4-shot, Pentax pixel shift) concurrently; the instance holds
+     * the frame given by `current` afterwards
+     * @param source Path to RAW image file or buffer containing it
+     * @param options Optional pixel-shift combination
+     */
+    loadAllFrames(source: string | Buffer, options?: LibRawAllFramesOptions): Promise<LibRawAllFrames>;
+
+    /**
+     * Switch to a frame decoded by loadAllFrames(); processed results and
+     * getRawData() views of the previous frame are released
+     * @param index Frame index
+     */
+    selectFrame(index: number): Promise<boolean>;
+
+    /**
+     * Identify a RAW file without unpacking the raw data
+     * @param filename Path to RAW image file
+     */
+    openFile(filename: string): Promise<boolean>;
+
+    /**
+     * Identify a RAW buffer without unpacking the raw data
+     * @param buffer Binary data buffer containing RAW image
      */
-    loadBuffer(buffer: Buffer): Promise<boolean>;
+    openBuffer(buffer: Buffer): Promise<boolean>;
 
     /**
      * Close current image and free resources
@@ -410,6 +1071,12 @@ declare module "libraw" {
      */
     getImageSize(): Promise<LibRawImageSize>;
 
+    /**
+     * Get the subsample factor of the current raw data and whether it was
+     * applied inside the decoder
+     */
+    getSubsampleInfo(): Promise<LibRawSubsampleInfo>;
+
     /**
      * Get advanced metadata including color matrices
      */
@@ -451,6 +1118,89 @@ declare module "libraw" {
      */
     adjustMaximum(): Promise<boolean>;
 
+    // ============== RE-RENDER CACHE ==============
+    /**
+     * Keep the demosaiced linear image so output-only or white balance changes skip the demosaic
+     * @param options true/false or cache options
+     */
+    setRenderCache(options: boolean | LibRawRenderCacheOptions): Promise<boolean>;
+
+    /**
+     * Get re-render cache status
+     */
+    getRenderCacheInfo(): LibRawRenderCacheInfo;
+
+    // ============== CALIBRATION ==============
+    /**
+     * Attach dark frame, bad pixel and green matching calibration applied by
+     * every processImage(); pass null to remove it. Path-only calibrations are
+     * loaded once per process and shared read-only by all instances and workers
+     */
+    setCalibration(options: LibRawCalibrationOptions | null): Promise<LibRawCalibrationInfo | null>;
+
+    /**
+     * Get the attached calibration, or null
+     */
+    getCalibrationInfo(): LibRawCalibrationInfo | null;
+
+    // ============== SHARED CACHE ==============
+    /**
+     * Render through the process-wide cache keyed by file identity, output
+     * parameters, operation and output options. Identical concurrent requests
+     * from any thread are rendered once. Requires LibRaw.configureCache()
+     */
+    renderCached(file: string, request?: LibRawRenderRequest): Promise<any & { cached: boolean }>;
+
+    // ============== MEMORY ESTIMATION ==============
+    /**
+     * Estimate the memory needed to process the current file (works before unpack)
+     * @param options Overrides for the current output parameters
+     */
+    estimateMemory(options?: LibRawMemoryEstimateOptions): Promise<LibRawMemoryEstimate>;
+
+    // ============== RAW DATA ACCESS ==============
+    /**
+     * Read the unpacked raw data without processing. By default returns a zero-copy view that is
+     * detached (length 0) by close(), a new load or unpack()
+     * @param options Split and copy options
+     */
+    getRawData(options?: LibRawRawDataOptions): Promise<LibRawRawData>;
+
+    // ============== CANCELLATION SUPPORT ==============
+    /**
+     * Set cancellation flag to stop processing
+     */
+    setCancelFlag(): Promise<boolean>;
+
+    /**
+     * Clear cancellation flag
+     */
+    clearCancelFlag(): Promise<boolean>;
+
+    /**
+     * Abort the current job if it is not finished within `ms` milliseconds.
+     * Aborted calls reject with `code === 'LIBRAW_DEADLINE_EXCEEDED'` and release the file.
+     * @param ms Milliseconds from now, 0 to remove the deadline
+     */
+    setDeadline(ms: number): Promise<boolean>;
+
+    /**
+     * Remove the deadline set by setDeadline()
+     */
+    clearDeadline(): Promise<boolean>;
+
+    // ============== PRIORITY SCHEDULING ==============
+    /**
+     * Set the scheduling lane; lower lanes pause at stage boundaries while higher lanes run
+     * @param priority 'interactive', 'normal' (default) or 'background'
+     */
+    setPriority(priority: LibRawPriority): Promise<boolean>;
+
+    /**
+     * Get the scheduling lane of this instance
+     */
+    getPriority(): LibRawPriority;
+
     // ============== MEMORY IMAGE CREATION ==============
     /**
      * Create processed image in memory
@@ -462,6 +1212,27 @@ declare module "libraw" {
      */
     createMemoryThumbnail(): Promise<LibRawImageData>;
 
+    /**
+     * Decode the embedded preview directly to a small RGB image whose longer
+     * side is at most maxDim, using DCT-domain scaling for JPEG previews.
+     * The currently unpacked thumbnail is left unchanged
+     */
+    getPreviewRGB(maxDim: number, options?: { orientation?: boolean }): Promise<LibRawPreviewImage>;
+
+    /**
+     * Encode the processed image as PNG without sharp: SIMD row filtering and
+     * chunked deflate on several threads, joined into a single zlib stream.
+     * The output color space profile is embedded as an iCCP chunk
+     */
+    createPNG(options?: LibRawNativePNGOptions): Promise<LibRawPNGImage>;
+
+    /**
+     * Export a Deep Zoom (DZI) tile pyramid from a single render. Each level is
+     * a 2x box reduction of the one above, tiles are encoded on native threads
+     * and delivered to the directory and/or onTile as they complete
+     */
+    exportTilePyramid(options: LibRawTilePyramidOptions): Promise<LibRawTilePyramidResult>;
+
     // ============== FILE WRITERS ==============
     /**
      * Write processed image as PPM file
@@ -481,6 +1252,21 @@ declare module "libraw" {
      */
     writeThumbnail(filename: string): Promise<boolean>;
 
+    /**
+     * Process the image in horizontal bands and write TIFF or JPEG without
+     * holding the whole processed image. Called after openFile(), formats
+     * with row-addressable raw data are decoded band by band as well; other
+     * formats (including Hasselblad, Phase One and Leaf) are unpacked first,
+     * so their raw data still takes memory proportional to the full frame.
+     * Output equals processImage() + writeTIFF() except for the auto-bright
+     * white point (see whiteEstimated). Throws for options that need the
+     * whole image (cropbox, wavelet denoise, CA correction, highlight > 2,
+     * DHT/AAHD demosaic, ...).
+     * @param filename Output file path
+     * @param options Format, band height and JPEG quality
+     */
+    writeStreamed(filename: string, options?: LibRawStreamedOptions): Promise<LibRawStreamedResult>;
+
     // ============== CONFIGURATION & SETTINGS ==============
     /**
      * Set output processing parameters
@@ -527,7 +1313,9 @@ declare module "libraw" {
     createJPEGBuffer(options?: LibRawJPEGOptions): Promise<LibRawBufferResult>;
 
     /**
-     * Create processed image as PNG buffer in memory
+     * Create processed image as PNG buffer in memory. Uses the native encoder
+     * (see createPNG) unless resizing, progressive output or a non-sRGB
+     * colorSpace is requested
      * @param options PNG conversion options
      */
     createPNGBuffer(options?: LibRawPNGOptions): Promise<LibRawBufferResult>;
@@ -653,6 +1441,72 @@ declare module "libraw" {
      * Get count of supported camera models
      */
     static getCameraCount(): number;
+
+    /**
+     * Get process-wide scheduler statistics per priority lane
+     */
+    static getSchedulerStats(): Record<LibRawPriority, LibRawSchedulerLaneStats>;
+
+    /**
+     * Get the instruction set selected at startup for scale_colors and convert_to_rgb
+     */
+    static getSimdInfo(): LibRawSimdInfo;
+
+    /**
+     * Whether the addon was built with libjpeg (node-gyp rebuild --use_libjpeg=true).
+     * Without it native JPEG preview decoding and JPEG output from writeStreamed()
+     * and exportTilePyramid() are unavailable, and exportTilePyramid() defaults to PNG
+     */
+    static hasNativeJpeg(): boolean;
+
+    /**
+     * Get process-wide performance counters aggregated over all instances, threads and worker pools
+     */
+    static getMetrics(options?: { format?: "json" }): LibRawMetricFamily[];
+    static getMetrics(options: { format: "prometheus" }): string;
+    static getMetrics(options: { format: "raw" }): LibRawMetricsSnapshot;
+
+    /**
+     * Record time a job spent waiting in an external queue (called by WorkerPool)
+     */
+    static observeQueueWait(lane: LibRawPriority, ms: number): boolean;
+
+    /**
+     * Load calibration data into the process-wide registry ahead of use
+     */
+    static loadCalibration(options: LibRawCalibrationOptions): LibRawCalibrationInfo;
+
+    /**
+     * Drop a registry entry; instances already using it keep their reference
+     */
+    static releaseCalibration(key: string): boolean;
+
+    /**
+     * Set the byte budgets of the process-wide output and raw caches (both default to 0, disabled)
+     * and the directory of the on-disk raw cache
+     */
+    static configureCache(options: LibRawCacheOptions): LibRawCacheStats;
+
+    /**
+     * Get hit/miss statistics of the process-wide caches
+     */
+    static getCacheStats(): LibRawCacheStats;
+
+    /**
+     * Drop all cached entries; budgets and counters are kept.
+     * With disk: true the files in the raw cache directory are deleted too
+     */
+    static clearCache(options?: { disk?: boolean }): boolean;
+
+    /**
+     * Estimate processing memory for a file or buffer without unpacking it
+     * @param input RAW file path or buffer
+     * @param options Output parameters and estimate overrides
+     */
+    static estimateMemory(
+      input: string | Buffer,
+      options?: LibRawMemoryEstimateOptions & { params?: LibRawOutputParams }
+    ): Promise<LibRawMemoryEstimate>;
   }
 
   export = LibRaw;
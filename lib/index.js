@@ -1,4 +1,6 @@
+const fs = require("fs");
 const path = require("path");
+const crypto = require("crypto");
 const sharp = require("sharp");
 
 let librawAddon;
@@ -12,11 +14,187 @@ try {
   }
 }
 
+// renderCached() 的输出操作到 LibRaw 方法的映射，与 WorkerPool 的 operation 相同
+const CACHED_BUFFER_OPERATIONS = {
+  jpeg: "createJPEGBuffer",
+  png: "createPNGBuffer",
+  tiff: "createTIFFBuffer",
+  webp: "createWebPBuffer",
+  avif: "createAVIFBuffer",
+  ppm: "createPPMBuffer",
+  thumbnail: "createThumbnailJPEGBuffer",
+};
+
+// 当前线程中正在渲染的缓存 key。原生缓存只能在线程之间去重（同一线程不能阻塞等待自己），
+// 同一线程内的并发请求在这里共享同一个 Promise
+const pendingRenders = new Map();
+
+// loadFile() 等待其他线程或 worker 解包同一文件的最长毫秒数，超时后自行解包
+const RAW_CACHE_WAIT_MS = 60000;
+
+// 共享缓存的单飞等待：原生层从不阻塞 JS 线程，其他线程正在计算时用定时器退避重试（1 ms 起，最多 50 ms），
+// 直到 isBusy() 返回 false 或超时。返回是否在超时前结束等待
+async function waitWhileBusy(isBusy, timeout) {
+  const deadline = Date.now() + timeout;
+  for (let wait = 1; isBusy(); wait = Math.min(wait * 2, 50)) {
+    const remaining = deadline - Date.now();
+    if (remaining <= 0) return false;
+    await new Promise((resolve) => setTimeout(resolve, Math.min(wait, remaining)));
+  }
+  return true;
+}
+
+// 键按名称排序的 JSON，使参数顺序不同的相同请求得到相同的缓存 key
+function stableStringify(value) {
+  if (Array.isArray(value)) return `[${value.map(stableStringify).join(",")}]`;
+  if (value && typeof value === "object") {
+    if (Buffer.isBuffer(value) || ArrayBuffer.isView(value)) {
+      throw new TypeError("renderCached() options must not contain binary data");
+    }
+    return `{${Object.keys(value)
+      .sort()
+      .filter((key) => value[key] !== undefined)
+      .map((key) => `${JSON.stringify(key)}:${stableStringify(value[key])}`)
+      .join(",")}}`;
+  }
+  return JSON.stringify(value);
+}
+
+// 文件身份：大小、纳秒精度的修改时间和开头结尾各 64KB 的哈希，与原生 raw 缓存的 key 取相同的部分。
+// 文件系统的时间精度只有秒时，同一秒内原样大小改写的文件仍能区分
+const IDENTITY_SAMPLE_BYTES = 64 * 1024;
+
+async function fileIdentity(file) {
+  const handle = await fs.promises.open(file, "r");
+  try {
+    const stat = await handle.stat({ bigint: true });
+    const size = Number(stat.size);
+    const hash = crypto.createHash("sha1");
+    const head = Buffer.alloc(Math.min(size, IDENTITY_SAMPLE_BYTES));
+    const { bytesRead } = await handle.read(head, 0, head.length, 0);
+    hash.update(head.subarray(0, bytesRead));
+    if (size > IDENTITY_SAMPLE_BYTES) {
+      const tail = Buffer.alloc(Math.min(size - IDENTITY_SAMPLE_BYTES, IDENTITY_SAMPLE_BYTES));
+      const result = await handle.read(tail, 0, tail.length, size - tail.length);
+      hash.update(tail.subarray(0, result.bytesRead));
+    }
+    return [String(stat.size), String(stat.mtimeNs), hash.digest("hex")];
+  } finally {
+    await handle.close();
+  }
+}
+
+// 把原生快照中不累加的直方图桶转换为 Prometheus 的累加桶（le 标签）和 _sum、_count 样本
+function histogramValues(name, labels, histogram, bounds) {
+  const values = [];
+  let cumulative = 0;
+  histogram.buckets.forEach((count, index) => {
+    cumulative += count;
+    const le = index < bounds.length ? String(bounds[index]) : "+Inf";
+    values.push({ labels: { ...labels, le }, value: cumulative, metricName: `${name}_bucket` });
+  });
+  values.push({ labels, value: histogram.sum, metricName: `${name}_sum` });
+  values.push({ labels, value: histogram.count, metricName: `${name}_count` });
+  return values;
+}
+
+// 由原生快照生成指标族，结构与 prom-client 的 getMetricsAsJSON() 相同
+function metricFamilies(snapshot) {
+  const bounds = snapshot.bucketBounds;
+  const stages = Object.entries(snapshot.stages);
+  const queues = Object.entries(snapshot.queueWait);
+  const family = (name, type, help, values) => ({ name, help, type, values });
+
+  return [
+    family(
+      "librawspeed_files_opened_total",
+      "counter",
+      "Raw files opened, by LibRaw decoder",
+      snapshot.decoders.map((d) => ({ labels: { decoder: d.decoder }, value: d.files }))
+    ),
+    family(
+      "librawspeed_input_bytes_total",
+      "counter",
+      "Bytes of raw input opened, by LibRaw decoder",
+      snapshot.decoders.map((d) => ({ labels: { decoder: d.decoder }, value: d.bytes }))
+    ),
+    family(
+      "librawspeed_stage_pixels_total",
+      "counter",
+      "Pixels produced by each processing stage",
+      stages.map(([stage, s]) => ({ labels: { stage }, value: s.pixels }))
+    ),
+    family(
+      "librawspeed_stage_duration_seconds",
+      "histogram",
+      "Wall time of successful processing stage calls",
+      stages.flatMap(([stage, s]) => histogramValues("librawspeed_stage_duration_seconds", { stage }, s, bounds))
+    ),
+    family(
+      "librawspeed_stage_megapixels_per_second",
+      "gauge",
+      "Average throughput of each processing stage since process start",
+      stages.map(([stage, s]) => ({ labels: { stage }, value: s.sum > 0 ? s.pixels / 1e6 / s.sum : 0 }))
+    ),
+    family(
+      "librawspeed_errors_total",
+      "counter",
+      "LibRaw errors reported to JavaScript, by error code",
+      Object.entries(snapshot.errors).map(([code, value]) => ({ labels: { code }, value }))
+    ),
+    family(
+      "librawspeed_cancellations_total",
+      "counter",
+      "Native calls cancelled by a deadline or another abort",
+      Object.entries(snapshot.cancellations).map(([reason, value]) => ({ labels: { reason }, value }))
+    ),
+    family(
+      "librawspeed_queue_wait_seconds",
+      "histogram",
+      "Time jobs spent waiting in the native scheduler or the worker pool",
+      queues.flatMap(([queue, lanes]) =>
+        Object.entries(lanes).flatMap(([lane, h]) =>
+          histogramValues("librawspeed_queue_wait_seconds", { queue, lane }, h, bounds)
+        )
+      )
+    ),
+    family("librawspeed_allocated_bytes", "gauge", "Bytes held in LibRaw raw, image and thumbnail buffers", [
+      { labels: {}, value: snapshot.memory.liveBytes },
+    ]),
+    family("librawspeed_allocated_bytes_peak", "gauge", "Highest value of librawspeed_allocated_bytes", [
+      { labels: {}, value: snapshot.memory.peakBytes },
+    ]),
+    family("librawspeed_allocations_total", "counter", "LibRaw raw, image and thumbnail buffer allocations", [
+      { labels: {}, value: snapshot.memory.allocations },
+    ]),
+    family("librawspeed_allocated_bytes_total", "counter", "Bytes of LibRaw raw, image and thumbnail buffers allocated", [
+      { labels: {}, value: snapshot.memory.allocatedBytes },
+    ]),
+  ];
+}
+
+// Prometheus 文本格式（0.0.4）
+function prometheusText(families) {
+  const escape = (value) => String(value).replace(/\\/g, "\\\\").replace(/\n/g, "\\n").replace(/"/g, '\\"');
+  const lines = [];
+  for (const f of families) {
+    lines.push(`# HELP ${f.name} ${f.help}`);
+    lines.push(`# TYPE ${f.name} ${f.type}`);
+    for (const v of f.values) {
+      const labels = Object.entries(v.labels).map(([key, value]) => `${key}="${escape(value)}"`);
+      const value = Number.isFinite(v.value) ? v.value : v.value > 0 ? "+Inf" : "NaN";
+      lines.push(`${v.metricName || f.name}${labels.length ? `{${labels.join(",")}}` : ""} ${value}`);
+    }
+  }
+  return `${lines.join("\n")}\n`;
+}
+
 class LibRaw {
   constructor() {
     this._wrapper = new librawAddon.LibRawWrapper();
     this._isProcessed = false; // 跟踪是否已调用 processImage()
     this._processedImageData = null; // 缓存处理后的图像数据
+    this._renderQueue = Promise.resolve(); // renderCached() 的渲染依次执行
   }
 
   // ============== FILE OPERATIONS ==============
@@ -24,12 +202,15 @@ class LibRaw {
   /**
    * 从文件系统加载 RAW 文件
    * @param {string} filename - RAW 文件路径
+   * @param {Object} [options] - { subsample }：预览用的降采样解包倍数（1-16）
    * @returns {Promise<boolean>} - 成功状态
    */
-  async loadFile(filename) {
+  async loadFile(filename, options) {
+    // 其他线程正在解包同一文件时异步等待其结果进入共享 raw 缓存（未启用缓存时立即返回）
+    await waitWhileBusy(() => this._wrapper.rawCacheBusy(filename), RAW_CACHE_WAIT_MS);
     return new Promise((resolve, reject) => {
       try {
-        const result = this._wrapper.loadFile(filename);
+        const result = this._wrapper.loadFile(filename, options);
         this._isProcessed = false; // 为新文件重置处理状态
         this._processedImageData = null; // 清除缓存数据
         resolve(result);
@@ -42,12 +223,50 @@ class LibRaw {
   /**
    * 从内存缓冲区加载 RAW 文件
    * @param {Buffer} buffer - 包含 RAW 数据的缓冲区
+   * @param {Object} [options] - { subsample }：预览用的降采样解包倍数（1-16）
    * @returns {Promise<boolean>} - 成功状态
    */
-  async loadBuffer(buffer) {
+  async loadBuffer(buffer, options) {
     return new Promise((resolve, reject) => {
       try {
-        const result = this._wrapper.loadBuffer(buffer);
+        const result = this._wrapper.loadBuffer(buffer, options);
+        resolve(result);
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  /**
+   * 只读取文件头（identify），不解包 raw 数据
+   * 之后可以调用 estimateMemory() 估算内存，再调用 unpack() 或 processImage()
+   * @param {string} filename - RAW 文件路径
+   * @returns {Promise<boolean>} - 成功状态
+   */
+  async openFile(filename) {
+    return new Promise((resolve, reject) => {
+      try {
+        const result = this._wrapper.openFile(filename);
+        this._isProcessed = false;
+        this._processedImageData = null;
+        resolve(result);
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  /**
+   * 只读取缓冲区中的文件头（identify），不解包 raw 数据
+   * @param {Buffer} buffer - 包含 RAW 数据的缓冲区
+   * @returns {Promise<boolean>} - 成功状态
+   */
+  async openBuffer(buffer) {
+    return new Promise((resolve, reject) => {
+      try {
+        const result = this._wrapper.openBuffer(buffer);
+        this._isProcessed = false;
+        this._processedImageData = null;
         resolve(result);
       } catch (error) {
         reject(error);
@@ -121,6 +340,20 @@ class LibRaw {
     });
   }
 
+  /**
+   * 获取当前 raw 数据的降采样信息
+   * @returns {Promise<Object>} - { factor, inDecoder, width, height }
+   */
+  async getSubsampleInfo() {
+    return new Promise((resolve, reject) => {
+      try {
+        resolve(this._wrapper.getSubsampleInfo());
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
   /**
    * 获取高级元数据，包括色彩矩阵和校准数据
    * @returns {Promise<Object>} - 高级元数据对象
@@ -192,6 +425,7 @@ class LibRaw {
       try {
         const result = this._wrapper.processImage();
         this._isProcessed = true; // 标记为已处理
+        this._processedImageData = null; // 参数可能已变化，丢弃旧的内存图像
         resolve(result);
       } catch (error) {
         reject(error);
@@ -244,6 +478,180 @@ class LibRaw {
     });
   }
 
+  // ============== RE-RENDER CACHE ==============
+
+  /**
+   * 启用或禁用重渲染缓存
+   * 启用后 processImage() 会保存去马赛克后、convert_to_rgb 之前的线性图像；
+   * 之后如果只修改了输出色彩空间、伽马、亮度或位深，只重做 convert_to_rgb 和内存图像阶段；
+   * 如果只修改了 user_mul 白平衡（且 highlight 为 0），则对缓存图像做按通道修正
+   * @param {boolean|Object} options - 布尔值或选项对象
+   * @param {boolean} [options.enabled] - 是否启用缓存
+   * @param {boolean} [options.approximateWhiteBalance=true] - 是否允许按通道修正白平衡（近似结果）
+   * @returns {Promise<boolean>} - 成功状态
+   */
+  async setRenderCache(options) {
+    return new Promise((resolve, reject) => {
+      try {
+        const result = this._wrapper.setRenderCache(options);
+        resolve(result);
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  /**
+   * 获取重渲染缓存状态
+   * @returns {Object} - { enabled, valid, bytes, lastReuse: 'none' | 'output' | 'whiteBalance' }
+   */
+  getRenderCacheInfo() {
+    return this._wrapper.getRenderCacheInfo();
+  }
+
+  // ============== CALIBRATION ==============
+
+  /**
+   * 附加校准数据：暗场、坏点表和绿平衡，之后每次 processImage() 都会应用
+   * 只使用文件路径时，数据按路径登记到进程级注册表，只加载一次，
+   * 并由所有实例（包括 WorkerPool 的各个 worker）只读共享
+   * @param {Object|null} options - 校准选项，null 表示移除
+   * @param {string|Buffer|Object} [options.darkFrame] - 16 位 PGM 路径、PGM 缓冲区或 { data: Uint16Array, width, height }
+   * @param {string|Array} [options.badPixels] - dcraw 格式的坏点表路径，或 [x, y] / { x, y } 数组
+   * @param {boolean} [options.greenMatching=false] - 绿平衡（代替 green_matching 输出参数）
+   * @param {string} [options.key] - 注册表中的 key；传入内存数据时提供 key 才会共享
+   * @param {number} [options.threads=1] - 按行并行应用的线程数
+   * @returns {Promise<Object|null>} - { key, darkFrame: { width, height } | null, badPixels, greenMatching, bytes }
+   */
+  async setCalibration(options) {
+    return new Promise((resolve, reject) => {
+      try {
+        const result = this._wrapper.setCalibration(options);
+        resolve(result);
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  /**
+   * 获取当前附加的校准数据
+   * @returns {Object|null} - 同 setCalibration() 的返回值
+   */
+  getCalibrationInfo() {
+    return this._wrapper.getCalibrationInfo();
+  }
+
+  // ============== SHARED CACHE ==============
+
+  /**
+   * 带进程级缓存的渲染：按（文件路径、大小、修改时间，输出参数，操作和输出选项）查找，
+   * 命中时不再加载、解包和处理。需要先用 LibRaw.configureCache() 设置预算。
+   * 多个线程或 worker 同时请求相同的渲染时只渲染一次，其余等待结果。
+   * 同一实例上并发的未命中请求依次渲染，不会互相覆盖加载和处理状态
+   * @param {string} file - RAW 文件路径
+   * @param {Object} [request]
+   * @param {string} [request.operation='memoryImage'] - 'memoryImage' 或 WorkerPool 支持的编码操作（'jpeg'、'png'、'webp' 等）
+   * @param {Object} [request.params] - 输出参数，同 setOutputParams()
+   * @param {Object} [request.options] - 传给对应 create*Buffer() 的选项（包括输出尺寸）
+   * @param {Object} [request.calibration] - 校准选项，只支持文件路径
+   * @param {number} [request.timeout=60000] - 等待其他线程渲染结果的最长毫秒数，超时后自行渲染
+   * @returns {Promise<Object>} - 与对应操作的结果相同，另加 cached 字段
+   */
+  async renderCached(file, request = {}) {
+    const { operation = "memoryImage", params = {}, options = {}, calibration = null, timeout = 60000 } = request;
+    if (operation !== "memoryImage" && !CACHED_BUFFER_OPERATIONS[operation]) {
+      throw new Error(`Unknown render operation: ${operation}`);
+    }
+
+    const resolved = path.resolve(file);
+    const identity = await fileIdentity(resolved);
+    const key = stableStringify([resolved, ...identity, operation, params, options, calibration]);
+
+    const pending = pendingRenders.get(key);
+    if (pending) {
+      return { ...(await pending), cached: true };
+    }
+
+    const render = this._renderCachedEntry(key, resolved, operation, params, options, calibration, timeout);
+    pendingRenders.set(key, render);
+    try {
+      return await render;
+    } finally {
+      pendingRenders.delete(key);
+    }
+  }
+
+  async _renderCachedEntry(key, file, operation, params, options, calibration, timeout) {
+    // 其他线程正在渲染时异步重试；超时后自行渲染（不登记为负责者，结果仍会提交到缓存）
+    let hit = librawAddon.LibRawWrapper.cacheAcquire(key, false);
+    if (hit === "busy") {
+      await waitWhileBusy(() => (hit = librawAddon.LibRawWrapper.cacheAcquire(key, true)) === "busy", timeout);
+      if (hit === "busy") hit = null;
+    }
+    if (hit && hit !== "pending") {
+      const meta = JSON.parse(hit.meta);
+      return operation === "memoryImage"
+        ? { ...meta, data: hit.data, cached: true }
+        : { ...meta, buffer: hit.data, cached: true };
+    }
+
+    // 负责渲染：无论成功与否都必须提交或放弃，否则其他线程会一直等到超时。
+    // 渲染跨越多个 await 使用本实例的加载和处理状态，同一实例上的并发请求依次执行
+    const previous = this._renderQueue;
+    let release;
+    this._renderQueue = new Promise((resolve) => (release = resolve));
+    try {
+      await previous;
+      await this.loadFile(file);
+      if (calibration) await this.setCalibration(calibration);
+      await this.setOutputParams(params);
+
+      let result;
+      let data;
+      if (operation === "memoryImage") {
+        await this.processImage();
+        result = await this.createMemoryImage();
+        data = result.data;
+      } else {
+        result = await this[CACHED_BUFFER_OPERATIONS[operation]](options);
+        data = result.buffer;
+      }
+
+      const { data: _data, buffer: _buffer, ...meta } = result;
+      librawAddon.LibRawWrapper.cacheFulfil(key, data, JSON.stringify(meta));
+      return { ...result, cached: false };
+    } catch (error) {
+      librawAddon.LibRawWrapper.cacheAbandon(key);
+      throw error;
+    } finally {
+      release();
+    }
+  }
+
+  // ============== MEMORY ESTIMATION ==============
+
+  /**
+   * 估算处理当前文件所需的内存
+   * 只需要 identify 阶段的信息，可在 openFile()/openBuffer() 之后、解包之前调用。
+   * 根据图像尺寸、解码器标志、去马赛克质量和当前输出参数计算各阶段分配量
+   * @param {Object} [options] - 覆盖当前输出参数
+   * @param {number} [options.quality] - 去马赛克质量（同 user_qual）
+   * @param {boolean} [options.halfSize] - 半尺寸输出
+   * @param {number} [options.outputBps] - 输出位深（8 或 16）
+   * @returns {Promise<Object>} - 字节数：{ raw, decoder, image, histogram, scratch, cache, output, peak }
+   */
+  async estimateMemory(options = {}) {
+    return new Promise((resolve, reject) => {
+      try {
+        const result = this._wrapper.estimateMemory(options);
+        resolve(result);
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
   // ============== MEMORY IMAGE CREATION ==============
 
   /**
@@ -288,6 +696,94 @@ class LibRaw {
     });
   }
 
+  /**
+   * 解码嵌入预览并缩小到长边不超过 maxDim 的 8 位 RGB。
+   * JPEG 预览在 IDCT 阶段按 1/2、1/4、1/8 缩放解码，不需要先得到全尺寸图像
+   * @param {number} maxDim - 长边最大像素数
+   * @param {Object} [options]
+   * @param {boolean} [options.orientation=true] - 按拍摄方向旋转
+   * @returns {Promise<Object>} - { width, height, colors, bits, data, sourceWidth, sourceHeight, scaleDenom, flip }
+   */
+  async getPreviewRGB(maxDim, options = {}) {
+    return new Promise((resolve, reject) => {
+      try {
+        resolve(this._wrapper.getPreviewRGB(maxDim, options));
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  /**
+   * 使用原生编码器把处理结果编码为 PNG（需要先调用 processImage()）。
+   * 行滤波使用指令集内核，图像按行分段后多线程压缩，拼接为一个 zlib 流；
+   * 输出色彩空间的 ICC 配置文件写入 iCCP 块
+   * @param {Object} [options]
+   * @param {number} [options.bits] - 8 或 16，默认为 outputBps
+   * @param {number} [options.compressionLevel=6] - zlib 压缩级别 (0-9)
+   * @param {string} [options.filter='adaptive'] - 'none' | 'sub' | 'up' | 'average' | 'paeth' | 'adaptive'，级别 0 时默认 'none'
+   * @param {number} [options.threads] - 压缩线程数 (1-8)，默认按 CPU 数
+   * @returns {Promise<Object>} - { data, width, height, colors, bits, iccProfile, segments, threads, filterRows }
+   */
+  async createPNG(options = {}) {
+    return new Promise((resolve, reject) => {
+      try {
+        resolve(this._wrapper.createPNG(options));
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  /**
+   * 由处理结果一次生成 Deep Zoom (DZI) 瓦片金字塔（需要先调用 processImage()）。
+   * 各层由上一层 2x2 平均缩小得到，瓦片在原生线程中并行编码，编码完成后逐个写入目录或交给回调
+   * @param {Object} options
+   * @param {string} [options.directory] - 输出目录，写入 <name>.dzi 和 <name>_files/<level>/<col>_<row>.<ext>
+   * @param {string} [options.name='image'] - .dzi 文件和瓦片目录的名称
+   * @param {Function} [options.onTile] - 每个瓦片完成后同步调用，参数为 { level, col, row, x, y, width, height, data }
+   * @param {number} [options.tileSize=256] - 瓦片边长 (16-4096)，不含重叠
+   * @param {number} [options.overlap=0] - 瓦片内侧边缘的重叠像素数 (0-tileSize)
+   * @param {string} [options.format] - 'jpeg'（链接了 libjpeg 时的默认值）或 'png'
+   * @param {number} [options.quality=90] - JPEG 质量 (1-100)
+   * @param {number} [options.compressionLevel=6] - PNG 压缩级别 (0-9)
+   * @param {number} [options.threads] - 编码线程数 (1-8)，默认按 CPU 数
+   * @returns {Promise<Object>} - { width, height, levels, tiles, bytes, threads, format, tileSize, overlap, dzi, dziPath, tileDirectory }
+   */
+  async exportTilePyramid(options = {}) {
+    return new Promise((resolve, reject) => {
+      try {
+        const { directory, name = "image", ...nativeOptions } = options;
+        let tileDirectory = null;
+        if (directory !== undefined) {
+          // 原生层只写文件，各层目录在这里按输出尺寸预先创建
+          const { width, height } = this._wrapper.getMemImageFormat();
+          tileDirectory = path.join(directory, `${name}_files`);
+          let levels = 1;
+          for (let w = width, h = height; w > 1 || h > 1; levels++) {
+            w = Math.ceil(w / 2);
+            h = Math.ceil(h / 2);
+          }
+          for (let level = 0; level < levels; level++) {
+            fs.mkdirSync(path.join(tileDirectory, String(level)), { recursive: true });
+          }
+          nativeOptions.directory = tileDirectory;
+        }
+
+        const result = this._wrapper.exportTilePyramid(nativeOptions);
+        result.tileDirectory = tileDirectory;
+        result.dziPath = null;
+        if (tileDirectory) {
+          result.dziPath = path.join(directory, `${name}.dzi`);
+          fs.writeFileSync(result.dziPath, result.dzi);
+        }
+        resolve(result);
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
   // ============== FILE WRITERS ==============
 
   /**
@@ -322,6 +818,22 @@ class LibRaw {
     });
   }
 
+  /**
+   * 分段处理并写入 TIFF 或 JPEG，内存占用与行段而不是整幅图像成正比
+   * @param {string} filename - 输出文件名
+   * @param {Object} [options] - { format: "tiff" | "jpeg", bandRows: 256, quality: 90 }
+   * @returns {Promise<Object>} - 输出尺寸、行段数和内存统计
+   */
+  async writeStreamed(filename, options) {
+    return new Promise((resolve, reject) => {
+      try {
+        resolve(this._wrapper.writeStreamed(filename, options));
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
   /**
    * 将缩略图写入文件
    * @param {string} filename - 输出文件名
@@ -560,12 +1072,13 @@ class LibRaw {
 
   /**
    * 解包 RAW 数据（低级操作）
+   * @param {Object} [options] - { subsample }：预览用的降采样解包倍数（1-16）
    * @returns {Promise<boolean>} - 成功状态
    */
-  async unpack() {
+  async unpack(options) {
     return new Promise((resolve, reject) => {
       try {
-        const result = this._wrapper.unpack();
+        const result = this._wrapper.unpack(options);
         resolve(result);
       } catch (error) {
         reject(error);
@@ -637,6 +1150,46 @@ class LibRaw {
     });
   }
 
+  // ============== MULTI-FRAME ==============
+
+  /**
+   * 打开文件并解码全部帧（包围曝光、Canon 双像素、Sinar 四次拍摄、多帧 DNG 等），
+   * 其余帧在多个线程中并行解码，之后用 selectFrame() 切换当前帧
+   * @param {string|Buffer} source - RAW 文件路径或包含 RAW 数据的缓冲区
+   * @param {Object} [options] - { combine }：Pentax 像素偏移文件额外合并为一个四通道帧
+   * @returns {Promise<Object>} - { count, current, combined, frames: [{ index, width, height, rawWidth, rawHeight, channels, colors, combined }] }
+   */
+  async loadAllFrames(source, options) {
+    return new Promise((resolve, reject) => {
+      try {
+        const result = this._wrapper.loadAllFrames(source, options);
+        this._isProcessed = false;
+        this._processedImageData = null;
+        resolve(result);
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  /**
+   * 切换到 loadAllFrames() 解码的一帧，之后的处理与普通解包相同
+   * @param {number} index - 帧下标
+   * @returns {Promise<boolean>} - 成功状态
+   */
+  async selectFrame(index) {
+    return new Promise((resolve, reject) => {
+      try {
+        const result = this._wrapper.selectFrame(index);
+        this._isProcessed = false;
+        this._processedImageData = null;
+        resolve(result);
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
   // ============== MEMORY OPERATIONS EXTENDED ==============
 
   /**
@@ -672,6 +1225,29 @@ class LibRaw {
     });
   }
 
+  // ============== RAW DATA ACCESS ==============
+
+  /**
+   * 读取解包后的 raw 数据（不经过 processImage 和内存图像复制）
+   * 默认返回 LibRaw 持有的 raw 缓冲区的零拷贝视图：Bayer/X-Trans 马赛克为 Uint16Array，
+   * 浮点 DNG 为 Float32Array，多通道 raw 为交错排列。视图包含边距，行步长见 stride；
+   * close()、重新加载或 unpack() 之后视图被分离（长度变为 0）
+   * @param {Object} [options] - 选项
+   * @param {string} [options.split='none'] - 'planes' 时拆分为减去黑电平的 R、G1、G2、B 四个平面（仅 Bayer）
+   * @param {boolean} [options.copy=false] - 返回独立副本而不是视图
+   * @returns {Promise<Object>} - raw 数据、尺寸、CFA 排列和黑白电平
+   */
+  async getRawData(options = {}) {
+    return new Promise((resolve, reject) => {
+      try {
+        const result = this._wrapper.getRawData(options);
+        resolve(result);
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
   // ============== COLOR OPERATIONS ==============
 
   /**
@@ -918,6 +1494,8 @@ class LibRaw {
    * @param {number} [options.compressionLevel=6] - PNG 压缩级别 (0-9)
    * @param {boolean} [options.progressive=false] - 使用渐进式 PNG
    * @param {string} [options.colorSpace='srgb'] - 输出色彩空间
+   * @param {number} [options.bits] - 8 或 16 位输出，默认为 outputBps（仅原生编码器）
+   * @param {string} [options.filter='adaptive'] - 行滤波类型（仅原生编码器，见 createPNG）
    * @returns {Promise<Object>} - 包含元数据的 PNG 缓冲区
    */
   async createPNGBuffer(options = {}) {
@@ -930,6 +1508,62 @@ class LibRaw {
           await this.processImage();
         }
 
+        // 不缩放、不隔行、不转换色彩空间时使用原生编码器：多线程压缩，并写入输出色彩空间的 ICC 配置文件
+        const colorSpace = (options.colorSpace || "srgb").toLowerCase();
+        if (
+          !options.width &&
+          !options.height &&
+          !options.progressive &&
+          colorSpace === "srgb"
+        ) {
+          const compressionLevel = Math.max(
+            0,
+            Math.min(9, options.compressionLevel ?? 6)
+          );
+          const png = await this.createPNG({
+            bits: options.bits,
+            compressionLevel,
+            filter: options.filter,
+          });
+          const dataSize = png.width * png.height * png.colors * (png.bits / 8);
+          const processingTime =
+            Number(process.hrtime.bigint() - startTime) / 1000000;
+
+          resolve({
+            success: true,
+            buffer: png.data,
+            metadata: {
+              originalDimensions: { width: png.width, height: png.height },
+              outputDimensions: { width: png.width, height: png.height },
+              fileSize: {
+                original: dataSize,
+                compressed: png.data.length,
+                compressionRatio: (dataSize / png.data.length).toFixed(2),
+              },
+              processing: {
+                timeMs: processingTime.toFixed(2),
+                throughputMBps: (
+                  dataSize /
+                  1024 /
+                  1024 /
+                  (processingTime / 1000)
+                ).toFixed(2),
+              },
+              pngOptions: {
+                compressionLevel,
+                progressive: false,
+                bits: png.bits,
+                filter: options.filter || (compressionLevel === 0 ? "none" : "adaptive"),
+                iccProfile: png.iccProfile,
+                segments: png.segments,
+                threads: png.threads,
+                encoder: "native",
+              },
+            },
+          });
+          return;
+        }
+
         // 在内存中创建处理后的图像（如果可用则使用缓存）
         const imageData = await this.createMemoryImage();
 
@@ -1612,6 +2246,55 @@ class LibRaw {
       try {
         const startTime = process.hrtime.bigint();
 
+        // 指定 maxSize 时直接取缩小解码的预览，只需再编码一次；
+        // 插件未链接 libjpeg 或预览无法解码时回退到下面的完整流程
+        if (options.maxSize) {
+          let preview = null;
+          try {
+            preview = await this.getPreviewRGB(options.maxSize);
+          } catch (error) {
+            preview = null;
+          }
+          if (preview) {
+            const jpegOptions = {
+              quality: Math.max(1, Math.min(100, options.quality || 85)),
+              progressive: false,
+              mozjpeg: false,
+            };
+            const jpegBuffer = await sharp(preview.data, {
+              raw: { width: preview.width, height: preview.height, channels: 3 },
+            })
+              .jpeg(jpegOptions)
+              .toBuffer({ resolveWithObject: true });
+            const processingTime = Number(process.hrtime.bigint() - startTime) / 1000000;
+
+            resolve({
+              success: true,
+              buffer: jpegBuffer.data,
+              metadata: {
+                format: "JPEG",
+                originalDimensions: {
+                  width: preview.sourceWidth,
+                  height: preview.sourceHeight,
+                },
+                outputDimensions: {
+                  width: jpegBuffer.info.width,
+                  height: jpegBuffer.info.height,
+                },
+                fileSize: {
+                  compressed: jpegBuffer.data.length,
+                },
+                processing: {
+                  timeMs: processingTime.toFixed(2),
+                  dctScale: `1/${preview.scaleDenom}`,
+                },
+                jpegOptions: jpegOptions,
+              },
+            });
+            return;
+          }
+        }
+
         // Unpack thumbnail if needed
         await this.unpackThumbnail();
 
@@ -2047,6 +2730,70 @@ class LibRaw {
     });
   }
 
+  /**
+   * Abort the current job if it is not finished within the given time.
+   * The deadline is enforced by a native watchdog thread, so it also interrupts
+   * long synchronous decode, demosaic and write calls. An aborted call rejects
+   * with an error whose code is 'LIBRAW_DEADLINE_EXCEEDED' and the file is
+   * released; load it again to retry.
+   * @param {number} ms - Milliseconds from now, 0 to remove the deadline
+   * @returns {Promise<boolean>} - Success status
+   */
+  async setDeadline(ms) {
+    return new Promise((resolve, reject) => {
+      try {
+        const result = this._wrapper.setDeadline(ms);
+        resolve(result);
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  /**
+   * Remove the deadline set by setDeadline()
+   * @returns {Promise<boolean>} - Success status
+   */
+  async clearDeadline() {
+    return new Promise((resolve, reject) => {
+      try {
+        const result = this._wrapper.clearDeadline();
+        resolve(result);
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  // ============== PRIORITY SCHEDULING ==============
+
+  /**
+   * Set the scheduling lane of this instance. At each LibRaw stage boundary a
+   * 'normal' job pauses while 'interactive' jobs are running, and a
+   * 'background' job pauses while 'interactive' or 'normal' jobs are running.
+   * Applies across all instances in the process, including worker threads.
+   * @param {string} priority - 'interactive', 'normal' (default) or 'background'
+   * @returns {Promise<boolean>} - Success status
+   */
+  async setPriority(priority) {
+    return new Promise((resolve, reject) => {
+      try {
+        const result = this._wrapper.setPriority(priority);
+        resolve(result);
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  /**
+   * Get the scheduling lane of this instance
+   * @returns {string} - 'interactive', 'normal' or 'background'
+   */
+  getPriority() {
+    return this._wrapper.getPriority();
+  }
+
   // ============== VERSION INFORMATION (INSTANCE METHODS) ==============
 
   /**
@@ -2067,6 +2814,34 @@ class LibRaw {
 
   // ============== STATIC METHODS ==============
 
+  /**
+   * 不解包文件，估算处理所需的内存
+   * @param {string|Buffer} input - RAW 文件路径或缓冲区
+   * @param {Object} [options] - 估算选项
+   * @param {Object} [options.params] - 处理时将使用的输出参数（同 setOutputParams）
+   * @param {number} [options.quality] - 去马赛克质量
+   * @param {boolean} [options.halfSize] - 半尺寸输出
+   * @param {number} [options.outputBps] - 输出位深
+   * @returns {Promise<Object>} - 同 estimateMemory() 的结果
+   */
+  static async estimateMemory(input, options = {}) {
+    const libraw = new LibRaw();
+    try {
+      if (typeof input === "string") {
+        await libraw.openFile(input);
+      } else {
+        await libraw.openBuffer(input);
+      }
+      if (options.params) {
+        await libraw.setOutputParams(options.params);
+      }
+      const { params, ...overrides } = options;
+      return await libraw.estimateMemory(overrides);
+    } finally {
+      await libraw.close();
+    }
+  }
+
   /**
    * Get LibRaw version
    * @returns {string} - Version string
@@ -2099,6 +2874,113 @@ class LibRaw {
     return librawAddon.LibRawWrapper.getCameraCount();
   }
 
+  /**
+   * Get process-wide scheduler statistics per priority lane
+   * @returns {Object} - { interactive, normal, background }, each with
+   *   active, paused, calls, preemptions and pausedMs
+   */
+  static getSchedulerStats() {
+    return librawAddon.LibRawWrapper.getSchedulerStats();
+  }
+
+  /**
+   * Get the instruction set used by the dispatched native kernels
+   * @returns {Object} - { level, detected }: 'scalar', 'sse4.1', 'avx2' or 'neon'.
+   *   level can be lowered with the LIBRAW_SIMD environment variable
+   */
+  static getSimdInfo() {
+    return librawAddon.LibRawWrapper.getSimdInfo();
+  }
+
+  /**
+   * 插件是否链接了 libjpeg（node-gyp rebuild --use_libjpeg=true）
+   * 未链接时 JPEG 预览解码、writeStreamed 和瓦片金字塔的 JPEG 输出不可用，瓦片金字塔默认改为 PNG
+   * @returns {boolean}
+   */
+  static hasNativeJpeg() {
+    return librawAddon.LibRawWrapper.hasNativeJpeg();
+  }
+
+  /**
+   * 获取进程级性能计数器（所有实例、worker 线程和 WorkerPool 的合计）
+   * @param {Object} [options] - { format }：'json'（默认）返回 prom-client 风格的指标族数组，
+   *   'prometheus' 返回文本格式，'raw' 返回原生快照（直方图的桶不累加）
+   * @returns {Array|string|Object} - 指标族 [{ name, help, type, values: [{ labels, value, metricName? }] }]
+   */
+  static getMetrics(options = {}) {
+    const format = options.format || "json";
+    if (format !== "json" && format !== "prometheus" && format !== "raw") {
+      throw new RangeError("format must be 'json', 'prometheus' or 'raw'");
+    }
+    const snapshot = librawAddon.LibRawWrapper.getMetrics();
+    if (format === "raw") return snapshot;
+    const families = metricFamilies(snapshot);
+    return format === "prometheus" ? prometheusText(families) : families;
+  }
+
+  /**
+   * 记录一次外部队列中的等待时间，计入 librawspeed_queue_wait_seconds{queue="pool"}
+   * （WorkerPool 会自动调用）
+   * @param {string} lane - 'interactive'、'normal' 或 'background'
+   * @param {number} ms - 等待毫秒数
+   */
+  static observeQueueWait(lane, ms) {
+    return librawAddon.LibRawWrapper.observeQueueWait(lane, ms);
+  }
+
+  /**
+   * 预先加载校准数据到进程级注册表，之后 setCalibration() 使用相同选项时直接共享
+   * @param {Object} options - 同 setCalibration()
+   * @returns {Object} - { key, darkFrame, badPixels, greenMatching, bytes }
+   */
+  static loadCalibration(options) {
+    return librawAddon.LibRawWrapper.loadCalibration(options);
+  }
+
+  /**
+   * 从注册表移除校准数据（例如文件已更新），正在使用它的实例不受影响
+   * @param {string} key - loadCalibration()/setCalibration() 返回的 key
+   * @returns {boolean} - 是否存在
+   */
+  static releaseCalibration(key) {
+    return librawAddon.LibRawWrapper.releaseCalibration(key);
+  }
+
+  /**
+   * 设置进程级共享缓存的预算（字节，0 表示禁用，默认均为 0）。
+   * 渲染结果缓存供 renderCached() 使用；raw 缓存保存解包结果，loadFile() 命中时跳过解码。
+   * 设置 rawCacheDir 后解包结果还会压缩写入该目录，之后的进程打开同一文件时解压读取，不再解码
+   * @param {Object} options
+   * @param {number} [options.outputBudget] - 渲染结果缓存预算
+   * @param {number} [options.rawBudget] - 解包 raw 数据缓存预算
+   * @param {string|null} [options.rawCacheDir] - 磁盘 raw 缓存目录（必须已存在），null 表示禁用
+   * @param {string} [options.rawCacheDecoders] - 'expensive'（默认，只缓存 CR3、富士压缩和 Phase One IIQ）或 'all'
+   * @param {number} [options.rawCacheBudget] - 磁盘 raw 缓存目录的字节上限，超出时按修改时间删除最旧的文件，0（默认）表示不限制
+   * @returns {Object} - 同 getCacheStats()
+   */
+  static configureCache(options) {
+    return librawAddon.LibRawWrapper.configureCache(options);
+  }
+
+  /**
+   * 共享缓存统计
+   * @returns {Object} - { output, raw, disk }：output 和 raw 为 { entries, bytes, budget, hits, misses, waits, evictions, rejected }，
+   * disk 为 { directory, decoders, budget, bytes, hits, misses, writes, errors, evictions, bytesRead, bytesWritten }
+   */
+  static getCacheStats() {
+    return librawAddon.LibRawWrapper.getCacheStats();
+  }
+
+  /**
+   * 清空两个共享缓存（预算和统计保留）
+   * @param {Object} [options]
+   * @param {boolean} [options.disk=false] - 同时删除磁盘 raw 缓存目录中的缓存文件
+   * @returns {boolean}
+   */
+  static clearCache(options = {}) {
+    return librawAddon.LibRawWrapper.clearCache({ disk: !!options.disk });
+  }
+
   /**
    * High-performance fast JPEG conversion with minimal processing
    * @param {string} outputPath - Output JPEG file path
@@ -2184,63 +3066,94 @@ class LibRaw {
    * @param {string[]} inputPaths - Array of RAW file paths
    * @param {string} outputDir - Output directory
    * @param {Object} options - Conversion options
+   * @param {number} [options.maxConcurrency] - Fixed number of files per batch
+   * @param {number|string|MemoryBudget} [options.memoryBudget] - Admit files against an estimated
+   *   memory budget (bytes, 'auto' or a shared MemoryBudget) instead of fixed batches
    * @returns {Promise<Object>} - Batch conversion results
    */
   static async batchConvertToJPEGParallel(inputPaths, outputDir, options = {}) {
     const fs = require("fs");
     const path = require("path");
     const os = require("os");
+    const MemoryBudget = require("./memory-budget");
 
     if (!fs.existsSync(outputDir)) {
       fs.mkdirSync(outputDir, { recursive: true });
     }
 
+    const { memoryBudget, ...jpegOptions } = options;
     const maxConcurrency =
       options.maxConcurrency || Math.min(os.cpus().length, 4);
     const results = [];
     const errors = [];
     const startTime = Date.now();
 
-    // Process files in parallel batches
-    for (let i = 0; i < inputPaths.length; i += maxConcurrency) {
-      const batch = inputPaths.slice(i, i + maxConcurrency);
+    const convertOne = async (inputPath) => {
+      try {
+        const fileName = path.parse(inputPath).name;
+        const outputPath = path.join(outputDir, `${fileName}.jpg`);
 
-      const batchPromises = batch.map(async (inputPath) => {
-        try {
-          const fileName = path.parse(inputPath).name;
-          const outputPath = path.join(outputDir, `${fileName}.jpg`);
+        const libraw = new LibRaw();
+        await libraw.loadFile(inputPath);
 
-          const libraw = new LibRaw();
-          await libraw.loadFile(inputPath);
+        const result = await libraw.convertToJPEG(outputPath, {
+          fastMode: true,
+          effort: 1,
+          quality: jpegOptions.quality || 85,
+          ...jpegOptions,
+        });
 
-          const result = await libraw.convertToJPEG(outputPath, {
-            fastMode: true,
-            effort: 1,
-            quality: options.quality || 85,
-            ...options,
-          });
+        await libraw.close();
+
+        return {
+          inputPath,
+          outputPath,
+          success: true,
+          fileSize: result.metadata.fileSize.compressed,
+          processingTime: result.metadata.processing.timeMs,
+        };
+      } catch (error) {
+        errors.push({ inputPath, error: error.message });
+        return {
+          inputPath,
+          success: false,
+          error: error.message,
+        };
+      }
+    };
 
-          await libraw.close();
+    if (memoryBudget) {
+      // 按估算的峰值内存准入，而不是固定并发数
+      const budget =
+        memoryBudget instanceof MemoryBudget
+          ? memoryBudget
+          : new MemoryBudget(memoryBudget);
 
-          return {
-            inputPath,
-            outputPath,
-            success: true,
-            fileSize: result.metadata.fileSize.compressed,
-            processingTime: result.metadata.processing.timeMs,
-          };
+      const admitted = inputPaths.map(async (inputPath) => {
+        let cost = 0;
+        try {
+          const estimate = await LibRaw.estimateMemory(inputPath);
+          // 内存图像还会再复制一份交给 sharp 编码
+          cost = estimate.peak + estimate.output;
         } catch (error) {
-          errors.push({ inputPath, error: error.message });
-          return {
-            inputPath,
-            success: false,
-            error: error.message,
-          };
+          // 无法识别的文件交给 convertOne 报告错误
         }
-      });
 
-      const batchResults = await Promise.all(batchPromises);
-      results.push(...batchResults);
+        await budget.acquire(cost);
+        try {
+          return await convertOne(inputPath);
+        } finally {
+          budget.release(cost);
+        }
+      });
+      results.push(...(await Promise.all(admitted)));
+    } else {
+      // Process files in parallel batches
+      for (let i = 0; i < inputPaths.length; i += maxConcurrency) {
+        const batch = inputPaths.slice(i, i + maxConcurrency);
+        const batchResults = await Promise.all(batch.map(convertOne));
+        results.push(...batchResults);
+      }
     }
 
     const endTime = Date.now();
@@ -2259,4 +3172,80 @@ class LibRaw {
   }
 }
 
+/**
+ * 连续处理格式固定的无文件头 Bayer 帧（视频、机器视觉相机）
+ * 格式只在构造时设置一次，之后每帧复用 LibRaw 的缓冲区和输出曲线，
+ * 结果写入预先分配的输出缓冲区环
+ */
+class BayerStream {
+  /**
+   * @param {Object} options - 帧格式和处理参数
+   * @param {number} options.width - raw 帧宽度（含边距）
+   * @param {number} options.height - raw 帧高度（含边距）
+   * @param {Object} [options.margins] - { left, top, right, bottom }，边距内的遮挡像素每帧统计黑电平
+   * @param {string} [options.pattern='RGGB'] - 'RGGB' | 'BGGR' | 'GRBG' | 'GBRG'
+   * @param {number} [options.flags=0] - open_bayer 的 otherflags（如 16 位大端、10 位紧密打包）
+   * @param {number} [options.unusedBits=0] - 每个样本低位未使用的位数
+   * @param {number} [options.blackLevel=0] - 黑电平
+   * @param {number} [options.whiteLevel] - 白电平，默认按位深计算
+   * @param {number[]|number[][]} [options.colorMatrix] - 相机 RGB 到 sRGB 的 3x3 矩阵
+   * @param {number[]} [options.whiteBalance] - 白平衡乘数 [R, G, B, G2]
+   * @param {string} [options.demosaic='linear'] - 'half' | 'linear' | 'vng' | 'ppg' | 'ahd' | 'dcb'
+   * @param {number} [options.outputBps=8] - 输出位深 8 或 16
+   * @param {number[]} [options.gamma] - 输出曲线 [幂, 斜率]
+   * @param {number} [options.bright=1] - 输出亮度
+   * @param {number} [options.ringSize=3] - 输出缓冲区个数
+   */
+  constructor(options) {
+    this._stream = new librawAddon.BayerStream(options);
+  }
+
+  /**
+   * 处理一帧。帧长度必须与第一帧相同，位深由帧长度推断（8/10/12/16 位）
+   * 返回的 data 属于输出缓冲区环，ringSize 帧之后会被覆盖，需要保留时请复制
+   * @param {Buffer} frame - raw 帧数据
+   * @returns {Promise<Object>} - { data, width, height, colors, bits, sequence, slot, blackLevel, processingMs }
+   */
+  async processFrame(frame) {
+    return new Promise((resolve, reject) => {
+      try {
+        resolve(this._stream.processFrame(frame));
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  /**
+   * 获取帧数、输出尺寸和平均处理时间
+   * @returns {Object}
+   */
+  getStats() {
+    return this._stream.getStats();
+  }
+
+  /**
+   * 释放 LibRaw 缓冲区和输出缓冲区环，已返回的 data 仍然有效
+   * @returns {Promise<boolean>}
+   */
+  async close() {
+    return new Promise((resolve, reject) => {
+      try {
+        resolve(this._stream.close());
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+}
+
+// 连续 Bayer 帧处理
+LibRaw.BayerStream = BayerStream;
+
+// 基于 worker_threads 的并行解码线程池
+LibRaw.WorkerPool = require("./worker-pool");
+
+// 按估算内存准入的预算计数器
+LibRaw.MemoryBudget = require("./memory-budget");
+
 module.exports = LibRaw;
@@ -0,0 +1,87 @@
+const os = require("os");
+
+/**
+ * 按内存预算准入的计数器
+ *
+ * 每个任务在开始前申请其估算的峰值内存，结束后归还。
+ * 队首任务放不下时后续任务也会等待（先进先出，避免大文件被小文件饿死）；
+ * 超过整个预算的任务在没有其他任务运行时单独放行，避免永久阻塞。
+ */
+class MemoryBudget {
+  /**
+   * @param {number|string} limit - 预算字节数，或 'auto'（当前空闲内存的一半）
+   */
+  constructor(limit) {
+    this.limit =
+      limit === "auto" ? Math.floor(os.freemem() / 2) : Number(limit);
+    if (!(this.limit > 0)) {
+      throw new Error("Memory budget must be a positive number of bytes");
+    }
+    this.inUse = 0;
+    this.active = 0;
+    this._waiters = [];
+  }
+
+  /**
+   * 立即尝试申请内存
+   * @param {number} bytes - 申请的字节数
+   * @returns {boolean} - 是否获准
+   */
+  tryAcquire(bytes) {
+    if (this._waiters.length > 0) {
+      return false;
+    }
+    return this._admit(bytes);
+  }
+
+  /**
+   * 申请内存，预算不足时等待
+   * @param {number} bytes - 申请的字节数
+   * @returns {Promise<void>}
+   */
+  acquire(bytes) {
+    if (this.tryAcquire(bytes)) {
+      return Promise.resolve();
+    }
+    return new Promise((resolve) => {
+      this._waiters.push({ bytes, resolve });
+    });
+  }
+
+  /**
+   * 归还之前申请的内存，并唤醒可以放行的等待者
+   * @param {number} bytes - 归还的字节数
+   */
+  release(bytes) {
+    this.inUse = Math.max(0, this.inUse - bytes);
+    this.active = Math.max(0, this.active - 1);
+
+    while (this._waiters.length > 0 && this._admit(this._waiters[0].bytes)) {
+      this._waiters.shift().resolve();
+    }
+  }
+
+  _admit(bytes) {
+    if (this.active > 0 && this.inUse + bytes > this.limit) {
+      return false;
+    }
+    this.inUse += bytes;
+    this.active++;
+    return true;
+  }
+
+  /**
+   * 当前预算状态
+   * @returns {{limit: number, inUse: number, active: number, waiting: number}}
+   */
+  getStats() {
+    return {
+      limit: this.limit,
+      inUse: this.inUse,
+      active: this.active,
+      waiting: this._waiters.length,
+    };
+  }
+}
+
+module.exports = MemoryBudget;
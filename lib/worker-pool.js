@@ -0,0 +1,426 @@
+const path = require("path");
+const os = require("os");
+const { Worker } = require("worker_threads");
+const MemoryBudget = require("./memory-budget");
+
+const WORKER_SCRIPT = path.join(__dirname, "decode-worker.js");
+
+// 优先级通道，按分派顺序排列
+const LANES = ["interactive", "normal", "background"];
+
+// 每个通道保留的最近样本数，用于计算延迟分位数
+const LATENCY_SAMPLES = 256;
+
+function percentile(sorted, p) {
+  if (sorted.length === 0) return 0;
+  const index = Math.min(sorted.length - 1, Math.floor(sorted.length * p));
+  return sorted[index];
+}
+
+function summarize(samples) {
+  const sorted = [...samples].sort((a, b) => a - b);
+  const total = sorted.reduce((sum, value) => sum + value, 0);
+  return {
+    avg: sorted.length ? total / sorted.length : 0,
+    p50: percentile(sorted, 0.5),
+    p95: percentile(sorted, 0.95),
+    max: sorted.length ? sorted[sorted.length - 1] : 0,
+  };
+}
+
+/**
+ * 基于 worker_threads 的 LibRaw 解码线程池
+ *
+ * 原生插件的实例数据按环境隔离，因此每个 worker 都可以独立加载插件并并行解码。
+ * 任务按优先级通道（interactive、normal、background）分派给空闲 worker，
+ * 同一通道内按提交顺序，输出缓冲区通过 transferList 零拷贝返回。
+ * 每个通道可以限制并发数；正在运行的低优先级任务会在 LibRaw 阶段边界
+ * 让出给高优先级任务（由原生调度器完成，跨所有 worker 生效）。
+ * 设置 memoryBudget 后，任务还需按估算的峰值内存获准才会分派。
+ */
+class LibRawWorkerPool {
+  /**
+   * @param {Object} [options] - 线程池选项
+   * @param {number} [options.size] - worker 数量（默认为 CPU 核心数，最多 8）
+   * @param {number|string|MemoryBudget} [options.memoryBudget] - 内存预算（字节、'auto' 或共享的 MemoryBudget）
+   * @param {Object} [options.laneLimits] - 各通道的最大并发数；默认 background 最多占用 size - 1 个 worker，为交互式任务保留一个
+   */
+  constructor(options = {}) {
+    this.size = Math.max(1, options.size || Math.min(os.cpus().length, 8));
+    this._laneLimits = {
+      interactive: this.size,
+      normal: this.size,
+      background: Math.max(1, this.size - 1),
+      ...(options.laneLimits || {}),
+    };
+    this._lanes = {};
+    for (const lane of LANES) {
+      this._lanes[lane] = {
+        queue: [],
+        running: 0,
+        completed: 0,
+        failed: 0,
+        waitSamples: [],
+        runSamples: [],
+      };
+    }
+    this._budget = null;
+    if (options.memoryBudget) {
+      this._budget =
+        options.memoryBudget instanceof MemoryBudget
+          ? options.memoryBudget
+          : new MemoryBudget(options.memoryBudget);
+    }
+    this._workers = [];
+    this._idle = [];
+    this._pending = new Map();
+    this._nextId = 1;
+    this._closed = false;
+
+    for (let i = 0; i < this.size; i++) {
+      this._spawnWorker();
+    }
+  }
+
+  _spawnWorker() {
+    const worker = new Worker(WORKER_SCRIPT);
+    worker._currentJobId = null;
+
+    worker.on("message", (message) => this._onMessage(worker, message));
+    worker.on("error", (error) => this._onWorkerError(worker, error));
+    worker.on("exit", (code) => {
+      if (!this._closed && code !== 0) {
+        this._onWorkerError(
+          worker,
+          new Error(`LibRaw worker exited with code ${code}`)
+        );
+      }
+    });
+
+    this._workers.push(worker);
+    this._idle.push(worker);
+    return worker;
+  }
+
+  _onMessage(worker, message) {
+    const task = this._pending.get(message.id);
+    this._pending.delete(message.id);
+    worker._currentJobId = null;
+
+    if (task) {
+      this._releaseBudget(task);
+      this._finishTask(task, !message.error);
+      if (message.error) {
+        const error = new Error(message.error.message);
+        error.stack = message.error.stack;
+        if (message.error.code) {
+          error.code = message.error.code;
+        }
+        task.reject(error);
+      } else {
+        task.resolve(this._restoreBuffers(message.result));
+      }
+    }
+
+    this._idle.push(worker);
+    this._dispatch();
+  }
+
+  _onWorkerError(worker, error) {
+    // 拒绝该 worker 上正在运行的任务，并用新的 worker 替换它
+    const jobId = worker._currentJobId;
+    if (jobId !== null && this._pending.has(jobId)) {
+      this._releaseBudget(this._pending.get(jobId));
+      this._finishTask(this._pending.get(jobId), false);
+      this._pending.get(jobId).reject(error);
+      this._pending.delete(jobId);
+    }
+
+    this._workers = this._workers.filter((w) => w !== worker);
+    this._idle = this._idle.filter((w) => w !== worker);
+    worker.removeAllListeners();
+    worker.terminate();
+
+    if (!this._closed) {
+      this._spawnWorker();
+      this._dispatch();
+    }
+  }
+
+  // 把移交回来的 ArrayBuffer 包装回 Buffer（不复制）
+  _restoreBuffers(result) {
+    if (result && result.data instanceof ArrayBuffer) {
+      result.data = Buffer.from(result.data);
+    }
+    if (result && result.buffer instanceof ArrayBuffer) {
+      result.buffer = Buffer.from(result.buffer);
+    }
+    return result;
+  }
+
+  _releaseBudget(task) {
+    if (this._budget && task.admitted) {
+      task.admitted = false;
+      this._budget.release(task.cost);
+    }
+  }
+
+  // 队首任务向预算申请内存；获准后再次分派。估算尚未完成时保持等待
+  _admit(task) {
+    if (task.cost === null || task.admitting) {
+      return;
+    }
+    task.admitting = true;
+    this._budget.acquire(task.cost).then(() => {
+      task.admitting = false;
+      task.admitted = true;
+      if (this._closed) {
+        this._releaseBudget(task);
+        return;
+      }
+      this._dispatch();
+    });
+  }
+
+  // 记录任务的运行时长并更新通道计数
+  _finishTask(task, succeeded) {
+    const lane = this._lanes[task.lane];
+    lane.running--;
+    if (succeeded) {
+      lane.completed++;
+    } else {
+      lane.failed++;
+    }
+    this._recordSample(lane.runSamples, Date.now() - task.startedAt);
+  }
+
+  _recordSample(samples, value) {
+    samples.push(value);
+    if (samples.length > LATENCY_SAMPLES) {
+      samples.shift();
+    }
+  }
+
+  // 优先级最高、且所在通道未达到并发上限的队首任务
+  _nextTask() {
+    for (const name of LANES) {
+      const lane = this._lanes[name];
+      if (lane.queue.length > 0 && lane.running < this._laneLimits[name]) {
+        return lane.queue[0];
+      }
+    }
+    return null;
+  }
+
+  _dispatch() {
+    while (this._idle.length > 0) {
+      const task = this._nextTask();
+      if (!task) {
+        break;
+      }
+      if (this._budget && !task.admitted) {
+        this._admit(task);
+        break;
+      }
+
+      const worker = this._idle.shift();
+      const lane = this._lanes[task.lane];
+      lane.queue.shift();
+      lane.running++;
+      task.startedAt = Date.now();
+      this._recordSample(lane.waitSamples, task.startedAt - task.queuedAt);
+      this._reportQueueWait(task.lane, task.startedAt - task.queuedAt);
+
+      worker._currentJobId = task.id;
+      this._pending.set(task.id, task);
+      worker.postMessage({ id: task.id, job: task.job }, task.transferList);
+    }
+  }
+
+  /**
+   * 把等待时间计入原生层的进程级计数器（LibRaw.getMetrics() 中 queue="pool" 的直方图）
+   * @param {string} lane - 优先级
+   * @param {number} ms - 等待毫秒数
+   */
+  _reportQueueWait(lane, ms) {
+    // 延迟加载，避免与 index.js 循环依赖；计数失败不影响任务分发
+    try {
+      require("./index.js").observeQueueWait(lane, ms);
+    } catch (error) {
+      // 忽略
+    }
+  }
+
+  /**
+   * 提交一个解码任务
+   * @param {Object} job - 任务描述
+   * @param {string|Buffer} job.input - RAW 文件路径或包含 RAW 数据的缓冲区
+   * @param {string} [job.operation='memoryImage'] - 'memoryImage'、'metadata'、'jpeg'、'png'、'tiff'、'webp'、'avif'、'ppm' 或 'thumbnail'
+   * @param {Object} [job.params] - 传给 setOutputParams() 的输出参数
+   * @param {Object} [job.calibration] - 传给 setCalibration() 的校准选项（同一路径只加载一次）
+   * @param {Object} [job.options] - 传给对应 create*Buffer() 方法的选项
+   * @param {boolean} [job.cache=false] - 通过 renderCached() 使用进程级共享缓存（仅文件路径输入，需先调用 LibRaw.configureCache()）
+   * @param {boolean} [job.transferInput=false] - 把输入缓冲区移交给 worker（调用方之后不能再使用它）
+   * @param {number} [job.memoryEstimate] - 预估峰值内存（字节）；设置了内存预算但未提供时自动估算
+   * @param {number} [job.deadline] - 截止时间（毫秒），从 worker 开始执行该任务时计时；超时以 code 为 'LIBRAW_DEADLINE_EXCEEDED' 的错误拒绝
+   * @param {string} [job.priority='normal'] - 'interactive'、'normal' 或 'background'
+   * @returns {Promise<Object>} - 任务结果，data/buffer 字段为 Buffer
+   */
+  run(job) {
+    if (this._closed) {
+      return Promise.reject(new Error("Worker pool is closed"));
+    }
+
+    const priority = job.priority || "normal";
+    if (!LANES.includes(priority)) {
+      return Promise.reject(new Error(`Unknown job priority: ${priority}`));
+    }
+
+    let input = job.input;
+    const transferList = [];
+
+    // 必须在移交输入缓冲区之前估算
+    const estimate = this._budget ? this._estimateCost(job) : null;
+
+    if (Buffer.isBuffer(input)) {
+      if (
+        job.transferInput &&
+        input.byteOffset === 0 &&
+        input.byteLength === input.buffer.byteLength
+      ) {
+        input = input.buffer;
+        transferList.push(input);
+      } else {
+        input = new Uint8Array(input);
+      }
+    }
+
+    return new Promise((resolve, reject) => {
+      const id = this._nextId++;
+      const task = {
+        id,
+        job: {
+          input,
+          operation: job.operation,
+          params: job.params,
+          calibration: job.calibration,
+          options: job.options,
+          cache: job.cache,
+          deadline: job.deadline,
+          priority,
+        },
+        lane: priority,
+        queuedAt: Date.now(),
+        startedAt: 0,
+        transferList,
+        resolve,
+        reject,
+        cost: this._budget ? null : 0,
+        admitted: false,
+        admitting: false,
+      };
+      this._lanes[priority].queue.push(task);
+
+      if (estimate) {
+        estimate.then((cost) => {
+          task.cost = cost;
+          this._dispatch();
+        });
+      }
+      this._dispatch();
+    });
+  }
+
+  /**
+   * 估算任务的峰值内存；无法识别的输入按 0 计，由 worker 报告错误
+   * @param {Object} job - 任务描述
+   * @returns {Promise<number>} - 字节数
+   */
+  async _estimateCost(job) {
+    if (typeof job.memoryEstimate === "number") {
+      return job.memoryEstimate;
+    }
+
+    // 延迟加载，避免与 index.js 循环依赖
+    const LibRaw = require("./index.js");
+    const operation = job.operation || "memoryImage";
+
+    try {
+      const estimate = await LibRaw.estimateMemory(job.input, {
+        params: job.params,
+      });
+      // 元数据和缩略图任务也会解包 raw 数据，但不做后续处理
+      if (operation === "metadata" || operation === "thumbnail") {
+        return estimate.raw + estimate.decoder;
+      }
+      // 编码类任务还会把内存图像复制给 sharp
+      return operation === "memoryImage"
+        ? estimate.peak
+        : estimate.peak + estimate.output;
+    } catch (error) {
+      return 0;
+    }
+  }
+
+  /**
+   * 当前线程池状态
+   * lanes 中的 waitMs 为排队时长，runMs 为从分派到完成的时长（均基于最近的任务）
+   * @returns {{size: number, busy: number, queued: number, lanes: Object, memory?: Object}}
+   */
+  getStats() {
+    const lanes = {};
+    let queued = 0;
+    for (const name of LANES) {
+      const lane = this._lanes[name];
+      queued += lane.queue.length;
+      lanes[name] = {
+        limit: this._laneLimits[name],
+        queued: lane.queue.length,
+        running: lane.running,
+        completed: lane.completed,
+        failed: lane.failed,
+        waitMs: summarize(lane.waitSamples),
+        runMs: summarize(lane.runSamples),
+      };
+    }
+
+    const stats = {
+      size: this._workers.length,
+      busy: this._workers.length - this._idle.length,
+      queued,
+      lanes,
+    };
+    if (this._budget) {
+      stats.memory = this._budget.getStats();
+    }
+    return stats;
+  }
+
+  /**
+   * 拒绝所有排队任务并终止所有 worker
+   * @returns {Promise<void>}
+   */
+  async close() {
+    this._closed = true;
+
+    const error = new Error("Worker pool is closed");
+    for (const name of LANES) {
+      for (const task of this._lanes[name].queue) {
+        this._releaseBudget(task);
+        task.reject(error);
+      }
+      this._lanes[name].queue = [];
+    }
+    for (const task of this._pending.values()) {
+      this._releaseBudget(task);
+      task.reject(error);
+    }
+    this._pending.clear();
+
+    await Promise.all(this._workers.map((worker) => worker.terminate()));
+    this._workers = [];
+    this._idle = [];
+  }
+}
+
+module.exports = LibRawWorkerPool;
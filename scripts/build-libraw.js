@@ -46,34 +46,7 @@ class LibRawBuilder {
       
       // 配置构建 - 使用新的统一构建目录
       const platformBuildDir = path.join(this.buildDir, this.getPlatformName());
-      const configureArgs = [
-        `--prefix=${platformBuildDir}`,
-        '--disable-shared',
-        '--enable-static',
-        '--disable-lcms',      // 禁用 LCMS 颜色管理
-        '--disable-jpeg',      // 禁用 JPEG 支持
-        '--disable-zlib',      // 禁用 zlib 压缩
-        '--disable-openmp',    // 禁用 OpenMP 多线程
-        '--disable-examples'   // 禁用示例程序
-      ];
-
-      this.log("配置 LibRaw...");
-      execSync(`./configure ${configureArgs.join(' ')}`, {
-        cwd: this.librawSourceDir,
-        stdio: 'inherit'
-      });
-
-      this.log("构建 LibRaw...");
-      execSync('make -j4', {
-        cwd: this.librawSourceDir,
-        stdio: 'inherit'
-      });
-
-      this.log("安装 LibRaw...");
-      execSync('make install', {
-        cwd: this.librawSourceDir,
-        stdio: 'inherit'
-      });
+      this.compile(platformBuildDir, {});
 
       this.log("LibRaw 构建成功完成!");
       this.log(`构建输出: ${platformBuildDir}`);
@@ -84,6 +57,252 @@ class LibRawBuilder {
     }
   }
 
+  /**
+   * 配置、编译并安装到 prefix
+   * @param {string} prefix - 安装目录
+   * @param {Object} env - 额外的环境变量（CFLAGS、CXXFLAGS、AR 等）
+   */
+  compile(prefix, env) {
+    const buildEnv = { ...process.env, ...env };
+    const configureArgs = [
+      `--prefix=${prefix}`,
+      '--disable-shared',
+      '--enable-static',
+      '--disable-lcms',      // 禁用 LCMS 颜色管理
+      '--disable-jpeg',      // 禁用 JPEG 支持
+      '--disable-zlib',      // 禁用 zlib 压缩
+      '--disable-openmp',    // 禁用 OpenMP 多线程
+      '--disable-examples'   // 禁用示例程序
+    ];
+
+    // 多次构建之间清除旧的目标文件，否则编译选项变化不会生效
+    if (fs.existsSync(path.join(this.librawSourceDir, 'Makefile'))) {
+      execSync('make distclean', { cwd: this.librawSourceDir, stdio: 'ignore' });
+    }
+
+    this.log("配置 LibRaw...");
+    execSync(`./configure ${configureArgs.join(' ')}`, {
+      cwd: this.librawSourceDir,
+      stdio: 'inherit',
+      env: buildEnv
+    });
+
+    this.log("构建 LibRaw...");
+    execSync('make -j4', {
+      cwd: this.librawSourceDir,
+      stdio: 'inherit',
+      env: buildEnv
+    });
+
+    this.log("安装 LibRaw...");
+    execSync('make install', {
+      cwd: this.librawSourceDir,
+      stdio: 'inherit',
+      env: buildEnv
+    });
+  }
+
+  // ============== PGO + LTO 构建 ==============
+
+  isClang() {
+    try {
+      const cxx = process.env.CXX || 'c++';
+      return execSync(`${cxx} --version`, { encoding: 'utf8' }).includes('clang');
+    } catch (error) {
+      return false;
+    }
+  }
+
+  /**
+   * 各阶段的编译选项：插桩、使用剖析数据，以及可选的 LTO
+   * GCC 的 LTO 使用胖目标文件，未开启 LTO 的插件链接时仍可使用其中的普通代码；
+   * Clang 使用 ThinLTO，插件也必须以 LTO 链接（node-gyp rebuild --enable_lto=true）
+   */
+  pgoFlags(profileDir, lto) {
+    const clang = this.isClang();
+    const xcrun = this.platform === 'darwin' ? 'xcrun ' : '';
+    const flags = {
+      clang,
+      generate: `-O2 -fprofile-generate=${profileDir}`,
+      use: clang
+        ? `-O2 -fprofile-use=${path.join(profileDir, 'merged.profdata')} -Wno-profile-instr-unprofiled`
+        : `-O2 -fprofile-use=${profileDir} -fprofile-partial-training -Wno-missing-profile`,
+      tools: {},
+      mergeCommand: clang
+        ? `${xcrun}llvm-profdata merge -o ${path.join(profileDir, 'merged.profdata')} ${path.join(profileDir, '*.profraw')}`
+        : null
+    };
+    if (!clang) {
+      // 多线程的截止时间监视和调度器也会更新计数器
+      flags.generate += ' -fprofile-update=prefer-atomic';
+    }
+    if (lto) {
+      flags.use += clang ? ' -flto=thin' : ' -flto=auto -ffat-lto-objects';
+      if (!clang) {
+        flags.tools = { AR: 'gcc-ar', RANLIB: 'gcc-ranlib', NM: 'gcc-nm' };
+      } else if (this.platform !== 'darwin') {
+        flags.tools = { AR: 'llvm-ar', RANLIB: 'llvm-ranlib', NM: 'llvm-nm' };
+      }
+    }
+    return flags;
+  }
+
+  /**
+   * 构建 tools/bench 的 libraw_bench；插件的处理器和指令集内核一起编译，
+   * 训练时同样被插桩。输出路径在插桩和优化两次构建中必须相同，GCC 按目标文件路径匹配剖析数据
+   */
+  buildBench(librawRoot, cxxflags, output) {
+    const benchDir = path.join(__dirname, '..', 'tools', 'bench');
+    execSync(
+      `make -B -C ${benchDir} LIBRAW_ROOT=${librawRoot} OUT=${output} ` +
+        `CXXFLAGS="${cxxflags} -std=c++17 -Wno-unused-parameter"`,
+      { stdio: 'inherit' }
+    );
+  }
+
+  runBench(bench, args, inputs) {
+    const samplesDir = path.join(__dirname, '..', 'raw-samples-repo');
+    const targets = inputs || [samplesDir];
+    return execSync(`${bench} ${args.join(' ')} ${targets.join(' ')}`, {
+      encoding: 'utf8',
+      maxBuffer: 64 * 1024 * 1024,
+      stdio: ['ignore', 'pipe', 'inherit']
+    });
+  }
+
+  /**
+   * 插桩构建 → 用样本库训练 → 以剖析数据（和 LTO）重新构建并安装到平台目录。
+   * compare 为 true 时先构建默认选项的基准版本，最后按格式对比两者
+   */
+  async buildPgo(options) {
+    const { lto, compare, repeat } = options;
+    const workDir = path.join(__dirname, '..', 'build', 'pgo');
+    const profileDir = path.join(workDir, 'profile');
+    const benchOut = path.join(workDir, 'libraw_bench');
+    const platformBuildDir = path.join(this.buildDir, this.getPlatformName());
+    const flags = this.pgoFlags(profileDir, lto);
+
+    this.log(`开始 PGO${lto ? ' + LTO' : ''} 构建（${flags.clang ? 'Clang' : 'GCC'}）...`);
+    await this.ensureDirectories();
+    this.checkBuildTools();
+    fs.rmSync(workDir, { recursive: true, force: true });
+    fs.mkdirSync(profileDir, { recursive: true });
+
+    if (compare) {
+      this.log("1/4 构建默认选项的基准版本...");
+      const baselineRoot = path.join(workDir, 'baseline');
+      this.compile(baselineRoot, {});
+      this.buildBench(baselineRoot, '-O2', benchOut);
+      fs.renameSync(benchOut, `${benchOut}-baseline`);
+    }
+
+    this.log("2/4 插桩构建...");
+    const instrumentedRoot = path.join(workDir, 'instrumented');
+    this.compile(instrumentedRoot, { CFLAGS: flags.generate, CXXFLAGS: flags.generate, LDFLAGS: flags.generate });
+    this.buildBench(instrumentedRoot, flags.generate, benchOut);
+
+    // 覆盖所有格式的解码器和全部去马赛克算法
+    this.log("3/4 使用样本库训练...");
+    this.runBench(benchOut, ['--repeat', '1', '--quality', '0,1,2,3,4,11,12']);
+    // configure 的测试程序也会写入剖析数据，重新配置时 GCC 会因控制流不匹配而报错
+    for (const file of fs.readdirSync(profileDir)) {
+      if (file.includes('conftest')) {
+        fs.rmSync(path.join(profileDir, file), { force: true });
+      }
+    }
+    if (flags.mergeCommand) {
+      execSync(flags.mergeCommand, { stdio: 'inherit', shell: true });
+    }
+
+    this.log("4/4 使用剖析数据重新构建...");
+    const useEnv = { CFLAGS: flags.use, CXXFLAGS: flags.use, LDFLAGS: flags.use, ...flags.tools };
+    this.compile(platformBuildDir, useEnv);
+    this.buildBench(platformBuildDir, flags.use, benchOut);
+    fs.renameSync(benchOut, `${benchOut}-pgo`);
+
+    this.log(`PGO 构建完成: ${platformBuildDir}`);
+    if (lto) {
+      this.log("插件使用 LTO 链接: node-gyp rebuild --enable_lto=true");
+    }
+
+    if (compare) {
+      this.comparePgo(workDir, repeat);
+    }
+  }
+
+  /**
+   * 分别运行基准版本和 PGO 版本的 libraw_bench，按格式汇总各阶段中位数之和
+   */
+  comparePgo(workDir, repeat) {
+    this.log(`对比基准版本与 PGO 版本（每阶段 ${repeat} 次）...`);
+    const args = ['--json', '--repeat', String(repeat)];
+    const samplesDir = path.join(__dirname, '..', 'raw-samples-repo');
+    const formatDirs = fs
+      .readdirSync(samplesDir)
+      .map((name) => path.join(samplesDir, name))
+      .filter((dir) => fs.statSync(dir).isDirectory() && !path.basename(dir).startsWith('.'));
+
+    // 按格式交替运行两个版本，机器负载的漂移对两者的影响相同
+    const runs = { baseline: { files: [] }, pgo: { files: [] } };
+    for (const dir of formatDirs) {
+      for (const variant of Object.keys(runs)) {
+        const bench = path.join(workDir, `libraw_bench-${variant}`);
+        runs[variant].files.push(...JSON.parse(this.runBench(bench, args, [dir])).files);
+      }
+    }
+
+    const median = (values) => {
+      const sorted = [...values].sort((a, b) => a - b);
+      const mid = Math.floor(sorted.length / 2);
+      return sorted.length % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+    };
+
+    const formats = {};
+    for (const [variant, results] of Object.entries(runs)) {
+      for (const file of results.files) {
+        const format = path.basename(path.dirname(file.path));
+        formats[format] = formats[format] || { files: new Set(), baseline: 0, pgo: 0, stages: {} };
+        formats[format].files.add(file.path);
+        for (const stage of file.stages) {
+          const ms = median(stage.samplesMs);
+          formats[format][variant] += ms;
+          const stageKey = stage.name.split(' ')[0];
+          formats[format].stages[stageKey] = formats[format].stages[stageKey] || { baseline: 0, pgo: 0 };
+          formats[format].stages[stageKey][variant] += ms;
+        }
+      }
+    }
+
+    console.log('');
+    console.log(`${'format'.padEnd(10)} ${'files'.padStart(5)} ${'baseline ms'.padStart(12)} ${'pgo ms'.padStart(10)} ${'speedup'.padStart(8)}`);
+    const report = {
+      createdAt: new Date().toISOString(),
+      platform: `${this.platform}-${this.arch}`,
+      compiler: this.isClang() ? 'clang' : 'gcc',
+      repeat,
+      formats: {}
+    };
+    for (const [format, data] of Object.entries(formats).sort()) {
+      const speedup = data.pgo > 0 ? data.baseline / data.pgo : 0;
+      console.log(
+        `${format.padEnd(10)} ${String(data.files.size).padStart(5)} ${data.baseline.toFixed(1).padStart(12)} ` +
+          `${data.pgo.toFixed(1).padStart(10)} ${`${speedup.toFixed(2)}x`.padStart(8)}`
+      );
+      report.formats[format] = {
+        files: data.files.size,
+        baselineMs: data.baseline,
+        pgoMs: data.pgo,
+        speedup,
+        stages: data.stages
+      };
+    }
+    console.log('');
+
+    const reportPath = path.join(workDir, 'report.json');
+    fs.writeFileSync(reportPath, JSON.stringify(report, null, 2) + '\n');
+    this.log(`对比报告: ${reportPath}`);
+  }
+
   checkBuildTools() {
     try {
       // 检查基本构建工具
@@ -100,8 +319,18 @@ class LibRawBuilder {
 // 主执行逻辑
 async function main() {
   const builder = new LibRawBuilder();
+  const args = process.argv.slice(2);
   try {
-    await builder.build();
+    if (args.includes('--pgo')) {
+      const repeatIndex = args.indexOf('--repeat');
+      await builder.buildPgo({
+        lto: !args.includes('--no-lto'),
+        compare: !args.includes('--no-compare'),
+        repeat: repeatIndex >= 0 ? Math.max(1, parseInt(args[repeatIndex + 1], 10)) : 5
+      });
+    } else {
+      await builder.build();
+    }
   } catch (error) {
     console.error(`LibRaw 构建失败: ${error.message}`);
     process.exit(1);
@@ -0,0 +1,308 @@
+#!/usr/bin/env node
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { execFileSync } = require('child_process');
+
+/**
+ * 性能回归门禁
+ *
+ * 用 tools/bench 的原生微基准对 raw-samples-repo 中的各格式样本计时，
+ * 写入或对比按平台存放的基线。每个阶段比较多次运行的中位数，
+ * 并用 MAD（中位数绝对偏差）估计噪声：只有超过阈值且明显高于噪声的变慢才算回归。
+ *
+ * 用法:
+ *   node scripts/perf-regression.js --update            生成基线
+ *   node scripts/perf-regression.js                     与基线对比，回归时退出码为 1
+ *   node scripts/perf-regression.js --results run.json  对比已有的 libraw_bench --json 输出
+ *
+ * 选项:
+ *   --baseline <file>   基线路径（默认 test/perf-baselines/<平台>-<架构>.json）
+ *   --threshold <0.1>   允许的相对变慢比例
+ *   --noise <3>         变慢还必须超过多少倍的合并噪声（1.4826 × MAD）
+ *   --min-ms <1>        忽略绝对变化小于该值的阶段
+ *   --repeat <5>        每个阶段的运行次数
+ *   --quality <list>    去马赛克质量列表，传给 libraw_bench
+ *   --formats <list>    样本子目录（默认 ARW,CR2,NEF,PEF,RW2,DNG,RAW）
+ *   --bench <file>      libraw_bench 路径（默认 build/tools/libraw_bench，不存在时自动构建）
+ */
+
+const ROOT = path.join(__dirname, '..');
+const DEFAULT_FORMATS = ['ARW', 'CR2', 'NEF', 'PEF', 'RW2', 'DNG', 'RAW'];
+
+// MAD 换算为正态分布标准差的系数
+const MAD_TO_SIGMA = 1.4826;
+
+function median(values) {
+  if (values.length === 0) return 0;
+  const sorted = [...values].sort((a, b) => a - b);
+  const mid = Math.floor(sorted.length / 2);
+  return sorted.length % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+}
+
+function mad(values) {
+  const m = median(values);
+  return median(values.map((v) => Math.abs(v - m)));
+}
+
+class PerfRegressionGate {
+  constructor(options) {
+    this.options = options;
+    this.ranFormats = null; // runBench() 实际运行的格式目录
+  }
+
+  log(message) {
+    console.log(`[性能回归] ${message}`);
+  }
+
+  defaultBaselinePath() {
+    return path.join(ROOT, 'test', 'perf-baselines', `${os.platform()}-${os.arch()}.json`);
+  }
+
+  ensureBench() {
+    if (this.options.bench) {
+      return this.options.bench;
+    }
+    // 总是运行 make，由它判断源文件、头文件或 LibRaw 库是否比已有的二进制新，避免测量旧代码
+    const bench = path.join(ROOT, 'build', 'tools', 'libraw_bench');
+    this.log('构建 libraw_bench...');
+    execFileSync('make', ['-C', path.join(ROOT, 'tools', 'bench')], { stdio: 'inherit' });
+    return bench;
+  }
+
+  runBench() {
+    const bench = this.ensureBench();
+    const samplesDir = path.join(ROOT, 'raw-samples-repo');
+    const formats = this.options.formats.filter((format) => fs.existsSync(path.join(samplesDir, format)));
+    const inputs = formats.map((format) => path.join(samplesDir, format));
+    this.ranFormats = formats;
+
+    if (inputs.length === 0) {
+      throw new Error(`未找到样本目录: ${samplesDir}`);
+    }
+
+    const args = ['--json', '--repeat', String(this.options.repeat)];
+    if (this.options.quality) {
+      args.push('--quality', this.options.quality);
+    }
+
+    this.log(`运行 libraw_bench（${inputs.length} 个格式目录，每阶段 ${this.options.repeat} 次）...`);
+    const output = execFileSync(bench, [...args, ...inputs], {
+      encoding: 'utf8',
+      maxBuffer: 64 * 1024 * 1024,
+      stdio: ['ignore', 'pipe', 'inherit'],
+    });
+    return JSON.parse(output);
+  }
+
+  /**
+   * 把 libraw_bench 的输出整理为以 "格式/文件名::阶段" 为键的条目
+   */
+  collect(results) {
+    const entries = {};
+    for (const file of results.files) {
+      const format = path.basename(path.dirname(file.path));
+      const fileKey = `${format}/${path.basename(file.path)}`;
+      for (const stage of file.stages) {
+        entries[`${fileKey}::${stage.name}`] = {
+          format,
+          camera: file.camera,
+          decoder: file.decoder,
+          samplesMs: stage.samplesMs,
+          medianMs: median(stage.samplesMs),
+          madMs: mad(stage.samplesMs),
+          allocatedBytes: stage.allocatedBytes,
+        };
+      }
+    }
+    return entries;
+  }
+
+  host() {
+    const cpus = os.cpus();
+    return {
+      platform: os.platform(),
+      arch: os.arch(),
+      cpu: cpus.length ? cpus[0].model : 'unknown',
+      cores: cpus.length,
+    };
+  }
+
+  writeBaseline(results, baselinePath) {
+    const baseline = {
+      createdAt: new Date().toISOString(),
+      libraw: results.libraw,
+      simd: results.simd,
+      host: this.host(),
+      repeat: results.repeat,
+      trackAllocations: results.trackAllocations,
+      entries: this.collect(results),
+    };
+    fs.mkdirSync(path.dirname(baselinePath), { recursive: true });
+    fs.writeFileSync(baselinePath, JSON.stringify(baseline, null, 2) + '\n');
+    this.log(`已写入基线: ${path.relative(ROOT, baselinePath)}（${Object.keys(baseline.entries).length} 个阶段）`);
+  }
+
+  /**
+   * 判断单个阶段的变化
+   * @returns {{status: string, delta: number, noise: number}}
+   */
+  classify(base, current) {
+    const { threshold, noise, minMs } = this.options;
+    const delta = current.medianMs - base.medianMs;
+    const sigma = MAD_TO_SIGMA * Math.sqrt(base.madMs ** 2 + current.madMs ** 2);
+    const significant =
+      Math.abs(delta) > threshold * base.medianMs &&
+      Math.abs(delta) > noise * sigma &&
+      Math.abs(delta) >= minMs;
+
+    // 分配量是确定的，不需要噪声判断
+    const allocGrowth =
+      base.allocatedBytes > 0 &&
+      current.allocatedBytes > base.allocatedBytes * (1 + threshold);
+
+    let status = 'ok';
+    if (significant) {
+      status = delta > 0 ? 'slower' : 'faster';
+    } else if (allocGrowth) {
+      status = 'more-memory';
+    }
+    return { status, delta, noise: sigma };
+  }
+
+  compare(results, baselinePath) {
+    if (!fs.existsSync(baselinePath)) {
+      throw new Error(`基线不存在: ${baselinePath}（先运行 --update）`);
+    }
+    const baseline = JSON.parse(fs.readFileSync(baselinePath, 'utf8'));
+    const current = this.collect(results);
+
+    const host = this.host();
+    if (baseline.host && baseline.host.cpu !== host.cpu) {
+      this.log(`⚠️ 基线来自不同的 CPU（${baseline.host.cpu}），结果仅供参考`);
+    }
+    if (baseline.simd && results.simd && baseline.simd !== results.simd) {
+      this.log(`⚠️ 指令集级别不同（基线 ${baseline.simd}，本次 ${results.simd}），检查 LIBRAW_SIMD 设置`);
+    }
+
+    // 本次运行的格式中缺少的阶段（改名、崩溃或被跳过）按失败处理；未运行的格式不参与比较
+    const formats = new Set(this.ranFormats || this.options.formats);
+    const rows = [];
+    const missing = [];
+    for (const [key, base] of Object.entries(baseline.entries)) {
+      if (!formats.has(base.format)) {
+        continue;
+      }
+      if (!current[key]) {
+        missing.push(key);
+        continue;
+      }
+      rows.push({ key, base, current: current[key], ...this.classify(base, current[key]) });
+    }
+
+    const regressions = rows.filter((r) => r.status === 'slower' || r.status === 'more-memory');
+    const improvements = rows.filter((r) => r.status === 'faster');
+
+    console.log('');
+    console.log(`${'stage'.padEnd(64)} ${'base ms'.padStart(10)} ${'now ms'.padStart(10)} ${'change'.padStart(8)}  status`);
+    for (const row of rows) {
+      const change = row.base.medianMs > 0 ? (row.delta / row.base.medianMs) * 100 : 0;
+      const marker = { ok: '  ', slower: '❌', faster: '✅', 'more-memory': '❌' }[row.status];
+      console.log(
+        `${row.key.padEnd(64)} ${row.base.medianMs.toFixed(2).padStart(10)} ${row.current.medianMs
+          .toFixed(2)
+          .padStart(10)} ${`${change >= 0 ? '+' : ''}${change.toFixed(1)}%`.padStart(8)}  ${marker} ${row.status}`
+      );
+    }
+    console.log('');
+
+    for (const key of missing) {
+      this.log(`❌ 本次运行缺少阶段: ${key}`);
+    }
+    this.log(
+      `${rows.length} 个阶段：${regressions.length} 个回归，${missing.length} 个缺失，${improvements.length} 个显著提升` +
+        `（阈值 ${(this.options.threshold * 100).toFixed(0)}%，噪声 ${this.options.noise}σ）`
+    );
+
+    return regressions.length === 0 && missing.length === 0;
+  }
+}
+
+function parseArgs(argv) {
+  const options = {
+    update: false,
+    baseline: null,
+    results: null,
+    bench: null,
+    threshold: 0.1,
+    noise: 3,
+    minMs: 1,
+    repeat: 5,
+    quality: null,
+    formats: DEFAULT_FORMATS,
+  };
+
+  for (let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    const next = () => argv[++i];
+    switch (arg) {
+      case '--update':
+        options.update = true;
+        break;
+      case '--baseline':
+        options.baseline = path.resolve(next());
+        break;
+      case '--results':
+        options.results = path.resolve(next());
+        break;
+      case '--bench':
+        options.bench = path.resolve(next());
+        break;
+      case '--threshold':
+        options.threshold = Number(next());
+        break;
+      case '--noise':
+        options.noise = Number(next());
+        break;
+      case '--min-ms':
+        options.minMs = Number(next());
+        break;
+      case '--repeat':
+        options.repeat = Math.max(1, parseInt(next(), 10));
+        break;
+      case '--quality':
+        options.quality = next();
+        break;
+      case '--formats':
+        options.formats = next().split(',').filter(Boolean);
+        break;
+      default:
+        throw new Error(`未知参数: ${arg}`);
+    }
+  }
+  return options;
+}
+
+// 主程序
+if (require.main === module) {
+  try {
+    const options = parseArgs(process.argv.slice(2));
+    const gate = new PerfRegressionGate(options);
+    const baselinePath = options.baseline || gate.defaultBaselinePath();
+    const results = options.results
+      ? JSON.parse(fs.readFileSync(options.results, 'utf8'))
+      : gate.runBench();
+
+    if (options.update) {
+      gate.writeBaseline(results, baselinePath);
+    } else {
+      process.exit(gate.compare(results, baselinePath) ? 0 : 1);
+    }
+  } catch (error) {
+    console.error(`[性能回归] ❌ ${error.message}`);
+    process.exit(2);
+  }
+}
+
+module.exports = { PerfRegressionGate, median, mad };
@@ -1,8 +1,14 @@
 #include <napi.h>
+#include "addon_data.h"
 #include "libraw_wrapper.h"
+#include "bayer_stream.h"
 
 Napi::Object InitAll(Napi::Env env, Napi::Object exports) {
-    return LibRawWrapper::Init(env, exports);
+    // 每个环境拥有自己的实例数据，环境退出时由默认终结器 delete
+    env.SetInstanceData<AddonData>(new AddonData());
+
+    LibRawWrapper::Init(env, exports);
+    return BayerStream::Init(env, exports);
 }
 
 NODE_API_MODULE(libraw_addon, InitAll)
@@ -0,0 +1,17 @@
+#ifndef ADDON_DATA_H
+#define ADDON_DATA_H
+
+#include <napi.h>
+
+// 每个 Node 环境（主线程或 worker_threads）独立持有的插件状态。
+// 通过 Napi::Env::SetInstanceData 挂载，环境销毁时由 N-API 自动释放，
+// 因此插件可以安全地在多个 worker 中同时加载。
+struct AddonData
+{
+    // LibRawWrapper 类构造函数
+    Napi::FunctionReference libRawWrapperConstructor;
+    // BayerStream 类构造函数
+    Napi::FunctionReference bayerStreamConstructor;
+};
+
+#endif // ADDON_DATA_H
@@ -0,0 +1,407 @@
+#include "band_writer.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef USE_LIBJPEG
+#include <csetjmp>
+#include <jpeglib.h>
+#endif
+
+namespace
+{
+    // LibRaw 的 flip 编码（4 交换行列，2 上下翻转，1 左右翻转）对应的 TIFF/EXIF Orientation，与 dcraw 的 tiff_head 相同
+    int orientationTag(int flip)
+    {
+        return "12435867"[flip & 7] - '0';
+    }
+
+    // 像素数据紧跟在 8 字节文件头之后，写完以后在末尾追加 IFD 并回填文件头中的偏移。
+    // 全部使用本机字节序，16 位样本不需要转换
+    class TiffBandWriter : public BandWriter
+    {
+    public:
+        explicit TiffBandWriter(const std::string &filename) : path(filename), file(nullptr), width(0), height(0),
+                                                               sampleBits(8), orientation(1), rowsWritten(0), written(0) {}
+        ~TiffBandWriter() override
+        {
+            if (file)
+            {
+                fclose(file);
+                remove(path.c_str());
+            }
+        }
+
+        int bits(int requested) const override { return requested == 16 ? 16 : 8; }
+
+        bool begin(int w, int h, int b, int flip, std::string &error) override
+        {
+            width = w;
+            height = h;
+            sampleBits = b;
+            orientation = orientationTag(flip);
+            if ((uint64_t)width * height * 3 * (sampleBits / 8) > 0xffff0000ull)
+            {
+                error = "Image is too large for a baseline TIFF";
+                return false;
+            }
+            file = fopen(path.c_str(), "wb");
+            if (!file)
+            {
+                error = "Cannot create output file";
+                return false;
+            }
+            const uint16_t probe = 1;
+            const bool little = *reinterpret_cast<const uint8_t *>(&probe) == 1;
+            unsigned char header[8] = {0};
+            header[0] = header[1] = little ? 'I' : 'M';
+            const uint16_t magic = 42;
+            memcpy(header + 2, &magic, 2);
+            return put(header, sizeof(header), error);
+        }
+
+        bool writeRows(const void *rows, int count, std::string &error) override
+        {
+            if (rowsWritten + count > height)
+            {
+                error = "Too many rows written";
+                return false;
+            }
+            rowsWritten += count;
+            return put(rows, (size_t)count * width * 3 * (sampleBits / 8), error);
+        }
+
+        bool finish(std::string &error) override
+        {
+            if (rowsWritten != height)
+            {
+                error = "Not all rows were written";
+                return false;
+            }
+            const uint32_t dataBytes = (uint32_t)((size_t)width * height * 3 * (sampleBits / 8));
+            if (written & 1)
+            {
+                const unsigned char pad = 0;
+                if (!put(&pad, 1, error))
+                    return false;
+            }
+
+            // IFD 之后依次是 BitsPerSample 的三个值和两个分辨率
+            const uint32_t ifdOffset = (uint32_t)written;
+            const uint16_t entryCount = 13;
+            const uint32_t extraOffset = ifdOffset + 2 + entryCount * 12 + 4;
+            std::vector<unsigned char> ifd;
+            append(ifd, entryCount);
+            entry(ifd, 256, 4, 1, (uint32_t)width);
+            entry(ifd, 257, 4, 1, (uint32_t)height);
+            entry(ifd, 258, 3, 3, extraOffset);
+            entry(ifd, 259, 3, 1, 1);
+            entry(ifd, 262, 3, 1, 2);
+            entry(ifd, 273, 4, 1, 8);
+            entry(ifd, 274, 3, 1, (uint32_t)orientation);
+            entry(ifd, 277, 3, 1, 3);
+            entry(ifd, 278, 4, 1, (uint32_t)height);
+            entry(ifd, 279, 4, 1, dataBytes);
+            entry(ifd, 282, 5, 1, extraOffset + 8);
+            entry(ifd, 283, 5, 1, extraOffset + 16);
+            entry(ifd, 296, 3, 1, 2);
+            append(ifd, (uint32_t)0);
+            for (int i = 0; i < 3; i++)
+                append(ifd, (uint16_t)sampleBits);
+            append(ifd, (uint16_t)0);
+            for (int i = 0; i < 2; i++)
+            {
+                append(ifd, (uint32_t)300);
+                append(ifd, (uint32_t)1);
+            }
+            if (!put(ifd.data(), ifd.size(), error))
+                return false;
+
+            if (fseek(file, 4, SEEK_SET) != 0 || fwrite(&ifdOffset, 4, 1, file) != 1 || fclose(file) != 0)
+            {
+                file = nullptr;
+                remove(path.c_str());
+                error = "Failed to write output file";
+                return false;
+            }
+            file = nullptr;
+            return true;
+        }
+
+        size_t bytesWritten() const override { return written; }
+
+    private:
+        template <typename T>
+        static void append(std::vector<unsigned char> &out, T value)
+        {
+            const unsigned char *p = reinterpret_cast<const unsigned char *>(&value);
+            out.insert(out.end(), p, p + sizeof(T));
+        }
+
+        // SHORT 类型的单个值放在值字段的前两个字节，本机字节序下按 16 位写入即可
+        static void entry(std::vector<unsigned char> &out, uint16_t tag, uint16_t type, uint32_t count, uint32_t value)
+        {
+            append(out, tag);
+            append(out, type);
+            append(out, count);
+            if (type == 3 && count == 1)
+            {
+                append(out, (uint16_t)value);
+                append(out, (uint16_t)0);
+            }
+            else
+                append(out, value);
+        }
+
+        bool put(const void *data, size_t size, std::string &error)
+        {
+            if (fwrite(data, 1, size, file) != size)
+            {
+                error = "Failed to write output file";
+                return false;
+            }
+            written += size;
+            return true;
+        }
+
+        std::string path;
+        FILE *file;
+        int width;
+        int height;
+        int sampleBits;
+        int orientation;
+        int rowsWritten;
+        size_t written;
+    };
+
+#ifdef USE_LIBJPEG
+    // libjpeg 默认的 error_exit 会结束进程，这里改为 longjmp 回调用处
+    struct JpegErrorManager
+    {
+        jpeg_error_mgr pub;
+        jmp_buf jump;
+        char message[JMSG_LENGTH_MAX];
+    };
+
+    void jpegErrorExit(j_common_ptr cinfo)
+    {
+        JpegErrorManager *err = reinterpret_cast<JpegErrorManager *>(cinfo->err);
+        (*cinfo->err->format_message)(cinfo, err->message);
+        longjmp(err->jump, 1);
+    }
+
+    void jpegOutputMessage(j_common_ptr) {}
+
+    // 把压缩数据追加到 vector 的目标管理器，缓冲区满一次追加一次
+    struct JpegVectorDestination
+    {
+        jpeg_destination_mgr pub;
+        std::vector<unsigned char> *out;
+        JOCTET buffer[16384];
+    };
+
+    void jpegVectorInit(j_compress_ptr cinfo)
+    {
+        JpegVectorDestination *dest = reinterpret_cast<JpegVectorDestination *>(cinfo->dest);
+        dest->pub.next_output_byte = dest->buffer;
+        dest->pub.free_in_buffer = sizeof(dest->buffer);
+    }
+
+    boolean jpegVectorEmpty(j_compress_ptr cinfo)
+    {
+        JpegVectorDestination *dest = reinterpret_cast<JpegVectorDestination *>(cinfo->dest);
+        dest->out->insert(dest->out->end(), dest->buffer, dest->buffer + sizeof(dest->buffer));
+        jpegVectorInit(cinfo);
+        return TRUE;
+    }
+
+    void jpegVectorTerm(j_compress_ptr cinfo)
+    {
+        JpegVectorDestination *dest = reinterpret_cast<JpegVectorDestination *>(cinfo->dest);
+        dest->out->insert(dest->out->end(), dest->buffer,
+                          dest->buffer + sizeof(dest->buffer) - dest->pub.free_in_buffer);
+    }
+
+    // 每个 libjpeg 调用都可能 longjmp，setjmp 必须在同一个函数中，所以每个方法各自设置
+    class JpegBandWriter : public BandWriter
+    {
+    public:
+        JpegBandWriter(const std::string &filename, int q) : path(filename), file(nullptr), quality(q), width(0), finalBytes(0)
+        {
+            cinfo.err = jpeg_std_error(&err.pub);
+            err.pub.error_exit = jpegErrorExit;
+            err.pub.output_message = jpegOutputMessage;
+            err.message[0] = 0;
+            jpeg_create_compress(&cinfo);
+        }
+        ~JpegBandWriter() override
+        {
+            jpeg_destroy_compress(&cinfo);
+            if (file)
+            {
+                fclose(file);
+                remove(path.c_str());
+            }
+        }
+
+        int bits(int) const override { return 8; }
+
+        bool begin(int w, int h, int, int flip, std::string &error) override
+        {
+            file = fopen(path.c_str(), "wb");
+            if (!file)
+            {
+                error = "Cannot create output file";
+                return false;
+            }
+            if (setjmp(err.jump))
+                return fail(error);
+
+            width = w;
+            jpeg_stdio_dest(&cinfo, file);
+            cinfo.image_width = w;
+            cinfo.image_height = h;
+            cinfo.input_components = 3;
+            cinfo.in_color_space = JCS_RGB;
+            jpeg_set_defaults(&cinfo);
+            jpeg_set_quality(&cinfo, quality, TRUE);
+            jpeg_start_compress(&cinfo, TRUE);
+
+            // 只含 Orientation 的 EXIF：小端 TIFF 头和一个 IFD 项
+            const int orientation = orientationTag(flip);
+            if (orientation != 1)
+            {
+                static const unsigned char exifTemplate[] = {'E', 'x', 'i', 'f', 0, 0, 'I', 'I', 42, 0, 8, 0, 0, 0,
+                                                             1, 0, 0x12, 0x01, 3, 0, 1, 0, 0, 0, 0, 0, 0, 0,
+                                                             0, 0, 0, 0};
+                unsigned char exif[sizeof(exifTemplate)];
+                memcpy(exif, exifTemplate, sizeof(exif));
+                exif[24] = (unsigned char)orientation;
+                jpeg_write_marker(&cinfo, JPEG_APP0 + 1, exif, sizeof(exif));
+            }
+            return true;
+        }
+
+        bool writeRows(const void *rows, int count, std::string &error) override
+        {
+            if (setjmp(err.jump))
+                return fail(error);
+            const unsigned char *data = static_cast<const unsigned char *>(rows);
+            for (int i = 0; i < count; i++)
+            {
+                JSAMPROW row[1] = {const_cast<unsigned char *>(data + (size_t)i * width * 3)};
+                jpeg_write_scanlines(&cinfo, row, 1);
+            }
+            return true;
+        }
+
+        bool finish(std::string &error) override
+        {
+            if (setjmp(err.jump))
+                return fail(error);
+            jpeg_finish_compress(&cinfo);
+            finalBytes = (size_t)ftell(file);
+            if (fclose(file) != 0)
+            {
+                file = nullptr;
+                remove(path.c_str());
+                error = "Failed to write output file";
+                return false;
+            }
+            file = nullptr;
+            return true;
+        }
+
+        size_t bytesWritten() const override
+        {
+            return file ? (size_t)ftell(file) : finalBytes;
+        }
+
+    private:
+        bool fail(std::string &error)
+        {
+            error = err.message;
+            jpeg_abort_compress(&cinfo);
+            return false;
+        }
+
+        std::string path;
+        FILE *file;
+        int quality;
+        int width;
+        size_t finalBytes;
+        jpeg_compress_struct cinfo;
+        JpegErrorManager err;
+    };
+#endif
+}
+
+std::unique_ptr<BandWriter> createTiffBandWriter(const std::string &filename)
+{
+    return std::unique_ptr<BandWriter>(new TiffBandWriter(filename));
+}
+
+std::unique_ptr<BandWriter> createJpegBandWriter(const std::string &filename, int quality)
+{
+#ifdef USE_LIBJPEG
+    return std::unique_ptr<BandWriter>(new JpegBandWriter(filename, quality));
+#else
+    (void)filename;
+    (void)quality;
+    return nullptr;
+#endif
+}
+
+bool encodeJpegImage(const unsigned char *pixels, int width, int height, int channels, size_t stride, int quality,
+                     std::vector<unsigned char> &out, std::string &error)
+{
+#ifdef USE_LIBJPEG
+    jpeg_compress_struct cinfo;
+    JpegErrorManager err;
+    JpegVectorDestination dest;
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = jpegErrorExit;
+    err.pub.output_message = jpegOutputMessage;
+    err.message[0] = 0;
+    jpeg_create_compress(&cinfo);
+    out.clear();
+    if (setjmp(err.jump))
+    {
+        error = err.message;
+        jpeg_destroy_compress(&cinfo);
+        return false;
+    }
+
+    dest.pub.init_destination = jpegVectorInit;
+    dest.pub.empty_output_buffer = jpegVectorEmpty;
+    dest.pub.term_destination = jpegVectorTerm;
+    dest.out = &out;
+    cinfo.dest = &dest.pub;
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = channels;
+    cinfo.in_color_space = channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        JSAMPROW row[1] = {const_cast<unsigned char *>(pixels + (size_t)cinfo.next_scanline * stride)};
+        jpeg_write_scanlines(&cinfo, row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    return true;
+#else
+    (void)pixels;
+    (void)width;
+    (void)height;
+    (void)channels;
+    (void)stride;
+    (void)quality;
+    (void)out;
+    error = "JPEG output is not available: addon was built without libjpeg";
+    return false;
+#endif
+}
@@ -0,0 +1,37 @@
+#ifndef BAND_WRITER_H
+#define BAND_WRITER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 按行段增量写出的编码器：begin 写文件头，writeRows 按从上到下的顺序追加若干行，
+// finish 补全文件。任何一步返回 false 之后不能再调用，error 为具体原因
+class BandWriter
+{
+public:
+    virtual ~BandWriter() {}
+
+    // 编码器实际使用的位深：TIFF 支持 8 和 16 位，JPEG 只支持 8 位
+    virtual int bits(int requested) const = 0;
+    // width x height 的 RGB 图像，flip 为 LibRaw 的 sizes.flip，像素不旋转，写入方向标签
+    virtual bool begin(int width, int height, int bits, int flip, std::string &error) = 0;
+    // rows 为 count 行紧密排列的 RGB 样本（16 位为本机字节序）
+    virtual bool writeRows(const void *rows, int count, std::string &error) = 0;
+    virtual bool finish(std::string &error) = 0;
+    // 已写入文件的字节数
+    virtual size_t bytesWritten() const = 0;
+};
+
+// 不压缩的基线 TIFF（单个条带，本机字节序），图像数据超过 4 GB 时 begin 失败
+std::unique_ptr<BandWriter> createTiffBandWriter(const std::string &filename);
+// 基线 JPEG，方向写入 EXIF；没有链接 libjpeg 时返回 nullptr
+std::unique_ptr<BandWriter> createJpegBandWriter(const std::string &filename, int quality);
+
+// 把 width x height 的 8 位图像（channels 为 3 时 RGB，1 时灰度，相邻两行相距 stride 字节）编码为内存中的基线 JPEG。
+// 可以在多个线程中同时调用；没有链接 libjpeg 时返回 false
+bool encodeJpegImage(const unsigned char *pixels, int width, int height, int channels, size_t stride, int quality,
+                     std::vector<unsigned char> &out, std::string &error);
+
+#endif // BAND_WRITER_H
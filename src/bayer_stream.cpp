@@ -0,0 +1,374 @@
+#include "bayer_stream.h"
+#include "addon_data.h"
+#include <chrono>
+#include <cstring>
+#include <string>
+
+namespace
+{
+    struct PatternName
+    {
+        const char *name;
+        unsigned char pattern;
+    };
+
+    const PatternName kPatterns[] = {
+        {"RGGB", LIBRAW_OPENBAYER_RGGB},
+        {"BGGR", LIBRAW_OPENBAYER_BGGR},
+        {"GRBG", LIBRAW_OPENBAYER_GRBG},
+        {"GBRG", LIBRAW_OPENBAYER_GBRG},
+    };
+
+    // 去马赛克方式：half 为半尺寸（不插值），其余对应 user_qual
+    struct DemosaicName
+    {
+        const char *name;
+        int quality;
+        int halfSize;
+    };
+
+    const DemosaicName kDemosaics[] = {
+        {"half", 0, 1},
+        {"linear", 0, 0},
+        {"vng", 1, 0},
+        {"ppg", 2, 0},
+        {"ahd", 3, 0},
+        {"dcb", 4, 0},
+    };
+
+    bool ReadUnsigned(Napi::Object obj, const char *key, unsigned &value)
+    {
+        if (!obj.Has(key) || obj.Get(key).IsUndefined())
+            return true;
+        Napi::Value v = obj.Get(key);
+        if (!v.IsNumber() || v.As<Napi::Number>().DoubleValue() < 0)
+            return false;
+        value = v.As<Napi::Number>().Uint32Value();
+        return true;
+    }
+}
+
+Napi::Object BayerStream::Init(Napi::Env env, Napi::Object exports)
+{
+    Napi::Function func = DefineClass(env, "BayerStream", {InstanceMethod("processFrame", &BayerStream::ProcessFrame), InstanceMethod("getStats", &BayerStream::GetStats), InstanceMethod("close", &BayerStream::Close)});
+
+    AddonData *data = env.GetInstanceData<AddonData>();
+    data->bayerStreamConstructor = Napi::Persistent(func);
+
+    exports.Set("BayerStream", func);
+    return exports;
+}
+
+BayerStream::BayerStream(const Napi::CallbackInfo &info)
+    : Napi::ObjectWrap<BayerStream>(info), ringSize(3), outputStride(0), outputWidth(0), outputHeight(0), frames(0),
+      totalMs(0), lastMs(0), closed(false)
+{
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+
+    memset(&config, 0, sizeof(config));
+    processor = std::make_unique<LibRawProcessor>();
+
+    if (info.Length() < 1 || !info[0].IsObject())
+    {
+        Napi::TypeError::New(env, "Expected stream options object").ThrowAsJavaScriptException();
+        return;
+    }
+    ParseOptions(env, info[0].As<Napi::Object>());
+}
+
+BayerStream::~BayerStream()
+{
+    if (processor)
+        processor->recycle();
+}
+
+bool BayerStream::ParseOptions(Napi::Env env, Napi::Object options)
+{
+    libraw_output_params_t &params = processor->imgdata.params;
+
+    if (!ReadUnsigned(options, "width", config.width) || !ReadUnsigned(options, "height", config.height) ||
+        config.width == 0 || config.height == 0 || config.width > 65535 || config.height > 65535)
+    {
+        Napi::TypeError::New(env, "width and height must be integers between 1 and 65535").ThrowAsJavaScriptException();
+        return false;
+    }
+
+    // 边距：{ left, top, right, bottom }，边距内的像素作为遮挡像素统计黑电平
+    if (options.Has("margins") && options.Get("margins").IsObject())
+    {
+        Napi::Object margins = options.Get("margins").As<Napi::Object>();
+        const char *keys[4] = {"left", "top", "right", "bottom"};
+        for (int i = 0; i < 4; i++)
+        {
+            if (!ReadUnsigned(margins, keys[i], config.margins[i]))
+            {
+                Napi::TypeError::New(env, "margins must be non-negative integers").ThrowAsJavaScriptException();
+                return false;
+            }
+        }
+    }
+    if (config.margins[0] + config.margins[2] >= config.width || config.margins[1] + config.margins[3] >= config.height)
+    {
+        Napi::RangeError::New(env, "margins leave no visible area").ThrowAsJavaScriptException();
+        return false;
+    }
+
+    config.pattern = LIBRAW_OPENBAYER_RGGB;
+    if (options.Has("pattern") && options.Get("pattern").IsString())
+    {
+        std::string name = options.Get("pattern").As<Napi::String>().Utf8Value();
+        bool found = false;
+        for (const PatternName &p : kPatterns)
+        {
+            if (name == p.name)
+            {
+                config.pattern = p.pattern;
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            Napi::TypeError::New(env, "pattern must be one of RGGB, BGGR, GRBG, GBRG").ThrowAsJavaScriptException();
+            return false;
+        }
+    }
+
+    if (!ReadUnsigned(options, "flags", config.flags) || !ReadUnsigned(options, "unusedBits", config.unusedBits) ||
+        !ReadUnsigned(options, "blackLevel", config.black) || !ReadUnsigned(options, "whiteLevel", config.white))
+    {
+        Napi::TypeError::New(env, "flags, unusedBits, blackLevel and whiteLevel must be non-negative integers")
+            .ThrowAsJavaScriptException();
+        return false;
+    }
+
+    // 颜色矩阵：3x3，按行展开的 9 个数或嵌套数组
+    if (options.Has("colorMatrix") && options.Get("colorMatrix").IsArray())
+    {
+        Napi::Array matrix = options.Get("colorMatrix").As<Napi::Array>();
+        float values[9];
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < matrix.Length() && count <= 9; i++)
+        {
+            Napi::Value row = matrix.Get(i);
+            if (row.IsArray())
+            {
+                Napi::Array r = row.As<Napi::Array>();
+                for (uint32_t j = 0; j < r.Length() && count <= 9; j++)
+                {
+                    Napi::Value v = r.Get(j);
+                    if (!v.IsNumber() || count == 9)
+                    {
+                        count = 10;
+                        break;
+                    }
+                    values[count++] = v.As<Napi::Number>().FloatValue();
+                }
+            }
+            else if (row.IsNumber() && count < 9)
+            {
+                values[count++] = row.As<Napi::Number>().FloatValue();
+            }
+            else
+            {
+                count = 10;
+            }
+        }
+        if (count != 9)
+        {
+            Napi::TypeError::New(env, "colorMatrix must contain 3x3 numbers").ThrowAsJavaScriptException();
+            return false;
+        }
+        for (int i = 0; i < 9; i++)
+            config.matrix[i / 3][i % 3] = values[i];
+        config.hasMatrix = true;
+    }
+
+    // 白平衡乘数：[R, G, B, G2]，写入 user_mul
+    if (options.Has("whiteBalance") && options.Get("whiteBalance").IsArray())
+    {
+        Napi::Array mul = options.Get("whiteBalance").As<Napi::Array>();
+        for (uint32_t i = 0; i < 4 && i < mul.Length(); i++)
+        {
+            Napi::Value v = mul.Get(i);
+            if (!v.IsNumber())
+            {
+                Napi::TypeError::New(env, "whiteBalance must contain numbers").ThrowAsJavaScriptException();
+                return false;
+            }
+            params.user_mul[i] = v.As<Napi::Number>().FloatValue();
+        }
+    }
+
+    params.user_qual = 0;
+    params.half_size = 0;
+    if (options.Has("demosaic") && options.Get("demosaic").IsString())
+    {
+        std::string name = options.Get("demosaic").As<Napi::String>().Utf8Value();
+        bool found = false;
+        for (const DemosaicName &d : kDemosaics)
+        {
+            if (name == d.name)
+            {
+                params.user_qual = d.quality;
+                params.half_size = d.halfSize;
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            Napi::TypeError::New(env, "demosaic must be one of half, linear, vng, ppg, ahd, dcb")
+                .ThrowAsJavaScriptException();
+            return false;
+        }
+    }
+
+    params.output_bps = 8;
+    if (options.Has("outputBps") && options.Get("outputBps").IsNumber())
+    {
+        params.output_bps = options.Get("outputBps").As<Napi::Number>().Int32Value();
+        if (params.output_bps != 8 && params.output_bps != 16)
+        {
+            Napi::TypeError::New(env, "outputBps must be 8 or 16").ThrowAsJavaScriptException();
+            return false;
+        }
+    }
+
+    if (options.Has("gamma") && options.Get("gamma").IsArray())
+    {
+        Napi::Array gamma = options.Get("gamma").As<Napi::Array>();
+        if (gamma.Length() >= 2)
+        {
+            params.gamm[0] = gamma.Get(0u).As<Napi::Number>().DoubleValue();
+            params.gamm[1] = gamma.Get(1u).As<Napi::Number>().DoubleValue();
+        }
+    }
+    if (options.Has("bright") && options.Get("bright").IsNumber())
+        params.bright = options.Get("bright").As<Napi::Number>().FloatValue();
+    if (params.bright <= 0)
+    {
+        Napi::RangeError::New(env, "bright must be positive").ThrowAsJavaScriptException();
+        return false;
+    }
+
+    if (options.Has("ringSize") && options.Get("ringSize").IsNumber())
+    {
+        int size = options.Get("ringSize").As<Napi::Number>().Int32Value();
+        if (size < 1 || size > 64)
+        {
+            Napi::RangeError::New(env, "ringSize must be between 1 and 64").ThrowAsJavaScriptException();
+            return false;
+        }
+        ringSize = size;
+    }
+
+    // 固定的输出曲线代替逐帧自动亮度，方向由调用方处理
+    params.no_auto_bright = 1;
+    params.user_flip = 0;
+    return true;
+}
+
+Napi::Value BayerStream::ProcessFrame(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+
+    if (closed)
+    {
+        Napi::Error::New(env, "Stream is closed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (info.Length() < 1 || !info[0].IsBuffer())
+    {
+        Napi::TypeError::New(env, "Expected Buffer").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    Napi::Buffer<uint8_t> frame = info[0].As<Napi::Buffer<uint8_t>>();
+    JobScope job(processor->priority());
+    auto start = std::chrono::steady_clock::now();
+
+    // 第一帧完整执行 open_bayer + unpack，之后只重新解码到已有的 raw 缓冲区
+    bool first = processor->bayerFrameLength() == 0;
+    int ret = first ? processor->openBayerStream(config, frame.Data(), frame.Length())
+                    : processor->loadBayerFrame(frame.Data(), frame.Length());
+    if (ret != LIBRAW_SUCCESS)
+    {
+        Metrics::instance().recordError(ret);
+        std::string error = first ? "Failed to open Bayer frame: " : "Failed to load Bayer frame: ";
+        error += libraw_strerror(ret);
+        if (ret == LIBRAW_DATA_ERROR && !first)
+            error += " (frame length must be " + std::to_string(processor->bayerFrameLength()) + " bytes)";
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    ret = processor->processBayerFrame();
+    if (ret != LIBRAW_SUCCESS)
+    {
+        Metrics::instance().recordError(ret);
+        std::string error = "Failed to process Bayer frame: ";
+        error += libraw_strerror(ret);
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    // 输出格式在整个流中不变，第一帧之后分配全部输出缓冲区
+    if (ring.empty())
+    {
+        int width = 0, height = 0, colors = 0, bps = 0;
+        processor->get_mem_image_format(&width, &height, &colors, &bps);
+        outputWidth = width;
+        outputHeight = height;
+        outputStride = (size_t)width * 3 * (bps / 8);
+        for (size_t i = 0; i < ringSize; i++)
+            ring.push_back(Napi::Persistent(Napi::Buffer<uint8_t>::New(env, outputStride * height)));
+    }
+
+    size_t slot = frames % ringSize;
+    Napi::Buffer<uint8_t> output = ring[slot].Value();
+    processor->writeBayerFrame(output.Data(), outputStride);
+
+    lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    totalMs += lastMs;
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("data", output);
+    result.Set("width", Napi::Number::New(env, outputWidth));
+    result.Set("height", Napi::Number::New(env, outputHeight));
+    result.Set("colors", Napi::Number::New(env, 3));
+    result.Set("bits", Napi::Number::New(env, processor->imgdata.params.output_bps));
+    result.Set("sequence", Napi::Number::New(env, (double)frames));
+    result.Set("slot", Napi::Number::New(env, (double)slot));
+    result.Set("blackLevel", Napi::Number::New(env, processor->imgdata.color.black));
+    result.Set("processingMs", Napi::Number::New(env, lastMs));
+    frames++;
+    return result;
+}
+
+Napi::Value BayerStream::GetStats(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    Napi::Object stats = Napi::Object::New(env);
+    stats.Set("frames", Napi::Number::New(env, (double)frames));
+    stats.Set("frameLength", Napi::Number::New(env, (double)processor->bayerFrameLength()));
+    stats.Set("width", Napi::Number::New(env, outputWidth));
+    stats.Set("height", Napi::Number::New(env, outputHeight));
+    stats.Set("ringSize", Napi::Number::New(env, (double)ringSize));
+    stats.Set("ringBytes", Napi::Number::New(env, (double)(ring.size() * outputStride * outputHeight)));
+    stats.Set("lastMs", Napi::Number::New(env, lastMs));
+    stats.Set("averageMs", Napi::Number::New(env, frames ? totalMs / frames : 0));
+    stats.Set("closed", Napi::Boolean::New(env, closed));
+    return stats;
+}
+
+Napi::Value BayerStream::Close(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (!closed)
+    {
+        processor->recycle();
+        ring.clear();
+        closed = true;
+    }
+    return Napi::Boolean::New(env, true);
+}
@@ -0,0 +1,44 @@
+#ifndef BAYER_STREAM_H
+#define BAYER_STREAM_H
+
+#include <napi.h>
+#include <memory>
+#include <vector>
+#include "libraw_processor.h"
+
+// 连续处理格式固定的无文件头 Bayer 帧（视频、机器视觉相机）。
+// 尺寸、CFA、黑白电平和颜色矩阵只在构造时设置一次，之后每帧复用
+// LibRaw 的 raw/image 缓冲区、输出曲线和预先分配的输出缓冲区环
+class BayerStream : public Napi::ObjectWrap<BayerStream>
+{
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    BayerStream(const Napi::CallbackInfo &info);
+    ~BayerStream();
+
+private:
+    Napi::Value ProcessFrame(const Napi::CallbackInfo &info);
+    Napi::Value GetStats(const Napi::CallbackInfo &info);
+    Napi::Value Close(const Napi::CallbackInfo &info);
+
+    // 解析构造参数，失败时已抛出异常
+    bool ParseOptions(Napi::Env env, Napi::Object options);
+
+    std::unique_ptr<LibRawProcessor> processor;
+    BayerStreamConfig config;
+
+    // 输出缓冲区环：第一帧处理后按输出格式分配，依次轮换
+    std::vector<Napi::Reference<Napi::Buffer<uint8_t>>> ring;
+    size_t ringSize;
+    size_t outputStride;
+    int outputWidth;
+    int outputHeight;
+
+    // 统计
+    uint64_t frames;
+    double totalMs;
+    double lastMs;
+    bool closed;
+};
+
+#endif // BAYER_STREAM_H
@@ -0,0 +1,205 @@
+#include "calibration.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <unordered_map>
+
+bool BadPixelGeometry::operator==(const BadPixelGeometry &other) const
+{
+    return width == other.width && height == other.height && timestamp == other.timestamp &&
+           hasFilters == other.hasFilters && memcmp(colors, other.colors, sizeof(colors)) == 0;
+}
+
+size_t CalibrationData::bytes() const
+{
+    return dark.size() * sizeof(unsigned short) + badPixels.size() * sizeof(BadPixel);
+}
+
+std::shared_ptr<const BadPixelPlan> CalibrationData::badPixelPlan(const BadPixelGeometry &geometry) const
+{
+    std::lock_guard<std::mutex> lock(planMutex);
+    if (cachedPlan && planGeometry == geometry)
+        return cachedPlan;
+
+    std::shared_ptr<BadPixelPlan> plan = std::make_shared<BadPixelPlan>();
+    const int width = geometry.width;
+    const int height = geometry.height;
+
+    // 与 LibRaw 的 bad_pixels 相同：非 Bayer 数据不处理；先找半径 1 内的同色像素，没有再找半径 2
+    if (geometry.hasFilters)
+    {
+        auto color = [&](int row, int col) { return geometry.colors[row % 48][col % 48]; };
+        std::unordered_map<long long, int> latest; // 像素位置 -> 最近一次修复
+        for (const BadPixel &bad : badPixels)
+        {
+            if ((unsigned)bad.col >= (unsigned)width || (unsigned)bad.row >= (unsigned)height)
+                continue;
+            if (bad.time > geometry.timestamp)
+                continue;
+
+            BadPixelPlan::Fix fix = {bad.row, bad.col, (int)plan->neighbours.size(), 0};
+            for (int rad = 1; rad < 3 && fix.count == 0; rad++)
+                for (int r = bad.row - rad; r <= bad.row + rad; r++)
+                    for (int c = bad.col - rad; c <= bad.col + rad; c++)
+                        if ((unsigned)r < (unsigned)height && (unsigned)c < (unsigned)width &&
+                            (r != bad.row || c != bad.col) && color(r, c) == color(bad.row, bad.col))
+                        {
+                            auto it = latest.find((long long)r * width + c);
+                            plan->neighbours.push_back({r, c, it == latest.end() ? -1 : it->second});
+                            fix.count++;
+                        }
+            if (fix.count == 0)
+                continue;
+            latest[(long long)bad.row * width + bad.col] = (int)plan->fixes.size();
+            plan->fixes.push_back(fix);
+        }
+    }
+
+    // 写回顺序：按位置排序，同一像素取最后一次修复
+    std::map<long long, int> positions;
+    for (size_t i = 0; i < plan->fixes.size(); i++)
+        positions[(long long)plan->fixes[i].row * width + plan->fixes[i].col] = (int)i;
+    plan->order.reserve(positions.size());
+    plan->rowStart.assign(height + 1, 0);
+    for (const auto &it : positions)
+    {
+        plan->order.push_back(it.second);
+        plan->rowStart[plan->fixes[it.second].row + 1]++;
+    }
+    for (int row = 0; row < height; row++)
+        plan->rowStart[row + 1] += plan->rowStart[row];
+
+    planGeometry = geometry;
+    cachedPlan = plan;
+    return cachedPlan;
+}
+
+const char *parseDarkFrame(const unsigned char *data, size_t size, CalibrationData &out)
+{
+    // 文件头："P5" 后跟宽、高、最大值三个十进制数，# 开始的注释到行尾
+    if (size < 2 || data[0] != 'P' || data[1] != '5')
+        return "Dark frame is not a binary PGM (P5) file";
+
+    int dim[3] = {0, 0, 0};
+    int nd = 0;
+    bool comment = false, number = false;
+    size_t pos = 2;
+    while (nd < 3 && pos < size)
+    {
+        int c = data[pos++];
+        if (c == '#')
+            comment = true;
+        if (c == '\n')
+            comment = false;
+        if (comment)
+            continue;
+        if (isdigit(c))
+        {
+            number = true;
+            if (dim[nd] > 100000)
+                return "Invalid PGM header";
+            dim[nd] = dim[nd] * 10 + c - '0';
+        }
+        else if (number)
+        {
+            if (!isspace(c))
+                return "Invalid PGM header";
+            number = false;
+            nd++;
+        }
+    }
+    if (nd < 3 || dim[0] <= 0 || dim[1] <= 0)
+        return "Invalid PGM header";
+    if (dim[2] != 65535)
+        return "Dark frame must be a 16-bit PGM (maxval 65535)";
+
+    size_t count = (size_t)dim[0] * dim[1];
+    if (size - pos < count * 2)
+        return "Dark frame is truncated";
+
+    out.darkWidth = dim[0];
+    out.darkHeight = dim[1];
+    out.dark.resize(count);
+    const unsigned char *src = data + pos;
+    for (size_t i = 0; i < count; i++)
+        out.dark[i] = (unsigned short)(src[2 * i] << 8 | src[2 * i + 1]);
+    return nullptr;
+}
+
+void parseBadPixels(const char *text, size_t size, CalibrationData &out)
+{
+    size_t pos = 0;
+    while (pos < size)
+    {
+        size_t end = pos;
+        while (end < size && text[end] != '\n')
+            end++;
+        std::string line(text + pos, end - pos);
+        pos = end + 1;
+
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.resize(hash);
+        int col, row;
+        long long time;
+        if (sscanf(line.c_str(), "%d %d %lld", &col, &row, &time) != 3)
+            continue;
+        out.badPixels.push_back({col, row, time});
+    }
+}
+
+bool readCalibrationFile(const std::string &path, std::vector<unsigned char> &out)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    file.seekg(0, std::ios::end);
+    std::streamoff length = file.tellg();
+    if (length < 0)
+        return false;
+    file.seekg(0, std::ios::beg);
+    out.resize((size_t)length);
+    return length == 0 || (bool)file.read(reinterpret_cast<char *>(out.data()), length);
+}
+
+// ============== 注册表 ==============
+
+namespace
+{
+    std::mutex registryMutex;
+    std::map<std::string, std::shared_ptr<const CalibrationData>> registry;
+}
+
+std::shared_ptr<const CalibrationData> acquireCalibration(const std::string &key, const CalibrationLoader &load,
+                                                          std::string &error)
+{
+    // 加载期间持有锁：同一 key 的并发请求等待并共享第一次的结果。
+    // 校准数据只在启动时加载少数几次，不值得按 key 细分锁
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry.find(key);
+    if (it != registry.end())
+        return it->second;
+
+    std::shared_ptr<CalibrationData> data = load(error);
+    if (!data)
+        return nullptr;
+    data->key = key;
+    registry[key] = data;
+    return data;
+}
+
+bool releaseCalibration(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return registry.erase(key) > 0;
+}
+
+size_t calibrationCount()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return registry.size();
+}
@@ -0,0 +1,105 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 坏点表中的一项，与 dcraw 的 .badpixels 文件相同：列、行和坏点出现的时间（Unix 时间）。
+// 拍摄时间早于 time 的图像不修复该点
+struct BadPixel
+{
+    int col;
+    int row;
+    long long time;
+};
+
+// 决定坏点插值邻居的图像几何：可见区域尺寸、拍摄时间和 CFA 颜色。
+// 颜色表取 48x48（Bayer、Leaf 16x16 和 X-Trans 6x6 周期的公倍数）
+struct BadPixelGeometry
+{
+    int width;
+    int height;
+    long long timestamp;
+    bool hasFilters;
+    unsigned char colors[48][48];
+
+    bool operator==(const BadPixelGeometry &other) const;
+};
+
+// 按几何预先计算的坏点插值计划。与 LibRaw 的 bad_pixels 一样按表中顺序修复，
+// 后面的坏点可以引用前面已修复的值，因此结果逐位一致
+struct BadPixelPlan
+{
+    struct Fix
+    {
+        int row;
+        int col;
+        int first; // 邻居在 neighbours 中的起始位置
+        int count;
+    };
+    struct Neighbour
+    {
+        int row;
+        int col;
+        int ref; // >= 0 时使用第 ref 项修复后的值，否则使用 raw 值
+    };
+
+    std::vector<Fix> fixes;
+    std::vector<Neighbour> neighbours;
+    // 按行、列排序的写回顺序（fixes 下标），同一像素只保留最后一次修复
+    std::vector<int> order;
+    // order 中每行的起始位置，共 height + 1 项
+    std::vector<int> rowStart;
+};
+
+// 加载一次、只读共享的校准数据：暗场、坏点表和绿平衡开关。
+// 同一进程中的所有 LibRaw 实例（包括各 worker_threads 环境）通过 shared_ptr 共享
+class CalibrationData
+{
+public:
+    CalibrationData() : darkWidth(0), darkHeight(0), greenMatching(false) {}
+
+    std::string key;
+
+    // 暗场：可见区域尺寸的 16 位值，按行存放
+    std::vector<unsigned short> dark;
+    int darkWidth;
+    int darkHeight;
+
+    std::vector<BadPixel> badPixels;
+    bool greenMatching;
+
+    size_t bytes() const;
+
+    // 返回该几何的插值计划，最近一次的计划被缓存
+    std::shared_ptr<const BadPixelPlan> badPixelPlan(const BadPixelGeometry &geometry) const;
+
+private:
+    mutable std::mutex planMutex;
+    mutable BadPixelGeometry planGeometry;
+    mutable std::shared_ptr<const BadPixelPlan> cachedPlan;
+};
+
+// 解析 16 位二进制 PGM（P5，最大值 65535，大端），与 LibRaw 的 subtract() 接受的格式相同。
+// 成功返回 nullptr，失败返回错误信息
+const char *parseDarkFrame(const unsigned char *data, size_t size, CalibrationData &out);
+
+// 解析 dcraw 格式的坏点表："列 行 时间"，# 之后为注释
+void parseBadPixels(const char *text, size_t size, CalibrationData &out);
+
+// 读取整个文件，失败返回 false
+bool readCalibrationFile(const std::string &path, std::vector<unsigned char> &out);
+
+// 进程级校准注册表。同一 key 只加载一次：并发请求等待第一次加载完成后共享结果
+using CalibrationLoader = std::function<std::shared_ptr<CalibrationData>(std::string &error)>;
+std::shared_ptr<const CalibrationData> acquireCalibration(const std::string &key, const CalibrationLoader &load,
+                                                          std::string &error);
+// 从注册表移除，已经使用它的实例不受影响
+bool releaseCalibration(const std::string &key);
+size_t calibrationCount();
+
+#endif // CALIBRATION_H
@@ -0,0 +1,74 @@
+#include "deadline_watchdog.h"
+
+DeadlineWatchdog &DeadlineWatchdog::instance()
+{
+    static DeadlineWatchdog watchdog;
+    return watchdog;
+}
+
+DeadlineWatchdog::DeadlineWatchdog() : nextId(1), stopping(false)
+{
+    worker = std::thread(&DeadlineWatchdog::run, this);
+}
+
+DeadlineWatchdog::~DeadlineWatchdog()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+        worker.join();
+}
+
+uint64_t DeadlineWatchdog::arm(LibRaw *processor, Clock::time_point deadline, std::atomic<bool> *expired)
+{
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = nextId++;
+        entries[id] = Entry{processor, deadline, expired};
+    }
+    // 新的截止时间可能早于当前等待的时间
+    wake.notify_all();
+    return id;
+}
+
+void DeadlineWatchdog::disarm(uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.erase(id);
+}
+
+void DeadlineWatchdog::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping)
+    {
+        Clock::time_point now = Clock::now();
+        Clock::time_point next = Clock::time_point::max();
+
+        for (auto it = entries.begin(); it != entries.end();)
+        {
+            if (it->second.deadline <= now)
+            {
+                // 在锁内设置标志，保证 disarm() 返回后不会再触碰该实例
+                it->second.expired->store(true);
+                it->second.processor->setCancelFlag();
+                it = entries.erase(it);
+            }
+            else
+            {
+                if (it->second.deadline < next)
+                    next = it->second.deadline;
+                ++it;
+            }
+        }
+
+        if (next == Clock::time_point::max())
+            wake.wait(lock);
+        else
+            wake.wait_until(lock, next);
+    }
+}
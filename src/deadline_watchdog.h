@@ -0,0 +1,52 @@
+#ifndef DEADLINE_WATCHDOG_H
+#define DEADLINE_WATCHDOG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "libraw/libraw.h"
+
+// 进程级截止时间监视线程：到期时对 LibRaw 实例调用 setCancelFlag()，
+// 由解码、去马赛克和写出循环中的 checkCancel() 中止处理。
+// 所有 Node 环境（包括 worker_threads）共享同一个线程
+class DeadlineWatchdog
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static DeadlineWatchdog &instance();
+
+    // 注册截止时间，到期时设置 processor 的取消标志并把 expired 置为 true，返回注册 id
+    uint64_t arm(LibRaw *processor, Clock::time_point deadline, std::atomic<bool> *expired);
+
+    // 取消注册；返回后监视线程不会再访问该 processor
+    void disarm(uint64_t id);
+
+private:
+    DeadlineWatchdog();
+    ~DeadlineWatchdog();
+    DeadlineWatchdog(const DeadlineWatchdog &) = delete;
+    DeadlineWatchdog &operator=(const DeadlineWatchdog &) = delete;
+
+    void run();
+
+    struct Entry
+    {
+        LibRaw *processor;
+        Clock::time_point deadline;
+        std::atomic<bool> *expired;
+    };
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::map<uint64_t, Entry> entries;
+    uint64_t nextId;
+    bool stopping;
+    std::thread worker;
+};
+
+#endif // DEADLINE_WATCHDOG_H
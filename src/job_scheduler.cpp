@@ -0,0 +1,101 @@
+#include "job_scheduler.h"
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+// 单个检查点最长让出时间，超过后即使仍有高优先级任务也继续执行
+static const std::chrono::milliseconds MAX_PAUSE(2000);
+// 等待期间轮询截止时间的间隔
+static const std::chrono::milliseconds ABORT_POLL(10);
+
+static const char *const LANE_NAMES[JOB_LANE_COUNT] = {"interactive", "normal", "background"};
+
+JobScheduler &JobScheduler::instance()
+{
+    static JobScheduler scheduler;
+    return scheduler;
+}
+
+JobScheduler::JobScheduler()
+{
+    memset(lanes, 0, sizeof(lanes));
+}
+
+void JobScheduler::begin(JobLane lane)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    lanes[lane].active++;
+    lanes[lane].calls++;
+}
+
+void JobScheduler::end(JobLane lane)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        lanes[lane].active--;
+    }
+    idle.notify_all();
+}
+
+bool JobScheduler::higherPriorityActive(JobLane lane) const
+{
+    // 已在检查点让出的任务不占用 CPU，不计入
+    for (int i = 0; i < lane; i++)
+        if (lanes[i].active > lanes[i].paused)
+            return true;
+    return false;
+}
+
+void JobScheduler::yieldPoint(JobLane lane, const std::atomic<bool> *abort)
+{
+    if (lane == JOB_LANE_INTERACTIVE)
+        return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!higherPriorityActive(lane))
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    auto limit = start + MAX_PAUSE;
+    lanes[lane].preemptions++;
+    lanes[lane].paused++;
+
+    while (higherPriorityActive(lane) && !(abort && abort->load()))
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= limit)
+            break;
+        idle.wait_until(lock, std::min(limit, now + ABORT_POLL));
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    lanes[lane].paused--;
+    lanes[lane].pausedMs += seconds * 1000;
+    lock.unlock();
+    Metrics::instance().recordQueueWait(METRIC_QUEUE_SCHEDULER, lane, seconds);
+}
+
+JobLaneStats JobScheduler::stats(JobLane lane)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return lanes[lane];
+}
+
+const char *JobScheduler::laneName(JobLane lane)
+{
+    return LANE_NAMES[lane];
+}
+
+bool JobScheduler::parseLane(const char *name, JobLane *lane)
+{
+    for (int i = 0; i < JOB_LANE_COUNT; i++)
+    {
+        if (strcmp(name, LANE_NAMES[i]) == 0)
+        {
+            *lane = static_cast<JobLane>(i);
+            return true;
+        }
+    }
+    return false;
+}
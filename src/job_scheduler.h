@@ -0,0 +1,75 @@
+#ifndef JOB_SCHEDULER_H
+#define JOB_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// 任务优先级通道，数值越小优先级越高
+enum JobLane
+{
+    JOB_LANE_INTERACTIVE = 0, // 交互式预览，从不让出
+    JOB_LANE_NORMAL = 1,      // 默认通道，让出给交互式任务
+    JOB_LANE_BACKGROUND = 2,  // 批量任务，让出给所有更高优先级的任务
+    JOB_LANE_COUNT = 3
+};
+
+// 单个通道的累计统计
+struct JobLaneStats
+{
+    unsigned active;      // 正在执行原生调用的任务数
+    unsigned paused;      // 当前在检查点让出的任务数
+    uint64_t calls;       // 累计原生调用数
+    uint64_t preemptions; // 累计让出次数
+    double pausedMs;      // 累计让出时长
+};
+
+// 进程级优先级调度：所有 Node 环境（包括 worker_threads）共享。
+// 抢占只发生在 LibRaw 的 LIBRAW_PROGRESS_* 阶段边界：低优先级任务的进度回调
+// 在有更高优先级任务运行时阻塞，把 CPU 让给交互式请求
+class JobScheduler
+{
+public:
+    static JobScheduler &instance();
+
+    void begin(JobLane lane);
+    void end(JobLane lane);
+
+    // 阶段边界检查点：存在更高优先级的活动任务时等待，直到它们结束、
+    // abort 被置位或达到单次让出上限（防止低优先级任务被永久饿死）
+    void yieldPoint(JobLane lane, const std::atomic<bool> *abort);
+
+    JobLaneStats stats(JobLane lane);
+
+    static const char *laneName(JobLane lane);
+    // 无法识别时返回 false
+    static bool parseLane(const char *name, JobLane *lane);
+
+private:
+    JobScheduler();
+    JobScheduler(const JobScheduler &) = delete;
+    JobScheduler &operator=(const JobScheduler &) = delete;
+
+    bool higherPriorityActive(JobLane lane) const;
+
+    std::mutex mutex;
+    std::condition_variable idle;
+    JobLaneStats lanes[JOB_LANE_COUNT];
+};
+
+// 在一次原生调用期间把任务计入所在通道的活动数
+class JobScope
+{
+public:
+    explicit JobScope(JobLane lane) : lane(lane) { JobScheduler::instance().begin(lane); }
+    ~JobScope() { JobScheduler::instance().end(lane); }
+
+private:
+    JobScope(const JobScope &) = delete;
+    JobScope &operator=(const JobScope &) = delete;
+
+    JobLane lane;
+};
+
+#endif // JOB_SCHEDULER_H
@@ -0,0 +1,245 @@
+#include "jpeg_preview.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#ifdef USE_LIBJPEG
+#include <csetjmp>
+#include <jpeglib.h>
+#endif
+
+bool jpegPreviewAvailable()
+{
+#ifdef USE_LIBJPEG
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef USE_LIBJPEG
+namespace
+{
+    // libjpeg 默认的 error_exit 会结束进程，这里改为 longjmp 回调用处
+    struct JpegErrorManager
+    {
+        jpeg_error_mgr pub;
+        jmp_buf jump;
+        char message[JMSG_LENGTH_MAX];
+    };
+
+    void jpegErrorExit(j_common_ptr cinfo)
+    {
+        JpegErrorManager *err = reinterpret_cast<JpegErrorManager *>(cinfo->err);
+        (*cinfo->err->format_message)(cinfo, err->message);
+        longjmp(err->jump, 1);
+    }
+
+    void jpegOutputMessage(j_common_ptr) {}
+}
+#endif
+
+const char *decodeJpegPreview(const unsigned char *jpeg, size_t size, int maxDim, PreviewImage &out, std::string &error)
+{
+#ifdef USE_LIBJPEG
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager err;
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = jpegErrorExit;
+    err.pub.output_message = jpegOutputMessage;
+    err.message[0] = 0;
+
+    // setjmp 之后修改、longjmp 之后还要读取的局部变量必须是 volatile，这里只有 cinfo
+    if (setjmp(err.jump))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        error = err.message;
+        return error.c_str();
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, const_cast<unsigned char *>(jpeg), (unsigned long)size);
+    jpeg_read_header(&cinfo, TRUE);
+
+    // 在 IDCT 阶段直接缩小：取不小于 maxDim 的最小 1/d（d = 8、4、2），
+    // 只解码需要的频率分量，比完整解码后再缩小快得多
+    const unsigned longSide = std::max(cinfo.image_width, cinfo.image_height);
+    int denom = 1;
+    if (maxDim > 0)
+        for (int d = 8; d > 1; d /= 2)
+            if ((longSide + d - 1) / d >= (unsigned)maxDim)
+            {
+                denom = d;
+                break;
+            }
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = denom;
+    // 预览之后还会缩小，快速 IDCT 的误差看不出来
+    cinfo.dct_method = JDCT_IFAST;
+
+    const bool gray = cinfo.jpeg_color_space == JCS_GRAYSCALE;
+    if (!gray && cinfo.num_components != 3)
+    {
+        jpeg_destroy_decompress(&cinfo);
+        error = "Unsupported JPEG preview color space";
+        return error.c_str();
+    }
+    cinfo.out_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
+
+    jpeg_start_decompress(&cinfo);
+    const int width = cinfo.output_width;
+    const int height = cinfo.output_height;
+    out.width = width;
+    out.height = height;
+    out.sourceWidth = cinfo.image_width;
+    out.sourceHeight = cinfo.image_height;
+    out.scaleDenom = denom;
+    out.flip = 0;
+    out.data.resize((size_t)width * height * 3);
+
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        unsigned char *row = out.data.data() + (size_t)cinfo.output_scanline * width * 3;
+        JSAMPROW rows[1] = {row};
+        jpeg_read_scanlines(&cinfo, rows, 1);
+        // 灰度行就地展开为 RGB：从行尾向前写，不会覆盖尚未读取的样本
+        if (gray)
+            for (int x = width - 1; x >= 0; x--)
+                row[x * 3] = row[x * 3 + 1] = row[x * 3 + 2] = row[x];
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return nullptr;
+#else
+    (void)jpeg;
+    (void)size;
+    (void)maxDim;
+    (void)out;
+    error = "JPEG preview decoding is not available in this build (compiled without libjpeg)";
+    return error.c_str();
+#endif
+}
+
+namespace
+{
+    // 面积平均的一维采样表：每个输出位置覆盖的源区间及各源像素的覆盖比例
+    struct Taps
+    {
+        std::vector<int> start;
+        std::vector<int> count;
+        std::vector<float> weight; // 每个输出位置 count 项，总和为 1
+        std::vector<int> offset;
+    };
+
+    Taps areaTaps(int src, int dst)
+    {
+        Taps taps;
+        const double scale = (double)src / dst;
+        for (int i = 0; i < dst; i++)
+        {
+            const double begin = i * scale;
+            const double end = (i + 1) * scale;
+            const int first = (int)begin;
+            const int last = std::min(src, (int)std::ceil(end));
+            taps.start.push_back(first);
+            taps.count.push_back(last - first);
+            taps.offset.push_back((int)taps.weight.size());
+            for (int s = first; s < last; s++)
+            {
+                const double overlap = std::min(end, (double)s + 1) - std::max(begin, (double)s);
+                taps.weight.push_back((float)(overlap / scale));
+            }
+        }
+        return taps;
+    }
+}
+
+void shrinkPreview(PreviewImage &image, int maxDim)
+{
+    const int longSide = std::max(image.width, image.height);
+    if (maxDim <= 0 || longSide <= maxDim)
+        return;
+
+    const double scale = (double)maxDim / longSide;
+    const int width = std::max(1, (int)std::lround(image.width * scale));
+    const int height = std::max(1, (int)std::lround(image.height * scale));
+    const Taps horizontal = areaTaps(image.width, width);
+    const Taps vertical = areaTaps(image.height, height);
+
+    // 先逐行水平缩小，再按列累加；DCT 缩放之后源图最多是目标的两倍，中间结果很小
+    std::vector<float> rows((size_t)image.height * width * 3);
+    for (int y = 0; y < image.height; y++)
+    {
+        const unsigned char *src = image.data.data() + (size_t)y * image.width * 3;
+        float *dst = rows.data() + (size_t)y * width * 3;
+        for (int x = 0; x < width; x++)
+        {
+            float r = 0, g = 0, b = 0;
+            const float *w = horizontal.weight.data() + horizontal.offset[x];
+            const unsigned char *p = src + (size_t)horizontal.start[x] * 3;
+            for (int k = 0; k < horizontal.count[x]; k++, p += 3)
+            {
+                r += p[0] * w[k];
+                g += p[1] * w[k];
+                b += p[2] * w[k];
+            }
+            dst[x * 3] = r;
+            dst[x * 3 + 1] = g;
+            dst[x * 3 + 2] = b;
+        }
+    }
+
+    std::vector<unsigned char> data((size_t)width * height * 3);
+    std::vector<float> acc((size_t)width * 3);
+    for (int y = 0; y < height; y++)
+    {
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        const float *w = vertical.weight.data() + vertical.offset[y];
+        for (int k = 0; k < vertical.count[y]; k++)
+        {
+            const float *src = rows.data() + (size_t)(vertical.start[y] + k) * width * 3;
+            for (size_t i = 0; i < acc.size(); i++)
+                acc[i] += src[i] * w[k];
+        }
+        unsigned char *dst = data.data() + (size_t)y * width * 3;
+        for (size_t i = 0; i < acc.size(); i++)
+            dst[i] = (unsigned char)std::min(255.0f, acc[i] + 0.5f);
+    }
+
+    image.width = width;
+    image.height = height;
+    image.data.swap(data);
+}
+
+void orientPreview(PreviewImage &image, int flip)
+{
+    flip &= 7;
+    if (flip == 0)
+        return;
+
+    // 与 LibRaw 的 flip_index 相同：对每个输出位置求源位置
+    const int srcWidth = image.width;
+    const int srcHeight = image.height;
+    const int width = (flip & 4) ? srcHeight : srcWidth;
+    const int height = (flip & 4) ? srcWidth : srcHeight;
+    std::vector<unsigned char> data((size_t)width * height * 3);
+    for (int row = 0; row < height; row++)
+        for (int col = 0; col < width; col++)
+        {
+            int r = row, c = col;
+            if (flip & 4)
+                std::swap(r, c);
+            if (flip & 2)
+                r = srcHeight - 1 - r;
+            if (flip & 1)
+                c = srcWidth - 1 - c;
+            memcpy(&data[((size_t)row * width + col) * 3], &image.data[((size_t)r * srcWidth + c) * 3], 3);
+        }
+
+    image.width = width;
+    image.height = height;
+    image.flip = flip;
+    image.data.swap(data);
+}
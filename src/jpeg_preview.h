@@ -0,0 +1,33 @@
+#ifndef JPEG_PREVIEW_H
+#define JPEG_PREVIEW_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// 缩小后的 8 位 RGB 预览图
+struct PreviewImage
+{
+    int width;
+    int height;
+    int sourceWidth;  // 嵌入预览的原始尺寸
+    int sourceHeight;
+    int scaleDenom;   // JPEG 解码时使用的 DCT 缩放（1、2、4、8 分之一），位图预览为 1
+    int flip;         // 已应用的方向（LibRaw 的 sizes.flip 编码）
+    std::vector<unsigned char> data;
+};
+
+// 编译时是否链接了 libjpeg（USE_LIBJPEG）
+bool jpegPreviewAvailable();
+
+// 解码 JPEG，利用 DCT 缩放直接得到不小于 maxDim 的最小尺寸（maxDim <= 0 时按原尺寸解码），
+// 输出 8 位 RGB。成功返回 nullptr，失败返回错误信息
+const char *decodeJpegPreview(const unsigned char *jpeg, size_t size, int maxDim, PreviewImage &out, std::string &error);
+
+// 按面积平均缩小到长边不超过 maxDim，不放大
+void shrinkPreview(PreviewImage &image, int maxDim);
+
+// 按 LibRaw 的 flip 编码旋转/镜像（4 交换行列，2 上下翻转，1 左右翻转）
+void orientPreview(PreviewImage &image, int flip);
+
+#endif // JPEG_PREVIEW_H
@@ -0,0 +1,3000 @@
+#include "libraw_processor.h"
+#include "deadline_watchdog.h"
+#include "raw_disk_cache.h"
+#include "simd_kernels.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <sys/stat.h>
+#include <thread>
+#include <zlib.h>
+
+LibRawProcessor::LibRawProcessor()
+    : LibRaw(), cacheEnabled(false), approximateWB(true), cacheValid(false), lastReuse(RENDER_REUSE_NONE),
+      cachedWidth(0), cachedHeight(0), cachedIWidth(0), cachedIHeight(0), cachedColors(0), cachedRawColor(0),
+      deadlineId(0), deadlineAt(), deadlineExpired(false), priorityLane(JOB_LANE_NORMAL), streamFrameLength(0),
+      calibrationThreads(1), subsample(1), subsampleInDecoder(false), subsampleDecoder(0), bandActive(false),
+      bandRowDecode(false), bandRawBase(nullptr), bandDataMaximum(0), bandAutoWB(false), replacedDecoder(nullptr),
+      fpDngDeflate(false), rawCacheWaited(false), countOpens(true)
+{
+    memset(&cachedParams, 0, sizeof(cachedParams));
+    memset(&pendingParams, 0, sizeof(pendingParams));
+    memset(cachedPreMul, 0, sizeof(cachedPreMul));
+    memset(&subsampleFullSizes, 0, sizeof(subsampleFullSizes));
+    memset(&bandFullSizes, 0, sizeof(bandFullSizes));
+    memset(meteredBuffers, 0, sizeof(meteredBuffers));
+
+    // 预编译的 LibRaw 在各处理阶段之间调用进度回调，借此在阶段边界检查截止时间并按优先级让出
+    callbacks.progress_cb = &LibRawProcessor::progressCallback;
+    callbacks.progresscb_data = this;
+}
+
+LibRawProcessor::~LibRawProcessor()
+{
+    // 必须在实例销毁前从监视线程注销
+    clearDeadline();
+    // ~LibRaw 中的释放不经过本类，在这里从内存计数中扣除
+    for (MeteredBuffer &buffer : meteredBuffers)
+        if (buffer.bytes)
+            Metrics::recordAllocation(-(long long)buffer.bytes);
+}
+
+void LibRawProcessor::recycle()
+{
+    LibRaw::recycle();
+    syncMemoryMetrics();
+}
+
+void LibRawProcessor::syncMemoryMetrics()
+{
+    const libraw_rawdata_t &raw = imgdata.rawdata;
+    const MeteredBuffer current[3] = {
+        {raw.raw_alloc, raw.raw_alloc ? (size_t)raw.sizes.raw_pitch * raw.sizes.raw_height : 0},
+        {imgdata.image, imgdata.image ? (size_t)imgdata.sizes.iwidth * imgdata.sizes.iheight * sizeof(*imgdata.image) : 0},
+        {imgdata.thumbnail.thumb, imgdata.thumbnail.thumb ? (size_t)imgdata.thumbnail.tlength : 0}};
+    for (int i = 0; i < 3; i++)
+    {
+        MeteredBuffer &metered = meteredBuffers[i];
+        if (metered.ptr == current[i].ptr && metered.bytes == current[i].bytes)
+            continue;
+        // 指针或尺寸变化视为释放旧缓冲区后重新分配
+        if (metered.bytes)
+            Metrics::recordAllocation(-(long long)metered.bytes);
+        if (current[i].bytes)
+            Metrics::recordAllocation((long long)current[i].bytes);
+        metered = current[i];
+    }
+}
+
+// ============== 重渲染缓存 ==============
+
+void LibRawProcessor::setRenderCacheEnabled(bool enabled, bool approximateWhiteBalance)
+{
+    cacheEnabled = enabled;
+    approximateWB = approximateWhiteBalance;
+    // convert_to_rgb 之前的回调负责保存去马赛克结果
+    callbacks.pre_converttorgb_cb = enabled ? &LibRawProcessor::preConvertToRgbCallback : nullptr;
+    if (!enabled)
+    {
+        invalidateRenderCache();
+    }
+}
+
+void LibRawProcessor::invalidateRenderCache()
+{
+    cacheValid = false;
+    lastReuse = RENDER_REUSE_NONE;
+    std::vector<ushort>().swap(cachedImage);
+}
+
+void LibRawProcessor::preConvertToRgbCallback(void *ctx)
+{
+    static_cast<LibRawProcessor *>(ctx)->saveRenderCache();
+}
+
+void LibRawProcessor::saveRenderCache()
+{
+    size_t pixels = (size_t)imgdata.sizes.height * imgdata.sizes.width;
+    try
+    {
+        cachedImage.assign(imgdata.image[0], imgdata.image[0] + pixels * 4);
+    }
+    catch (const std::bad_alloc &)
+    {
+        // 缓存失败不影响本次处理，只是下次无法复用
+        invalidateRenderCache();
+        return;
+    }
+
+    cachedParams = pendingParams;
+    cachedWidth = imgdata.sizes.width;
+    cachedHeight = imgdata.sizes.height;
+    cachedIWidth = imgdata.sizes.iwidth;
+    cachedIHeight = imgdata.sizes.iheight;
+    cachedColors = imgdata.idata.colors;
+    cachedRawColor = libraw_internal_data.internal_output_params.raw_color;
+    memcpy(cachedPreMul, imgdata.color.pre_mul, sizeof(cachedPreMul));
+    cacheValid = true;
+}
+
+bool LibRawProcessor::restoreRenderCache()
+{
+    size_t pixels = (size_t)cachedHeight * cachedWidth;
+    // stretch() 可能改变了图像尺寸，按缓存尺寸重新分配
+    ushort(*img)[4] = (ushort(*)[4])realloc(imgdata.image, pixels * sizeof(*imgdata.image));
+    if (!img)
+        return false;
+
+    imgdata.image = img;
+    memcpy(imgdata.image[0], cachedImage.data(), pixels * sizeof(*imgdata.image));
+    imgdata.sizes.width = cachedWidth;
+    imgdata.sizes.height = cachedHeight;
+    imgdata.sizes.iwidth = cachedIWidth;
+    imgdata.sizes.iheight = cachedIHeight;
+    imgdata.idata.colors = cachedColors;
+    libraw_internal_data.internal_output_params.raw_color = cachedRawColor;
+    memcpy(imgdata.color.pre_mul, cachedPreMul, sizeof(cachedPreMul));
+    return true;
+}
+
+// 比较 convert_to_rgb 之前各阶段会用到的参数。
+// 只影响 convert_to_rgb 和内存图像阶段的参数（输出色彩空间、伽马、亮度、位深等）被排除在外
+bool LibRawProcessor::sameParamsExceptOutput(const libraw_output_params_t &a, const libraw_output_params_t &b, bool ignoreWhiteBalance) const
+{
+    libraw_output_params_t x = a;
+    libraw_output_params_t y = b;
+
+    libraw_output_params_t *both[2] = {&x, &y};
+    for (libraw_output_params_t *p : both)
+    {
+        p->gamm[0] = p->gamm[1] = p->gamm[2] = p->gamm[3] = p->gamm[4] = p->gamm[5] = 0;
+        p->bright = 0;
+        p->output_color = 0;
+        p->output_bps = 0;
+        p->output_tiff = 0;
+        p->no_auto_bright = 0;
+        p->auto_bright_thr = 0;
+        p->user_flip = 0;
+        if (ignoreWhiteBalance)
+        {
+            p->user_mul[0] = p->user_mul[1] = p->user_mul[2] = p->user_mul[3] = 0;
+            p->use_camera_wb = 0;
+            p->use_auto_wb = 0;
+        }
+    }
+
+    return memcmp(&x, &y, sizeof(libraw_output_params_t)) == 0;
+}
+
+// 仅当新白平衡是显式乘数、且高光模式为裁剪时，按通道比例修正才与重新处理等价（在去马赛克的线性近似下）。
+// 旧的白平衡无论来源如何，都已归一化保存在 cachedPreMul 中
+bool LibRawProcessor::canCorrectWhiteBalance() const
+{
+    const libraw_output_params_t &p = imgdata.params;
+    if (!approximateWB || p.highlight != 0 || p.use_auto_wb || p.use_camera_wb)
+        return false;
+    return p.user_mul[0] > 0 && p.user_mul[1] >= 0 && p.user_mul[2] > 0;
+}
+
+void LibRawProcessor::applyWhiteBalanceCorrection()
+{
+    // 按 scale_colors 的方式归一化新的乘数
+    float mul[4];
+    memcpy(mul, imgdata.params.user_mul, sizeof(mul));
+    if (mul[1] == 0)
+        mul[1] = 1;
+    if (mul[3] == 0)
+        mul[3] = cachedColors < 4 ? mul[1] : 1;
+
+    float dmin = *std::min_element(mul, mul + 4);
+    float ratio[4];
+    for (int c = 0; c < 4; c++)
+    {
+        float normalized = mul[c] / dmin;
+        ratio[c] = cachedPreMul[c] > 0.00001f ? normalized / cachedPreMul[c] : 1.0f;
+        imgdata.color.pre_mul[c] = normalized;
+    }
+
+    size_t pixels = (size_t)imgdata.sizes.height * imgdata.sizes.width;
+    ushort(*img)[4] = imgdata.image;
+    for (size_t i = 0; i < pixels; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            // 已饱和的像素在裁剪模式下保持饱和
+            if (img[i][c] == 65535)
+                continue;
+            float v = img[i][c] * ratio[c] + 0.5f;
+            img[i][c] = v >= 65535.0f ? 65535 : (ushort)v;
+        }
+    }
+}
+
+int LibRawProcessor::runConvertStage()
+{
+    try
+    {
+        // convert_to_rgb 每次都会重新生成输出配置文件
+        if (libraw_internal_data.output_data.oprof)
+        {
+            free(libraw_internal_data.output_data.oprof);
+            libraw_internal_data.output_data.oprof = nullptr;
+        }
+        if (!libraw_internal_data.output_data.histogram)
+        {
+            libraw_internal_data.output_data.histogram =
+                (int(*)[LIBRAW_HISTOGRAM_SIZE])calloc(1, sizeof(*libraw_internal_data.output_data.histogram) * 4);
+        }
+
+        int save4color = imgdata.params.four_color_rgb;
+        convert_to_rgb();
+        if (imgdata.params.use_fuji_rotate)
+        {
+            stretch();
+        }
+        imgdata.params.four_color_rgb = save4color;
+        return LIBRAW_SUCCESS;
+    }
+    catch (const std::bad_alloc &)
+    {
+        return LIBRAW_UNSUFFICIENT_MEMORY;
+    }
+    catch (const LibRaw_exceptions &err)
+    {
+        if (err == LIBRAW_EXCEPTION_CANCELLED_BY_CALLBACK)
+            return LIBRAW_CANCELLED_BY_CALLBACK;
+        if (err == LIBRAW_EXCEPTION_ALLOC)
+            return LIBRAW_UNSUFFICIENT_MEMORY;
+        return LIBRAW_UNSPECIFIED_ERROR;
+    }
+}
+
+int LibRawProcessor::processImage()
+{
+    lastReuse = RENDER_REUSE_NONE;
+    StageTimer timer(METRIC_STAGE_PROCESS);
+
+    if (cacheEnabled && cacheValid && imgdata.image)
+    {
+        RenderReuse reuse = RENDER_REUSE_NONE;
+        if (sameParamsExceptOutput(cachedParams, imgdata.params, false))
+            reuse = RENDER_REUSE_OUTPUT;
+        else if (sameParamsExceptOutput(cachedParams, imgdata.params, true) && canCorrectWhiteBalance())
+            reuse = RENDER_REUSE_WHITE_BALANCE;
+
+        if (reuse != RENDER_REUSE_NONE && restoreRenderCache())
+        {
+            if (reuse == RENDER_REUSE_WHITE_BALANCE)
+                applyWhiteBalanceCorrection();
+
+            int ret = runConvertStage();
+            if (ret == LIBRAW_SUCCESS)
+            {
+                lastReuse = reuse;
+                timer.done((uint64_t)imgdata.sizes.iwidth * imgdata.sizes.iheight);
+            }
+            syncMemoryMetrics();
+            return ret;
+        }
+    }
+
+    // 完整处理；启用缓存时 preConvertToRgbCallback 会重新保存去马赛克结果。
+    // dcraw_process 过程中会临时修改部分参数，因此在开始前记录调用方设置的参数
+    cacheValid = false;
+    pendingParams = imgdata.params;
+    int ret = dcraw_process();
+    if (ret == LIBRAW_SUCCESS)
+        timer.done((uint64_t)imgdata.sizes.iwidth * imgdata.sizes.iheight);
+    syncMemoryMetrics();
+    return ret;
+}
+
+// ============== 内存估算 ==============
+
+// 与 LibRaw 内部实现保持一致的分配规则，按 identify 阶段得到的尺寸推算。
+// 插件未启用 OpenMP，每种去马赛克算法只有一个线程缓冲区
+MemoryEstimate LibRawProcessor::estimateMemory(const libraw_output_params_t &params)
+{
+    MemoryEstimate est;
+    memset(&est, 0, sizeof(est));
+
+    const libraw_image_sizes_t &S = imgdata.sizes;
+    const unsigned filters = imgdata.idata.filters;
+    const int colors = imgdata.idata.colors;
+
+    libraw_decoder_info_t decoder;
+    memset(&decoder, 0, sizeof(decoder));
+    get_decoder_info(&decoder);
+
+    // unpack：与 unpack() 相同的 raw_alloc 规则，高度额外多出 8 行
+    size_t rawPixels = (size_t)S.raw_width * (S.raw_height + 8);
+    size_t fullPixels = (size_t)std::max(S.width, S.raw_width) * (std::max(S.height, S.raw_height) + 8);
+    bool legacyImage = false;
+
+    if (decoder.decoder_flags & LIBRAW_DECODER_OWNALLOC)
+    {
+        // 浮点 DNG 等：解码器自行分配浮点缓冲区，随后转换为整数
+        int samples = filters ? 1 : std::max(colors, 1);
+        est.decoderBytes = (size_t)S.raw_width * S.raw_height * samples * sizeof(float);
+        est.rawBytes = (size_t)S.raw_width * S.raw_height * (samples == 1 ? 1 : 4) * sizeof(ushort);
+    }
+    else if (decoder.decoder_flags & LIBRAW_DECODER_3CHANNEL)
+    {
+        est.rawBytes = rawPixels * 3 * sizeof(ushort);
+    }
+    else if (filters || colors == 1)
+    {
+        est.rawBytes = rawPixels * sizeof(ushort);
+    }
+    else
+    {
+        // 旧式解码器直接解码到 4 通道图像
+        est.rawBytes = fullPixels * 4 * sizeof(ushort);
+        legacyImage = true;
+    }
+
+    // raw2image_ex：按 half_size 等参数缩小后的 4 通道图像
+    bool colorRaw = legacyImage || (decoder.decoder_flags & LIBRAW_DECODER_3CHANNEL) || (!filters && colors > 1);
+    int shrink = !colorRaw && filters &&
+                 (params.half_size || params.threshold || params.aber[0] != 1 || params.aber[2] != 1);
+    size_t iwidth = (S.width + shrink) >> shrink;
+    size_t iheight = (S.height + shrink) >> shrink;
+
+    if (libraw_internal_data.internal_output_params.fuji_width)
+    {
+        int layout = libraw_internal_data.unpacker_data.fuji_layout;
+        size_t allocWidth = (S.height >> layout) + (S.width >> (layout ? 0 : 1));
+        iwidth = (allocWidth + shrink) >> shrink;
+        iheight = (allocWidth - 1 + shrink) >> shrink;
+    }
+
+    size_t imagePixels = iwidth * iheight;
+    est.imageBytes = imagePixels * 4 * sizeof(ushort);
+    est.histogramBytes = sizeof(int) * 4 * LIBRAW_HISTOGRAM_SIZE;
+
+    // Phase One 压缩格式在 raw2image_ex 中复制一份 raw 数据扣除黑电平
+    size_t scratch = 0;
+    if (is_phaseone_compressed())
+        scratch = std::max(scratch, (size_t)S.raw_width * S.raw_height * sizeof(ushort));
+
+    // 去马赛克临时缓冲区；half_size 时不做插值
+    if (filters && !params.no_interpolation && !shrink)
+    {
+        int quality = params.user_qual >= 0 ? params.user_qual
+                                            : 2 + !libraw_internal_data.internal_output_params.fuji_width;
+        const size_t tile = 512; // LIBRAW_AHD_TILE
+        size_t demosaic = 0;
+
+        if (filters == 9)
+            demosaic = tile * tile * ((quality > 2 ? 8 : 4) * 11 + 6);
+        else if (quality == 0)
+            demosaic = 16 * 16 * 32 * sizeof(int);
+        else if (quality == 1 || colors > 3)
+            demosaic = iwidth * 3 * 4 * sizeof(ushort) + 16 * 16 * 1280;
+        else if (quality == 2)
+            demosaic = 0;
+        else if (quality == 4)
+            demosaic = imagePixels * 2 * 3 * sizeof(float);
+        else if (quality == 11)
+            demosaic = (iwidth + 8) * (iheight + 8) * (3 * sizeof(float) + 1);
+        else if (quality == 12)
+            demosaic = (iwidth + 8) * (iheight + 8) * (3 * sizeof(ushort) * 2 + 3 * sizeof(int) * 2 + 3);
+        else
+            demosaic = 26 * tile * tile;
+
+        // FBDD 降噪使用双精度 3 通道副本
+        if (params.fbdd_noiserd > 0 && colors == 3 && filters > 1000)
+            demosaic = std::max(demosaic, imagePixels * 3 * sizeof(double));
+
+        scratch = std::max(scratch, demosaic);
+    }
+
+    // 小波降噪
+    if (params.threshold > 0)
+        scratch = std::max(scratch, (imagePixels * 3 + iwidth + iheight + 128) * sizeof(float));
+
+    // 富士旋转和像素宽高比拉伸都会分配一张新图像
+    if (params.use_fuji_rotate && (libraw_internal_data.internal_output_params.fuji_width || S.pixel_aspect != 1.0))
+        scratch = std::max(scratch, (size_t)S.width * S.height * 4 * sizeof(ushort) * 2);
+
+    est.scratchBytes = scratch;
+    est.cacheBytes = cacheEnabled ? est.imageBytes : 0;
+
+    // dcraw_make_mem_image：convert_to_rgb 之后为 3 通道（单色为 1 通道）
+    size_t outWidth = shrink ? iwidth : S.width;
+    size_t outHeight = shrink ? iheight : S.height;
+    int outColors = colors == 1 ? 1 : 3;
+    int outBps = params.output_bps > 8 ? 2 : 1;
+    est.outputBytes = outWidth * outHeight * outColors * outBps + sizeof(libraw_processed_image_t);
+
+    // 各阶段峰值：unpack、处理（临时缓冲区与缓存不会同时存在）、输出（含复制到 JS Buffer 的副本）
+    size_t unpackPeak = est.rawBytes + est.decoderBytes;
+    size_t base = est.rawBytes + est.imageBytes + est.histogramBytes;
+    size_t processPeak = base + std::max(est.scratchBytes, est.cacheBytes);
+    size_t outputPeak = base + est.cacheBytes + est.outputBytes * 2;
+    est.peakBytes = std::max(unpackPeak, std::max(processPeak, outputPeak));
+    return est;
+}
+
+// ============== 截止时间 ==============
+
+void LibRawProcessor::setDeadline(unsigned ms)
+{
+    clearDeadline();
+    if (ms == 0)
+        return;
+
+    armDeadline(DeadlineWatchdog::Clock::now() + std::chrono::milliseconds(ms));
+}
+
+void LibRawProcessor::armDeadline(std::chrono::steady_clock::time_point at)
+{
+    deadlineAt = at;
+    deadlineId = DeadlineWatchdog::instance().arm(this, at, &deadlineExpired);
+}
+
+void LibRawProcessor::clearDeadline()
+{
+    if (deadlineId)
+    {
+        DeadlineWatchdog::instance().disarm(deadlineId);
+        deadlineId = 0;
+    }
+    // 到期后可能还有未被 checkCancel() 消费的取消标志
+    if (deadlineExpired.exchange(false))
+        clearCancelFlag();
+}
+
+int LibRawProcessor::progressCallback(void *ctx, enum LibRaw_progress, int, int)
+{
+    LibRawProcessor *self = static_cast<LibRawProcessor *>(ctx);
+    JobScheduler::instance().yieldPoint(self->priorityLane, &self->deadlineExpired);
+    return self->deadlineExpired.load() ? 1 : 0;
+}
+
+// ============== Raw 马赛克 ==============
+// 只读取 imgdata.rawdata 中 unpack 时保存的副本，processImage() 修改 imgdata 后结果不变
+
+int LibRawProcessor::rawColorAt(int row, int col) const
+{
+    const libraw_iparams_t &iparams = imgdata.rawdata.iparams;
+    if (iparams.filters == 9)
+        return iparams.xtrans[(row + 6) % 6][(col + 6) % 6];
+    if (iparams.filters < 1000)
+        return -1;
+    return iparams.filters >> (((row << 1 & 14) | (col & 1)) << 1) & 3;
+}
+
+void LibRawProcessor::rawBlackLevels(unsigned &black, unsigned channel[4], bool &pattern) const
+{
+    const libraw_colordata_t &color = imgdata.rawdata.color;
+    bool overridden = imgdata.params.user_black >= 0;
+    black = overridden ? imgdata.params.user_black : color.black;
+    for (int c = 0; c < 4; c++)
+    {
+        bool user = imgdata.params.user_cblack[c] > -1000000;
+        channel[c] = user ? imgdata.params.user_cblack[c] : color.cblack[c];
+        overridden = overridden || user;
+    }
+    pattern = !overridden && color.cblack[4] && color.cblack[5];
+}
+
+unsigned LibRawProcessor::rawBlackAt(int row, int col) const
+{
+    const libraw_colordata_t &color = imgdata.rawdata.color;
+    unsigned black, channel[4];
+    bool pattern;
+    rawBlackLevels(black, channel, pattern);
+
+    int c = rawColorAt(row, col);
+    unsigned value = black + channel[c < 0 ? 0 : c];
+    if (pattern)
+        value += color.cblack[6 + (row % color.cblack[4]) * color.cblack[5] + col % color.cblack[5]];
+    return value;
+}
+
+const char *LibRawProcessor::rawPlaneLayout(RawPlaneLayout &layout) const
+{
+    const libraw_iparams_t &iparams = imgdata.rawdata.iparams;
+    const libraw_image_sizes_t &sizes = imgdata.rawdata.sizes;
+
+    if (!imgdata.rawdata.raw_image)
+        return "Raw data is not a single-channel mosaic";
+    if (iparams.filters < 1000)
+        return "CFA is not a Bayer pattern";
+    if (libraw_internal_data.internal_output_params.fuji_width)
+        return "Rotated Fuji sensor layout is not supported";
+
+    // filters 编码 8 行 x 2 列，拆分要求以 2x2 为周期
+    for (int row = 2; row < 8; row++)
+        for (int col = 0; col < 2; col++)
+            if (rawColorAt(row, col) != rawColorAt(row & 1, col))
+                return "CFA pattern does not repeat every 2x2 pixels";
+
+    int red = -1, blue = -1, greens = 0;
+    int green[2] = {-1, -1};
+    for (int p = 0; p < 4; p++)
+    {
+        char name = iparams.cdesc[rawColorAt(p >> 1, p & 1)];
+        if (name == 'R' && red < 0)
+            red = p;
+        else if (name == 'B' && blue < 0)
+            blue = p;
+        else if (name == 'G' && greens < 2)
+            green[greens++] = p;
+        else
+            return "CFA is not an RGGB Bayer pattern";
+    }
+    if ((red >> 1) == (blue >> 1) || (red & 1) == (blue & 1))
+        return "CFA is not an RGGB Bayer pattern";
+    // G1 与 R 同行
+    if ((green[0] >> 1) != (red >> 1))
+        std::swap(green[0], green[1]);
+    layout.plane[red] = 0;
+    layout.plane[green[0]] = 1;
+    layout.plane[green[1]] = 2;
+    layout.plane[blue] = 3;
+
+    // 与 raw2image_ex 相同，可见区域不超出 raw 帧
+    int rows = std::min<int>(sizes.height, (int)sizes.raw_height - (int)sizes.top_margin);
+    int cols = std::min<int>(sizes.width, (int)sizes.raw_width - (int)sizes.left_margin);
+    layout.width = std::max(cols, 0) / 2;
+    layout.height = std::max(rows, 0) / 2;
+    if (!layout.width || !layout.height)
+        return "Visible area is empty";
+    return nullptr;
+}
+
+void LibRawProcessor::splitRawPlanes(const RawPlaneLayout &layout, ushort *out) const
+{
+    const libraw_image_sizes_t &sizes = imgdata.rawdata.sizes;
+    const libraw_colordata_t &color = imgdata.rawdata.color;
+    const size_t pitch = sizes.raw_pitch / sizeof(ushort);
+    const size_t planeSize = (size_t)layout.width * layout.height;
+
+    unsigned black, channel[4];
+    bool pattern;
+    rawBlackLevels(black, channel, pattern);
+
+    // 黑电平图案周期不超过 2x2 时每个位置的黑电平固定，整行使用向量内核
+    bool uniform = !pattern || (color.cblack[4] <= 2 && color.cblack[5] <= 2);
+    ushort blockBlack[4];
+    for (int p = 0; p < 4; p++)
+        blockBlack[p] = (ushort)std::min(rawBlackAt(p >> 1, p & 1), 65535u);
+
+    for (int y = 0; y < layout.height; y++)
+    {
+        for (int dr = 0; dr < 2; dr++)
+        {
+            int row = 2 * y + dr;
+            const ushort *src = imgdata.rawdata.raw_image + (size_t)(row + sizes.top_margin) * pitch + sizes.left_margin;
+            ushort *even = out + layout.plane[dr * 2] * planeSize + (size_t)y * layout.width;
+            ushort *odd = out + layout.plane[dr * 2 + 1] * planeSize + (size_t)y * layout.width;
+
+            if (uniform)
+            {
+                simdSplitBayerRow(src, layout.width, blockBlack[dr * 2], blockBlack[dr * 2 + 1], even, odd);
+                continue;
+            }
+            for (int x = 0; x < layout.width; x++)
+            {
+                unsigned be = rawBlackAt(row, 2 * x), bo = rawBlackAt(row, 2 * x + 1);
+                even[x] = src[2 * x] > be ? src[2 * x] - be : 0;
+                odd[x] = src[2 * x + 1] > bo ? src[2 * x + 1] - bo : 0;
+            }
+        }
+    }
+}
+
+// ============== 连续 Bayer 帧 ==============
+// open_bayer 每次都要 recycle、重新 identify 并重新分配 raw 缓冲区。
+// 这里只在第一帧完整执行，之后直接对新的帧数据调用 load_raw，其余状态
+// （尺寸、颜色矩阵、rawdata 中保存的副本）保持不变
+
+int LibRawProcessor::openBayerStream(const BayerStreamConfig &config, const unsigned char *frame, size_t length)
+{
+    recycle();
+    streamFrameLength = 0;
+    streamCurve.clear();
+
+    // 方向由调用方处理，procflags 不设置 flip
+    int ret = open_bayer(frame, (unsigned)length, config.width, config.height, config.margins[0], config.margins[1],
+                         config.margins[2], config.margins[3], 0, config.pattern, config.unusedBits, config.flags,
+                         config.black);
+    if (ret != LIBRAW_SUCCESS)
+        return ret;
+    if (!load_raw)
+        return LIBRAW_FILE_UNSUPPORTED;
+
+    // unpack 会把 imgdata.color 保存到 rawdata，raw2image_ex 每帧从中恢复
+    if (config.white)
+        imgdata.color.maximum = config.white;
+    if (config.hasMatrix)
+    {
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                imgdata.color.rgb_cam[i][j] = config.matrix[i][j];
+    }
+
+    if (!streamColor)
+        streamColor.reset(new libraw_colordata_t);
+    memcpy(streamColor.get(), &imgdata.color, sizeof(imgdata.color));
+
+    ret = unpack();
+    if (ret != LIBRAW_SUCCESS)
+        return ret;
+    streamFrameLength = length;
+    return LIBRAW_SUCCESS;
+}
+
+int LibRawProcessor::loadBayerFrame(const unsigned char *frame, size_t length)
+{
+    if (!streamFrameLength || !imgdata.rawdata.raw_image)
+        return LIBRAW_OUT_OF_ORDER_CALL;
+    if (length != streamFrameLength)
+        return LIBRAW_DATA_ERROR;
+
+    // 恢复 unpack 结束时的尺寸等数据（上一帧的处理会修改它们）。颜色数据恢复到 unpack 之前，
+    // 因为与 unpack 一样，边距中的遮挡像素每帧都要重新统计黑电平
+    raw2image_start();
+    memcpy(&imgdata.color, streamColor.get(), sizeof(imgdata.color));
+
+    // load_raw 从 ID.input 读取并写入 raw_image，临时换成新帧的数据流
+    LibRaw_buffer_datastream stream(frame, length);
+    LibRaw_abstract_datastream *previous = libraw_internal_data.internal_data.input;
+    libraw_internal_data.internal_data.input = &stream;
+
+    int ret = LIBRAW_SUCCESS;
+    try
+    {
+        stream.seek(libraw_internal_data.unpacker_data.data_offset, SEEK_SET);
+        (this->*load_raw)();
+        crop_masked_pixels();
+
+        // 与 unpack 结尾相同：公共部分移入 black，再保存供 raw2image_ex 恢复
+        unsigned common = std::min(std::min(imgdata.color.cblack[0], imgdata.color.cblack[1]),
+                                   std::min(imgdata.color.cblack[2], imgdata.color.cblack[3]));
+        for (int c = 0; c < 4; c++)
+            imgdata.color.cblack[c] -= common;
+        imgdata.color.black += common;
+        memmove(&imgdata.rawdata.color, &imgdata.color, sizeof(imgdata.color));
+    }
+    catch (const std::bad_alloc &)
+    {
+        ret = LIBRAW_UNSUFFICIENT_MEMORY;
+    }
+    catch (const LibRaw_exceptions &err)
+    {
+        if (err == LIBRAW_EXCEPTION_CANCELLED_BY_CALLBACK)
+            ret = LIBRAW_CANCELLED_BY_CALLBACK;
+        else if (err == LIBRAW_EXCEPTION_ALLOC)
+            ret = LIBRAW_UNSUFFICIENT_MEMORY;
+        else
+            ret = LIBRAW_DATA_ERROR;
+    }
+    libraw_internal_data.internal_data.input = previous;
+    return ret;
+}
+
+int LibRawProcessor::processBayerFrame()
+{
+    if (!streamFrameLength)
+        return LIBRAW_OUT_OF_ORDER_CALL;
+    StageTimer timer(METRIC_STAGE_PROCESS);
+    int ret = dcraw_process();
+    if (ret == LIBRAW_SUCCESS)
+        timer.done((uint64_t)imgdata.sizes.iwidth * imgdata.sizes.iheight);
+    syncMemoryMetrics();
+    return ret;
+}
+
+void LibRawProcessor::writeBayerFrame(void *out, size_t stride)
+{
+    // 与 no_auto_bright 时的 copy_mem_image 相同的曲线，帧间亮度不随直方图跳动
+    if (streamCurve.empty())
+    {
+        gamma_curve(imgdata.params.gamm[0], imgdata.params.gamm[1], 2, (0x2000 << 3) / imgdata.params.bright);
+        streamCurve.assign(imgdata.color.curve, imgdata.color.curve + 0x10000);
+    }
+
+    // 不旋转时 copy_mem_image 按 width 索引 image
+    const ushort *curve = streamCurve.data();
+    const int width = imgdata.sizes.width;
+    const int height = imgdata.sizes.height;
+    for (int row = 0; row < height; row++)
+    {
+        const ushort(*src)[4] = imgdata.image + (size_t)row * width;
+        if (imgdata.params.output_bps == 8)
+        {
+            uint8_t *dst = static_cast<uint8_t *>(out) + row * stride;
+            for (int col = 0; col < width; col++, dst += 3)
+            {
+                dst[0] = curve[src[col][0]] >> 8;
+                dst[1] = curve[src[col][1]] >> 8;
+                dst[2] = curve[src[col][2]] >> 8;
+            }
+        }
+        else
+        {
+            ushort *dst = reinterpret_cast<ushort *>(static_cast<uint8_t *>(out) + row * stride);
+            for (int col = 0; col < width; col++, dst += 3)
+            {
+                dst[0] = curve[src[col][0]];
+                dst[1] = curve[src[col][1]];
+                dst[2] = curve[src[col][2]];
+            }
+        }
+    }
+}
+
+// ============== 校准 ==============
+// LibRaw 的 bad_pixels() 和 subtract() 每次处理都重新读取并解析文件，green_matching() 复制整幅图像后串行执行。
+// 这里使用预先加载的数据，在 copy_bayer 中与 raw 复制合并为一遍，结果与 LibRaw 逐位一致
+
+// 把 [0, rows) 分成若干连续的行段并行执行 fn(begin, end, band)，每段至少 64 行
+template <typename Fn>
+static void forEachRowBand(int rows, int threads, Fn fn)
+{
+    int bands = std::max(1, std::min(threads, rows / 64));
+    if (bands == 1)
+    {
+        fn(0, rows, 0);
+        return;
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(bands - 1);
+    for (int band = 1; band < bands; band++)
+        workers.emplace_back(fn, (int)((long long)rows * band / bands), (int)((long long)rows * (band + 1) / bands), band);
+    fn(0, rows / bands, 0);
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void LibRawProcessor::setCalibration(std::shared_ptr<const CalibrationData> data, int threads)
+{
+    calibrationData = std::move(data);
+    calibrationThreads = std::max(1, threads);
+    callbacks.pre_scalecolors_cb =
+        calibrationData && calibrationData->greenMatching ? &LibRawProcessor::preScaleColorsCallback : nullptr;
+}
+
+void LibRawProcessor::copy_bayer(unsigned short cblack[4], unsigned short *dmaxp)
+{
+    const CalibrationData *cal = calibrationData.get();
+    // 与 dcraw_process 一致：设置了裁剪框时不应用暗场和坏点
+    if (!cal || (cal->dark.empty() && cal->badPixels.empty()) ||
+        (~imgdata.params.cropbox[2] && ~imgdata.params.cropbox[3]))
+    {
+        LibRaw::copy_bayer(cblack, dmaxp);
+        return;
+    }
+
+    libraw_image_sizes_t &S = imgdata.sizes;
+    const int width = S.width;
+    const int height = S.height;
+    const int maxHeight = std::min((int)S.height, (int)S.raw_height - (int)S.top_margin);
+    const int copyWidth = std::max(0, std::min((int)S.width, (int)S.raw_width - (int)S.left_margin));
+    const int shrink = libraw_internal_data.internal_output_params.shrink;
+    const size_t pitch = S.raw_pitch / 2;
+    const ushort *raw = imgdata.rawdata.raw_image;
+
+    bool useDark = !cal->dark.empty();
+    if (useDark && (cal->darkWidth != width || cal->darkHeight != height))
+    {
+        imgdata.process_warnings |= LIBRAW_WARN_BAD_DARKFRAME_DIM;
+        useDark = false;
+    }
+
+    // 坏点：与 bad_pixels() 一样在暗场相减之前、按表中顺序用同色邻居的原始值插值
+    std::shared_ptr<const BadPixelPlan> plan;
+    std::vector<ushort> fixed;
+    if (!cal->badPixels.empty())
+    {
+        BadPixelGeometry geometry;
+        geometry.width = width;
+        geometry.height = height;
+        geometry.timestamp = (long long)imgdata.other.timestamp;
+        geometry.hasFilters = imgdata.idata.filters != 0;
+        for (int r = 0; r < 48; r++)
+            for (int c = 0; c < 48; c++)
+                geometry.colors[r][c] = (unsigned char)fcol(r, c);
+        plan = cal->badPixelPlan(geometry);
+
+        fixed.resize(plan->fixes.size());
+        for (size_t k = 0; k < plan->fixes.size(); k++)
+        {
+            const BadPixelPlan::Fix &fix = plan->fixes[k];
+            int total = 0;
+            for (int n = 0; n < fix.count; n++)
+            {
+                const BadPixelPlan::Neighbour &nb = plan->neighbours[fix.first + n];
+                if (nb.ref >= 0)
+                    total += fixed[nb.ref];
+                else if (nb.row < maxHeight && nb.col < copyWidth)
+                    total += raw[(nb.row + S.top_margin) * pitch + nb.col + S.left_margin];
+            }
+            fixed[k] = (ushort)(total / fix.count);
+        }
+    }
+
+    // 暗场相减之后 LibRaw 把黑电平全部清零，不再减去
+    ushort black[4];
+    for (int c = 0; c < 4; c++)
+        black[c] = useDark ? 0 : cblack[c];
+    if (useDark)
+    {
+        memset(imgdata.color.cblack, 0, sizeof(imgdata.color.cblack));
+        imgdata.color.black = 0;
+    }
+
+    const ushort *dark = useDark ? cal->dark.data() : nullptr;
+    int bands = std::max(1, std::min(calibrationThreads, maxHeight / 64));
+    std::vector<ushort> rows((size_t)bands * std::max(copyWidth, 1));
+    std::vector<ushort> bandMax(bands, 0);
+
+    forEachRowBand(maxHeight, bands, [&](int begin, int end, int band) {
+        ushort *values = rows.data() + (size_t)band * std::max(copyWidth, 1);
+        ushort ldmax = 0;
+        for (int row = begin; row < end; row++)
+        {
+            const ushort *src = raw + (row + S.top_margin) * pitch + S.left_margin;
+            if (dark)
+                simdSubtractRow(src, dark + (size_t)row * width, copyWidth, values);
+            else
+                memcpy(values, src, copyWidth * sizeof(ushort));
+
+            if (plan)
+            {
+                for (int i = plan->rowStart[row]; i < plan->rowStart[row + 1]; i++)
+                {
+                    int k = plan->order[i];
+                    int col = plan->fixes[k].col;
+                    if (col >= copyWidth)
+                        continue;
+                    ushort d = dark ? dark[(size_t)row * width + col] : 0;
+                    values[col] = fixed[k] > d ? fixed[k] - d : 0;
+                }
+            }
+
+            // 与 LibRaw::copy_bayer 相同的颜色索引、黑电平和缩小规则
+            unsigned char colors[48];
+            for (int c = 0; c < 48; c++)
+                colors[c] = (unsigned char)fcol(row, c);
+            ushort(*dst)[4] = imgdata.image + (size_t)(row >> shrink) * S.iwidth;
+            for (int col = 0; col < copyWidth; col++)
+            {
+                int cc = colors[col % 48];
+                ushort val = values[col];
+                if (val > black[cc])
+                {
+                    val -= black[cc];
+                    if (val > ldmax)
+                        ldmax = val;
+                }
+                else
+                    val = 0;
+                dst[col >> shrink][cc] = val;
+            }
+        }
+        bandMax[band] = ldmax;
+    });
+
+    for (ushort value : bandMax)
+        if (*dmaxp < value)
+            *dmaxp = value;
+}
+
+void LibRawProcessor::preScaleColorsCallback(void *ctx)
+{
+    LibRawProcessor *self = static_cast<LibRawProcessor *>(ctx);
+    if (!self->imgdata.params.half_size)
+        self->applyGreenMatching();
+}
+
+void LibRawProcessor::applyGreenMatching()
+{
+    // 与 LibRaw 的 green_matching() 相同的公式和判定。它只修改第二个绿色通道，
+    // 读取的原始值也只来自第二个绿色的位置，因此只复制这些位置（原来复制整幅图像）
+    if (libraw_internal_data.internal_output_params.shrink)
+        return;
+    const int width = imgdata.sizes.width;
+    const int height = imgdata.sizes.height;
+    const int margin = 3;
+    const float thr = 0.01f;
+    int oj = 2, oi = 2;
+    if (FC(oj, oi) != 3)
+        oj++;
+    if (FC(oj, oi) != 3)
+        oi++;
+    if (FC(oj, oi) != 3)
+        oj--;
+    if (FC(oj, oi) != 3 || height <= oj + margin || width <= oi + margin)
+        return;
+
+    ushort(*image)[4] = imgdata.image;
+    const int gw = width / 2 + 1;
+    std::vector<ushort> g2((size_t)(height / 2 + 1) * gw);
+    for (int j = oj & 1; j < height; j += 2)
+        for (int i = oi & 1; i < width; i += 2)
+            g2[(size_t)(j >> 1) * gw + (i >> 1)] = image[(size_t)j * width + i][3];
+    auto orig = [&](int j, int i) { return (int)g2[(size_t)(j >> 1) * gw + (i >> 1)]; };
+
+    const unsigned maximum = imgdata.color.maximum;
+    const int pairs = (height - margin - oj + 1) / 2; // 处理的行数
+    forEachRowBand(pairs, calibrationThreads, [&](int begin, int end, int) {
+        for (int p = begin; p < end; p++)
+        {
+            int j = oj + 2 * p;
+            for (int i = oi; i < width - margin; i += 2)
+            {
+                int o1_1 = image[(size_t)(j - 1) * width + i - 1][1];
+                int o1_2 = image[(size_t)(j - 1) * width + i + 1][1];
+                int o1_3 = image[(size_t)(j + 1) * width + i - 1][1];
+                int o1_4 = image[(size_t)(j + 1) * width + i + 1][1];
+                int o2_1 = orig(j - 2, i);
+                int o2_2 = orig(j + 2, i);
+                int o2_3 = orig(j, i - 2);
+                int o2_4 = orig(j, i + 2);
+
+                double m1 = (o1_1 + o1_2 + o1_3 + o1_4) / 4.0;
+                double m2 = (o2_1 + o2_2 + o2_3 + o2_4) / 4.0;
+                double c1 = (abs(o1_1 - o1_2) + abs(o1_1 - o1_3) + abs(o1_1 - o1_4) + abs(o1_2 - o1_3) +
+                             abs(o1_3 - o1_4) + abs(o1_2 - o1_4)) /
+                            6.0;
+                double c2 = (abs(o2_1 - o2_2) + abs(o2_1 - o2_3) + abs(o2_1 - o2_4) + abs(o2_2 - o2_3) +
+                             abs(o2_3 - o2_4) + abs(o2_2 - o2_4)) /
+                            6.0;
+                if ((orig(j, i) < maximum * 0.95) && (c1 < maximum * thr) && (c2 < maximum * thr))
+                {
+                    float f = image[(size_t)j * width + i][3] * m1 / m2;
+                    image[(size_t)j * width + i][3] = f > 0xffff ? 0xffff : f;
+                }
+            }
+        }
+    });
+}
+
+// ============== 共享 raw 缓存 ==============
+// 同一文件反复渲染时，identify 很快，耗时的是 unpack 中的解码。unpack 结束时 LibRaw 已经把
+// 颜色、尺寸等数据保存到 rawdata，之后的处理只依赖这些数据和 raw 缓冲区，因此可以整体复制
+
+// 磁盘缓存文件中的元数据：各结构体的大小（不同版本编译的文件结构不同，不能使用），之后依次是
+// color、sizes、iparams、ioparams 和 Phase One 黑电平表
+struct RawSnapshotMeta
+{
+    uint32_t colorSize, sizesSize, iparamsSize, ioparamsSize;
+    int32_t layout;
+    uint32_t warnings;
+    uint32_t ph1ColumnCount, ph1RowCount;
+};
+
+static void packSnapshot(const RawSnapshot &snapshot, RawCacheImage &image)
+{
+    RawSnapshotMeta meta = {sizeof(snapshot.color), sizeof(snapshot.sizes), sizeof(snapshot.iparams),
+                            sizeof(snapshot.ioparams), snapshot.layout, snapshot.warnings,
+                            (uint32_t)snapshot.ph1ColumnBlack.size(), (uint32_t)snapshot.ph1RowBlack.size()};
+    image.meta.assign((const char *)&meta, sizeof(meta));
+    image.meta.append((const char *)&snapshot.color, sizeof(snapshot.color));
+    image.meta.append((const char *)&snapshot.sizes, sizeof(snapshot.sizes));
+    image.meta.append((const char *)&snapshot.iparams, sizeof(snapshot.iparams));
+    image.meta.append((const char *)&snapshot.ioparams, sizeof(snapshot.ioparams));
+    image.meta.append((const char *)snapshot.ph1ColumnBlack.data(), snapshot.ph1ColumnBlack.size() * sizeof(short));
+    image.meta.append((const char *)snapshot.ph1RowBlack.data(), snapshot.ph1RowBlack.size() * sizeof(short));
+    image.samples = snapshot.data.data();
+    image.rowSamples = snapshot.sizes.raw_pitch / 2;
+    image.rows = snapshot.sizes.raw_height;
+    image.stride = snapshot.layout == 1 ? 4 : snapshot.layout == 2 ? 3 : 2;
+}
+
+static std::shared_ptr<RawSnapshot> unpackSnapshot(RawCacheImage &image)
+{
+    RawSnapshotMeta meta;
+    if (image.meta.size() < sizeof(meta))
+        return nullptr;
+    memcpy(&meta, image.meta.data(), sizeof(meta));
+    std::shared_ptr<RawSnapshot> snapshot = std::make_shared<RawSnapshot>();
+    if (meta.colorSize != sizeof(snapshot->color) || meta.sizesSize != sizeof(snapshot->sizes) ||
+        meta.iparamsSize != sizeof(snapshot->iparams) || meta.ioparamsSize != sizeof(snapshot->ioparams) ||
+        meta.layout < 0 || meta.layout > 2 ||
+        image.meta.size() != sizeof(meta) + meta.colorSize + meta.sizesSize + meta.iparamsSize + meta.ioparamsSize +
+                                 ((size_t)meta.ph1ColumnCount + meta.ph1RowCount) * sizeof(short))
+        return nullptr;
+
+    const char *p = image.meta.data() + sizeof(meta);
+    memcpy(&snapshot->color, p, sizeof(snapshot->color));
+    p += sizeof(snapshot->color);
+    memcpy(&snapshot->sizes, p, sizeof(snapshot->sizes));
+    p += sizeof(snapshot->sizes);
+    memcpy(&snapshot->iparams, p, sizeof(snapshot->iparams));
+    p += sizeof(snapshot->iparams);
+    memcpy(&snapshot->ioparams, p, sizeof(snapshot->ioparams));
+    p += sizeof(snapshot->ioparams);
+    snapshot->ph1ColumnBlack.assign((const short *)p, (const short *)p + meta.ph1ColumnCount);
+    p += meta.ph1ColumnCount * sizeof(short);
+    snapshot->ph1RowBlack.assign((const short *)p, (const short *)p + meta.ph1RowCount);
+    snapshot->layout = meta.layout;
+    snapshot->warnings = meta.warnings;
+    // 另一个实例的指针，restoreRaw 不会使用
+    snapshot->color.profile = nullptr;
+    snapshot->iparams.xmpdata = nullptr;
+
+    if ((size_t)snapshot->sizes.raw_pitch * snapshot->sizes.raw_height != image.data.size() ||
+        image.rowSamples != snapshot->sizes.raw_pitch / 2u || image.rows != snapshot->sizes.raw_height)
+        return nullptr;
+    snapshot->data.swap(image.data);
+    return snapshot;
+}
+
+// 修改时间的纳秒部分：Windows 的 stat 只有整秒，这时为 0
+static long long mtimeNanoseconds(const struct stat &st)
+{
+#if defined(__APPLE__)
+    return (long long)st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    (void)st;
+    return 0;
+#else
+    return (long long)st.st_mtim.tv_nsec;
+#endif
+}
+
+// 文件开头和结尾各 64KB 的 CRC32。同一秒内原样大小改写（或文件系统的时间精度只有秒）时，
+// EXIF 时间、缩略图和 raw 数据的差异仍会改变 key
+static bool sampleChecksum(const char *filename, long long size, unsigned long &crc)
+{
+    static const long long SAMPLE_BYTES = 64 * 1024;
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+        return false;
+    std::vector<unsigned char> buffer((size_t)std::min(size, SAMPLE_BYTES));
+    crc = crc32(0L, Z_NULL, 0);
+    bool ok = fread(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    if (ok)
+        crc = crc32(crc, buffer.data(), (uInt)buffer.size());
+    if (ok && size > SAMPLE_BYTES)
+    {
+        const long long tail = std::min(size - SAMPLE_BYTES, SAMPLE_BYTES);
+        buffer.resize((size_t)tail);
+        ok = fseek(file, -(long)tail, SEEK_END) == 0 && fread(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        if (ok)
+            crc = crc32(crc, buffer.data(), (uInt)buffer.size());
+    }
+    fclose(file);
+    return ok;
+}
+
+bool LibRawProcessor::rawCacheKey(const char *filename, std::string &key)
+{
+    struct stat st;
+    unsigned long crc;
+    if (!filename || stat(filename, &st) != 0 || !sampleChecksum(filename, (long long)st.st_size, crc))
+        return false;
+    char identity[128];
+    snprintf(identity, sizeof(identity), "|%lld|%lld.%09lld|%08lx|%u|%u", (long long)st.st_size,
+             (long long)st.st_mtime, mtimeNanoseconds(st), crc, imgdata.rawparams.shot_select,
+             imgdata.rawparams.options);
+    key = std::string(filename) + identity;
+    return true;
+}
+
+bool LibRawProcessor::rawCacheBusy(const char *filename)
+{
+    std::string key;
+    if (rawCache().budget() == 0 || !rawCacheKey(filename, key))
+        return false;
+    const bool busy = rawCache().busy(key);
+    rawCacheWaited = rawCacheWaited || busy;
+    return busy;
+}
+
+int LibRawProcessor::unpackShared(const char *filename)
+{
+    SharedCache &cache = rawCache();
+    const bool memory = cache.budget() > 0;
+    const bool waited = rawCacheWaited;
+    rawCacheWaited = false;
+    libraw_decoder_info_t decoder;
+    const bool disk = get_decoder_info(&decoder) == LIBRAW_SUCCESS && rawDiskCacheAccepts(decoder.decoder_name);
+    std::string key;
+    if ((!memory && !disk) || !rawCacheKey(filename, key))
+        return unpack();
+
+    // 其他线程正在解包同一文件（JS 端等待超时或刚好开始）时不阻塞，自行解包且不登记
+    std::shared_ptr<const CacheEntry> entry;
+    SharedCache::AcquireState state = SharedCache::ACQUIRE_PENDING;
+    if (memory)
+    {
+        state = cache.acquire(key, entry, waited);
+        if (state == SharedCache::ACQUIRE_HIT && restoreRaw(static_cast<const RawSnapshot &>(*entry)) == LIBRAW_SUCCESS)
+        {
+            syncMemoryMetrics();
+            return LIBRAW_SUCCESS;
+        }
+    }
+
+    // 磁盘文件的 key 还包含 LibRaw 版本：解码器修正后旧文件自然失效
+    const std::string diskKey = key + "|" + LibRaw::version();
+    const int threads = std::max(1, std::min(8, (int)std::thread::hardware_concurrency()));
+    std::shared_ptr<const RawSnapshot> snapshot;
+    int ret = LIBRAW_UNSPECIFIED_ERROR;
+    if (disk)
+    {
+        RawCacheImage image;
+        if (readRawDiskCache(diskKey, image, threads))
+            snapshot = unpackSnapshot(image);
+        if (snapshot)
+            ret = restoreRaw(*snapshot);
+        if (ret != LIBRAW_SUCCESS)
+            snapshot = nullptr;
+    }
+    if (!snapshot)
+    {
+        ret = unpack();
+        if (ret == LIBRAW_SUCCESS && (disk || state == SharedCache::ACQUIRE_LEADER))
+            snapshot = snapshotRaw();
+        if (snapshot && disk)
+        {
+            RawCacheImage image;
+            packSnapshot(*snapshot, image);
+            writeRawDiskCache(diskKey, image, threads);
+        }
+    }
+
+    if (state == SharedCache::ACQUIRE_LEADER)
+    {
+        if (snapshot)
+            cache.fulfil(key, snapshot);
+        else
+            cache.abandon(key);
+    }
+    syncMemoryMetrics();
+    return ret;
+}
+
+std::shared_ptr<const RawSnapshot> LibRawProcessor::snapshotRaw()
+{
+    const libraw_rawdata_t &raw = imgdata.rawdata;
+    if (!(imgdata.progress_flags & LIBRAW_PROGRESS_LOAD_RAW) || !raw.raw_alloc)
+        return nullptr;
+
+    // 解码器在 raw 缓冲区之外保存的状态无法复制：浮点数据、元数据块（Sinar、Kodak 等）、
+    // 自行分配内存的 Foveon 解码器。Phase One 黑电平表单独保存
+    libraw_decoder_info_t decoder;
+    get_decoder_info(&decoder);
+    if (decoder.decoder_flags & (LIBRAW_DECODER_OWNALLOC | LIBRAW_DECODER_SINAR4SHOT))
+        return nullptr;
+    return copyRaw();
+}
+
+std::shared_ptr<const RawSnapshot> LibRawProcessor::copyRaw()
+{
+    const libraw_rawdata_t &raw = imgdata.rawdata;
+    if (!(imgdata.progress_flags & LIBRAW_PROGRESS_LOAD_RAW) || !raw.raw_alloc || raw.float_image ||
+        raw.float3_image || raw.float4_image || libraw_internal_data.unpacker_data.meta_length)
+        return nullptr;
+
+    int layout;
+    if (raw.raw_image == raw.raw_alloc)
+        layout = 0;
+    else if ((void *)raw.color4_image == raw.raw_alloc)
+        layout = 1;
+    else if ((void *)raw.color3_image == raw.raw_alloc)
+        layout = 2;
+    else
+        return nullptr;
+
+    const size_t length = (size_t)raw.sizes.raw_pitch * raw.sizes.raw_height;
+    if (length == 0)
+        return nullptr;
+
+    std::shared_ptr<RawSnapshot> snapshot = std::make_shared<RawSnapshot>();
+    snapshot->data.assign((const unsigned char *)raw.raw_alloc, (const unsigned char *)raw.raw_alloc + length);
+    snapshot->layout = layout;
+    memcpy(&snapshot->color, &raw.color, sizeof(snapshot->color));
+    memcpy(&snapshot->sizes, &raw.sizes, sizeof(snapshot->sizes));
+    memcpy(&snapshot->iparams, &raw.iparams, sizeof(snapshot->iparams));
+    memcpy(&snapshot->ioparams, &raw.ioparams, sizeof(snapshot->ioparams));
+    snapshot->warnings = imgdata.process_warnings;
+    // 表的大小见 phase_one_load_raw / phase_one_load_raw_c
+    if (raw.ph1_cblack && raw.ph1_rblack)
+    {
+        snapshot->ph1ColumnBlack.assign(raw.ph1_cblack[0], raw.ph1_cblack[0] + raw.sizes.raw_height * 2);
+        snapshot->ph1RowBlack.assign(raw.ph1_rblack[0], raw.ph1_rblack[0] + raw.sizes.raw_width * 2);
+    }
+    return snapshot;
+}
+
+int LibRawProcessor::restoreRaw(const RawSnapshot &snapshot)
+{
+    if (!(imgdata.progress_flags & LIBRAW_PROGRESS_IDENTIFY) || (imgdata.progress_flags & LIBRAW_PROGRESS_LOAD_RAW))
+        return LIBRAW_OUT_OF_ORDER_CALL;
+
+    // 与 unpack 一样多分配 8 行，部分处理阶段会读到最后一行之后
+    const size_t length = snapshot.data.size();
+    const size_t padding = (size_t)snapshot.sizes.raw_pitch * 8;
+    void *buffer = malloc(length + padding);
+    if (!buffer)
+        return LIBRAW_UNSUFFICIENT_MEMORY;
+    memcpy(buffer, snapshot.data.data(), length);
+    memset((char *)buffer + length, 0, padding);
+
+    short(*columnBlack)[2] = nullptr;
+    short(*rowBlack)[2] = nullptr;
+    if (!snapshot.ph1ColumnBlack.empty())
+    {
+        columnBlack = (short(*)[2])malloc(snapshot.ph1ColumnBlack.size() * sizeof(short));
+        rowBlack = (short(*)[2])malloc(snapshot.ph1RowBlack.size() * sizeof(short));
+        if (!columnBlack || !rowBlack)
+        {
+            free(buffer);
+            if (columnBlack)
+                free(columnBlack);
+            if (rowBlack)
+                free(rowBlack);
+            return LIBRAW_UNSUFFICIENT_MEMORY;
+        }
+        memcpy(columnBlack, snapshot.ph1ColumnBlack.data(), snapshot.ph1ColumnBlack.size() * sizeof(short));
+        memcpy(rowBlack, snapshot.ph1RowBlack.data(), snapshot.ph1RowBlack.size() * sizeof(short));
+    }
+
+    if (imgdata.image)
+    {
+        free(imgdata.image);
+        imgdata.image = nullptr;
+    }
+    if (imgdata.rawdata.raw_alloc)
+        free(imgdata.rawdata.raw_alloc);
+    libraw_rawdata_t &raw = imgdata.rawdata;
+    raw.raw_alloc = buffer;
+    raw.raw_image = snapshot.layout == 0 ? (ushort *)buffer : nullptr;
+    raw.color4_image = snapshot.layout == 1 ? (ushort(*)[4])buffer : nullptr;
+    raw.color3_image = snapshot.layout == 2 ? (ushort(*)[3])buffer : nullptr;
+    raw.float_image = nullptr;
+    raw.float3_image = nullptr;
+    raw.float4_image = nullptr;
+    if (raw.ph1_cblack)
+        free(raw.ph1_cblack);
+    if (raw.ph1_rblack)
+        free(raw.ph1_rblack);
+    raw.ph1_cblack = columnBlack;
+    raw.ph1_rblack = rowBlack;
+
+    // unpack 结束时 imgdata 与 rawdata 中的副本相同。ICC 配置文件和 XMP 由本实例的 identify 分配，
+    // 保留自己的指针，不能使用副本中另一个实例的
+    void *profile = imgdata.color.profile;
+    char *xmpdata = imgdata.idata.xmpdata;
+    memcpy(&raw.color, &snapshot.color, sizeof(raw.color));
+    memcpy(&raw.sizes, &snapshot.sizes, sizeof(raw.sizes));
+    memcpy(&raw.iparams, &snapshot.iparams, sizeof(raw.iparams));
+    raw.color.profile = profile;
+    raw.iparams.xmpdata = xmpdata;
+    memcpy(&raw.ioparams, &snapshot.ioparams, sizeof(raw.ioparams));
+    memcpy(&imgdata.color, &snapshot.color, sizeof(imgdata.color));
+    memcpy(&imgdata.sizes, &snapshot.sizes, sizeof(imgdata.sizes));
+    memcpy(&imgdata.idata, &snapshot.iparams, sizeof(imgdata.idata));
+    imgdata.color.profile = profile;
+    imgdata.idata.xmpdata = xmpdata;
+    memcpy(&libraw_internal_data.internal_output_params, &snapshot.ioparams,
+           sizeof(libraw_internal_data.internal_output_params));
+
+    imgdata.process_warnings |= snapshot.warnings;
+    imgdata.progress_flags |= LIBRAW_PROGRESS_LOAD_RAW;
+    return LIBRAW_SUCCESS;
+}
+
+// ============== 降采样解包 ==============
+// half_size 在完整解码之后才缩小。预览只需要一小部分像素：按 2x2 CFA 块抽取，块内的颜色排列和
+// 相对可见区域的奇偶性保持不变，LibRaw 之后的所有阶段都按一幅较小的 Bayer 图像处理
+
+// 抽取后的坐标 v 对应的原坐标：保留第 0、n、2n... 个块，块内位置不变
+static inline unsigned subsampleSource(unsigned v, int n)
+{
+    return (v >> 1) * 2 * n + (v & 1);
+}
+
+// 原坐标不小于 v 的第一个抽取后坐标；parity >= 0 时还要求与 parity 奇偶相同
+static unsigned subsampleStart(unsigned v, int n, int parity)
+{
+    const unsigned q = v / (2 * n);
+    const unsigned rem = v % (2 * n);
+    unsigned start = rem == 0 ? 2 * q : rem == 1 ? 2 * q + 1 : 2 * (q + 1);
+    if (parity >= 0 && (int)(start & 1) != parity)
+        start++;
+    return start;
+}
+
+// 按抽取倍数换算尺寸、边距、遮蔽区和裁剪框
+static void subsampleSizes(libraw_image_sizes_t &s, int n)
+{
+    const libraw_image_sizes_t full = s;
+    s.raw_width = (ushort)(2 * ((full.raw_width / 2 + n - 1) / n));
+    s.raw_height = (ushort)(2 * ((full.raw_height / 2 + n - 1) / n));
+    s.left_margin = (ushort)subsampleStart(full.left_margin, n, full.left_margin & 1);
+    s.top_margin = (ushort)subsampleStart(full.top_margin, n, full.top_margin & 1);
+    s.width = (ushort)std::min<int>((int)subsampleStart(full.left_margin + full.width, n, -1) - s.left_margin,
+                                    s.raw_width - s.left_margin);
+    s.height = (ushort)std::min<int>((int)subsampleStart(full.top_margin + full.height, n, -1) - s.top_margin,
+                                     s.raw_height - s.top_margin);
+    s.iwidth = s.width;
+    s.iheight = s.height;
+    s.raw_pitch = s.raw_width * 2;
+    for (int m = 0; m < 8; m++)
+        for (int i = 0; i < 4; i++)
+            if (full.mask[m][i] > 0)
+                s.mask[m][i] = (int)subsampleStart(full.mask[m][i], n, -1);
+    for (int i = 0; i < 2; i++)
+    {
+        libraw_raw_inset_crop_t &crop = s.raw_inset_crops[i];
+        if (crop.cwidth == 0 || crop.cwidth == 0xffff)
+            continue;
+        crop.cleft = (ushort)(crop.cleft / n);
+        crop.ctop = (ushort)(crop.ctop / n);
+        crop.cwidth = (ushort)std::max(1, crop.cwidth / n);
+        crop.cheight = (ushort)std::max(1, crop.cheight / n);
+    }
+}
+
+enum SubsampleRowDecoder
+{
+    SUBSAMPLE_DECODER_NONE = 0,
+    SUBSAMPLE_DECODER_UNPACKED = 1, // unpacked_load_raw：每行 raw_width 个 16 位样本
+    SUBSAMPLE_DECODER_ARW2 = 2,     // sony_arw2_load_raw：每行 raw_width 字节，每 16 字节压缩 16 个同色样本
+    SUBSAMPLE_DECODER_DNG8 = 3,     // packed_dng_load_raw，未分块、单通道、8 位
+    SUBSAMPLE_DECODER_DNG16 = 4     // packed_dng_load_raw，未分块、单通道、16 位
+};
+
+bool LibRawProcessor::canSubsample() const
+{
+    // 四个字节相同的 filters 表示 2x2 周期；黑电平图案也必须不超过 2x2
+    const unsigned filters = imgdata.idata.filters;
+    if (filters < 1000 || filters != (filters & 0xff) * 0x01010101u)
+        return false;
+    if (imgdata.color.cblack[4] > 2 || imgdata.color.cblack[5] > 2)
+        return false;
+    if (libraw_internal_data.internal_output_params.fuji_width || libraw_internal_data.unpacker_data.meta_length ||
+        imgdata.idata.colors != 3)
+        return false;
+
+    // 浮点、自行分配、多帧合成和 Phase One 黑电平表（按原始行列索引）都不能抽取
+    LibRawProcessor *self = const_cast<LibRawProcessor *>(this);
+    libraw_decoder_info_t decoder;
+    if (self->get_decoder_info(&decoder) != LIBRAW_SUCCESS || !decoder.decoder_name ||
+        (decoder.decoder_flags & (LIBRAW_DECODER_OWNALLOC | LIBRAW_DECODER_SINAR4SHOT | LIBRAW_DECODER_3CHANNEL)))
+        return false;
+    if (!strncmp(decoder.decoder_name, "phase_one_load_raw", 18) || self->is_floating_point())
+        return false;
+    return true;
+}
+
+// 解码器函数只在 LibRaw 自身编译时声明，按 get_decoder_info 的名称判断
+int LibRawProcessor::subsampleRowDecoder() const
+{
+    libraw_decoder_info_t decoder;
+    if (const_cast<LibRawProcessor *>(this)->get_decoder_info(&decoder) != LIBRAW_SUCCESS || !decoder.decoder_name)
+        return SUBSAMPLE_DECODER_NONE;
+    const std::string name = decoder.decoder_name;
+    const auto &unpacker = libraw_internal_data.unpacker_data;
+    if (name == "unpacked_load_raw()")
+        return SUBSAMPLE_DECODER_UNPACKED;
+    if (name == "sony_arw2_load_raw()" && !(imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_ALLFLAGS))
+        return SUBSAMPLE_DECODER_ARW2;
+    // 未分块的 DNG 每行占固定字节数，8 位 getbits 与逐字节读取相同
+    if (name == "packed_dng_load_raw()" && unpacker.tile_length >= INT_MAX &&
+        unpacker.tiff_samples == 1 && !unpacker.zero_after_ff)
+    {
+        if (unpacker.tiff_bps == 8)
+            return SUBSAMPLE_DECODER_DNG8;
+        if (unpacker.tiff_bps == 16)
+            return SUBSAMPLE_DECODER_DNG16;
+    }
+    return SUBSAMPLE_DECODER_NONE;
+}
+
+int LibRawProcessor::unpackSubsampled(int factor, const char *filename)
+{
+    subsample = 1;
+    subsampleInDecoder = false;
+    if (factor <= 1 || !(imgdata.progress_flags & LIBRAW_PROGRESS_IDENTIFY) ||
+        (imgdata.progress_flags & LIBRAW_PROGRESS_LOAD_RAW) || !canSubsample())
+        return filename ? unpackShared(filename) : unpack();
+
+    // 可以按行定位的格式：先缩小尺寸，unpack 按缩小后的尺寸分配缓冲区，替换的 load_raw 只解码需要的行
+    subsampleDecoder = subsampleRowDecoder();
+    if (subsampleDecoder != SUBSAMPLE_DECODER_NONE)
+    {
+        subsampleFullSizes = imgdata.sizes;
+        subsampleSizes(imgdata.sizes, factor);
+        subsample = factor;
+        void (LibRaw::*original)() = load_raw;
+        load_raw = static_cast<void (LibRaw::*)()>(&LibRawProcessor::subsampledRowsLoadRaw);
+        int ret = unpack();
+        load_raw = original;
+        if (ret != LIBRAW_SUCCESS)
+        {
+            imgdata.sizes = subsampleFullSizes;
+            subsample = 1;
+            return ret;
+        }
+        subsampleInDecoder = true;
+        return ret;
+    }
+
+    // 其他格式完整解码后原地抽取（可以命中共享 raw 缓存）
+    int ret = filename ? unpackShared(filename) : unpack();
+    if (ret != LIBRAW_SUCCESS || !imgdata.rawdata.raw_image)
+        return ret;
+    const libraw_image_sizes_t full = imgdata.sizes;
+    subsampleSizes(imgdata.sizes, factor);
+    subsample = factor;
+    subsampleRawBuffer(full);
+    syncMemoryMetrics();
+    return LIBRAW_SUCCESS;
+}
+
+void LibRawProcessor::subsampleRawBuffer(const libraw_image_sizes_t &full)
+{
+    // 目标位置总是不晚于源位置，可以按顺序原地复制
+    ushort *raw = imgdata.rawdata.raw_image;
+    const size_t srcPitch = full.raw_pitch / 2;
+    const libraw_image_sizes_t &s = imgdata.sizes;
+    for (unsigned row = 0; row < s.raw_height; row++)
+    {
+        const ushort *src = raw + (size_t)subsampleSource(row, subsample) * srcPitch;
+        ushort *dst = raw + (size_t)row * s.raw_width;
+        for (unsigned col = 0; col < s.raw_width; col++)
+            dst[col] = src[subsampleSource(col, subsample)];
+    }
+    // unpack 结束时保存的副本也要换成抽取后的尺寸
+    imgdata.rawdata.sizes = imgdata.sizes;
+}
+
+// 行解码器可以读取的原始行数：sony_arw2_load_raw 只有可见高度的行
+unsigned LibRawProcessor::rowDecoderRows(const libraw_image_sizes_t &full) const
+{
+    return subsampleDecoder == SUBSAMPLE_DECODER_ARW2 ? full.height : full.raw_height;
+}
+
+// 读取并解码原始第 source 行的 rawWidth 个样本，data 为行字节数加 1 的缓冲区
+void LibRawProcessor::decodeRawRow(unsigned source, unsigned rawWidth, std::vector<uchar> &data, ushort *line)
+{
+    LibRaw_abstract_datastream *input = libraw_internal_data.internal_data.input;
+    const auto &unpacker = libraw_internal_data.unpacker_data;
+    const bool littleEndian = unpacker.order == 0x4949;
+    const size_t rowBytes = data.size() - 1;
+
+    input->seek(unpacker.data_offset + (INT64)source * rowBytes, SEEK_SET);
+    if ((size_t)input->read(data.data(), 1, (int)rowBytes) < rowBytes)
+        derror();
+
+    switch (subsampleDecoder)
+    {
+    case SUBSAMPLE_DECODER_UNPACKED:
+    case SUBSAMPLE_DECODER_DNG16:
+        for (unsigned col = 0; col < rawWidth; col++)
+        {
+            const uchar *p = &data[col * 2];
+            ushort value = littleEndian ? (ushort)(p[0] | p[1] << 8) : (ushort)(p[0] << 8 | p[1]);
+            line[col] = subsampleDecoder == SUBSAMPLE_DECODER_UNPACKED ? (ushort)(value >> unpacker.load_flags)
+                                                                       : imgdata.color.curve[value];
+        }
+        break;
+    case SUBSAMPLE_DECODER_DNG8:
+        for (unsigned col = 0; col < rawWidth; col++)
+            line[col] = imgdata.color.curve[data[col]];
+        break;
+    case SUBSAMPLE_DECODER_ARW2:
+    {
+        // sony_arw2_load_raw 的默认分支：每 16 字节保存 16 个同色样本的最大值、最小值和 7 位差值
+        std::fill(line, line + rawWidth, 0);
+        int col = 0;
+        ushort pix[16];
+        for (uchar *dp = data.data(); col < (int)rawWidth - 30; dp += 16)
+        {
+            int val = littleEndian ? (dp[0] | dp[1] << 8 | dp[2] << 16 | dp[3] << 24)
+                                   : (dp[0] << 24 | dp[1] << 16 | dp[2] << 8 | dp[3]);
+            int max = 0x7ff & val, min = 0x7ff & val >> 11;
+            int imax = 0x0f & val >> 22, imin = 0x0f & val >> 26;
+            int sh = 0;
+            while (sh < 4 && 0x80 << sh <= max - min)
+                sh++;
+            for (int bit = 30, i = 0; i < 16; i++)
+                if (i == imax)
+                    pix[i] = max;
+                else if (i == imin)
+                    pix[i] = min;
+                else
+                {
+                    const uchar *p = dp + (bit >> 3);
+                    const int word = littleEndian ? (p[0] | p[1] << 8) : (p[0] << 8 | p[1]);
+                    pix[i] = ((word >> (bit & 7) & 0x7f) << sh) + min;
+                    if (pix[i] > 0x7ff)
+                        pix[i] = 0x7ff;
+                    bit += 7;
+                }
+            for (int i = 0; i < 16; i++, col += 2)
+                line[col] = imgdata.color.curve[pix[i] << 1];
+            col -= col & 1 ? 1 : 31;
+        }
+        break;
+    }
+    }
+}
+
+void LibRawProcessor::subsampledRowsLoadRaw()
+{
+    const libraw_image_sizes_t &full = subsampleFullSizes;
+    const libraw_image_sizes_t &s = imgdata.sizes;
+    size_t rowBytes = full.raw_width;
+    if (subsampleDecoder == SUBSAMPLE_DECODER_UNPACKED || subsampleDecoder == SUBSAMPLE_DECODER_DNG16)
+        rowBytes *= 2;
+    const unsigned rows = rowDecoderRows(full);
+
+    std::vector<uchar> data(rowBytes + 1);
+    std::vector<ushort> line(full.raw_width);
+    for (unsigned row = 0; row < s.raw_height; row++)
+    {
+        checkCancel();
+        ushort *dst = imgdata.rawdata.raw_image + (size_t)row * s.raw_width;
+        const unsigned source = subsampleSource(row, subsample);
+        if (source >= rows)
+        {
+            memset(dst, 0, s.raw_width * sizeof(ushort));
+            continue;
+        }
+        decodeRawRow(source, full.raw_width, data, line.data());
+        for (unsigned col = 0; col < s.raw_width; col++)
+            dst[col] = line[subsampleSource(col, subsample)];
+    }
+}
+
+// ============== 分段流式输出 ==============
+// 整幅处理时 raw 缓冲区、四通道 image、去马赛克的临时缓冲区和输出图像同时存在。这里把可见区域
+// 分成若干行段，每段连同上下的邻域行复制到 image，依次执行 dcraw_process 的各阶段，去掉邻域后
+// 交给编码器。依赖整幅图像统计的量（data_maximum、自动白平衡、自动亮度）先用半尺寸的一遍求出，
+// 再在各段中固定。只有 prepareBand 能按行定位解码的格式（见 unpackSubsampled）连 raw 也按段读取，
+// 其余格式（包括 Hasselblad、Phase One、Leaf）先整幅解包，raw 部分的峰值不随行段减小
+
+// 行段边界对齐到 16 行，CFA 图案（filters 以 8 行为周期）在每段中的相位不变
+static const int BAND_ALIGN = 16;
+
+static bool hasMaskedAreas(const libraw_image_sizes_t &s)
+{
+    for (int m = 0; m < 8; m++)
+        for (int i = 0; i < 4; i++)
+            if (s.mask[m][i])
+                return true;
+    return false;
+}
+
+int LibRawProcessor::is_phaseone_compressed()
+{
+    return !bandActive && LibRaw::is_phaseone_compressed();
+}
+
+const char *LibRawProcessor::streamUnsupported()
+{
+    // 解包之后 imgdata 中可能是上一次处理修改过的数据，以 unpack 时保存的副本为准
+    const bool unpacked = (imgdata.progress_flags & LIBRAW_PROGRESS_LOAD_RAW) != 0;
+    const libraw_iparams_t &iparams = unpacked ? imgdata.rawdata.iparams : imgdata.idata;
+    const libraw_image_sizes_t &sizes = unpacked ? imgdata.rawdata.sizes : imgdata.sizes;
+    const libraw_internal_output_params_t &io =
+        unpacked ? imgdata.rawdata.ioparams : libraw_internal_data.internal_output_params;
+    const libraw_output_params_t &params = imgdata.params;
+
+    if (iparams.filters < 1000 || iparams.colors != 3)
+        return "Only 3-color Bayer images can be streamed";
+    if (io.fuji_width)
+        return "Fuji SuperCCD images must be rotated as a whole";
+    if (is_floating_point())
+        return "Floating point raw data cannot be streamed";
+    if (unpacked && !imgdata.rawdata.raw_image)
+        return "Raw data is not a Bayer buffer";
+    if (calibrationData)
+        return "Calibration set with setCalibration() is not applied when streaming";
+    if (params.bad_pixels || params.dark_frame)
+        return "bad_pixels and dark_frame are not supported when streaming";
+    if (~params.cropbox[2] && ~params.cropbox[3])
+        return "cropbox is not supported when streaming";
+    if (params.threshold || params.aber[0] != 1 || params.aber[2] != 1)
+        return "Wavelet denoising and chromatic aberration correction need the whole image";
+    if (params.highlight > 2)
+        return "Highlight reconstruction (highlight > 2) needs the whole image";
+    if (params.user_qual == 11 || params.user_qual == 12)
+        return "DHT and AAHD demosaicing scale by whole-image channel maxima";
+    if (params.fbdd_noiserd > 0)
+        return "FBDD noise reduction is not supported when streaming";
+    if (params.camera_profile)
+        return "camera_profile is not supported when streaming";
+    if (sizes.pixel_aspect != 1)
+        return "Non-square pixels must be stretched as a whole";
+    if ((params.use_auto_wb || params.use_camera_wb) && params.greybox[1] % 8)
+        return "greybox must start on a multiple of 8 rows when streaming";
+    return nullptr;
+}
+
+int LibRawProcessor::prepareBand(int top, int bottom)
+{
+    libraw_image_sizes_t &sizes = imgdata.rawdata.sizes;
+    sizes = bandFullSizes;
+    sizes.height = (ushort)(bottom - top);
+    if (bandRowDecode)
+    {
+        // 解码 DNG 和 ARW2 时查找 color.curve，它可能已被上一段的 gamma_curve 覆盖
+        raw2image_start();
+        const unsigned rows = rowDecoderRows(bandFullSizes);
+        const unsigned rawWidth = bandFullSizes.raw_width;
+        size_t rowBytes = rawWidth;
+        if (subsampleDecoder == SUBSAMPLE_DECODER_UNPACKED || subsampleDecoder == SUBSAMPLE_DECODER_DNG16)
+            rowBytes *= 2;
+        std::vector<uchar> data(rowBytes + 1);
+        bandRaw.resize((size_t)rawWidth * (bottom - top));
+        for (int row = 0; row < bottom - top; row++)
+        {
+            checkCancel();
+            ushort *dst = bandRaw.data() + (size_t)row * rawWidth;
+            const unsigned source = bandFullSizes.top_margin + top + row;
+            if (source >= rows)
+                memset(dst, 0, rawWidth * sizeof(ushort));
+            else
+                decodeRawRow(source, rawWidth, data, dst);
+        }
+        imgdata.rawdata.raw_image = bandRaw.data();
+        sizes.top_margin = 0;
+        sizes.raw_height = (ushort)(bottom - top);
+    }
+    else
+    {
+        imgdata.rawdata.raw_image = bandRawBase;
+        sizes.top_margin = (ushort)(bandFullSizes.top_margin + top);
+    }
+
+    // 与 dcraw_process 相同：需要修补零值像素时先复制再减黑电平
+    const bool zeroIsBad = libraw_internal_data.internal_output_params.zero_is_bad != 0;
+    int ret = raw2image_ex(!zeroIsBad);
+    if (ret != LIBRAW_SUCCESS)
+        return ret;
+    if (zeroIsBad)
+    {
+        remove_zeroes();
+        adjust_bl();
+        subtract_black_internal();
+    }
+    // adjust_maximum 按整幅图像的最大值判断
+    if (bandDataMaximum)
+        imgdata.color.data_maximum = bandDataMaximum;
+    return LIBRAW_SUCCESS;
+}
+
+// 与 dcraw_process 从 adjust_maximum 到 convert_to_rgb 的顺序相同，streamUnsupported 排除的阶段除外
+void LibRawProcessor::processBand()
+{
+    libraw_output_params_t &params = imgdata.params;
+    libraw_decoder_info_t decoder;
+    get_decoder_info(&decoder);
+    const int save4color = params.four_color_rgb;
+
+    if (!(decoder.decoder_flags & LIBRAW_DECODER_FIXEDMAXC))
+        adjust_maximum();
+    if (params.user_sat > 0)
+        imgdata.color.maximum = params.user_sat;
+    if (params.green_matching && !params.half_size)
+        green_matching();
+    if (!params.no_auto_scale)
+    {
+        if (bandAutoWB)
+            pinAutoWhiteBalance();
+        scale_colors();
+    }
+    pre_interpolate();
+    if (params.exp_correc > 0)
+        exp_bef(params.exp_shift, params.exp_preser);
+
+    if (imgdata.idata.filters && !params.no_interpolation)
+    {
+        const int quality = params.user_qual >= 0 ? params.user_qual : 3;
+        const int iterations = params.dcb_iterations >= 0 ? params.dcb_iterations : -1;
+        const int enhance = params.dcb_enhance_fl >= 0 ? params.dcb_enhance_fl : 1;
+        if (quality == 0)
+            lin_interpolate();
+        else if (quality == 1 || imgdata.idata.colors > 3)
+            vng_interpolate();
+        else if (quality == 2)
+            ppg_interpolate();
+        else if (quality == 3)
+            ahd_interpolate();
+        else if (quality == 4)
+            dcb(iterations, enhance);
+        else if (quality == 11)
+            dht_interpolate();
+        else if (quality == 12)
+            aahd_interpolate();
+        else
+        {
+            ahd_interpolate();
+            imgdata.process_warnings |= LIBRAW_WARN_FALLBACK_TO_AHD;
+        }
+    }
+    if (libraw_internal_data.internal_output_params.mix_green)
+    {
+        imgdata.idata.colors = 3;
+        for (size_t i = 0; i < (size_t)imgdata.sizes.height * imgdata.sizes.width; i++)
+            imgdata.image[i][1] = (imgdata.image[i][1] + imgdata.image[i][3]) >> 1;
+    }
+    if (imgdata.idata.colors == 3 && params.med_passes > 0)
+        median_filter();
+    if (params.highlight == 2)
+        blend_highlights();
+
+    if (libraw_internal_data.output_data.oprof)
+    {
+        free(libraw_internal_data.output_data.oprof);
+        libraw_internal_data.output_data.oprof = nullptr;
+    }
+    if (!libraw_internal_data.output_data.histogram)
+    {
+        libraw_internal_data.output_data.histogram =
+            (int(*)[LIBRAW_HISTOGRAM_SIZE])calloc(1, sizeof(*libraw_internal_data.output_data.histogram) * 4);
+    }
+    convert_to_rgb();
+    params.four_color_rgb = save4color;
+}
+
+// 与 scale_colors 相同的 8x8 块和饱和判定。饱和阈值取决于 adjust_maximum 之后的 maximum，
+// 这时还不知道，所以按块内最大值分桶累加，pinAutoWhiteBalance 再按阈值求和
+void LibRawProcessor::accumulateAutoWhiteBalance(int top)
+{
+    const libraw_image_sizes_t &s = imgdata.sizes;
+    const unsigned *greybox = imgdata.params.greybox;
+    const unsigned filters = imgdata.idata.filters;
+    const int shrink = libraw_internal_data.internal_output_params.shrink;
+    // 与 scale_colors 相同的无符号运算（greybox 默认宽高为 UINT_MAX）
+    const int bottom = (int)std::min<unsigned>(greybox[1] + greybox[3], bandFullSizes.height);
+    const int right = (int)std::min<unsigned>(greybox[0] + greybox[2], s.width);
+    const int bandBottom = std::min(bottom, top + (int)s.height);
+
+    for (int row = std::max<int>(greybox[1], top); row < bandBottom; row += 8)
+        for (int col = greybox[0]; col < right; col += 8)
+        {
+            unsigned sum[8] = {0};
+            unsigned blockMax = 0;
+            for (int y = row; y < row + 8 && y < bottom; y++)
+                for (int x = col; x < col + 8 && x < right; x++)
+                {
+                    const int c = filters >> ((((y - top) << 1 & 14) | (x & 1)) << 1) & 3;
+                    const unsigned val = imgdata.image[((y - top) >> shrink) * s.iwidth + (x >> shrink)][c];
+                    blockMax = std::max(blockMax, val);
+                    sum[c] += val;
+                    sum[c + 4]++;
+                }
+            double *bucket = &bandWBBuckets[(size_t)std::min(blockMax, 65535u) * 8];
+            for (int c = 0; c < 8; c++)
+                bucket[c] += sum[c];
+        }
+}
+
+// 求出的倍率写入 user_mul，之后各段的 scale_colors 使用相同的值
+void LibRawProcessor::pinAutoWhiteBalance()
+{
+    libraw_output_params_t &params = imgdata.params;
+    const int limit = std::min((int)imgdata.color.maximum - 25, 65535);
+    double dsum[8] = {0};
+    for (int m = 0; m <= limit; m++)
+        for (int c = 0; c < 8; c++)
+            dsum[c] += bandWBBuckets[(size_t)m * 8 + c];
+
+    float mul[4];
+    memcpy(mul, params.user_mul[0] ? params.user_mul : imgdata.color.pre_mul, sizeof(mul));
+    for (int c = 0; c < 4; c++)
+        if (dsum[c])
+            mul[c] = (float)(dsum[c + 4] / dsum[c]);
+    memcpy(params.user_mul, mul, sizeof(mul));
+    // 有相机白平衡时 scale_colors 仍然用它覆盖自动白平衡的结果，与整幅处理相同
+    params.use_auto_wb = 0;
+    if (!(imgdata.color.cam_mul[0] > 0.00001f))
+        params.use_camera_wb = 0;
+    bandAutoWB = false;
+}
+
+int LibRawProcessor::processStreamed(BandWriter &writer, int bandRows, StreamedStats &stats, std::string &error,
+                                     const char *filename)
+{
+    memset(&stats, 0, sizeof(stats));
+    if (!(imgdata.progress_flags & LIBRAW_PROGRESS_IDENTIFY))
+        return LIBRAW_OUT_OF_ORDER_CALL;
+    StageTimer timer(METRIC_STAGE_STREAM);
+    if (const char *reason = streamUnsupported())
+    {
+        error = reason;
+        return LIBRAW_NOT_IMPLEMENTED;
+    }
+    bandRows = std::max(BAND_ALIGN, (bandRows + BAND_ALIGN - 1) / BAND_ALIGN * BAND_ALIGN);
+
+    // raw 来源：还没有解包时，可以按行定位且没有遮蔽区的格式按段从文件解码，其他格式先完整解包
+    const unsigned savedFlags = imgdata.progress_flags;
+    bandRowDecode = false;
+    if (!(imgdata.progress_flags & LIBRAW_PROGRESS_LOAD_RAW))
+    {
+        if (canSubsample() && !hasMaskedAreas(imgdata.sizes))
+        {
+            subsampleDecoder = subsampleRowDecoder();
+            bandRowDecode = subsampleDecoder != SUBSAMPLE_DECODER_NONE;
+        }
+        if (bandRowDecode)
+        {
+            // 与 unpack 结束时相同：公共黑电平并入 black，保存 raw2image_start 每段恢复的数据
+            if (!imgdata.sizes.raw_pitch)
+                imgdata.sizes.raw_pitch = imgdata.sizes.raw_width * 2;
+            unsigned common = imgdata.color.cblack[0];
+            for (int c = 1; c < 4; c++)
+                common = std::min(common, imgdata.color.cblack[c]);
+            for (int c = 0; c < 4; c++)
+                imgdata.color.cblack[c] -= common;
+            imgdata.color.black += common;
+            memmove(&imgdata.rawdata.color, &imgdata.color, sizeof(imgdata.color));
+            memmove(&imgdata.rawdata.sizes, &imgdata.sizes, sizeof(imgdata.sizes));
+            memmove(&imgdata.rawdata.iparams, &imgdata.idata, sizeof(imgdata.idata));
+            memmove(&imgdata.rawdata.ioparams, &libraw_internal_data.internal_output_params,
+                    sizeof(libraw_internal_data.internal_output_params));
+            imgdata.progress_flags |= LIBRAW_PROGRESS_LOAD_RAW;
+        }
+        else
+        {
+            int ret = filename ? unpackShared(filename) : unpack();
+            if (ret != LIBRAW_SUCCESS)
+                return ret;
+        }
+    }
+    const unsigned restoreFlags =
+        (bandRowDecode ? savedFlags : imgdata.progress_flags) &
+        (LIBRAW_PROGRESS_START | LIBRAW_PROGRESS_OPEN | LIBRAW_PROGRESS_IDENTIFY | LIBRAW_PROGRESS_SIZE_ADJUST |
+         LIBRAW_PROGRESS_LOAD_RAW | LIBRAW_PROGRESS_THUMB_LOAD);
+
+    bandFullSizes = imgdata.rawdata.sizes;
+    bandRawBase = imgdata.rawdata.raw_image;
+    bandDataMaximum = 0;
+    const libraw_output_params_t savedParams = imgdata.params;
+    libraw_output_params_t &params = imgdata.params;
+    bool phaseOne = false;
+    int ret = LIBRAW_SUCCESS;
+    stats.bandRows = bandRows;
+    stats.rowDecoder = bandRowDecode;
+
+    try
+    {
+        // Phase One 的黑电平表和平场校正按整幅 raw 做一次，之后 raw2image_ex 不再重复。
+        // 扣除黑电平写入整幅大小的临时缓冲区，这一路径的峰值是两份 raw 加一个行段
+        if (!bandRowDecode && LibRaw::is_phaseone_compressed() && imgdata.rawdata.raw_alloc)
+        {
+            raw2image_start();
+            phase_one_allocate_tempbuffer();
+            phaseOne = true;
+            ret = phase_one_subtract_black((ushort *)imgdata.rawdata.raw_alloc, imgdata.rawdata.raw_image);
+            if (ret == 0)
+                ret = phase_one_correct();
+            bandRawBase = imgdata.rawdata.raw_image;
+        }
+        bandActive = true;
+
+        const int height = bandFullSizes.height;
+        const libraw_colordata_t &color = imgdata.rawdata.color;
+        libraw_decoder_info_t decoder;
+        get_decoder_info(&decoder);
+        bandAutoWB = !params.no_auto_scale &&
+                     (params.use_auto_wb ||
+                      (params.use_camera_wb &&
+                       (color.cam_mul[0] < -0.5 ||
+                        (color.cam_mul[0] <= 0.00001f &&
+                         !(imgdata.rawparams.options & LIBRAW_RAWOPTIONS_CAMERAWB_FALLBACK_TO_DAYLIGHT)))));
+        const bool globalMaximum =
+            !(decoder.decoder_flags & LIBRAW_DECODER_FIXEDMAXC) && params.adjust_maximum_thr >= 0.00001f;
+        const bool autoBright = !((params.highlight & ~2) || params.no_auto_bright);
+
+        // 第一遍（半尺寸）：整幅图像的 data_maximum 和自动白平衡的块统计
+        if (ret == LIBRAW_SUCCESS && (globalMaximum || bandAutoWB))
+        {
+            params.half_size = 1;
+            if (bandAutoWB)
+                bandWBBuckets.assign((size_t)65536 * 8, 0.0);
+            unsigned dataMaximum = 0;
+            for (int top = 0; top < height; top += bandRows)
+            {
+                ret = prepareBand(top, std::min(height, top + bandRows));
+                if (ret != LIBRAW_SUCCESS)
+                    break;
+                dataMaximum = std::max(dataMaximum, imgdata.color.data_maximum);
+                if (bandAutoWB)
+                    accumulateAutoWhiteBalance(top);
+            }
+            bandDataMaximum = dataMaximum;
+            params.half_size = savedParams.half_size;
+        }
+
+        // 第二遍（半尺寸）：自动亮度的直方图
+        int white = 0x2000;
+        if (ret == LIBRAW_SUCCESS && autoBright)
+        {
+            params.half_size = 1;
+            std::vector<long long> histogram((size_t)4 * LIBRAW_HISTOGRAM_SIZE, 0);
+            long long pixels = 0;
+            for (int top = 0; top < height; top += bandRows)
+            {
+                ret = prepareBand(top, std::min(height, top + bandRows));
+                if (ret != LIBRAW_SUCCESS)
+                    break;
+                processBand();
+                const int *bandHistogram = libraw_internal_data.output_data.histogram[0];
+                for (size_t i = 0; i < histogram.size(); i++)
+                    histogram[i] += bandHistogram[i];
+                pixels += (long long)imgdata.sizes.width * imgdata.sizes.height;
+            }
+            // 与 dcraw_make_mem_image 相同：每个通道从高到低累计超过 auto_bright_thr 的位置
+            const int perc = (int)(pixels * params.auto_bright_thr);
+            white = 0;
+            for (int c = 0; c < imgdata.idata.colors; c++)
+            {
+                int val;
+                long long total = 0;
+                for (val = 0x2000; --val > 32;)
+                    if ((total += histogram[(size_t)c * LIBRAW_HISTOGRAM_SIZE + val]) > perc)
+                        break;
+                white = std::max(white, val);
+            }
+            // 半尺寸输出时直方图与 processImage() 相同，除非中值滤波或零值修补在段边界处缺少邻域
+            stats.whiteEstimated = !savedParams.half_size || savedParams.med_passes > 0 ||
+                                   imgdata.rawdata.ioparams.zero_is_bad;
+            params.half_size = savedParams.half_size;
+        }
+
+        // 第三遍：每段连同邻域处理，去掉邻域后写出
+        if (ret == LIBRAW_SUCCESS)
+        {
+            // 去马赛克的邻域不超过 16 行（DCB 的多轮修正另加 32 行，每次迭代 16 行），中值滤波每遍 2 行
+            int reach = 2 * std::max(0, savedParams.med_passes);
+            if (savedParams.user_qual == 4)
+                reach += 32 + 16 * std::max(0, savedParams.dcb_iterations);
+            const int halo = BAND_ALIGN + (reach + BAND_ALIGN - 1) / BAND_ALIGN * BAND_ALIGN;
+            const int shrink = savedParams.half_size ? 1 : 0;
+
+            raw2image_start();
+            gamma_curve(params.gamm[0], params.gamm[1], 2, (int)((white << 3) / params.bright));
+            const std::vector<ushort> curve(imgdata.color.curve, imgdata.color.curve + 0x10000);
+            const int outWidth = (bandFullSizes.width + shrink) >> shrink;
+            const int outHeight = (height + shrink) >> shrink;
+            const int bits = writer.bits(params.output_bps);
+            const size_t rowBytes = (size_t)outWidth * 3 * (bits / 8);
+            std::vector<uchar> out(rowBytes * (bandRows >> shrink));
+
+            stats.width = outWidth;
+            stats.height = outHeight;
+            stats.haloRows = halo;
+            if (!writer.begin(outWidth, outHeight, bits, imgdata.sizes.flip, error))
+                ret = LIBRAW_IO_ERROR;
+
+            for (int top = 0; top < height && ret == LIBRAW_SUCCESS; top += bandRows)
+            {
+                const int bottom = std::min(height, top + bandRows);
+                const int first = std::max(0, top - halo);
+                ret = prepareBand(first, std::min(height, bottom + halo));
+                if (ret != LIBRAW_SUCCESS)
+                    break;
+                processBand();
+
+                const int skip = (top - first) >> shrink;
+                const int rows = ((bottom - first + shrink) >> shrink) - skip;
+                const int width = imgdata.sizes.width;
+                for (int row = 0; row < rows; row++)
+                {
+                    const ushort(*src)[4] = imgdata.image + (size_t)(skip + row) * width;
+                    uchar *dst = out.data() + (size_t)row * rowBytes;
+                    for (int col = 0; col < width; col++)
+                        for (int c = 0; c < 3; c++)
+                        {
+                            const ushort v = curve[src[col][c]];
+                            if (bits == 8)
+                                dst[col * 3 + c] = (uchar)(v >> 8);
+                            else
+                                ((ushort *)dst)[col * 3 + c] = v;
+                        }
+                }
+                stats.bandBytes = std::max(stats.bandBytes, (size_t)imgdata.sizes.iwidth * imgdata.sizes.iheight *
+                                                                    sizeof(*imgdata.image) +
+                                                                bandRaw.size() * sizeof(ushort) + out.size());
+                stats.bands++;
+                if (!writer.writeRows(out.data(), rows, error))
+                    ret = LIBRAW_IO_ERROR;
+            }
+            if (ret == LIBRAW_SUCCESS && !writer.finish(error))
+                ret = LIBRAW_IO_ERROR;
+            stats.bytesWritten = writer.bytesWritten();
+        }
+    }
+    catch (const std::bad_alloc &)
+    {
+        ret = LIBRAW_UNSUFFICIENT_MEMORY;
+    }
+    catch (const LibRaw_exceptions &err)
+    {
+        if (err == LIBRAW_EXCEPTION_CANCELLED_BY_CALLBACK)
+            ret = LIBRAW_CANCELLED_BY_CALLBACK;
+        else if (err == LIBRAW_EXCEPTION_ALLOC)
+            ret = LIBRAW_UNSUFFICIENT_MEMORY;
+        else
+            ret = LIBRAW_DATA_ERROR;
+    }
+
+    // 恢复解包后（或 open 之后）的状态：参数、完整尺寸、raw 缓冲区，释放段图像
+    bandActive = false;
+    bandAutoWB = false;
+    imgdata.params = savedParams;
+    imgdata.rawdata.sizes = bandFullSizes;
+    imgdata.rawdata.raw_image = bandRowDecode ? nullptr : bandRawBase;
+    if (phaseOne)
+        phase_one_free_tempbuffer();
+    if (imgdata.image)
+    {
+        free(imgdata.image);
+        imgdata.image = nullptr;
+    }
+    std::vector<ushort>().swap(bandRaw);
+    std::vector<double>().swap(bandWBBuckets);
+    imgdata.progress_flags = restoreFlags;
+    raw2image_start();
+    if (ret == LIBRAW_SUCCESS)
+        timer.done((uint64_t)stats.width * stats.height);
+    syncMemoryMetrics();
+    return ret;
+}
+
+// ============== 浮点 DNG ==============
+// 预编译的 LibRaw 以 --disable-zlib 构建，deflate 压缩的浮点 DNG（HDR 合并、编辑软件导出的线性 DNG）无法解码，
+// 未压缩的浮点 DNG 也是逐行串行转换。unpack 期间把这两个解码器换成 fpDngLoadRaw：文件数据按分块（未压缩时
+// 每 64 行一段）在锁内串行读取，解压、预测器还原和浮点换算在多个线程中进行。分块布局、最大值和输出字段与
+// LibRaw 的 fp_dng.cpp 相同
+
+namespace
+{
+    const unsigned FP_DNG_ROWS = 64;
+
+    // 一个解码任务：分块 tile 中从 row 开始的 rows 行，分块左上角位于 (x, y)
+    struct FpDngTask
+    {
+        unsigned tile;
+        unsigned x, y;
+        unsigned row, rows;
+    };
+}
+
+int LibRawProcessor::unpack()
+{
+    StageTimer timer(METRIC_STAGE_UNPACK);
+    replacedDecoder = nullptr;
+    libraw_decoder_info_t decoder;
+    if ((imgdata.progress_flags & LIBRAW_PROGRESS_IDENTIFY) && load_raw &&
+        LibRaw::get_decoder_info(&decoder) == LIBRAW_SUCCESS && decoder.decoder_name)
+    {
+        // 解码器函数只在 LibRaw 自身编译时声明，按名称判断
+        const char *name = decoder.decoder_name;
+        void (LibRawProcessor::*replacement)() = nullptr;
+        const bool deflate = !strcmp(name, "deflate_dng_load_raw()");
+        if (deflate || !strcmp(name, "uncompressed_fp_dng_load_raw()"))
+            replacement = &LibRawProcessor::fpDngLoadRaw;
+        else if (!strcmp(name, "pentax_4shot_load_raw()") && fourShotFrames.size() == 4)
+            replacement = &LibRawProcessor::pentaxFourShotLoadRaw;
+        else if (!strcmp(name, "sinar_4shot_load_raw()") && imgdata.rawparams.shot_select == 0)
+            replacement = &LibRawProcessor::sinarFourShotLoadRaw;
+        else if (!strcmp(name, "sony_arq_load_raw()"))
+            replacement = &LibRawProcessor::sonyArqLoadRaw;
+        if (replacement)
+        {
+            replacedDecoder = load_raw;
+            fpDngDeflate = deflate;
+            load_raw = static_cast<void (LibRaw::*)()>(replacement);
+        }
+    }
+    int ret = LibRaw::unpack();
+    if (replacedDecoder)
+        load_raw = replacedDecoder;
+    replacedDecoder = nullptr;
+    if (ret == LIBRAW_SUCCESS)
+        timer.done((uint64_t)imgdata.sizes.raw_width * imgdata.sizes.raw_height);
+    syncMemoryMetrics();
+    return ret;
+}
+
+int LibRawProcessor::open_datastream(LibRaw_abstract_datastream *stream)
+{
+    int ret = LibRaw::open_datastream(stream);
+    libraw_decoder_info_t decoder;
+    if (ret == LIBRAW_SUCCESS && countOpens && LibRaw::get_decoder_info(&decoder) == LIBRAW_SUCCESS)
+        Metrics::instance().recordOpen(decoder.decoder_name, (uint64_t)std::max<INT64>(0, stream->size()));
+    // 打开前 LibRaw 释放了上一个文件的缓冲区
+    syncMemoryMetrics();
+    return ret;
+}
+
+int LibRawProcessor::get_decoder_info(libraw_decoder_info_t *d_info)
+{
+    if (!replacedDecoder)
+        return LibRaw::get_decoder_info(d_info);
+    void (LibRaw::*current)() = load_raw;
+    load_raw = replacedDecoder;
+    int ret = LibRaw::get_decoder_info(d_info);
+    load_raw = current;
+    return ret;
+}
+
+void LibRawProcessor::fpDngLoadRaw()
+{
+    const libraw_image_sizes_t &S = imgdata.sizes;
+    const auto &unpacker = libraw_internal_data.unpacker_data;
+    LibRaw_abstract_datastream *input = libraw_internal_data.internal_data.input;
+
+    // find_ifd_by_offset
+    int iifd = -1;
+    for (unsigned i = 0; i < libraw_internal_data.identify_data.tiff_nifds && i < LIBRAW_IFD_MAXCOUNT; i++)
+        if (tiff_ifd[i].offset == unpacker.data_offset)
+        {
+            iifd = (int)i;
+            break;
+        }
+    if (iifd < 0)
+        throw LIBRAW_EXCEPTION_DECODE_RAW;
+    const tiff_ifd_t *ifd = &tiff_ifd[iifd];
+    const int samples = ifd->samples;
+    if (samples != 1 && samples != 3 && samples != 4)
+        throw LIBRAW_EXCEPTION_DECODE_RAW;
+    if ((imgdata.idata.filters && samples > 1) || (int)unpacker.tiff_samples != samples)
+        throw LIBRAW_EXCEPTION_DECODE_RAW;
+    if (ifd->sample_format != 3)
+        throw LIBRAW_EXCEPTION_DECODE_RAW; // 与 LibRaw 一样只支持浮点
+    const int bytesps = fpDngDeflate ? ifd->bps >> 3 : (ifd->bps + 7) >> 3;
+    if (bytesps < 2 || bytesps > 4)
+    {
+        // LibRaw 对 1 字节的未压缩样本不做换算，交给原来的解码器；deflate 时同样报错
+        (this->*replacedDecoder)();
+        return;
+    }
+
+    // tile_stripe_data_t::init：分块时偏移表位于当前位置，长度表位于 ifd->bytes
+    const bool tiled = unpacker.tile_width <= S.raw_width && unpacker.tile_length <= S.raw_height;
+    const bool striped = ifd->rows_per_strip > 0 && ifd->rows_per_strip < S.raw_height && ifd->strip_byte_counts_count > 0;
+    const unsigned tileWidth = tiled ? unpacker.tile_width : S.raw_width;
+    const unsigned tileHeight = tiled ? unpacker.tile_length : (striped ? ifd->rows_per_strip : S.raw_height);
+    if (!tileWidth || !tileHeight)
+        throw LIBRAW_EXCEPTION_DECODE_RAW;
+    const unsigned tilesH = tiled ? (S.raw_width + tileWidth - 1) / tileWidth : 1;
+    const unsigned tilesV = tiled ? (S.raw_height + tileHeight - 1) / tileHeight
+                                  : (striped ? (S.raw_height + ifd->rows_per_strip - 1) / ifd->rows_per_strip : 1);
+    const uint64_t tileCount = (uint64_t)tilesH * tilesV;
+    if (tileCount < 1 || tileCount > 1000000)
+        throw LIBRAW_EXCEPTION_DECODE_RAW;
+
+    std::vector<INT64> offsets(tileCount, 0);
+    std::vector<size_t> lengths(tileCount, 0);
+    if (tiled)
+        for (auto &offset : offsets)
+            offset = get4();
+    else if (striped)
+        for (unsigned t = 0; t < tileCount && (int)t < ifd->strip_offsets_count; t++)
+            offsets[t] = ifd->strip_offsets[t];
+    else
+        offsets[0] = ifd->offset;
+    size_t maxLength = 0;
+    if (tileCount == 1 || (!tiled && !striped))
+        lengths[0] = maxLength = ifd->bytes;
+    else if (tiled)
+    {
+        input->seek(ifd->bytes, SEEK_SET);
+        for (auto &length : lengths)
+            maxLength = std::max(maxLength, length = get4());
+    }
+    else
+        for (unsigned t = 0; t < tileCount && (int)t < ifd->strip_byte_counts_count; t++)
+            maxLength = std::max(maxLength, lengths[t] = ifd->strip_byte_counts[t]);
+
+    const INT64 memoryLimit = INT64(imgdata.rawparams.max_raw_memory_mb) * INT64(1024 * 1024);
+    const size_t allocCount = (size_t)tileCount * tileWidth * tileHeight * samples;
+    if (INT64(allocCount * sizeof(float)) > memoryLimit || (fpDngDeflate && INT64(maxLength) > memoryLimit))
+        throw LIBRAW_EXCEPTION_TOOBIG;
+
+    // deflate 的预测器：34894、34895 按 2、4 个样本一组做字节差分，其他值（含 3）逐个样本。
+    // 分块宽度不是组大小的倍数时（规范不允许）末尾不足一组的列为 0，LibRaw 在这里读到的是缓冲区中的残留数据
+    const int xFactor = ifd->predictor == 34894 ? 2 : (ifd->predictor == 34895 ? 4 : 1);
+    const size_t rowValues = fpDngDeflate ? (size_t)(tileWidth / xFactor) * xFactor * samples : (size_t)tileWidth * samples;
+    const size_t inRowBytes = (size_t)tileWidth * samples * bytesps;
+    const bool bigEndian = unpacker.order == 0x4d4d;
+
+    // deflate 的分块必须整块解压；未压缩的分块按行连续存放，可以按段读取
+    std::vector<FpDngTask> tasks;
+    for (unsigned ty = 0, t = 0; ty < tilesV; ty++)
+        for (unsigned tx = 0; tx < tilesH; tx++, t++)
+        {
+            const unsigned y = ty * tileHeight;
+            const unsigned x = tx * tileWidth;
+            if (y >= S.raw_height || x >= S.raw_width)
+                continue;
+            const unsigned rows = std::min(tileHeight, (unsigned)S.raw_height - y);
+            const unsigned step = fpDngDeflate ? rows : FP_DNG_ROWS;
+            for (unsigned row = 0; row < rows; row += step)
+                tasks.push_back({t, x, y, row, std::min(step, rows - row)});
+        }
+
+    float *floatImage = (float *)calloc(allocCount, sizeof(float));
+    if (!floatImage)
+        throw LIBRAW_EXCEPTION_ALLOC;
+    std::mutex inputMutex;
+    std::atomic<unsigned> next(0);
+    // 工作线程不能抛出异常，记录第一个错误，全部结束后再抛出
+    std::atomic<int> failure(LIBRAW_EXCEPTION_NONE);
+    const int threads = std::max(1, std::min({8, (int)std::thread::hardware_concurrency(), (int)tasks.size()}));
+    std::vector<float> threadMax(threads, 0.f);
+
+    auto decode = [&](int index) {
+        std::vector<unsigned char> compressed;
+        std::vector<unsigned char> data(fpDngDeflate ? (size_t)tileWidth * tileHeight * samples * sizeof(float)
+                                                     : inRowBytes * FP_DNG_ROWS);
+        std::vector<float> rowBuffer(rowValues);
+        float max = 0.f;
+        for (unsigned i = next++; i < tasks.size() && failure == LIBRAW_EXCEPTION_NONE && !deadlineExpired.load();
+             i = next++)
+        {
+            const FpDngTask &task = tasks[i];
+            const size_t cols = std::min(tileWidth, (unsigned)S.raw_width - task.x);
+
+            // 只有读取文件需要串行
+            size_t got;
+            {
+                std::lock_guard<std::mutex> lock(inputMutex);
+                if (fpDngDeflate)
+                {
+                    compressed.resize(lengths[task.tile]);
+                    input->seek(offsets[task.tile], SEEK_SET);
+                    got = input->read(compressed.data(), 1, compressed.size());
+                }
+                else
+                {
+                    input->seek(offsets[task.tile] + (INT64)task.row * inRowBytes, SEEK_SET);
+                    got = input->read(data.data(), 1, inRowBytes * task.rows);
+                }
+            }
+
+            if (fpDngDeflate)
+            {
+                uLongf length = (uLongf)data.size();
+                if (uncompress(data.data(), &length, compressed.data(), (uLong)got) != Z_OK)
+                {
+                    failure = LIBRAW_EXCEPTION_DECODE_RAW;
+                    break;
+                }
+            }
+            else if (got < inRowBytes * task.rows)
+                memset(data.data() + got, 0, inRowBytes * task.rows - got);
+
+            for (unsigned r = 0; r < task.rows; r++)
+            {
+                unsigned char *src = data.data() + r * inRowBytes;
+                float *dst = floatImage + ((size_t)(task.y + task.row + r) * S.raw_width + task.x) * samples;
+                // 最后一列分块的多余列先写入行缓冲区，最大值与 LibRaw 一样包含这些列
+                float *out = cols * samples < rowValues ? rowBuffer.data() : dst;
+                float lmax;
+                if (fpDngDeflate)
+                {
+                    simdUndoByteDelta(src, rowValues * bytesps, samples * xFactor);
+                    lmax = simdMergeFloatPlanes(src, rowValues, bytesps, out);
+                }
+                else
+                    lmax = simdExpandFloats(src, rowValues, bytesps, bigEndian, out);
+                if (out != dst)
+                    memcpy(dst, out, cols * samples * sizeof(float));
+                max = std::max(max, lmax);
+            }
+        }
+        threadMax[index] = max;
+    };
+    auto worker = [&](int index) {
+        try
+        {
+            decode(index);
+        }
+        catch (const std::bad_alloc &)
+        {
+            failure = LIBRAW_EXCEPTION_ALLOC;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (int t = 1; t < threads; t++)
+        workers.emplace_back(worker, t);
+    worker(0);
+    for (std::thread &t : workers)
+        t.join();
+
+    if (failure != LIBRAW_EXCEPTION_NONE || deadlineExpired.load())
+    {
+        free(floatImage);
+        if (failure != LIBRAW_EXCEPTION_NONE)
+            throw (LibRaw_exceptions)failure.load();
+        throw LIBRAW_EXCEPTION_CANCELLED_BY_CALLBACK;
+    }
+
+    // 最大值忽略 NaN，与分块顺序无关。LibRaw 的 MAX 宏遇到 NaN 会从下一个值重新开始，
+    // 含 NaN 的 32 位文件的 fmaximum 因此可能比 LibRaw 的大
+    float max = 0.f;
+    for (float value : threadMax)
+        max = std::max(max, value);
+    imgdata.color.fmaximum = max;
+
+    imgdata.rawdata.raw_alloc = floatImage;
+    if (samples == 1)
+        imgdata.rawdata.float_image = floatImage;
+    else if (samples == 3)
+        imgdata.rawdata.float3_image = (float(*)[3])floatImage;
+    else
+        imgdata.rawdata.float4_image = (float(*)[4])floatImage;
+    imgdata.rawdata.sizes.raw_pitch = imgdata.sizes.raw_pitch = S.raw_width * samples * sizeof(float);
+
+    if (imgdata.rawparams.options & LIBRAW_RAWOPTIONS_CONVERTFLOAT_TO_INT)
+        convertFloatToInt();
+}
+
+void LibRawProcessor::convertFloatToInt(float dmin, float dmax, float dtarget)
+{
+    int samples = 0;
+    float *data = nullptr;
+    void *oldAlloc = imgdata.rawdata.raw_alloc;
+    if (imgdata.rawdata.float_image)
+        samples = 1, data = imgdata.rawdata.float_image;
+    else if (imgdata.rawdata.float3_image)
+        samples = 3, data = (float *)imgdata.rawdata.float3_image;
+    else if (imgdata.rawdata.float4_image)
+        samples = 4, data = (float *)imgdata.rawdata.float4_image;
+    else
+        return;
+
+    // 与 LibRaw 相同：按 tiff_samples 分配，数据范围超出 [dmin, dmax] 时缩放到 dtarget 并同步黑电平
+    const size_t count = (size_t)imgdata.sizes.raw_height * imgdata.sizes.raw_width *
+                         libraw_internal_data.unpacker_data.tiff_samples;
+    ushort *converted = (ushort *)malloc(count * sizeof(ushort));
+    if (!converted)
+        return; // 也会从 unpack 之外调用，不能抛出；保留浮点数据
+    float tmax = std::max((float)imgdata.color.maximum, 1.f);
+    tmax = std::max(tmax, imgdata.color.fmaximum);
+    tmax = std::max(tmax, 1.f);
+
+    float multip = 1.f;
+    if (tmax < dmin || tmax > dmax)
+    {
+        imgdata.rawdata.color.fnorm = imgdata.color.fnorm = multip = dtarget / tmax;
+        imgdata.rawdata.color.maximum = imgdata.color.maximum = dtarget;
+        imgdata.rawdata.color.black = imgdata.color.black = (float)imgdata.color.black * multip;
+        for (int i = 0; i < int(sizeof(imgdata.color.cblack) / sizeof(imgdata.color.cblack[0])); i++)
+            if (i != 4 && i != 5)
+                imgdata.rawdata.color.cblack[i] = imgdata.color.cblack[i] = (float)imgdata.color.cblack[i] * multip;
+    }
+    else
+        imgdata.rawdata.color.fnorm = imgdata.color.fnorm = 0.f;
+
+    forEachRowBand(imgdata.sizes.raw_height, std::max(1, std::min(8, (int)std::thread::hardware_concurrency())),
+                   [&](int begin, int end, int) {
+                       const size_t rowSamples = count / imgdata.sizes.raw_height;
+                       simdFloatToUshort(data + begin * rowSamples, (size_t)(end - begin) * rowSamples, multip,
+                                         converted + begin * rowSamples);
+                   });
+
+    imgdata.rawdata.raw_alloc = converted;
+    if (samples == 1)
+        imgdata.rawdata.raw_image = converted;
+    else if (samples == 3)
+        imgdata.rawdata.color3_image = (ushort(*)[3])converted;
+    else
+        imgdata.rawdata.color4_image = (ushort(*)[4])converted;
+    imgdata.rawdata.sizes.raw_pitch = imgdata.sizes.raw_pitch = imgdata.sizes.raw_width * samples * sizeof(ushort);
+    if (oldAlloc)
+        free(oldAlloc);
+    imgdata.rawdata.float_image = nullptr;
+    imgdata.rawdata.float3_image = nullptr;
+    imgdata.rawdata.float4_image = nullptr;
+}
+
+// ============== 多帧 ==============
+// LibRaw 每次只解码 shot_select 选择的一帧，逐帧处理时每一帧都要重新打开和解码。这里由工作线程
+// 各自持有一个实例和数据流并行解码。帧选择的 IFD、黑电平和 CFA 排列在 identify 中随 shot_select
+// 确定，因此每个工作实例仍执行自己的 identify（与解码相比可以忽略）
+
+static bool hostLittleEndian()
+{
+    const ushort probe = 1;
+    return *(const uchar *)&probe == 1;
+}
+
+// 像素偏移各帧解码时使用的 CFA 排列（pentax_4shot_load_raw 中的 filters = 0xb4b4b4b4）
+static int pentaxShotColor(int row, int col)
+{
+    return 0xb4b4b4b4u >> ((((row << 1) & 14) | (col & 1)) << 1) & 3;
+}
+
+int LibRawProcessor::decodeFrame(LibRawProcessor &worker, const FrameSource &source, int shot,
+                                 std::shared_ptr<const RawSnapshot> &frame, INT64 &dataOffset)
+{
+    worker.recycle();
+    worker.imgdata.rawparams.shot_select = shot;
+    int ret = source.filename ? worker.open_file(source.filename) : worker.open_buffer(source.buffer, source.size);
+    if (ret == LIBRAW_SUCCESS)
+        ret = worker.unpack();
+    if (ret != LIBRAW_SUCCESS)
+        return ret;
+    frame = worker.copyRaw();
+    dataOffset = worker.libraw_internal_data.unpacker_data.data_offset;
+    return frame ? LIBRAW_SUCCESS : LIBRAW_NOT_IMPLEMENTED;
+}
+
+int LibRawProcessor::unpackAllFrames(const FrameSource &source, std::vector<std::shared_ptr<const RawSnapshot>> &frames,
+                                     int &combinedFrame)
+{
+    frames.clear();
+    combinedFrame = -1;
+    if (!(imgdata.progress_flags & LIBRAW_PROGRESS_IDENTIFY) || (imgdata.progress_flags & LIBRAW_PROGRESS_LOAD_RAW))
+        return LIBRAW_OUT_OF_ORDER_CALL;
+    if (!source.filename && !source.buffer)
+        return LIBRAW_INPUT_CLOSED;
+
+    libraw_decoder_info_t decoder;
+    memset(&decoder, 0, sizeof(decoder));
+    get_decoder_info(&decoder);
+    const char *name = decoder.decoder_name ? decoder.decoder_name : "";
+    // 以 PENTAX_PS_ALLFRAMES 打开的像素偏移文件 raw_count 为 1，四帧都由工作线程解码
+    const bool pentaxShift = !strcmp(name, "pentax_4shot_load_raw()");
+    const int count = pentaxShift ? 4 : std::max(1, (int)imgdata.idata.raw_count);
+    int own = pentaxShift ? -1 : (int)imgdata.rawparams.shot_select;
+    if (own >= count)
+        return LIBRAW_REQUEST_FOR_NONEXISTENT_IMAGE;
+
+    std::vector<int> shots;
+    for (int shot = 0; shot < count; shot++)
+        if (shot != own)
+            shots.push_back(shot);
+    std::vector<std::shared_ptr<const RawSnapshot>> decoded(count);
+    std::vector<INT64> offsets(count, 0);
+
+    // 工作实例在启动线程之前复制参数：当前实例解码期间会临时修改 rawparams（DNG 的 shot_select）
+    const int threads = std::max(0, std::min(std::min(8, (int)std::thread::hardware_concurrency()), (int)shots.size()));
+    std::vector<std::unique_ptr<LibRawProcessor>> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        LibRawProcessor *worker = new (std::nothrow) LibRawProcessor();
+        if (!worker)
+            return LIBRAW_UNSUFFICIENT_MEMORY;
+        workers.emplace_back(worker);
+        worker->imgdata.params = imgdata.params;
+        worker->imgdata.rawparams = imgdata.rawparams;
+        worker->imgdata.rawparams.options &= ~LIBRAW_RAWOPTIONS_PENTAX_PS_ALLFRAMES;
+        worker->setPriority(priorityLane);
+        worker->countOpens = false;
+        if (deadlineId)
+            worker->armDeadline(deadlineAt);
+    }
+
+    std::atomic<size_t> next(0);
+    std::atomic<int> failure(LIBRAW_SUCCESS);
+    std::atomic<bool> expired(false);
+    auto work = [&](LibRawProcessor *worker) {
+        size_t i;
+        while (failure.load() == LIBRAW_SUCCESS && (i = next++) < shots.size())
+        {
+            const int shot = shots[i];
+            const int ret = decodeFrame(*worker, source, shot, decoded[shot], offsets[shot]);
+            if (ret == LIBRAW_SUCCESS)
+                continue;
+            if (worker->deadlineExceeded())
+                expired = true;
+            int expected = LIBRAW_SUCCESS;
+            failure.compare_exchange_strong(expected, ret);
+        }
+    };
+    std::vector<std::thread> running;
+    running.reserve(threads);
+    for (int t = 0; t < threads; t++)
+        running.emplace_back(work, workers[t].get());
+
+    // 普通文件由当前实例同时解码自己的一帧
+    int ret = LIBRAW_SUCCESS;
+    if (!pentaxShift)
+        ret = unpack();
+    for (std::thread &thread : running)
+        thread.join();
+    workers.clear();
+
+    if (expired)
+    {
+        deadlineExpired = true;
+        return LIBRAW_CANCELLED_BY_CALLBACK;
+    }
+    if (ret == LIBRAW_SUCCESS)
+        ret = failure.load();
+    if (ret != LIBRAW_SUCCESS)
+        return ret;
+
+    if (pentaxShift)
+    {
+        // 合并解码器按 IFD 顺序取用并行解码的四帧，偏移不一致时回退到 LibRaw 逐帧重新解码
+        fourShotFrames = decoded;
+        fourShotOffsets = offsets;
+        ret = unpack();
+        fourShotFrames.clear();
+        fourShotOffsets.clear();
+        if (ret != LIBRAW_SUCCESS)
+            return ret;
+        decoded.push_back(nullptr);
+        own = count;
+        combinedFrame = count;
+    }
+    else if (!strcmp(name, "sinar_4shot_load_raw()") && own == 0)
+        combinedFrame = 0;
+
+    decoded[own] = copyRaw();
+    if (!decoded[own])
+    {
+        combinedFrame = -1;
+        return LIBRAW_NOT_IMPLEMENTED;
+    }
+    frames.swap(decoded);
+    return LIBRAW_SUCCESS;
+}
+
+int LibRawProcessor::selectFrame(const RawSnapshot &frame)
+{
+    if (!(imgdata.progress_flags & LIBRAW_PROGRESS_IDENTIFY))
+        return LIBRAW_OUT_OF_ORDER_CALL;
+    // 回到 identify 之后的状态，restoreRaw 释放当前的 raw 缓冲区和处理结果
+    imgdata.progress_flags &= LIBRAW_PROGRESS_LOAD_RAW - 1;
+    invalidateRenderCache();
+    return restoreRaw(frame);
+}
+
+void LibRawProcessor::pentaxFourShotLoadRaw()
+{
+    const libraw_image_sizes_t &S = imgdata.sizes;
+
+    // 与 pentax_4shot_load_raw 相同的移动量和帧选择：按 IFD 顺序取尺寸与 raw 相同、多于 8 位的单通道帧
+    static const int defaultMove[4][2] = {{1, 1}, {0, 1}, {0, 0}, {1, 0}};
+    int move[4][2];
+    bool usable = true;
+    int found = 0;
+    for (int tidx = 0; found < 4; tidx++, found++)
+    {
+        const char order = imgdata.rawparams.p4shot_order[found];
+        move[found][0] = order >= '0' && order <= '3' ? ((order - '0') & 2 ? 1 : 0) : defaultMove[found][0];
+        move[found][1] = order >= '0' && order <= '3' ? ((order - '0') & 1 ? 1 : 0) : defaultMove[found][1];
+        for (; tidx < 16; tidx++)
+            if (tiff_ifd[tidx].t_width == S.raw_width && tiff_ifd[tidx].t_height == S.raw_height &&
+                tiff_ifd[tidx].bps > 8 && tiff_ifd[tidx].samples == 1)
+                break;
+        if (tidx >= 16)
+            break;
+        const RawSnapshot &frame = *fourShotFrames[found];
+        if (tiff_ifd[tidx].offset != fourShotOffsets[found] || frame.layout != 0 ||
+            frame.sizes.raw_width != S.raw_width || frame.sizes.raw_height != S.raw_height ||
+            frame.sizes.raw_pitch != S.raw_width * 2u || frame.data.size() < (size_t)S.raw_width * S.raw_height * 2)
+            usable = false;
+    }
+    if (found < 4 || !usable)
+    {
+        (this->*replacedDecoder)();
+        return;
+    }
+
+    ushort(*result)[4] = (ushort(*)[4])calloc((size_t)S.raw_width * (S.raw_height + 16), sizeof(*result));
+    if (!result)
+        throw LIBRAW_EXCEPTION_ALLOC;
+    const ushort *planes[4];
+    for (int f = 0; f < 4; f++)
+        planes[f] = (const ushort *)fourShotFrames[f]->data.data();
+
+    // 帧 f 的 (r, c) 落在 (r + move[f][0], c + move[f][1])。从输出的第 1 列开始对齐，各帧的
+    // 指针都不会早于行首；第 0 列只有不向右移动的帧覆盖
+    checkCancel();
+    const unsigned width = S.raw_width;
+    forEachRowBand(S.raw_height, std::max(1, std::min(8, (int)std::thread::hardware_concurrency())),
+                   [&](int begin, int end, int) {
+                       for (int row = begin; row < end; row++)
+                       {
+                           ushort(*out)[4] = result + (size_t)row * width;
+                           const ushort *frames[4];
+                           int channel[4][2];
+                           for (int f = 0; f < 4; f++)
+                           {
+                               const int r = row - move[f][0];
+                               if (r < 0)
+                               {
+                                   frames[f] = nullptr;
+                                   continue;
+                               }
+                               const ushort *line = planes[f] + (size_t)r * width;
+                               if (move[f][1] == 0)
+                                   out[0][pentaxShotColor(r, 0)] = line[0];
+                               frames[f] = line + 1 - move[f][1];
+                               // 局部第 p 列是输出的第 p + 1 列、帧内的第 p + 1 - move 列
+                               for (int p = 0; p < 2; p++)
+                                   channel[f][p] = pentaxShotColor(r, p + 1 - move[f][1]);
+                           }
+                           if (width > 1)
+                               simdCombineFourShot(frames, channel, 0, width - 1, out + 1);
+                       }
+                   });
+
+    imgdata.idata.filters = 0xb4b4b4b4;
+    if (imgdata.color.cblack[4] == 2 && imgdata.color.cblack[5] == 2)
+        for (int c = 0; c < 4; c++)
+            imgdata.color.cblack[FC(c / 2, c % 2)] +=
+                imgdata.color.cblack[6 + c / 2 % imgdata.color.cblack[4] * imgdata.color.cblack[5] +
+                                     c % 2 % imgdata.color.cblack[5]];
+    imgdata.color.cblack[4] = imgdata.color.cblack[5] = 0;
+
+    libraw_internal_data.unpacker_data.data_offset = fourShotOffsets[3];
+    imgdata.sizes.raw_pitch = S.raw_width * 8;
+    imgdata.idata.filters = 0;
+    imgdata.rawdata.raw_alloc = imgdata.rawdata.color4_image = result;
+    imgdata.rawdata.raw_image = nullptr;
+}
+
+void LibRawProcessor::sinarFourShotLoadRaw()
+{
+    const libraw_image_sizes_t &S = imgdata.sizes;
+    const auto &unpacker = libraw_internal_data.unpacker_data;
+    LibRaw_abstract_datastream *input = libraw_internal_data.internal_data.input;
+    if (!imgdata.image)
+        throw LIBRAW_EXCEPTION_IO_CORRUPT;
+
+    INT64 offsets[4];
+    for (int shot = 0; shot < 4; shot++)
+    {
+        input->seek(unpacker.data_offset + shot * 4, SEEK_SET);
+        offsets[shot] = get4();
+    }
+
+    // 第 shot 次拍摄的 raw (row, col) 写入 (row - top - dy, col - left - dx)，dy、dx 为 shot 的第 1、0 位，
+    // 通道由 raw 坐标的奇偶决定，四次拍摄在同一输出像素上各占一个通道。按输出行段并行，
+    // 每段分批读取四次拍摄中对应的行（数据流共享，读取时加锁）
+    const unsigned rawWidth = S.raw_width;
+    const size_t rowBytes = (size_t)rawWidth * 2;
+    const bool swap = (unpacker.order == 0x4949) != hostLittleEndian();
+    const int batch = 32;
+    std::mutex inputMutex;
+    std::atomic<bool> shortRead(false);
+    checkCancel();
+    forEachRowBand(S.height, std::max(1, std::min(8, (int)std::thread::hardware_concurrency())),
+                   [&](int begin, int end, int) {
+                       std::vector<ushort> lines((size_t)4 * batch * rawWidth);
+                       for (int first = begin; first < end && !shortRead; first += batch)
+                       {
+                           const int rows = std::min(batch, end - first);
+                           for (int shot = 0; shot < 4; shot++)
+                           {
+                               const unsigned from = first + S.top_margin + (shot >> 1 & 1);
+                               const unsigned to = std::min<unsigned>(from + rows, S.raw_height);
+                               if (from >= to)
+                                   continue;
+                               ushort *dst = &lines[(size_t)shot * batch * rawWidth];
+                               const size_t bytes = (to - from) * rowBytes;
+                               std::lock_guard<std::mutex> lock(inputMutex);
+                               input->seek(offsets[shot] + (INT64)from * rowBytes, SEEK_SET);
+                               if ((size_t)input->read(dst, 1, bytes) < bytes)
+                                   shortRead = true;
+                           }
+                           if (swap)
+                               for (ushort &v : lines)
+                                   v = (ushort)(v >> 8 | v << 8);
+
+                           for (int i = 0; i < rows; i++)
+                           {
+                               const unsigned R = first + i;
+                               const ushort *frames[4];
+                               int channel[4][2];
+                               int cover[4];
+                               int common = S.width;
+                               for (int shot = 0; shot < 4; shot++)
+                               {
+                                   const unsigned dy = shot >> 1 & 1, dx = shot & 1;
+                                   const unsigned r = R + S.top_margin + dy;
+                                   cover[shot] = std::max(0, std::min((int)S.width, (int)rawWidth - S.left_margin - (int)dx));
+                                   if (r >= S.raw_height || cover[shot] == 0)
+                                       cover[shot] = 0;
+                                   frames[shot] = cover[shot] ? &lines[((size_t)shot * batch + i) * rawWidth] + S.left_margin + dx
+                                                              : nullptr;
+                                   for (int p = 0; p < 2; p++)
+                                       channel[shot][p] = (r & 1) * 3 ^ (~(p + S.left_margin + dx) & 1);
+                                   common = std::min(common, cover[shot]);
+                               }
+                               ushort(*out)[4] = imgdata.image + (size_t)R * S.width;
+                               simdCombineFourShot(frames, channel, 0, common, out);
+                               // 右边界处只有部分拍摄覆盖的列
+                               for (int col = common; col < S.width; col++)
+                               {
+                                   const ushort *partial[4];
+                                   for (int shot = 0; shot < 4; shot++)
+                                       partial[shot] = col < cover[shot] ? frames[shot] : nullptr;
+                                   simdCombineFourShot(partial, channel, col, col + 1, out);
+                               }
+                           }
+                       }
+                   });
+    if (shortRead)
+    {
+        // 与 read_shorts 相同：第一次读取不足且位于文件末尾时抛出 IO_EOF
+        input->seek(0, SEEK_END);
+        derror();
+    }
+    libraw_internal_data.internal_output_params.mix_green = 1;
+}
+
+void LibRawProcessor::sonyArqLoadRaw()
+{
+    const libraw_image_sizes_t &S = imgdata.sizes;
+    LibRaw_abstract_datastream *input = libraw_internal_data.internal_data.input;
+    if (imgdata.idata.filters || imgdata.idata.colors < 3)
+        throw LIBRAW_EXCEPTION_IO_CORRUPT;
+
+    ushort(*pixels)[4] = (ushort(*)[4])imgdata.rawdata.raw_image;
+    const size_t count = (size_t)S.raw_width * S.raw_height;
+    if ((size_t)input->read(pixels, 2, count * 4) < count * 4)
+        derror();
+    input->seek(-2, SEEK_CUR); // 与 LibRaw 相同，避免随后误报 EOF
+
+    // 字节序转换、通道 2、3 交换和超出 maximum 的计数合并为一遍，按行段并行
+    const bool swap = (libraw_internal_data.unpacker_data.order == 0x4949) != hostLittleEndian();
+    const bool channelSwap = !(imgdata.rawparams.options & LIBRAW_RAWOPTIONS_ARQ_SKIP_CHANNEL_SWAP);
+    if (!swap && !channelSwap)
+        return;
+    const ushort limit = (ushort)std::min<unsigned>(imgdata.color.maximum, 65535);
+    const size_t left = std::min<size_t>(S.left_margin, S.raw_width);
+    const size_t right = std::min<size_t>(left + S.width, S.raw_width);
+    std::atomic<size_t> over(0);
+    forEachRowBand(S.raw_height, std::max(1, std::min(8, (int)std::thread::hardware_concurrency())),
+                   [&](int begin, int end, int) {
+                       size_t local = 0;
+                       for (int row = begin; row < end; row++)
+                       {
+                           ushort(*line)[4] = pixels + (size_t)row * S.raw_width;
+                           if ((unsigned)(row - S.top_margin) >= S.height)
+                           {
+                               simdArqPixels(line, S.raw_width, swap, channelSwap, 0xFFFF);
+                               continue;
+                           }
+                           simdArqPixels(line, left, swap, channelSwap, 0xFFFF);
+                           local += simdArqPixels(line + left, right - left, swap, channelSwap, limit);
+                           simdArqPixels(line + right, S.raw_width - right, swap, channelSwap, 0xFFFF);
+                       }
+                       over += local;
+                   });
+    // LibRaw 对每个超出的像素调用一次 derror()，只有第一次会通知回调
+    if (over)
+    {
+        derror();
+        libraw_internal_data.unpacker_data.data_error += (unsigned)(over - 1);
+    }
+}
+
+// ============== 嵌入预览 ==============
+// 新机型的嵌入预览通常是全尺寸 JPEG。用于网格缩略图时，在 IDCT 阶段按 1/2、1/4、1/8
+// 缩放解码，剩下不到两倍的缩小用面积平均完成，不需要先得到全尺寸图像
+
+int LibRawProcessor::makePreview(int maxDim, bool orient, PreviewImage &out, std::string &error)
+{
+    StageTimer timer(METRIC_STAGE_PREVIEW);
+    // 有多幅预览时选择长边不小于 maxDim 的最小 JPEG，都不够大时选最大的一幅
+    int best = -1;
+    int bestSide = 0;
+    for (int i = 0; i < imgdata.thumbs_list.thumbcount && i < LIBRAW_THUMBNAIL_MAXCOUNT; i++)
+    {
+        const libraw_thumbnail_item_t &item = imgdata.thumbs_list.thumblist[i];
+        if (item.tformat != LIBRAW_INTERNAL_THUMBNAIL_JPEG || item.tlength == 0)
+            continue;
+        const int side = std::max(item.twidth, item.theight);
+        const bool enough = maxDim > 0 && side >= maxDim;
+        const bool bestEnough = maxDim > 0 && bestSide >= maxDim;
+        if (best < 0 || (enough && (!bestEnough || side < bestSide)) || (!enough && !bestEnough && side > bestSide))
+        {
+            best = i;
+            bestSide = side;
+        }
+    }
+
+    int ret = LIBRAW_UNSUPPORTED_THUMBNAIL;
+    if (best >= 0)
+    {
+        // unpack_thumb_ex 会改写默认缩略图的位置和格式。临时读入选中的预览，
+        // 解码后恢复原状，之后的 unpack_thumb / dcraw_make_mem_thumb 不受影响
+        const libraw_thumbnail_t savedThumb = imgdata.thumbnail;
+        const INT64 savedOffset = libraw_internal_data.internal_data.toffset;
+        const LibRaw_internal_thumbnail_formats savedFormat = libraw_internal_data.unpacker_data.thumb_format;
+        const unsigned savedMisc = libraw_internal_data.unpacker_data.thumb_misc;
+        const unsigned savedFlags = imgdata.progress_flags;
+
+        imgdata.thumbnail.thumb = nullptr;
+        imgdata.progress_flags &= ~LIBRAW_PROGRESS_THUMB_LOAD;
+        ret = unpack_thumb_ex(best);
+        if (ret == LIBRAW_SUCCESS)
+            ret = decodeThumbnail(maxDim, out, error);
+        free(imgdata.thumbnail.thumb);
+
+        imgdata.thumbnail = savedThumb;
+        libraw_internal_data.internal_data.toffset = savedOffset;
+        libraw_internal_data.unpacker_data.thumb_format = savedFormat;
+        libraw_internal_data.unpacker_data.thumb_misc = savedMisc;
+        imgdata.progress_flags = savedFlags;
+    }
+
+    // 列表中的预览无法解码（个别机型把位图标记为 JPEG）或没有列表时，使用 LibRaw 选择的默认缩略图
+    if (ret != LIBRAW_SUCCESS)
+    {
+        error.clear();
+        if (!imgdata.thumbnail.thumb)
+        {
+            ret = unpack_thumb();
+            syncMemoryMetrics();
+            if (ret != LIBRAW_SUCCESS)
+                return ret;
+        }
+        ret = decodeThumbnail(maxDim, out, error);
+        if (ret != LIBRAW_SUCCESS)
+            return ret;
+    }
+
+    shrinkPreview(out, maxDim);
+    if (orient)
+        orientPreview(out, imgdata.sizes.flip);
+    timer.done((uint64_t)out.width * out.height);
+    return LIBRAW_SUCCESS;
+}
+
+int LibRawProcessor::decodeThumbnail(int maxDim, PreviewImage &out, std::string &error)
+{
+    const libraw_thumbnail_t &thumb = imgdata.thumbnail;
+    if (!thumb.thumb)
+        return LIBRAW_NO_THUMBNAIL;
+
+    if (thumb.tformat == LIBRAW_THUMBNAIL_JPEG)
+    {
+        if (decodeJpegPreview(reinterpret_cast<const unsigned char *>(thumb.thumb), thumb.tlength, maxDim, out,
+                              error))
+            return LIBRAW_UNSUPPORTED_THUMBNAIL;
+        return LIBRAW_SUCCESS;
+    }
+    if (thumb.tformat != LIBRAW_THUMBNAIL_BITMAP)
+        return LIBRAW_UNSUPPORTED_THUMBNAIL;
+
+    const int colors = thumb.tcolors == 1 ? 1 : 3;
+    const size_t pixels = (size_t)thumb.twidth * thumb.theight;
+    if (pixels == 0 || thumb.tlength < pixels * colors)
+        return LIBRAW_UNSUPPORTED_THUMBNAIL;
+    out.width = out.sourceWidth = thumb.twidth;
+    out.height = out.sourceHeight = thumb.theight;
+    out.scaleDenom = 1;
+    out.flip = 0;
+    out.data.resize(pixels * 3);
+    const unsigned char *src = reinterpret_cast<const unsigned char *>(thumb.thumb);
+    if (colors == 3)
+        memcpy(out.data.data(), src, pixels * 3);
+    else
+        for (size_t i = 0; i < pixels; i++)
+            out.data[i * 3] = out.data[i * 3 + 1] = out.data[i * 3 + 2] = src[i];
+    return LIBRAW_SUCCESS;
+}
+
+// ============== PNG 输出 ==============
+
+int LibRawProcessor::makePng(int bits, PngOptions options, std::vector<unsigned char> &out, PngStats &stats,
+                             std::string &error)
+{
+    // dcraw_make_mem_image 按 output_bps 生成 8 或 16 位样本，只在这一次调用中改变
+    StageTimer timer(METRIC_STAGE_PNG);
+    const int savedBps = imgdata.params.output_bps;
+    if (bits)
+        imgdata.params.output_bps = bits;
+    int ret = LIBRAW_SUCCESS;
+    libraw_processed_image_t *img = dcraw_make_mem_image(&ret);
+    imgdata.params.output_bps = savedBps;
+    if (!img)
+        return ret != LIBRAW_SUCCESS ? ret : LIBRAW_UNSPECIFIED_ERROR;
+
+    // convert_to_rgb 生成的配置文件（指定了 output_profile 时为该文件），按大端存放，第一个字为总长度
+    static const char *const names[] = {"sRGB",       "Adobe RGB (1998)", "WideGamut D65", "ProPhoto D65",
+                                        "XYZ",        "ACES",             "DCI-P3 D65",    "Rec. 2020"};
+    const unsigned char *profile = reinterpret_cast<const unsigned char *>(libraw_internal_data.output_data.oprof);
+    if (profile)
+    {
+        options.icc = profile;
+        options.iccSize = ((size_t)profile[0] << 24) | (profile[1] << 16) | (profile[2] << 8) | profile[3];
+        const int color = imgdata.params.output_color;
+        options.iccName = !imgdata.params.output_profile && color >= 1 && color <= 8 ? names[color - 1] : "ICC profile";
+    }
+    options.abort = &deadlineExpired;
+
+    const bool ok = encodePng(img->data, img->width, img->height, img->colors, img->bits, options, out, stats, error);
+    dcraw_clear_mem(img);
+    if (deadlineExpired.load())
+        return LIBRAW_CANCELLED_BY_CALLBACK;
+    if (!ok)
+        return LIBRAW_UNSPECIFIED_ERROR;
+    timer.done((uint64_t)stats.width * stats.height);
+    return LIBRAW_SUCCESS;
+}
+
+int LibRawProcessor::makeTilePyramid(TilePyramidOptions options, const std::function<bool(PyramidTile &)> &sink,
+                                     TilePyramidStats &stats, std::string &error)
+{
+    StageTimer timer(METRIC_STAGE_TILES);
+    // 瓦片只有 8 位格式，金字塔各层都由这一份图像缩小得到
+    const int savedBps = imgdata.params.output_bps;
+    imgdata.params.output_bps = 8;
+    int ret = LIBRAW_SUCCESS;
+    libraw_processed_image_t *img = dcraw_make_mem_image(&ret);
+    imgdata.params.output_bps = savedBps;
+    if (!img)
+        return ret != LIBRAW_SUCCESS ? ret : LIBRAW_UNSPECIFIED_ERROR;
+
+    options.abort = &deadlineExpired;
+    const bool ok = buildTilePyramid(img->data, img->width, img->height, img->colors, options, sink, stats, error);
+    dcraw_clear_mem(img);
+    if (deadlineExpired.load())
+        return LIBRAW_CANCELLED_BY_CALLBACK;
+    if (!ok)
+        return LIBRAW_UNSPECIFIED_ERROR;
+    timer.done((uint64_t)stats.width * stats.height);
+    return LIBRAW_SUCCESS;
+}
+
+// ============== 指令集分派 ==============
+
+void LibRawProcessor::scale_colors_loop(float scale_mul[4])
+{
+    // 按位置变化的黑电平图案交给 LibRaw 处理
+    if (imgdata.color.cblack[4] && imgdata.color.cblack[5])
+    {
+        LibRaw::scale_colors_loop(scale_mul);
+        return;
+    }
+
+    // 黑电平为 0 时 LibRaw 不跳过零值，但 0 乘以系数仍为 0，结果相同
+    int black[4];
+    for (int c = 0; c < 4; c++)
+        black[c] = (int)imgdata.color.cblack[c];
+
+    size_t pixels = (size_t)imgdata.sizes.iheight * imgdata.sizes.iwidth;
+    if (!simdScaleColors(imgdata.image, pixels, black, scale_mul))
+        LibRaw::scale_colors_loop(scale_mul);
+}
+
+void LibRawProcessor::convert_to_rgb_loop(float out_cam[3][4])
+{
+    int colors = imgdata.idata.colors;
+    if (libraw_internal_data.internal_output_params.raw_color || (colors != 3 && colors != 4) ||
+        simdLevel() == SIMD_SCALAR)
+    {
+        LibRaw::convert_to_rgb_loop(out_cam);
+        return;
+    }
+
+    int(*histogram)[LIBRAW_HISTOGRAM_SIZE] = libraw_internal_data.output_data.histogram;
+    memset(histogram, 0, sizeof(int) * LIBRAW_HISTOGRAM_SIZE * 4);
+
+    size_t width = imgdata.sizes.width;
+    for (int row = 0; row < imgdata.sizes.height; row++)
+    {
+        checkCancel();
+        ushort(*line)[4] = imgdata.image + (size_t)row * width;
+        if (!simdConvertToRgb(line, width, colors, out_cam))
+        {
+            // 当前级别只实现了 scale_colors，整体交给 LibRaw
+            LibRaw::convert_to_rgb_loop(out_cam);
+            return;
+        }
+        // 直方图是分散写入，保持标量
+        for (size_t col = 0; col < width; col++)
+            for (int c = 0; c < colors; c++)
+                histogram[c][line[col][c] >> 3]++;
+    }
+}
@@ -0,0 +1,396 @@
+#ifndef LIBRAW_PROCESSOR_H
+#define LIBRAW_PROCESSOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "libraw/libraw.h"
+#include "band_writer.h"
+#include "calibration.h"
+#include "jpeg_preview.h"
+#include "metrics.h"
+#include "png_writer.h"
+#include "tile_pyramid.h"
+#include "shared_cache.h"
+#include "job_scheduler.h"
+
+// 重渲染时实际复用的阶段
+enum RenderReuse
+{
+    RENDER_REUSE_NONE = 0,          // 完整执行 dcraw_process
+    RENDER_REUSE_OUTPUT = 1,        // 复用去马赛克结果，仅重做 convert_to_rgb
+    RENDER_REUSE_WHITE_BALANCE = 2  // 复用去马赛克结果，按通道修正白平衡后重做 convert_to_rgb
+};
+
+// 解码各阶段的内存占用估算（字节）
+struct MemoryEstimate
+{
+    size_t rawBytes;       // unpack 分配的 raw_alloc
+    size_t decoderBytes;   // 解码器临时缓冲区（浮点 DNG、Phase One 黑电平副本等）
+    size_t imageBytes;     // raw2image_ex 分配的 image[4]
+    size_t histogramBytes; // 直方图
+    size_t scratchBytes;   // 去马赛克、降噪、旋转等阶段的临时缓冲区峰值
+    size_t cacheBytes;     // 重渲染缓存
+    size_t outputBytes;    // dcraw_make_mem_image 输出（不含复制到 JS 的副本）
+    size_t peakBytes;      // 各阶段同时存活的最大总量（含 JS 副本）
+};
+
+// Bayer 马赛克四平面拆分布局
+struct RawPlaneLayout
+{
+    int width;    // 每个平面的宽度（可见区域宽度的一半）
+    int height;   // 每个平面的高度
+    int plane[4]; // 2x2 块中各位置（row * 2 + col）对应的平面：0=R 1=G1 2=G2 3=B
+};
+
+// 无文件头 Bayer 帧的格式，第一帧之前设置一次
+struct BayerStreamConfig
+{
+    unsigned width;          // raw 帧宽度（含边距）
+    unsigned height;         // raw 帧高度（含边距）
+    unsigned margins[4];     // 左、上、右、下边距
+    unsigned char pattern;   // LIBRAW_OPENBAYER_*
+    unsigned flags;          // open_bayer 的 otherflags（16 位大端、10 位紧密打包等）
+    unsigned unusedBits;     // 每个样本低位未使用的位数
+    unsigned black;          // 黑电平
+    unsigned white;          // 白电平，0 表示按位深计算
+    bool hasMatrix;          // 是否使用 matrix 代替单位矩阵
+    float matrix[3][3];      // 相机 RGB 到 sRGB 的矩阵（rgb_cam）
+};
+
+// 分段流式输出的结果
+struct StreamedStats
+{
+    int width;            // 输出尺寸（未旋转，方向写入文件）
+    int height;
+    int bands;            // 行段数
+    int bandRows;         // 每段输出的可见行数
+    int haloRows;         // 每段上下额外处理的行数（去马赛克和中值滤波的邻域）
+    bool rowDecoder;      // raw 行按段从文件解码，没有分配完整的 raw 缓冲区
+    bool whiteEstimated;  // 自动亮度的白点来自半尺寸统计，与 processImage() 可能略有差异
+    size_t bandBytes;     // 单个行段的 image、raw 行和输出行缓冲区
+    size_t bytesWritten;
+};
+
+// 多帧解码时各工作线程独立打开的数据来源：文件路径或调用方持有的内存缓冲区
+struct FrameSource
+{
+    const char *filename; // 不为空时打开文件
+    const void *buffer;   // 否则打开这段内存（只读，各线程共享）
+    size_t size;
+};
+
+// unpack 结果的只读副本：raw 缓冲区和 unpack 结束时保存的尺寸、颜色数据
+class RawSnapshot : public CacheEntry
+{
+public:
+    size_t bytes() const override
+    {
+        return data.size() + (ph1ColumnBlack.size() + ph1RowBlack.size()) * sizeof(short) + sizeof(*this);
+    }
+
+    std::vector<unsigned char> data; // raw_alloc 中的 raw_pitch * raw_height 字节
+    std::vector<short> ph1ColumnBlack; // Phase One 黑电平表（ph1_cblack、ph1_rblack），没有时为空
+    std::vector<short> ph1RowBlack;
+    int layout;                      // 0 = raw_image，1 = color4_image，2 = color3_image
+    libraw_colordata_t color;
+    libraw_image_sizes_t sizes;
+    libraw_iparams_t iparams;
+    libraw_internal_output_params_t ioparams;
+    unsigned warnings;
+};
+
+// LibRaw 子类：通过受保护成员和处理阶段回调扩展处理管线
+class LibRawProcessor : public LibRaw
+{
+public:
+    LibRawProcessor();
+    ~LibRawProcessor();
+
+    // 隐藏 LibRaw::recycle()：释放后同步进程级内存计数
+    void recycle();
+
+    // ============== 重渲染缓存 ==============
+
+    // 启用后，dcraw_process 在 convert_to_rgb 之前保存去马赛克后的线性图像
+    void setRenderCacheEnabled(bool enabled, bool approximateWhiteBalance);
+    bool renderCacheEnabled() const { return cacheEnabled; }
+    bool renderCacheValid() const { return cacheValid; }
+    size_t renderCacheBytes() const { return cachedImage.size() * sizeof(ushort); }
+    RenderReuse lastRenderReuse() const { return lastReuse; }
+
+    // 源数据变化（加载、关闭、重新解包）时必须调用
+    void invalidateRenderCache();
+
+    // 带缓存的 dcraw_process，返回 LibRaw 错误码
+    int processImage();
+
+    // ============== 内存估算 ==============
+
+    // 在 open_file/open_buffer 之后即可调用（不需要 unpack），按给定参数估算处理所需内存
+    MemoryEstimate estimateMemory(const libraw_output_params_t &params);
+
+    // ============== 截止时间 ==============
+
+    // 从现在起 ms 毫秒后中止正在进行的处理；0 表示取消截止时间
+    void setDeadline(unsigned ms);
+    void clearDeadline();
+    bool deadlineExceeded() const { return deadlineExpired.load(); }
+
+    // ============== 优先级 ==============
+
+    // 低优先级任务在阶段边界让出给正在运行的高优先级任务
+    void setPriority(JobLane lane) { priorityLane = lane; }
+    JobLane priority() const { return priorityLane; }
+
+    // ============== Raw 马赛克 ==============
+
+    // 可见区域坐标处的 CFA 颜色索引（cdesc 下标）；Bayer 和 X-Trans 以外的排列返回 -1
+    int rawColorAt(int row, int col) const;
+
+    // 未处理 raw 数据的黑电平，user_black/user_cblack 优先（此时与 LibRaw 一样忽略黑电平图案）
+    void rawBlackLevels(unsigned &black, unsigned channel[4], bool &pattern) const;
+    // 可见区域坐标处应减去的黑电平：black + channel[颜色] + 黑电平图案
+    unsigned rawBlackAt(int row, int col) const;
+
+    // 检查可见区域能否拆分为 R、G1、G2、B 四个平面，可以时返回 nullptr，否则返回原因
+    const char *rawPlaneLayout(RawPlaneLayout &layout) const;
+    // 拆分并减去黑电平（不足时为 0），out 依次存放四个平面
+    void splitRawPlanes(const RawPlaneLayout &layout, ushort *out) const;
+
+    // ============== 连续 Bayer 帧 ==============
+
+    // 用第一帧执行 open_bayer 和 unpack，之后每帧复用 raw 缓冲区
+    int openBayerStream(const BayerStreamConfig &config, const unsigned char *frame, size_t length);
+    // 把新的一帧解码到已有的 raw 缓冲区，帧长度必须与第一帧相同
+    int loadBayerFrame(const unsigned char *frame, size_t length);
+    // 对当前帧执行 dcraw_process
+    int processBayerFrame();
+    // 用第一帧生成的固定色调曲线输出 RGB（8 或 16 位），不重新统计直方图
+    void writeBayerFrame(void *out, size_t stride);
+    size_t bayerFrameLength() const { return streamFrameLength; }
+
+    // ============== 校准 ==============
+
+    // 附加共享的校准数据（nullptr 表示移除）。暗场和坏点在 raw 数据复制到 image 时应用，
+    // 绿平衡在 scale_colors 之前应用；threads 为按行并行的线程数
+    void setCalibration(std::shared_ptr<const CalibrationData> data, int threads);
+    const CalibrationData *calibration() const { return calibrationData.get(); }
+
+    // ============== 共享 raw 缓存 ==============
+
+    // open_file 之后代替 unpack。启用了进程级 raw 缓存（rawCache() 预算大于 0）时，
+    // 按文件路径、大小、修改时间和 shot_select 查找，命中则直接复制解包结果；
+    // 多个线程同时解包同一文件时只有一个登记为负责者，其他线程不等待，直接自行解包。
+    // 启用了磁盘缓存时，内存中没有的再查找磁盘，解码后写入磁盘供以后的进程使用
+    int unpackShared(const char *filename);
+    // 其他线程是否正在解包同一文件（按当前的 raw 选项）。JS 端在 loadFile 之前据此异步等待，之后的命中计入 waits
+    bool rawCacheBusy(const char *filename);
+    // 保存当前 unpack 结果；浮点、Foveon 等带有额外解码状态的格式返回 nullptr
+    std::shared_ptr<const RawSnapshot> snapshotRaw();
+    // 从副本恢复 unpack 结果，必须在同一文件的 open_file 之后调用
+    int restoreRaw(const RawSnapshot &snapshot);
+
+    // ============== 降采样解包 ==============
+
+    // open_file 之后代替 unpack：行列方向每 factor 个 2x2 CFA 块只保留一个，尺寸、边距和遮蔽区
+    // 按比例缩小，之后的处理与普通解包相同。可以按行定位的格式（未压缩、Sony ARW2、未分块的
+    // 未压缩 DNG）只读取和解码需要的行，其他 Bayer 格式完整解码（filename 不为空时经过 unpackShared）
+    // 后抽取：CR3、富士压缩和无损 JPEG 是顺序熵编码，不能跳行；位打包格式和分块 DNG 尚未实现按行读取。
+    // 不是 2x2 周期的 Bayer 排列（X-Trans、Foveon、sRAW、富士旋转等）按 factor 1 解包
+    int unpackSubsampled(int factor, const char *filename = nullptr);
+    // 最近一次解包实际使用的倍数，以及是否在解码器中跳过了不需要的行
+    int subsampleFactor() const { return subsample; }
+    bool subsampledInDecoder() const { return subsampleInDecoder; }
+
+    // ============== 分段流式输出 ==============
+
+    // 当前文件和输出参数能否分段处理，可以时返回 nullptr，否则返回原因
+    const char *streamUnsupported();
+    // 按行段执行 dcraw_process 的各阶段并交给 writer，内存占用与行段而不是整幅图像成正比。
+    // open_file 之后即可调用：可以按行定位的格式（见 unpackSubsampled）按段从文件解码 raw 行，
+    // 其他格式先解包（filename 不为空时经过 unpackShared），这时 raw 的占用仍与整幅图像成正比，
+    // Hasselblad、Phase One、Leaf 等中画幅格式都属于这一类。结果与 processImage() 逐位一致，
+    // 自动亮度的白点除外（见 StreamedStats::whiteEstimated）。失败时返回 LibRaw 错误码，
+    // writer 的错误和不支持的原因写入 error
+    int processStreamed(BandWriter &writer, int bandRows, StreamedStats &stats, std::string &error,
+                        const char *filename = nullptr);
+
+    // ============== 多帧 ==============
+
+    // open_file/open_buffer 之后代替 unpack：解码文件中的全部帧（raw_count 个，包括多帧 DNG、
+    // Sinar 四次拍摄和 Canon 双像素等），当前实例解码 shot_select 对应的一帧，其余帧由最多 8 个
+    // 线程各自打开 source 并行解码（每个线程独立的数据流和读取位置）。Pentax 像素偏移文件以
+    // LIBRAW_RAWOPTIONS_PENTAX_PS_ALLFRAMES 打开时，先并行解码四帧，再由当前实例合并，frames 依次为
+    // 四帧和合并结果。combinedFrame 为合并结果的下标（Sinar 为 0），没有时为 -1。成功后当前实例
+    // 保持合并结果或 shot_select 对应的帧。解码器带有额外状态（浮点、元数据块）时返回 LIBRAW_NOT_IMPLEMENTED
+    int unpackAllFrames(const FrameSource &source, std::vector<std::shared_ptr<const RawSnapshot>> &frames,
+                        int &combinedFrame);
+    // 切换到 unpackAllFrames 得到的一帧，之后的处理与普通解包相同
+    int selectFrame(const RawSnapshot &frame);
+
+    // ============== 浮点 DNG ==============
+
+    // 代替 LibRaw::unpack（不是虚函数，经由 LibRawProcessor 调用时生效）：浮点 DNG（deflate 压缩或未压缩）
+    // 使用插件的解码器，各分块并行解压和转换，deflate 使用 Node 进程自带的 zlib。结果与启用 zlib 的 LibRaw 逐位一致，
+    // 例外见 fpDngLoadRaw
+    int unpack();
+    // 代替 LibRaw::convertFloatToInt，转换循环使用指令集内核
+    void convertFloatToInt(float dmin = 4096.f, float dmax = 32767.f, float dtarget = 16383.f);
+    // unpack 期间解码器被替换（浮点 DNG、四次拍摄合并、Sony ARQ），仍报告 LibRaw 原来的名称和标志
+    int get_decoder_info(libraw_decoder_info_t *d_info) override;
+    // open_file/open_buffer 成功后按解码器名称计入打开的文件数和输入字节数（多帧解码的工作实例不计）
+    int open_datastream(LibRaw_abstract_datastream *stream) override;
+
+    // ============== 嵌入预览 ==============
+
+    // 从嵌入预览中选择长边不小于 maxDim 的最小一幅，解码并缩小到长边不超过 maxDim 的 8 位 RGB，
+    // orient 为 true 时按 sizes.flip 旋转。返回 LibRaw 错误码，解码失败时 error 为具体原因
+    int makePreview(int maxDim, bool orient, PreviewImage &out, std::string &error);
+
+    // ============== PNG 输出 ==============
+
+    // processImage() 之后调用：dcraw_make_mem_image 的结果（按 sizes.flip 旋转）编码为 PNG，bits 为 8 或 16，
+    // 0 表示使用 output_bps。输出色彩空间的 ICC 配置文件（与 writeTIFF 嵌入的相同，raw 色彩空间时没有）写入 iCCP。
+    // 返回 LibRaw 错误码，截止时间到期时为 LIBRAW_CANCELLED_BY_CALLBACK，编码失败时 error 为具体原因
+    int makePng(int bits, PngOptions options, std::vector<unsigned char> &out, PngStats &stats, std::string &error);
+
+    // ============== 瓦片金字塔 ==============
+
+    // processImage() 之后调用：由 8 位的 dcraw_make_mem_image 结果一次生成 Deep Zoom 金字塔，瓦片按完成顺序交给
+    // sink（在调用线程中执行，返回 false 时停止）。返回 LibRaw 错误码，截止时间到期时为 LIBRAW_CANCELLED_BY_CALLBACK，
+    // sink 中止时为 LIBRAW_UNSPECIFIED_ERROR 且 error 为空
+    int makeTilePyramid(TilePyramidOptions options, const std::function<bool(PyramidTile &)> &sink,
+                        TilePyramidStats &stats, std::string &error);
+
+protected:
+    // ============== 指令集分派 ==============
+
+    // 按运行时检测的指令集执行热点循环，没有对应内核时回退到 LibRaw 的实现
+    void scale_colors_loop(float scale_mul[4]) override;
+    void convert_to_rgb_loop(float out_cam[3][4]) override;
+
+    // 附加了校准数据时，复制 raw 数据的同时完成坏点插值和暗场相减
+    void copy_bayer(unsigned short cblack[4], unsigned short *dmaxp) override;
+
+    // 分段处理时 Phase One 的黑电平和平场校正已经预先做完，raw2image_ex 不能每段重做
+    int is_phaseone_compressed() override;
+
+private:
+    static void preConvertToRgbCallback(void *ctx);
+    static void preScaleColorsCallback(void *ctx);
+    void applyGreenMatching();
+    // 解码当前已读入的缩略图（JPEG 或 8 位位图）
+    int decodeThumbnail(int maxDim, PreviewImage &out, std::string &error);
+    // 降采样解包：是否为 2x2 周期的 Bayer 数据、解码器能否按行跳过，以及替换 load_raw 的行解码器
+    bool canSubsample() const;
+    int subsampleRowDecoder() const;
+    void subsampledRowsLoadRaw();
+    void subsampleRawBuffer(const libraw_image_sizes_t &full);
+    unsigned rowDecoderRows(const libraw_image_sizes_t &full) const;
+    void decodeRawRow(unsigned source, unsigned rawWidth, std::vector<uchar> &data, ushort *line);
+    // 分段流式输出：把可见区域的 [top, bottom) 行复制到 image，以及之后直到 convert_to_rgb 的各阶段
+    int prepareBand(int top, int bottom);
+    void processBand();
+    void accumulateAutoWhiteBalance(int top);
+    void pinAutoWhiteBalance();
+    static int progressCallback(void *ctx, enum LibRaw_progress stage, int iteration, int expected);
+    // 浮点 DNG：替换 deflate_dng_load_raw / uncompressed_fp_dng_load_raw 的解码器
+    void fpDngLoadRaw();
+    // 多帧：工作实例（参数已从当前实例复制）打开 source 并解码第 shot 帧，dataOffset 为该帧的数据位置
+    static int decodeFrame(LibRawProcessor &worker, const FrameSource &source, int shot,
+                    std::shared_ptr<const RawSnapshot> &frame, INT64 &dataOffset);
+    // snapshotRaw 去掉缓存相关的限制：允许 Sinar 四次拍摄和合并后的四通道结果
+    std::shared_ptr<const RawSnapshot> copyRaw();
+    // 替换 pentax_4shot_load_raw、sinar_4shot_load_raw（合并）和 sony_arq_load_raw 的解码器
+    void pentaxFourShotLoadRaw();
+    void sinarFourShotLoadRaw();
+    void sonyArqLoadRaw();
+    void armDeadline(std::chrono::steady_clock::time_point at);
+
+    void saveRenderCache();
+    bool restoreRenderCache();
+    bool sameParamsExceptOutput(const libraw_output_params_t &a, const libraw_output_params_t &b, bool ignoreWhiteBalance) const;
+    bool canCorrectWhiteBalance() const;
+    void applyWhiteBalanceCorrection();
+    int runConvertStage();
+
+    bool cacheEnabled;
+    bool approximateWB;
+    bool cacheValid;
+    RenderReuse lastReuse;
+
+    // 缓存的去马赛克结果及其对应状态
+    std::vector<ushort> cachedImage;
+    libraw_output_params_t cachedParams;
+    libraw_output_params_t pendingParams;
+    ushort cachedWidth, cachedHeight, cachedIWidth, cachedIHeight;
+    int cachedColors;
+    int cachedRawColor;
+    float cachedPreMul[4];
+
+    // 截止时间监视线程中的注册 id（0 表示未设置）、到期时刻（多帧解码的工作实例使用同一时刻）和到期标志
+    uint64_t deadlineId;
+    std::chrono::steady_clock::time_point deadlineAt;
+    std::atomic<bool> deadlineExpired;
+
+    JobLane priorityLane;
+
+    // 连续 Bayer 帧：第一帧的长度、unpack 之前的颜色数据和固定的输出曲线
+    size_t streamFrameLength;
+    std::unique_ptr<libraw_colordata_t> streamColor;
+    std::vector<ushort> streamCurve;
+
+    // 校准数据（多个实例只读共享）和按行并行的线程数
+    std::shared_ptr<const CalibrationData> calibrationData;
+    int calibrationThreads;
+
+    // 降采样解包的倍数、是否在解码器中完成，以及解码器按行读取时使用的完整尺寸和行格式
+    int subsample;
+    bool subsampleInDecoder;
+    int subsampleDecoder;
+    libraw_image_sizes_t subsampleFullSizes;
+
+    // 分段流式输出：是否正在分段处理、完整的尺寸、raw 来源（内存中的缓冲区或按段解码的行）、
+    // 整幅图像的 data_maximum，以及自动白平衡按 8x8 块最大值分桶的和与计数
+    bool bandActive;
+    bool bandRowDecode;
+    libraw_image_sizes_t bandFullSizes;
+    ushort *bandRawBase;
+    std::vector<ushort> bandRaw;
+    unsigned bandDataMaximum;
+    bool bandAutoWB;
+    std::vector<double> bandWBBuckets;
+
+    // unpack 期间被替换的 LibRaw 解码器（未替换时为空），以及浮点 DNG 是否为 deflate 压缩
+    void (LibRaw::*replacedDecoder)();
+    bool fpDngDeflate;
+
+    // 共享 raw 缓存的 key（路径、大小、修改时间、shot_select 和 raw 选项），文件不存在时返回 false
+    bool rawCacheKey(const char *filename, std::string &key);
+    // rawCacheBusy 返回过 true：下一次 unpackShared 的命中计入 waits
+    bool rawCacheWaited;
+
+    // 是否在 open_datastream 中计入性能计数器，多帧解码的工作实例重复打开同一文件，不计入
+    bool countOpens;
+
+    // 已计入进程级内存计数的 LibRaw 缓冲区（raw_alloc、image、缩略图）。LibRaw 的分配函数不是虚函数，
+    // 在阶段边界按 imgdata 中的指针和尺寸同步，阶段内部的临时缓冲区不计入
+    struct MeteredBuffer
+    {
+        const void *ptr;
+        size_t bytes;
+    };
+    MeteredBuffer meteredBuffers[3];
+    void syncMemoryMetrics();
+
+    // Pentax 像素偏移：unpackAllFrames 并行解码的四帧及其数据位置，合并解码器按 IFD 顺序取用
+    std::vector<std::shared_ptr<const RawSnapshot>> fourShotFrames;
+    std::vector<INT64> fourShotOffsets;
+};
+
+#endif // LIBRAW_PROCESSOR_H
@@ -1,31 +1,45 @@
 #include "libraw_wrapper.h"
+#include "addon_data.h"
+#include "jpeg_preview.h"
+#include "metrics.h"
+#include "raw_disk_cache.h"
+#include "simd_kernels.h"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <vector>
 
-Napi::FunctionReference LibRawWrapper::constructor;
-
 Napi::Object LibRawWrapper::Init(Napi::Env env, Napi::Object exports)
 {
     Napi::HandleScope scope(env);
 
     Napi::Function func = DefineClass(env, "LibRawWrapper", {// 文件操作
-                                                             InstanceMethod("loadFile", &LibRawWrapper::LoadFile), InstanceMethod("loadBuffer", &LibRawWrapper::LoadBuffer), InstanceMethod("close", &LibRawWrapper::Close),
+                                                             InstanceMethod("loadFile", &LibRawWrapper::LoadFile), InstanceMethod("loadBuffer", &LibRawWrapper::LoadBuffer), InstanceMethod("openFile", &LibRawWrapper::OpenFile), InstanceMethod("openBuffer", &LibRawWrapper::OpenBuffer), InstanceMethod("close", &LibRawWrapper::Close), InstanceMethod("rawCacheBusy", &LibRawWrapper::RawCacheBusy),
 
                                                              // 错误处理
                                                              InstanceMethod("getLastError", &LibRawWrapper::GetLastError), InstanceMethod("strerror", &LibRawWrapper::Strerror),
 
                                                              // 元数据和信息
-                                                             InstanceMethod("getMetadata", &LibRawWrapper::GetMetadata), InstanceMethod("getImageSize", &LibRawWrapper::GetImageSize), InstanceMethod("getAdvancedMetadata", &LibRawWrapper::GetAdvancedMetadata), InstanceMethod("getLensInfo", &LibRawWrapper::GetLensInfo), InstanceMethod("getColorInfo", &LibRawWrapper::GetColorInfo),
+                                                             InstanceMethod("getMetadata", &LibRawWrapper::GetMetadata), InstanceMethod("getImageSize", &LibRawWrapper::GetImageSize), InstanceMethod("getSubsampleInfo", &LibRawWrapper::GetSubsampleInfo), InstanceMethod("getAdvancedMetadata", &LibRawWrapper::GetAdvancedMetadata), InstanceMethod("getLensInfo", &LibRawWrapper::GetLensInfo), InstanceMethod("getColorInfo", &LibRawWrapper::GetColorInfo),
 
                                                              // 图像处理
                                                              InstanceMethod("unpackThumbnail", &LibRawWrapper::UnpackThumbnail), InstanceMethod("processImage", &LibRawWrapper::ProcessImage), InstanceMethod("subtractBlack", &LibRawWrapper::SubtractBlack), InstanceMethod("raw2Image", &LibRawWrapper::Raw2Image), InstanceMethod("adjustMaximum", &LibRawWrapper::AdjustMaximum),
 
+                                                             // 重渲染缓存
+                                                             InstanceMethod("setRenderCache", &LibRawWrapper::SetRenderCache), InstanceMethod("getRenderCacheInfo", &LibRawWrapper::GetRenderCacheInfo),
+
+                                                             // 校准
+                                                             InstanceMethod("setCalibration", &LibRawWrapper::SetCalibration), InstanceMethod("getCalibrationInfo", &LibRawWrapper::GetCalibrationInfo),
+
+                                                             // 内存估算
+                                                             InstanceMethod("estimateMemory", &LibRawWrapper::EstimateMemory),
+
                                                              // 内存图像创建
-                                                             InstanceMethod("createMemoryImage", &LibRawWrapper::CreateMemoryImage), InstanceMethod("createMemoryThumbnail", &LibRawWrapper::CreateMemoryThumbnail),
+                                                             InstanceMethod("createMemoryImage", &LibRawWrapper::CreateMemoryImage), InstanceMethod("createMemoryThumbnail", &LibRawWrapper::CreateMemoryThumbnail), InstanceMethod("getPreviewRGB", &LibRawWrapper::GetPreviewRGB), InstanceMethod("createPNG", &LibRawWrapper::CreatePNG), InstanceMethod("exportTilePyramid", &LibRawWrapper::ExportTilePyramid),
 
                                                              // 文件写入器
-                                                             InstanceMethod("writePPM", &LibRawWrapper::WritePPM), InstanceMethod("writeTIFF", &LibRawWrapper::WriteTIFF), InstanceMethod("writeThumbnail", &LibRawWrapper::WriteThumbnail),
+                                                             InstanceMethod("writePPM", &LibRawWrapper::WritePPM), InstanceMethod("writeTIFF", &LibRawWrapper::WriteTIFF), InstanceMethod("writeThumbnail", &LibRawWrapper::WriteThumbnail), InstanceMethod("writeStreamed", &LibRawWrapper::WriteStreamed),
 
                                                              // 配置和设置
                                                              InstanceMethod("setOutputParams", &LibRawWrapper::SetOutputParams), InstanceMethod("getOutputParams", &LibRawWrapper::GetOutputParams),
@@ -39,35 +53,43 @@ Napi::Object LibRawWrapper::Init(Napi::Env env, Napi::Object exports)
                                                              // 高级处理
                                                              InstanceMethod("unpack", &LibRawWrapper::Unpack), InstanceMethod("raw2ImageEx", &LibRawWrapper::Raw2ImageEx), InstanceMethod("adjustSizesInfoOnly", &LibRawWrapper::AdjustSizesInfoOnly), InstanceMethod("freeImage", &LibRawWrapper::FreeImage), InstanceMethod("convertFloatToInt", &LibRawWrapper::ConvertFloatToInt),
 
+                                                             // 多帧解码
+                                                             InstanceMethod("loadAllFrames", &LibRawWrapper::LoadAllFrames), InstanceMethod("selectFrame", &LibRawWrapper::SelectFrame),
+
                                                              // 扩展内存操作
                                                              InstanceMethod("getMemImageFormat", &LibRawWrapper::GetMemImageFormat), InstanceMethod("copyMemImage", &LibRawWrapper::CopyMemImage),
 
+                                                             // Raw 数据访问
+                                                             InstanceMethod("getRawData", &LibRawWrapper::GetRawData),
+
                                                              // 颜色操作
                                                              InstanceMethod("getColorAt", &LibRawWrapper::GetColorAt), InstanceMethod("getWhitepointPhysics", &LibRawWrapper::GetWhitepointPhysics),
 
                                                              // 取消支持
-                                                             InstanceMethod("setCancelFlag", &LibRawWrapper::SetCancelFlag), InstanceMethod("clearCancelFlag", &LibRawWrapper::ClearCancelFlag),
+                                                             InstanceMethod("setCancelFlag", &LibRawWrapper::SetCancelFlag), InstanceMethod("clearCancelFlag", &LibRawWrapper::ClearCancelFlag), InstanceMethod("setDeadline", &LibRawWrapper::SetDeadline), InstanceMethod("clearDeadline", &LibRawWrapper::ClearDeadline), InstanceMethod("setPriority", &LibRawWrapper::SetPriority), InstanceMethod("getPriority", &LibRawWrapper::GetPriority),
 
                                                              // 版本信息（实例方法）
                                                              InstanceMethod("version", &LibRawWrapper::Version), InstanceMethod("versionNumber", &LibRawWrapper::VersionNumber),
 
                                                              // 静态方法
-                                                             StaticMethod("getVersion", &LibRawWrapper::GetVersion), StaticMethod("getCapabilities", &LibRawWrapper::GetCapabilities), StaticMethod("getCameraList", &LibRawWrapper::GetCameraList), StaticMethod("getCameraCount", &LibRawWrapper::GetCameraCount)});
+                                                             StaticMethod("getVersion", &LibRawWrapper::GetVersion), StaticMethod("getCapabilities", &LibRawWrapper::GetCapabilities), StaticMethod("getCameraList", &LibRawWrapper::GetCameraList), StaticMethod("getCameraCount", &LibRawWrapper::GetCameraCount), StaticMethod("getSchedulerStats", &LibRawWrapper::GetSchedulerStats), StaticMethod("getMetrics", &LibRawWrapper::GetMetrics), StaticMethod("observeQueueWait", &LibRawWrapper::ObserveQueueWait), StaticMethod("getSimdInfo", &LibRawWrapper::GetSimdInfo), StaticMethod("hasNativeJpeg", &LibRawWrapper::HasNativeJpeg), StaticMethod("loadCalibration", &LibRawWrapper::LoadCalibration), StaticMethod("releaseCalibration", &LibRawWrapper::ReleaseCalibration), StaticMethod("configureCache", &LibRawWrapper::ConfigureCache), StaticMethod("getCacheStats", &LibRawWrapper::GetCacheStats), StaticMethod("clearCache", &LibRawWrapper::ClearCache), StaticMethod("cacheAcquire", &LibRawWrapper::CacheAcquire), StaticMethod("cacheFulfil", &LibRawWrapper::CacheFulfil), StaticMethod("cacheAbandon", &LibRawWrapper::CacheAbandon)});
 
-    constructor = Napi::Persistent(func);
-    constructor.SuppressDestruct();
+    // 构造函数引用保存在当前环境的实例数据中，而不是进程全局变量，
+    // 这样每个 worker_threads 环境都有独立的引用，并随环境一起释放
+    AddonData *data = env.GetInstanceData<AddonData>();
+    data->libRawWrapperConstructor = Napi::Persistent(func);
 
     exports.Set("LibRawWrapper", func);
     return exports;
 }
 
 LibRawWrapper::LibRawWrapper(const Napi::CallbackInfo &info)
-    : Napi::ObjectWrap<LibRawWrapper>(info), isLoaded(false), isUnpacked(false), isProcessed(false)
+    : Napi::ObjectWrap<LibRawWrapper>(info), isLoaded(false), isUnpacked(false), isProcessed(false), rawViewData(nullptr), currentFrame(-1)
 {
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
 
-    processor = std::make_unique<LibRaw>();
+    processor = std::make_unique<LibRawProcessor>();
     if (!processor)
     {
         Napi::TypeError::New(env, "Failed to initialize LibRaw").ThrowAsJavaScriptException();
@@ -92,6 +114,78 @@ bool LibRawWrapper::CheckLoaded(Napi::Env env)
     return true;
 }
 
+// 截止时间已过但尚未被处理循环发现时，直接以超时失败，不再开始新的阶段
+bool LibRawWrapper::CheckDeadline(Napi::Env env)
+{
+    if (processor->deadlineExceeded())
+    {
+        ThrowLibRawError(env, "Operation aborted: ", LIBRAW_CANCELLED_BY_CALLBACK);
+        return false;
+    }
+    return true;
+}
+
+// 解包选项 { subsample }：行列方向的抽取倍数，1 到 16 的整数，默认 1
+bool LibRawWrapper::ReadSubsample(Napi::Env env, const Napi::CallbackInfo &info, size_t index, int &factor)
+{
+    factor = 1;
+    if (info.Length() <= index || info[index].IsUndefined() || info[index].IsNull())
+        return true;
+    if (!info[index].IsObject())
+    {
+        Napi::TypeError::New(env, "Expected options object").ThrowAsJavaScriptException();
+        return false;
+    }
+    Napi::Value value = info[index].As<Napi::Object>().Get("subsample");
+    if (value.IsUndefined())
+        return true;
+    double number = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : 0;
+    if (!(number >= 1 && number <= 16) || number != (int)number)
+    {
+        Napi::RangeError::New(env, "subsample must be an integer between 1 and 16").ThrowAsJavaScriptException();
+        return false;
+    }
+    factor = (int)number;
+    return true;
+}
+
+// 把 LibRaw 错误码转换为 JS 异常。取消和超时带有独立的 error.code，
+// 并释放当前文件：被中止的处理状态不完整，调用方需要重新加载
+Napi::Value LibRawWrapper::ThrowLibRawError(Napi::Env env, const char *prefix, int ret)
+{
+    std::string message = prefix;
+    const char *code = nullptr;
+    Metrics::instance().recordError(ret);
+
+    if (ret == LIBRAW_CANCELLED_BY_CALLBACK)
+    {
+        bool deadline = processor->deadlineExceeded();
+        message += deadline ? "Deadline exceeded" : libraw_strerror(ret);
+        code = deadline ? "LIBRAW_DEADLINE_EXCEEDED" : "LIBRAW_CANCELLED";
+        Metrics::instance().recordCancellation(deadline);
+
+        ReleaseRawView();
+        ReleaseFrames();
+        inputBuffer.Reset();
+        processor->invalidateRenderCache();
+        processor->recycle();
+        processor->clearDeadline();
+        isLoaded = false;
+        isUnpacked = false;
+        isProcessed = false;
+    }
+    else
+    {
+        message += libraw_strerror(ret);
+    }
+
+    Napi::Error error = Napi::Error::New(env, message);
+    if (code)
+        error.Set("code", Napi::String::New(env, code));
+    error.ThrowAsJavaScriptException();
+    return env.Null();
+}
+
 // ============== 文件操作 ==============
 
 Napi::Value LibRawWrapper::LoadFile(const Napi::CallbackInfo &info)
@@ -105,23 +199,22 @@ Napi::Value LibRawWrapper::LoadFile(const Napi::CallbackInfo &info)
     }
 
     std::string filename = info[0].As<Napi::String>().Utf8Value();
+    int subsample;
+    if (!ReadSubsample(env, info, 1, subsample) || !CheckDeadline(env))
+        return env.Null();
+    JobScope job(processor->priority());
+    ReleaseRawView();
+    ReleaseFrames();
+    inputBuffer.Reset();
+    processor->invalidateRenderCache();
     int ret = processor->open_file(filename.c_str());
     if (ret != LIBRAW_SUCCESS)
-    {
-        std::string error = "Failed to open file: ";
-        error += libraw_strerror(ret);
-        Napi::Error::New(env, error).ThrowAsJavaScriptException();
-        return env.Null();
-    }
+        return ThrowLibRawError(env, "Failed to open file: ", ret);
 
-    ret = processor->unpack();
+    // 启用了 raw 缓存时，同一文件的解包结果在实例和 worker 之间共享（降采样时缓存完整结果）
+    ret = processor->unpackSubsampled(subsample, filename.c_str());
     if (ret != LIBRAW_SUCCESS)
-    {
-        std::string error = "Failed to unpack file: ";
-        error += libraw_strerror(ret);
-        Napi::Error::New(env, error).ThrowAsJavaScriptException();
-        return env.Null();
-    }
+        return ThrowLibRawError(env, "Failed to unpack file: ", ret);
 
     isLoaded = true;
     isUnpacked = true;
@@ -140,26 +233,84 @@ Napi::Value LibRawWrapper::LoadBuffer(const Napi::CallbackInfo &info)
     }
 
     Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
+    int subsample;
+    if (!ReadSubsample(env, info, 1, subsample) || !CheckDeadline(env))
+        return env.Null();
+    JobScope job(processor->priority());
+    ReleaseRawView();
+    ReleaseFrames();
+    inputBuffer.Reset();
+    processor->invalidateRenderCache();
     int ret = processor->open_buffer(buffer.Data(), buffer.Length());
     if (ret != LIBRAW_SUCCESS)
+        return ThrowLibRawError(env, "Failed to open buffer: ", ret);
+    inputBuffer = Napi::Persistent(buffer);
+
+    ret = processor->unpackSubsampled(subsample);
+    if (ret != LIBRAW_SUCCESS)
+        return ThrowLibRawError(env, "Failed to unpack buffer: ", ret);
+
+    isLoaded = true;
+    isUnpacked = true;
+    isProcessed = false;
+    return Napi::Boolean::New(env, true);
+}
+
+// 只解析文件头（identify），不解包 raw 数据。
+// 可以先调用 estimateMemory() 估算内存，再调用 unpack() 或 processImage()
+Napi::Value LibRawWrapper::OpenFile(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsString())
     {
-        std::string error = "Failed to open buffer: ";
-        error += libraw_strerror(ret);
-        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        Napi::TypeError::New(env, "Expected string filename").ThrowAsJavaScriptException();
         return env.Null();
     }
 
-    ret = processor->unpack();
+    std::string filename = info[0].As<Napi::String>().Utf8Value();
+    if (!CheckDeadline(env))
+        return env.Null();
+    JobScope job(processor->priority());
+    ReleaseRawView();
+    ReleaseFrames();
+    inputBuffer.Reset();
+    processor->invalidateRenderCache();
+    int ret = processor->open_file(filename.c_str());
     if (ret != LIBRAW_SUCCESS)
+        return ThrowLibRawError(env, "Failed to open file: ", ret);
+
+    isLoaded = true;
+    isUnpacked = false;
+    isProcessed = false;
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value LibRawWrapper::OpenBuffer(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsBuffer())
     {
-        std::string error = "Failed to unpack buffer: ";
-        error += libraw_strerror(ret);
-        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        Napi::TypeError::New(env, "Expected Buffer").ThrowAsJavaScriptException();
         return env.Null();
     }
 
+    Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
+    if (!CheckDeadline(env))
+        return env.Null();
+    JobScope job(processor->priority());
+    ReleaseRawView();
+    ReleaseFrames();
+    inputBuffer.Reset();
+    processor->invalidateRenderCache();
+    int ret = processor->open_buffer(buffer.Data(), buffer.Length());
+    if (ret != LIBRAW_SUCCESS)
+        return ThrowLibRawError(env, "Failed to open buffer: ", ret);
+    inputBuffer = Napi::Persistent(buffer);
+
     isLoaded = true;
-    isUnpacked = true;
+    isUnpacked = false;
     isProcessed = false;
     return Napi::Boolean::New(env, true);
 }
@@ -170,15 +321,31 @@ Napi::Value LibRawWrapper::Close(const Napi::CallbackInfo &info)
 
     if (processor && isLoaded)
     {
+        ReleaseRawView();
+        ReleaseFrames();
+        inputBuffer.Reset();
+        processor->invalidateRenderCache();
         processor->recycle();
         isLoaded = false;
         isUnpacked = false;
         isProcessed = false;
     }
+    // 关闭即结束当前任务，截止时间随之失效
+    processor->clearDeadline();
 
     return Napi::Boolean::New(env, true);
 }
 
+// 其他线程或 worker 是否正在解包同一文件：loadFile() 之前在 JS 端异步等待，避免阻塞事件循环
+Napi::Value LibRawWrapper::RawCacheBusy(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsString())
+        return Napi::Boolean::New(env, false);
+    std::string filename = info[0].As<Napi::String>().Utf8Value();
+    return Napi::Boolean::New(env, processor->rawCacheBusy(filename.c_str()));
+}
+
 // ============== 元数据和信息 ==============
 
 Napi::Value LibRawWrapper::GetMetadata(const Napi::CallbackInfo &info)
@@ -258,6 +425,20 @@ Napi::Value LibRawWrapper::GetImageSize(const Napi::CallbackInfo &info)
     return size;
 }
 
+Napi::Value LibRawWrapper::GetSubsampleInfo(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (!CheckLoaded(env))
+        return env.Null();
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("factor", Napi::Number::New(env, processor->subsampleFactor()));
+    result.Set("inDecoder", Napi::Boolean::New(env, processor->subsampledInDecoder()));
+    result.Set("width", Napi::Number::New(env, processor->imgdata.sizes.width));
+    result.Set("height", Napi::Number::New(env, processor->imgdata.sizes.height));
+    return result;
+}
+
 Napi::Value LibRawWrapper::GetAdvancedMetadata(const Napi::CallbackInfo &info)
 {
     Napi::Env env = info.Env();
@@ -437,6 +618,7 @@ Napi::Value LibRawWrapper::UnpackThumbnail(const Napi::CallbackInfo &info)
     int ret = processor->unpack_thumb();
     if (ret != LIBRAW_SUCCESS)
     {
+        Metrics::instance().recordError(ret);
         std::string error = "Failed to unpack thumbnail: ";
         error += libraw_strerror(ret);
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
@@ -451,15 +633,24 @@ Napi::Value LibRawWrapper::ProcessImage(const Napi::CallbackInfo &info)
     Napi::Env env = info.Env();
     if (!CheckLoaded(env))
         return env.Null();
-    int ret = processor->dcraw_process();
-    if (ret != LIBRAW_SUCCESS)
-    {
-        std::string error = "Failed to process image: ";
-        error += libraw_strerror(ret);
-        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+    if (!CheckDeadline(env))
         return env.Null();
+    JobScope job(processor->priority());
+
+    // openFile()/openBuffer() 只做了 identify，处理前先解包
+    if (!isUnpacked)
+    {
+        int ret = processor->unpack();
+        if (ret != LIBRAW_SUCCESS)
+            return ThrowLibRawError(env, "Failed to unpack: ", ret);
+        isUnpacked = true;
     }
 
+    // 启用重渲染缓存时，只有后期参数变化会复用去马赛克结果
+    int ret = processor->processImage();
+    if (ret != LIBRAW_SUCCESS)
+        return ThrowLibRawError(env, "Failed to process image: ", ret);
+
     isProcessed = true;
     return Napi::Boolean::New(env, true);
 }
@@ -472,6 +663,7 @@ Napi::Value LibRawWrapper::SubtractBlack(const Napi::CallbackInfo &info)
     int ret = processor->subtract_black();
     if (ret != LIBRAW_SUCCESS)
     {
+        Metrics::instance().recordError(ret);
         std::string error = "Failed to subtract black: ";
         error += libraw_strerror(ret);
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
@@ -489,6 +681,7 @@ Napi::Value LibRawWrapper::Raw2Image(const Napi::CallbackInfo &info)
     int ret = processor->raw2image();
     if (ret != LIBRAW_SUCCESS)
     {
+        Metrics::instance().recordError(ret);
         std::string error = "Failed to convert raw to image: ";
         error += libraw_strerror(ret);
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
@@ -506,6 +699,7 @@ Napi::Value LibRawWrapper::AdjustMaximum(const Napi::CallbackInfo &info)
     int ret = processor->adjust_maximum();
     if (ret != LIBRAW_SUCCESS)
     {
+        Metrics::instance().recordError(ret);
         std::string error = "Failed to adjust maximum: ";
         error += libraw_strerror(ret);
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
@@ -515,6 +709,304 @@ Napi::Value LibRawWrapper::AdjustMaximum(const Napi::CallbackInfo &info)
     return Napi::Boolean::New(env, true);
 }
 
+// ============== 重渲染缓存 ==============
+
+Napi::Value LibRawWrapper::SetRenderCache(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+
+    bool enabled = false;
+    bool approximateWhiteBalance = true;
+    if (info.Length() > 0 && info[0].IsBoolean())
+    {
+        enabled = info[0].As<Napi::Boolean>().Value();
+    }
+    else if (info.Length() > 0 && info[0].IsObject())
+    {
+        Napi::Object options = info[0].As<Napi::Object>();
+        if (options.Has("enabled") && options.Get("enabled").IsBoolean())
+        {
+            enabled = options.Get("enabled").As<Napi::Boolean>().Value();
+        }
+        if (options.Has("approximateWhiteBalance") && options.Get("approximateWhiteBalance").IsBoolean())
+        {
+            approximateWhiteBalance = options.Get("approximateWhiteBalance").As<Napi::Boolean>().Value();
+        }
+    }
+    else
+    {
+        Napi::TypeError::New(env, "Expected boolean or options object").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    processor->setRenderCacheEnabled(enabled, approximateWhiteBalance);
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value LibRawWrapper::GetRenderCacheInfo(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+
+    static const char *reuseNames[] = {"none", "output", "whiteBalance"};
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("enabled", Napi::Boolean::New(env, processor->renderCacheEnabled()));
+    result.Set("valid", Napi::Boolean::New(env, processor->renderCacheValid()));
+    result.Set("bytes", Napi::Number::New(env, static_cast<double>(processor->renderCacheBytes())));
+    result.Set("lastReuse", Napi::String::New(env, reuseNames[processor->lastRenderReuse()]));
+    return result;
+}
+
+// ============== 校准 ==============
+
+// 从选项加载校准数据。只使用文件路径时以路径为 key 登记到进程级注册表，
+// 所有实例（包括其他 worker_threads 中的实例）共享同一份数据；传入内存数据时需要显式提供 key 才会共享
+std::shared_ptr<const CalibrationData> LibRawWrapper::AcquireCalibration(Napi::Env env, Napi::Object options)
+{
+    std::string key;
+    if (options.Has("key") && options.Get("key").IsString())
+        key = options.Get("key").As<Napi::String>().Utf8Value();
+    bool pathsOnly = true;
+
+    // 先在主线程把 JS 值转换为普通数据，加载函数可能在持有注册表锁时执行
+    std::string darkPath;
+    std::vector<unsigned char> darkPgm;
+    std::vector<unsigned short> darkPixels;
+    int darkWidth = 0, darkHeight = 0;
+    if (options.Has("darkFrame") && !options.Get("darkFrame").IsUndefined() && !options.Get("darkFrame").IsNull())
+    {
+        Napi::Value dark = options.Get("darkFrame");
+        if (dark.IsString())
+        {
+            darkPath = dark.As<Napi::String>().Utf8Value();
+        }
+        else if (dark.IsBuffer())
+        {
+            Napi::Buffer<uint8_t> buffer = dark.As<Napi::Buffer<uint8_t>>();
+            darkPgm.assign(buffer.Data(), buffer.Data() + buffer.Length());
+            pathsOnly = false;
+        }
+        else if (dark.IsObject() && dark.As<Napi::Object>().Get("data").IsTypedArray())
+        {
+            Napi::Object frame = dark.As<Napi::Object>();
+            Napi::TypedArray data = frame.Get("data").As<Napi::TypedArray>();
+            darkWidth = frame.Get("width").IsNumber() ? frame.Get("width").As<Napi::Number>().Int32Value() : 0;
+            darkHeight = frame.Get("height").IsNumber() ? frame.Get("height").As<Napi::Number>().Int32Value() : 0;
+            if (data.TypedArrayType() != napi_uint16_array || darkWidth <= 0 || darkHeight <= 0 ||
+                data.ElementLength() != (size_t)darkWidth * darkHeight)
+            {
+                Napi::TypeError::New(env, "darkFrame.data must be a Uint16Array of width * height values")
+                    .ThrowAsJavaScriptException();
+                return nullptr;
+            }
+            Napi::Uint16Array pixels = data.As<Napi::Uint16Array>();
+            darkPixels.assign(pixels.Data(), pixels.Data() + pixels.ElementLength());
+            pathsOnly = false;
+        }
+        else
+        {
+            Napi::TypeError::New(env, "darkFrame must be a PGM path, a PGM Buffer or { data, width, height }")
+                .ThrowAsJavaScriptException();
+            return nullptr;
+        }
+    }
+
+    std::string badPath;
+    std::vector<BadPixel> badList;
+    if (options.Has("badPixels") && !options.Get("badPixels").IsUndefined() && !options.Get("badPixels").IsNull())
+    {
+        Napi::Value bad = options.Get("badPixels");
+        if (bad.IsString())
+        {
+            badPath = bad.As<Napi::String>().Utf8Value();
+        }
+        else if (bad.IsArray())
+        {
+            // [列, 行] 或 { x, y }，可选的第三项/ time 为坏点出现的时间
+            Napi::Array list = bad.As<Napi::Array>();
+            for (uint32_t i = 0; i < list.Length(); i++)
+            {
+                Napi::Value item = list.Get(i);
+                Napi::Value x, y, time;
+                if (item.IsArray())
+                {
+                    Napi::Array pair = item.As<Napi::Array>();
+                    x = pair.Get(0u);
+                    y = pair.Get(1u);
+                    time = pair.Get(2u);
+                }
+                else if (item.IsObject())
+                {
+                    Napi::Object point = item.As<Napi::Object>();
+                    x = point.Get("x");
+                    y = point.Get("y");
+                    time = point.Get("time");
+                }
+                if (x.IsEmpty() || y.IsEmpty() || !x.IsNumber() || !y.IsNumber())
+                {
+                    Napi::TypeError::New(env, "badPixels entries must be [x, y] or { x, y }").ThrowAsJavaScriptException();
+                    return nullptr;
+                }
+                long long t = time.IsNumber() ? time.As<Napi::Number>().Int64Value() : 0;
+                badList.push_back({x.As<Napi::Number>().Int32Value(), y.As<Napi::Number>().Int32Value(), t});
+            }
+            pathsOnly = false;
+        }
+        else
+        {
+            Napi::TypeError::New(env, "badPixels must be a file path or an array of points").ThrowAsJavaScriptException();
+            return nullptr;
+        }
+    }
+
+    bool greenMatching = options.Has("greenMatching") && options.Get("greenMatching").ToBoolean().Value();
+
+    CalibrationLoader load = [&](std::string &error) -> std::shared_ptr<CalibrationData> {
+        std::shared_ptr<CalibrationData> data = std::make_shared<CalibrationData>();
+        data->greenMatching = greenMatching;
+
+        if (!darkPath.empty() && !readCalibrationFile(darkPath, darkPgm))
+        {
+            error = "Failed to read dark frame: " + darkPath;
+            return nullptr;
+        }
+        if (!darkPgm.empty())
+        {
+            const char *message = parseDarkFrame(darkPgm.data(), darkPgm.size(), *data);
+            if (message)
+            {
+                error = message;
+                return nullptr;
+            }
+        }
+        else if (!darkPixels.empty())
+        {
+            data->dark.swap(darkPixels);
+            data->darkWidth = darkWidth;
+            data->darkHeight = darkHeight;
+        }
+
+        if (!badPath.empty())
+        {
+            std::vector<unsigned char> text;
+            if (!readCalibrationFile(badPath, text))
+            {
+                error = "Failed to read bad pixel list: " + badPath;
+                return nullptr;
+            }
+            parseBadPixels(reinterpret_cast<const char *>(text.data()), text.size(), *data);
+        }
+        else
+        {
+            data->badPixels.swap(badList);
+        }
+        return data;
+    };
+
+    if (key.empty() && pathsOnly)
+        key = "dark=" + darkPath + "\nbad=" + badPath + "\ngreen=" + (greenMatching ? "1" : "0");
+
+    std::string error;
+    std::shared_ptr<const CalibrationData> data;
+    if (key.empty())
+        data = load(error);
+    else
+        data = acquireCalibration(key, load, error);
+    if (!data)
+    {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return nullptr;
+    }
+    return data;
+}
+
+Napi::Object LibRawWrapper::CalibrationInfo(Napi::Env env, const CalibrationData &data)
+{
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("key", data.key.empty() ? env.Null() : Napi::String::New(env, data.key));
+    if (data.dark.empty())
+    {
+        result.Set("darkFrame", env.Null());
+    }
+    else
+    {
+        Napi::Object dark = Napi::Object::New(env);
+        dark.Set("width", Napi::Number::New(env, data.darkWidth));
+        dark.Set("height", Napi::Number::New(env, data.darkHeight));
+        result.Set("darkFrame", dark);
+    }
+    result.Set("badPixels", Napi::Number::New(env, static_cast<double>(data.badPixels.size())));
+    result.Set("greenMatching", Napi::Boolean::New(env, data.greenMatching));
+    result.Set("bytes", Napi::Number::New(env, static_cast<double>(data.bytes())));
+    return result;
+}
+
+Napi::Value LibRawWrapper::SetCalibration(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || info[0].IsNull() || info[0].IsUndefined())
+    {
+        processor->setCalibration(nullptr, 1);
+        processor->invalidateRenderCache();
+        return env.Null();
+    }
+    if (!info[0].IsObject())
+    {
+        Napi::TypeError::New(env, "Expected calibration options object or null").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    Napi::Object options = info[0].As<Napi::Object>();
+    std::shared_ptr<const CalibrationData> data = AcquireCalibration(env, options);
+    if (!data)
+        return env.Null();
+
+    int threads = 1;
+    if (options.Has("threads") && options.Get("threads").IsNumber())
+        threads = std::max(1, std::min(64, options.Get("threads").As<Napi::Number>().Int32Value()));
+
+    processor->setCalibration(data, threads);
+    // 已缓存的去马赛克结果是用之前的校准得到的
+    processor->invalidateRenderCache();
+    return CalibrationInfo(env, *data);
+}
+
+Napi::Value LibRawWrapper::GetCalibrationInfo(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    const CalibrationData *data = processor->calibration();
+    if (!data)
+        return env.Null();
+    return CalibrationInfo(env, *data);
+}
+
+Napi::Value LibRawWrapper::LoadCalibration(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsObject())
+    {
+        Napi::TypeError::New(env, "Expected calibration options object").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    std::shared_ptr<const CalibrationData> data = AcquireCalibration(env, info[0].As<Napi::Object>());
+    if (!data)
+        return env.Null();
+    return CalibrationInfo(env, *data);
+}
+
+Napi::Value LibRawWrapper::ReleaseCalibration(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsString())
+    {
+        Napi::TypeError::New(env, "Expected calibration key").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return Napi::Boolean::New(env, releaseCalibration(info[0].As<Napi::String>().Utf8Value()));
+}
+
 // ============== 内存图像创建 ==============
 
 Napi::Object LibRawWrapper::CreateImageDataObject(Napi::Env env, libraw_processed_image_t *img)
@@ -540,19 +1032,61 @@ Napi::Object LibRawWrapper::CreateImageDataObject(Napi::Env env, libraw_processe
     return result;
 }
 
+// ============== 内存估算 ==============
+
+// 可选参数覆盖当前输出参数：{ quality, halfSize, outputBps }
+Napi::Value LibRawWrapper::EstimateMemory(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (!CheckLoaded(env))
+        return env.Null();
+
+    libraw_output_params_t params = processor->imgdata.params;
+    if (info.Length() > 0 && info[0].IsObject())
+    {
+        Napi::Object options = info[0].As<Napi::Object>();
+        if (options.Has("quality") && options.Get("quality").IsNumber())
+            params.user_qual = options.Get("quality").As<Napi::Number>().Int32Value();
+        if (options.Has("halfSize") && options.Get("halfSize").IsBoolean())
+            params.half_size = options.Get("halfSize").As<Napi::Boolean>().Value();
+        if (options.Has("outputBps") && options.Get("outputBps").IsNumber())
+            params.output_bps = options.Get("outputBps").As<Napi::Number>().Int32Value();
+    }
+
+    MemoryEstimate est = processor->estimateMemory(params);
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("raw", Napi::Number::New(env, static_cast<double>(est.rawBytes)));
+    result.Set("decoder", Napi::Number::New(env, static_cast<double>(est.decoderBytes)));
+    result.Set("image", Napi::Number::New(env, static_cast<double>(est.imageBytes)));
+    result.Set("histogram", Napi::Number::New(env, static_cast<double>(est.histogramBytes)));
+    result.Set("scratch", Napi::Number::New(env, static_cast<double>(est.scratchBytes)));
+    result.Set("cache", Napi::Number::New(env, static_cast<double>(est.cacheBytes)));
+    result.Set("output", Napi::Number::New(env, static_cast<double>(est.outputBytes)));
+    result.Set("peak", Napi::Number::New(env, static_cast<double>(est.peakBytes)));
+    return result;
+}
+
 Napi::Value LibRawWrapper::CreateMemoryImage(const Napi::CallbackInfo &info)
 {
     Napi::Env env = info.Env();
     if (!CheckLoaded(env))
         return env.Null();
+    if (!CheckDeadline(env))
+        return env.Null();
+    JobScope job(processor->priority());
     int errcode = 0;
     libraw_processed_image_t *img = processor->dcraw_make_mem_image(&errcode);
 
+    if (errcode == LIBRAW_CANCELLED_BY_CALLBACK)
+        return ThrowLibRawError(env, "Failed to create memory image: ", errcode);
+
     if (!img || errcode != LIBRAW_SUCCESS)
     {
         std::string error = "Failed to create memory image: ";
         if (errcode != LIBRAW_SUCCESS)
         {
+            Metrics::instance().recordError(errcode);
             error += libraw_strerror(errcode);
         }
         else
@@ -582,6 +1116,7 @@ Napi::Value LibRawWrapper::CreateMemoryThumbnail(const Napi::CallbackInfo &info)
         std::string error = "Failed to create memory thumbnail: ";
         if (errcode != LIBRAW_SUCCESS)
         {
+            Metrics::instance().recordError(errcode);
             error += libraw_strerror(errcode);
         }
         else
@@ -598,30 +1133,382 @@ Napi::Value LibRawWrapper::CreateMemoryThumbnail(const Napi::CallbackInfo &info)
     return result;
 }
 
-// ============== 文件写入器 ==============
-
-Napi::Value LibRawWrapper::WritePPM(const Napi::CallbackInfo &info)
+// 嵌入预览按 DCT 缩放解码并缩小到 maxDim，可选参数：{ orientation: 是否按拍摄方向旋转，默认 true }
+Napi::Value LibRawWrapper::GetPreviewRGB(const Napi::CallbackInfo &info)
 {
     Napi::Env env = info.Env();
     if (!CheckLoaded(env))
         return env.Null();
 
-    if (info.Length() < 1 || !info[0].IsString())
+    if (info.Length() < 1 || !info[0].IsNumber())
     {
-        Napi::TypeError::New(env, "Expected string filename").ThrowAsJavaScriptException();
+        Napi::TypeError::New(env, "Expected maximum dimension as first argument").ThrowAsJavaScriptException();
         return env.Null();
     }
-
-    std::string filename = info[0].As<Napi::String>().Utf8Value();
-    int ret = processor->dcraw_ppm_tiff_writer(filename.c_str());
+    int maxDim = info[0].As<Napi::Number>().Int32Value();
+    if (maxDim < 1 || maxDim > 65535)
+    {
+        Napi::RangeError::New(env, "Maximum dimension must be between 1 and 65535").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    bool orient = true;
+    if (info.Length() > 1 && info[1].IsObject())
+    {
+        Napi::Object options = info[1].As<Napi::Object>();
+        if (options.Has("orientation") && options.Get("orientation").IsBoolean())
+            orient = options.Get("orientation").As<Napi::Boolean>().Value();
+    }
+
+    PreviewImage preview;
+    std::string detail;
+    int ret = processor->makePreview(maxDim, orient, preview, detail);
     if (ret != LIBRAW_SUCCESS)
     {
-        std::string error = "Failed to write PPM file: ";
-        error += libraw_strerror(ret);
+        Metrics::instance().recordError(ret);
+        std::string error = "Failed to create preview: ";
+        error += detail.empty() ? libraw_strerror(ret) : detail;
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("width", Napi::Number::New(env, preview.width));
+    result.Set("height", Napi::Number::New(env, preview.height));
+    result.Set("colors", Napi::Number::New(env, 3));
+    result.Set("bits", Napi::Number::New(env, 8));
+    result.Set("sourceWidth", Napi::Number::New(env, preview.sourceWidth));
+    result.Set("sourceHeight", Napi::Number::New(env, preview.sourceHeight));
+    result.Set("scaleDenom", Napi::Number::New(env, preview.scaleDenom));
+    result.Set("flip", Napi::Number::New(env, preview.flip));
+    result.Set("data", Napi::Buffer<uint8_t>::Copy(env, preview.data.data(), preview.data.size()));
+    return result;
+}
+
+// 处理结果编码为 PNG，选项 { bits: 8 | 16（默认 output_bps）, compressionLevel: 0-9（默认 6）,
+// filter: "none" | "sub" | "up" | "average" | "paeth" | "adaptive"（默认 adaptive，压缩级别 0 时默认 none）,
+// threads: 压缩线程数（默认按 CPU 数，最多 8） }
+Napi::Value LibRawWrapper::CreatePNG(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (!CheckLoaded(env))
+        return env.Null();
+
+    int bits = 0;
+    bool filterSet = false;
+    PngOptions options;
+    if (info.Length() > 0 && !info[0].IsUndefined() && !info[0].IsNull())
+    {
+        if (!info[0].IsObject())
+        {
+            Napi::TypeError::New(env, "Expected options object").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        Napi::Object opts = info[0].As<Napi::Object>();
+        Napi::Value value = opts.Get("bits");
+        if (!value.IsUndefined())
+        {
+            double number = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : 0;
+            if (number != 8 && number != 16)
+            {
+                Napi::RangeError::New(env, "bits must be 8 or 16").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            bits = (int)number;
+        }
+        value = opts.Get("compressionLevel");
+        if (!value.IsUndefined())
+        {
+            double number = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : -1;
+            if (!(number >= 0 && number <= 9) || number != (int)number)
+            {
+                Napi::RangeError::New(env, "compressionLevel must be an integer between 0 and 9").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            options.level = (int)number;
+        }
+        value = opts.Get("filter");
+        if (!value.IsUndefined())
+        {
+            static const char *const filters[] = {"none", "sub", "up", "average", "paeth", "adaptive"};
+            std::string name = value.IsString() ? value.As<Napi::String>().Utf8Value() : "";
+            options.filter = -1;
+            for (int f = 0; f < 6; f++)
+                if (name == filters[f])
+                    options.filter = f;
+            if (options.filter < 0)
+            {
+                Napi::RangeError::New(env, "filter must be \"none\", \"sub\", \"up\", \"average\", \"paeth\" or \"adaptive\"")
+                    .ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            filterSet = true;
+        }
+        value = opts.Get("threads");
+        if (!value.IsUndefined())
+        {
+            double number = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : 0;
+            if (!(number >= 1 && number <= 8) || number != (int)number)
+            {
+                Napi::RangeError::New(env, "threads must be an integer between 1 and 8").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            options.threads = (int)number;
+        }
+    }
+    // 不压缩时滤波没有作用，与 libpng 一样默认不滤波
+    if (!filterSet && options.level == 0)
+        options.filter = PNG_FILTER_NONE;
+
+    if (!CheckDeadline(env))
+        return env.Null();
+    JobScope job(processor->priority());
+    std::vector<unsigned char> png;
+    PngStats stats;
+    std::string detail;
+    int ret = processor->makePng(bits, options, png, stats, detail);
+    if (ret == LIBRAW_CANCELLED_BY_CALLBACK)
+        return ThrowLibRawError(env, "Failed to create PNG: ", ret);
+    if (ret != LIBRAW_SUCCESS)
+    {
+        Metrics::instance().recordError(ret);
+        std::string error = "Failed to create PNG: ";
+        error += detail.empty() ? libraw_strerror(ret) : detail;
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
         return env.Null();
     }
 
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("width", Napi::Number::New(env, stats.width));
+    result.Set("height", Napi::Number::New(env, stats.height));
+    result.Set("colors", Napi::Number::New(env, stats.channels));
+    result.Set("bits", Napi::Number::New(env, stats.bits));
+    result.Set("iccProfile", stats.iccName.empty() ? env.Null() : Napi::String::New(env, stats.iccName));
+    result.Set("segments", Napi::Number::New(env, stats.segments));
+    result.Set("threads", Napi::Number::New(env, stats.threads));
+    Napi::Object filterRows = Napi::Object::New(env);
+    static const char *const filterNames[] = {"none", "sub", "up", "average", "paeth"};
+    for (int f = 0; f < 5; f++)
+        filterRows.Set(filterNames[f], Napi::Number::New(env, stats.filterRows[f]));
+    result.Set("filterRows", filterRows);
+    result.Set("data", Napi::Buffer<uint8_t>::Copy(env, png.data(), png.size()));
+    return result;
+}
+
+// 处理结果一次生成 Deep Zoom 瓦片金字塔，选项 { tileSize: 16-4096（默认 256）, overlap: 0-tileSize（默认 0）,
+// format: "jpeg" | "png"（默认 jpeg）, quality: 1-100（默认 90）, compressionLevel: 0-9（PNG，默认 6）,
+// threads: 编码线程数（默认按 CPU 数，最多 8）, directory: 瓦片目录（各层子目录需已存在）,
+// onTile: 每个瓦片编码完成后同步调用的函数 }，directory 和 onTile 至少指定一个
+Napi::Value LibRawWrapper::ExportTilePyramid(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (!CheckLoaded(env))
+        return env.Null();
+
+    if (info.Length() < 1 || !info[0].IsObject())
+    {
+        Napi::TypeError::New(env, "Expected options object").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Napi::Object opts = info[0].As<Napi::Object>();
+    TilePyramidOptions options;
+    Napi::Value value = opts.Get("tileSize");
+    if (!value.IsUndefined())
+    {
+        double number = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : -1;
+        if (!(number >= 16 && number <= 4096) || number != (int)number)
+        {
+            Napi::RangeError::New(env, "tileSize must be an integer between 16 and 4096").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        options.tileSize = (int)number;
+    }
+    value = opts.Get("overlap");
+    if (!value.IsUndefined())
+    {
+        double number = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : -1;
+        if (!(number >= 0 && number <= options.tileSize) || number != (int)number)
+        {
+            Napi::RangeError::New(env, "overlap must be an integer between 0 and tileSize").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        options.overlap = (int)number;
+    }
+    value = opts.Get("quality");
+    if (!value.IsUndefined())
+    {
+        double number = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : -1;
+        if (!(number >= 1 && number <= 100) || number != (int)number)
+        {
+            Napi::RangeError::New(env, "quality must be an integer between 1 and 100").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        options.quality = (int)number;
+    }
+    value = opts.Get("compressionLevel");
+    if (!value.IsUndefined())
+    {
+        double number = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : -1;
+        if (!(number >= 0 && number <= 9) || number != (int)number)
+        {
+            Napi::RangeError::New(env, "compressionLevel must be an integer between 0 and 9").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        options.pngLevel = (int)number;
+    }
+    value = opts.Get("threads");
+    if (!value.IsUndefined())
+    {
+        double number = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : -1;
+        if (!(number >= 1 && number <= 8) || number != (int)number)
+        {
+            Napi::RangeError::New(env, "threads must be an integer between 1 and 8").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        options.threads = (int)number;
+    }
+    value = opts.Get("format");
+    if (!value.IsUndefined())
+    {
+        std::string format = value.IsString() ? value.As<Napi::String>().Utf8Value() : "";
+        if (format != "jpeg" && format != "png")
+        {
+            Napi::RangeError::New(env, "format must be \"jpeg\" or \"png\"").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        options.format = format == "png" ? TILE_FORMAT_PNG : TILE_FORMAT_JPEG;
+    }
+    else if (!jpegPreviewAvailable())
+    {
+        // 没有链接 libjpeg 时默认输出 PNG
+        options.format = TILE_FORMAT_PNG;
+    }
+#ifndef USE_LIBJPEG
+    if (options.format == TILE_FORMAT_JPEG)
+    {
+        Napi::Error::New(env, "JPEG output is not available: addon was built without libjpeg").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+#endif
+    std::string directory;
+    value = opts.Get("directory");
+    if (!value.IsUndefined())
+    {
+        if (!value.IsString())
+        {
+            Napi::TypeError::New(env, "directory must be a string").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        directory = value.As<Napi::String>().Utf8Value();
+    }
+    Napi::Function onTile;
+    value = opts.Get("onTile");
+    if (!value.IsUndefined())
+    {
+        if (!value.IsFunction())
+        {
+            Napi::TypeError::New(env, "onTile must be a function").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        onTile = value.As<Napi::Function>();
+    }
+    if (directory.empty() && onTile.IsEmpty())
+    {
+        Napi::TypeError::New(env, "Expected directory or onTile").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    // 瓦片在调用线程中逐个交付：先写文件，再交给回调；回调抛出异常时停止导出
+    const std::string extension = options.format == TILE_FORMAT_PNG ? ".png" : ".jpeg";
+    std::string sinkError;
+    auto sink = [&](PyramidTile &tile) -> bool {
+        Napi::HandleScope scope(env);
+        if (!directory.empty())
+        {
+            std::string path = directory + "/" + std::to_string(tile.level) + "/" + std::to_string(tile.col) + "_" +
+                               std::to_string(tile.row) + extension;
+            FILE *file = fopen(path.c_str(), "wb");
+            bool written = file && fwrite(tile.data.data(), 1, tile.data.size(), file) == tile.data.size();
+            if (file && fclose(file) != 0)
+                written = false;
+            if (!written)
+            {
+                sinkError = "Cannot write tile " + path;
+                return false;
+            }
+        }
+        if (!onTile.IsEmpty())
+        {
+            Napi::Object object = Napi::Object::New(env);
+            object.Set("level", Napi::Number::New(env, tile.level));
+            object.Set("col", Napi::Number::New(env, tile.col));
+            object.Set("row", Napi::Number::New(env, tile.row));
+            object.Set("x", Napi::Number::New(env, tile.x));
+            object.Set("y", Napi::Number::New(env, tile.y));
+            object.Set("width", Napi::Number::New(env, tile.width));
+            object.Set("height", Napi::Number::New(env, tile.height));
+            object.Set("data", Napi::Buffer<uint8_t>::Copy(env, tile.data.data(), tile.data.size()));
+            onTile.Call({object});
+            if (env.IsExceptionPending())
+                return false;
+        }
+        return true;
+    };
+
+    if (!CheckDeadline(env))
+        return env.Null();
+    JobScope job(processor->priority());
+    TilePyramidStats stats;
+    std::string detail;
+    int ret = processor->makeTilePyramid(options, sink, stats, detail);
+    if (env.IsExceptionPending())
+        return env.Null();
+    if (ret == LIBRAW_CANCELLED_BY_CALLBACK)
+        return ThrowLibRawError(env, "Failed to export tile pyramid: ", ret);
+    if (ret != LIBRAW_SUCCESS)
+    {
+        Metrics::instance().recordError(ret);
+        std::string error = "Failed to export tile pyramid: ";
+        error += !sinkError.empty() ? sinkError : detail.empty() ? libraw_strerror(ret) : detail;
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("width", Napi::Number::New(env, stats.width));
+    result.Set("height", Napi::Number::New(env, stats.height));
+    result.Set("levels", Napi::Number::New(env, stats.levels));
+    result.Set("tiles", Napi::Number::New(env, stats.tiles));
+    result.Set("bytes", Napi::Number::New(env, (double)stats.bytes));
+    result.Set("threads", Napi::Number::New(env, stats.threads));
+    result.Set("format", Napi::String::New(env, options.format == TILE_FORMAT_PNG ? "png" : "jpeg"));
+    result.Set("tileSize", Napi::Number::New(env, options.tileSize));
+    result.Set("overlap", Napi::Number::New(env, options.overlap));
+    result.Set("dzi", Napi::String::New(env, tilePyramidDescriptor(stats.width, stats.height, options)));
+    return result;
+}
+
+// ============== 文件写入器 ==============
+
+Napi::Value LibRawWrapper::WritePPM(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (!CheckLoaded(env))
+        return env.Null();
+
+    if (info.Length() < 1 || !info[0].IsString())
+    {
+        Napi::TypeError::New(env, "Expected string filename").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    std::string filename = info[0].As<Napi::String>().Utf8Value();
+    if (!CheckDeadline(env))
+        return env.Null();
+    JobScope job(processor->priority());
+    int ret = processor->dcraw_ppm_tiff_writer(filename.c_str());
+    if (ret != LIBRAW_SUCCESS)
+        return ThrowLibRawError(env, "Failed to write PPM file: ", ret);
+
     return Napi::Boolean::New(env, true);
 }
 
@@ -638,19 +1525,119 @@ Napi::Value LibRawWrapper::WriteTIFF(const Napi::CallbackInfo &info)
     }
 
     std::string filename = info[0].As<Napi::String>().Utf8Value();
+    if (!CheckDeadline(env))
+        return env.Null();
+    JobScope job(processor->priority());
     // 设置输出格式为 TIFF
     processor->imgdata.params.output_tiff = 1;
 
     int ret = processor->dcraw_ppm_tiff_writer(filename.c_str());
     if (ret != LIBRAW_SUCCESS)
+        return ThrowLibRawError(env, "Failed to write TIFF file: ", ret);
+
+    return Napi::Boolean::New(env, true);
+}
+
+// 分段流式输出，选项 { format: "tiff" | "jpeg", bandRows, quality }。openFile() 之后调用时，
+// 可以按行定位的格式按段从文件解码，不分配完整的 raw 缓冲区
+Napi::Value LibRawWrapper::WriteStreamed(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (!CheckLoaded(env))
+        return env.Null();
+
+    if (info.Length() < 1 || !info[0].IsString())
     {
-        std::string error = "Failed to write TIFF file: ";
-        error += libraw_strerror(ret);
+        Napi::TypeError::New(env, "Expected string filename").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    std::string filename = info[0].As<Napi::String>().Utf8Value();
+
+    std::string format = "tiff";
+    int bandRows = 256;
+    int quality = 90;
+    if (info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsNull())
+    {
+        if (!info[1].IsObject())
+        {
+            Napi::TypeError::New(env, "Expected options object").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        Napi::Object options = info[1].As<Napi::Object>();
+        Napi::Value value = options.Get("format");
+        if (!value.IsUndefined())
+            format = value.IsString() ? value.As<Napi::String>().Utf8Value() : "";
+        value = options.Get("bandRows");
+        if (!value.IsUndefined())
+        {
+            double number = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : 0;
+            if (!(number >= 16 && number <= 65535) || number != (int)number)
+            {
+                Napi::RangeError::New(env, "bandRows must be an integer between 16 and 65535").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            bandRows = (int)number;
+        }
+        value = options.Get("quality");
+        if (!value.IsUndefined())
+        {
+            double number = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : 0;
+            if (!(number >= 1 && number <= 100) || number != (int)number)
+            {
+                Napi::RangeError::New(env, "quality must be an integer between 1 and 100").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            quality = (int)number;
+        }
+    }
+
+    std::unique_ptr<BandWriter> writer;
+    if (format == "tiff")
+        writer = createTiffBandWriter(filename);
+    else if (format == "jpeg")
+        writer = createJpegBandWriter(filename, quality);
+    else
+    {
+        Napi::RangeError::New(env, "format must be \"tiff\" or \"jpeg\"").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!writer)
+    {
+        Napi::Error::New(env, "JPEG output is not available: addon was built without libjpeg").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    if (!CheckDeadline(env))
+        return env.Null();
+    JobScope job(processor->priority());
+    StreamedStats stats;
+    std::string detail;
+    int ret = processor->processStreamed(*writer, bandRows, stats, detail);
+    // 处理结果不保留在 image 中；内存模式下 raw 数据已经解包
+    isUnpacked = (processor->imgdata.progress_flags & LIBRAW_PROGRESS_LOAD_RAW) != 0;
+    isProcessed = false;
+    if (ret == LIBRAW_CANCELLED_BY_CALLBACK)
+        return ThrowLibRawError(env, "Failed to write streamed image: ", ret);
+    if (ret != LIBRAW_SUCCESS)
+    {
+        Metrics::instance().recordError(ret);
+        std::string error = "Failed to write streamed image: ";
+        error += detail.empty() ? libraw_strerror(ret) : detail;
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
         return env.Null();
     }
 
-    return Napi::Boolean::New(env, true);
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("width", Napi::Number::New(env, stats.width));
+    result.Set("height", Napi::Number::New(env, stats.height));
+    result.Set("bands", Napi::Number::New(env, stats.bands));
+    result.Set("bandRows", Napi::Number::New(env, stats.bandRows));
+    result.Set("haloRows", Napi::Number::New(env, stats.haloRows));
+    result.Set("rowDecoder", Napi::Boolean::New(env, stats.rowDecoder));
+    result.Set("whiteEstimated", Napi::Boolean::New(env, stats.whiteEstimated));
+    result.Set("bandBytes", Napi::Number::New(env, (double)stats.bandBytes));
+    result.Set("bytesWritten", Napi::Number::New(env, (double)stats.bytesWritten));
+    return result;
 }
 
 Napi::Value LibRawWrapper::WriteThumbnail(const Napi::CallbackInfo &info)
@@ -669,6 +1656,7 @@ Napi::Value LibRawWrapper::WriteThumbnail(const Napi::CallbackInfo &info)
     int ret = processor->dcraw_thumb_writer(filename.c_str());
     if (ret != LIBRAW_SUCCESS)
     {
+        Metrics::instance().recordError(ret);
         std::string error = "Failed to write thumbnail: ";
         error += libraw_strerror(ret);
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
@@ -904,6 +1892,352 @@ Napi::Value LibRawWrapper::GetCameraCount(const Napi::CallbackInfo &info)
     return Napi::Number::New(env, count);
 }
 
+// 进程级调度统计，包含所有 worker 中的 LibRaw 实例
+Napi::Value LibRawWrapper::GetSchedulerStats(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    Napi::Object result = Napi::Object::New(env);
+
+    for (int i = 0; i < JOB_LANE_COUNT; i++)
+    {
+        JobLane lane = static_cast<JobLane>(i);
+        JobLaneStats stats = JobScheduler::instance().stats(lane);
+
+        Napi::Object laneStats = Napi::Object::New(env);
+        laneStats.Set("active", Napi::Number::New(env, stats.active));
+        laneStats.Set("paused", Napi::Number::New(env, stats.paused));
+        laneStats.Set("calls", Napi::Number::New(env, static_cast<double>(stats.calls)));
+        laneStats.Set("preemptions", Napi::Number::New(env, static_cast<double>(stats.preemptions)));
+        laneStats.Set("pausedMs", Napi::Number::New(env, stats.pausedMs));
+        result.Set(JobScheduler::laneName(lane), laneStats);
+    }
+
+    return result;
+}
+
+static Napi::Object HistogramObject(Napi::Env env, const MetricHistogram &histogram)
+{
+    Napi::Object result = Napi::Object::New(env);
+    Napi::Array buckets = Napi::Array::New(env, METRIC_BUCKETS + 1);
+    for (int b = 0; b <= METRIC_BUCKETS; b++)
+        buckets[static_cast<uint32_t>(b)] = Napi::Number::New(env, static_cast<double>(histogram.buckets[b]));
+    result.Set("buckets", buckets);
+    result.Set("count", Napi::Number::New(env, static_cast<double>(histogram.count)));
+    result.Set("sum", Napi::Number::New(env, histogram.sum));
+    return result;
+}
+
+// 进程级性能计数器的快照（所有 worker 和线程的合计），直方图的桶不累加，最后一个为 +Inf
+Napi::Value LibRawWrapper::GetMetrics(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    MetricsSnapshot snap = Metrics::instance().snapshot();
+    Napi::Object result = Napi::Object::New(env);
+
+    Napi::Array bounds = Napi::Array::New(env, METRIC_BUCKETS);
+    for (int b = 0; b < METRIC_BUCKETS; b++)
+        bounds[static_cast<uint32_t>(b)] = Napi::Number::New(env, Metrics::bucketBounds()[b]);
+    result.Set("bucketBounds", bounds);
+
+    Napi::Array decoders = Napi::Array::New(env, snap.decoders.size());
+    for (size_t d = 0; d < snap.decoders.size(); d++)
+    {
+        Napi::Object decoder = Napi::Object::New(env);
+        decoder.Set("decoder", Napi::String::New(env, snap.decoders[d]));
+        decoder.Set("files", Napi::Number::New(env, static_cast<double>(snap.filesOpened[d])));
+        decoder.Set("bytes", Napi::Number::New(env, static_cast<double>(snap.inputBytes[d])));
+        decoders[static_cast<uint32_t>(d)] = decoder;
+    }
+    result.Set("decoders", decoders);
+
+    Napi::Object stages = Napi::Object::New(env);
+    for (int s = 0; s < METRIC_STAGE_COUNT; s++)
+    {
+        Napi::Object stage = HistogramObject(env, snap.stageSeconds[s]);
+        stage.Set("pixels", Napi::Number::New(env, static_cast<double>(snap.stagePixels[s])));
+        stages.Set(Metrics::stageName(static_cast<MetricStage>(s)), stage);
+    }
+    result.Set("stages", stages);
+
+    Napi::Object errors = Napi::Object::New(env);
+    for (int e = 0; e < METRIC_ERROR_CODES; e++)
+        if (snap.errors[e])
+            errors.Set(Metrics::errorName(e), Napi::Number::New(env, static_cast<double>(snap.errors[e])));
+    result.Set("errors", errors);
+
+    Napi::Object cancellations = Napi::Object::New(env);
+    cancellations.Set("deadline", Napi::Number::New(env, static_cast<double>(snap.cancellations[0])));
+    cancellations.Set("other", Napi::Number::New(env, static_cast<double>(snap.cancellations[1])));
+    result.Set("cancellations", cancellations);
+
+    Napi::Object queueWait = Napi::Object::New(env);
+    for (int q = 0; q < METRIC_QUEUE_COUNT; q++)
+    {
+        Napi::Object lanes = Napi::Object::New(env);
+        for (int l = 0; l < JOB_LANE_COUNT; l++)
+            lanes.Set(JobScheduler::laneName(static_cast<JobLane>(l)), HistogramObject(env, snap.queueWait[q][l]));
+        queueWait.Set(Metrics::queueName(static_cast<MetricQueue>(q)), lanes);
+    }
+    result.Set("queueWait", queueWait);
+
+    Napi::Object memory = Napi::Object::New(env);
+    memory.Set("allocations", Napi::Number::New(env, static_cast<double>(snap.allocations)));
+    memory.Set("allocatedBytes", Napi::Number::New(env, static_cast<double>(snap.allocatedBytes)));
+    memory.Set("liveBytes", Napi::Number::New(env, static_cast<double>(snap.liveBytes)));
+    memory.Set("peakBytes", Napi::Number::New(env, static_cast<double>(snap.peakBytes)));
+    result.Set("memory", memory);
+
+    return result;
+}
+
+// 记录 JS 端队列（WorkerPool）中任务的等待时间：observeQueueWait(lane, ms)
+Napi::Value LibRawWrapper::ObserveQueueWait(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    JobLane lane;
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsNumber())
+    {
+        Napi::TypeError::New(env, "Expected (lane, ms)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    std::string name = info[0].As<Napi::String>().Utf8Value();
+    if (!JobScheduler::parseLane(name.c_str(), &lane))
+    {
+        Napi::RangeError::New(env, "Priority must be 'interactive', 'normal' or 'background'").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    double ms = info[1].As<Napi::Number>().DoubleValue();
+    if (!(ms >= 0 && ms < 1e12))
+    {
+        Napi::RangeError::New(env, "ms must be a non-negative number").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Metrics::instance().recordQueueWait(METRIC_QUEUE_POOL, lane, ms / 1000);
+    return Napi::Boolean::New(env, true);
+}
+
+// 热点循环实际使用的指令集和 CPU 支持的最高指令集
+Napi::Value LibRawWrapper::GetSimdInfo(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("level", Napi::String::New(env, simdLevelName(simdLevel())));
+    result.Set("detected", Napi::String::New(env, simdLevelName(simdDetectedLevel())));
+    return result;
+}
+
+// 编译时是否链接了 libjpeg（node-gyp rebuild --use_libjpeg=true）
+Napi::Value LibRawWrapper::HasNativeJpeg(const Napi::CallbackInfo &info)
+{
+    return Napi::Boolean::New(info.Env(), jpegPreviewAvailable());
+}
+
+// ============== 共享缓存 ==============
+
+namespace
+{
+    // 渲染结果：输出数据和 JS 侧的其余字段（JSON）
+    class CachedOutput : public CacheEntry
+    {
+    public:
+        size_t bytes() const override { return data.size() + meta.size() + sizeof(*this); }
+
+        std::vector<uint8_t> data;
+        std::string meta;
+    };
+
+    Napi::Object CacheStatsObject(Napi::Env env, const SharedCacheStats &stats)
+    {
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("entries", Napi::Number::New(env, (double)stats.entries));
+        result.Set("bytes", Napi::Number::New(env, (double)stats.bytes));
+        result.Set("budget", Napi::Number::New(env, (double)stats.budget));
+        result.Set("hits", Napi::Number::New(env, (double)stats.hits));
+        result.Set("misses", Napi::Number::New(env, (double)stats.misses));
+        result.Set("waits", Napi::Number::New(env, (double)stats.waits));
+        result.Set("evictions", Napi::Number::New(env, (double)stats.evictions));
+        result.Set("rejected", Napi::Number::New(env, (double)stats.rejected));
+        return result;
+    }
+}
+
+// { outputBudget, rawBudget }：字节数，0 表示禁用；{ rawCacheDir, rawCacheDecoders, rawCacheBudget }：磁盘 raw
+// 缓存的目录（空字符串或 null 表示禁用）、缓存的格式（'expensive' 或 'all'）和目录的字节上限（0 表示不限制）。
+// 未给出的保持不变
+Napi::Value LibRawWrapper::ConfigureCache(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsObject())
+    {
+        Napi::TypeError::New(env, "Expected cache options object").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Napi::Object options = info[0].As<Napi::Object>();
+    const char *names[2] = {"outputBudget", "rawBudget"};
+    SharedCache *caches[2] = {&outputCache(), &rawCache()};
+    for (int i = 0; i < 2; i++)
+    {
+        Napi::Value value = options.Get(names[i]);
+        if (value.IsUndefined())
+            continue;
+        double budget = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : -1;
+        if (!(budget >= 0))
+        {
+            Napi::RangeError::New(env, std::string(names[i]) + " must be a non-negative number of bytes")
+                .ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        caches[i]->setBudget((size_t)budget);
+    }
+
+    Napi::Value dir = options.Get("rawCacheDir");
+    Napi::Value decoders = options.Get("rawCacheDecoders");
+    Napi::Value diskBudget = options.Get("rawCacheBudget");
+    if (!dir.IsUndefined() || !decoders.IsUndefined() || !diskBudget.IsUndefined())
+    {
+        RawDiskCacheStats current = rawDiskCacheStats();
+        std::string directory = current.directory;
+        bool allDecoders = current.allDecoders;
+        uint64_t budget = current.budget;
+        if (!diskBudget.IsUndefined())
+        {
+            double bytes = diskBudget.IsNumber() ? diskBudget.As<Napi::Number>().DoubleValue() : -1;
+            if (!(bytes >= 0))
+            {
+                Napi::RangeError::New(env, "rawCacheBudget must be a non-negative number of bytes")
+                    .ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            budget = (uint64_t)bytes;
+        }
+        if (dir.IsNull() || dir.IsString())
+            directory = dir.IsNull() ? std::string() : dir.As<Napi::String>().Utf8Value();
+        else if (!dir.IsUndefined())
+        {
+            Napi::TypeError::New(env, "rawCacheDir must be a directory path or null").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        if (decoders.IsString())
+        {
+            std::string mode = decoders.As<Napi::String>().Utf8Value();
+            if (mode != "expensive" && mode != "all")
+            {
+                Napi::RangeError::New(env, "rawCacheDecoders must be 'expensive' or 'all'").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            allDecoders = mode == "all";
+        }
+        else if (!decoders.IsUndefined())
+        {
+            Napi::TypeError::New(env, "rawCacheDecoders must be a string").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        if (!setRawDiskCache(directory, allDecoders, budget))
+        {
+            Napi::Error::New(env, "Raw cache directory does not exist: " + directory).ThrowAsJavaScriptException();
+            return env.Null();
+        }
+    }
+    return GetCacheStats(info);
+}
+
+Napi::Value LibRawWrapper::GetCacheStats(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("output", CacheStatsObject(env, outputCache().stats()));
+    result.Set("raw", CacheStatsObject(env, rawCache().stats()));
+
+    RawDiskCacheStats disk = rawDiskCacheStats();
+    Napi::Object diskStats = Napi::Object::New(env);
+    if (disk.directory.empty())
+        diskStats.Set("directory", env.Null());
+    else
+        diskStats.Set("directory", Napi::String::New(env, disk.directory));
+    diskStats.Set("decoders", Napi::String::New(env, disk.allDecoders ? "all" : "expensive"));
+    diskStats.Set("budget", Napi::Number::New(env, (double)disk.budget));
+    diskStats.Set("bytes", Napi::Number::New(env, (double)disk.bytes));
+    diskStats.Set("hits", Napi::Number::New(env, (double)disk.hits));
+    diskStats.Set("misses", Napi::Number::New(env, (double)disk.misses));
+    diskStats.Set("writes", Napi::Number::New(env, (double)disk.writes));
+    diskStats.Set("errors", Napi::Number::New(env, (double)disk.errors));
+    diskStats.Set("evictions", Napi::Number::New(env, (double)disk.evictions));
+    diskStats.Set("bytesRead", Napi::Number::New(env, (double)disk.bytesRead));
+    diskStats.Set("bytesWritten", Napi::Number::New(env, (double)disk.bytesWritten));
+    result.Set("disk", diskStats);
+    return result;
+}
+
+// clearCache({ disk })：disk 为 true 时同时删除磁盘 raw 缓存目录中的缓存文件
+Napi::Value LibRawWrapper::ClearCache(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    outputCache().clear();
+    rawCache().clear();
+    if (info.Length() > 0 && info[0].IsObject() && info[0].As<Napi::Object>().Get("disk").ToBoolean().Value())
+        clearRawDiskCache();
+    return Napi::Boolean::New(env, true);
+}
+
+// 返回 { data, meta } 表示命中；null 表示调用方负责渲染，之后必须调用 cacheFulfil 或 cacheAbandon；
+// 'pending' 表示当前线程已在渲染该 key；'busy' 表示其他线程正在渲染，调用方稍后重试（第二个参数为 true），
+// 不阻塞 JS 线程。cacheAcquire(key, waited)
+Napi::Value LibRawWrapper::CacheAcquire(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsString())
+    {
+        Napi::TypeError::New(env, "Expected cache key").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    std::string key = info[0].As<Napi::String>().Utf8Value();
+    const bool waited = info.Length() > 1 && info[1].ToBoolean().Value();
+
+    std::shared_ptr<const CacheEntry> entry;
+    SharedCache::AcquireState state = outputCache().acquire(key, entry, waited);
+    if (state == SharedCache::ACQUIRE_PENDING)
+        return Napi::String::New(env, "pending");
+    if (state == SharedCache::ACQUIRE_BUSY)
+        return Napi::String::New(env, "busy");
+    if (state == SharedCache::ACQUIRE_LEADER)
+        return env.Null();
+
+    // 缓存项在线程间共享，交给 JS 的是副本
+    const CachedOutput &output = static_cast<const CachedOutput &>(*entry);
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("data", Napi::Buffer<uint8_t>::Copy(env, output.data.data(), output.data.size()));
+    result.Set("meta", Napi::String::New(env, output.meta));
+    return result;
+}
+
+Napi::Value LibRawWrapper::CacheFulfil(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() < 3 || !info[0].IsString() || !info[1].IsBuffer() || !info[2].IsString())
+    {
+        Napi::TypeError::New(env, "Expected cache key, data buffer and metadata string").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Napi::Buffer<uint8_t> data = info[1].As<Napi::Buffer<uint8_t>>();
+    std::shared_ptr<CachedOutput> output = std::make_shared<CachedOutput>();
+    output->data.assign(data.Data(), data.Data() + data.Length());
+    output->meta = info[2].As<Napi::String>().Utf8Value();
+    outputCache().fulfil(info[0].As<Napi::String>().Utf8Value(), output);
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value LibRawWrapper::CacheAbandon(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsString())
+    {
+        Napi::TypeError::New(env, "Expected cache key").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    outputCache().abandon(info[0].As<Napi::String>().Utf8Value());
+    return Napi::Boolean::New(env, true);
+}
+
 // ============== 扩展实用函数 ==============
 
 Napi::Value LibRawWrapper::IsNikonSRAW(const Napi::CallbackInfo &info)
@@ -982,6 +2316,7 @@ Napi::Value LibRawWrapper::GetDecoderInfo(const Napi::CallbackInfo &info)
 
     if (ret != LIBRAW_SUCCESS)
     {
+        Metrics::instance().recordError(ret);
         std::string error = "Failed to get decoder info: ";
         error += libraw_strerror(ret);
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
@@ -1002,15 +2337,18 @@ Napi::Value LibRawWrapper::Unpack(const Napi::CallbackInfo &info)
     Napi::Env env = info.Env();
     if (!CheckLoaded(env))
         return env.Null();
-    int ret = processor->unpack();
-    if (ret != LIBRAW_SUCCESS)
-    {
-        std::string error = "Failed to unpack: ";
-        error += libraw_strerror(ret);
-        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+    int subsample;
+    if (!ReadSubsample(env, info, 0, subsample) || !CheckDeadline(env))
         return env.Null();
-    }
+    JobScope job(processor->priority());
+    // unpack 会重新分配 raw 缓冲区
+    ReleaseRawView();
+    processor->invalidateRenderCache();
+    int ret = processor->unpackSubsampled(subsample);
+    if (ret != LIBRAW_SUCCESS)
+        return ThrowLibRawError(env, "Failed to unpack: ", ret);
 
+    isUnpacked = true;
     return Napi::Boolean::New(env, true);
 }
 
@@ -1029,6 +2367,7 @@ Napi::Value LibRawWrapper::Raw2ImageEx(const Napi::CallbackInfo &info)
     int ret = processor->raw2image_ex(do_subtract_black);
     if (ret != LIBRAW_SUCCESS)
     {
+        Metrics::instance().recordError(ret);
         std::string error = "Failed to convert raw to image: ";
         error += libraw_strerror(ret);
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
@@ -1046,6 +2385,7 @@ Napi::Value LibRawWrapper::AdjustSizesInfoOnly(const Napi::CallbackInfo &info)
     int ret = processor->adjust_sizes_info_only();
     if (ret != LIBRAW_SUCCESS)
     {
+        Metrics::instance().recordError(ret);
         std::string error = "Failed to adjust sizes: ";
         error += libraw_strerror(ret);
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
@@ -1088,10 +2428,143 @@ Napi::Value LibRawWrapper::ConvertFloatToInt(const Napi::CallbackInfo &info)
         dtarget = info[2].As<Napi::Number>().FloatValue();
     }
 
+    // 转换后浮点缓冲区被整数缓冲区替换
+    ReleaseRawView();
     processor->convertFloatToInt(dmin, dmax, dtarget);
     return Napi::Boolean::New(env, true);
 }
 
+// ============== 多帧解码 ==============
+
+// 打开文件或 Buffer 并解码全部帧（见 LibRawProcessor::unpackAllFrames）。
+// { combine: true } 时以 PENTAX_PS_ALLFRAMES 打开，像素偏移文件额外得到合并后的四通道帧
+Napi::Value LibRawWrapper::LoadAllFrames(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || (!info[0].IsString() && !info[0].IsBuffer()))
+    {
+        Napi::TypeError::New(env, "Expected string filename or Buffer").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    bool combine = false;
+    if (info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsNull())
+    {
+        if (!info[1].IsObject())
+        {
+            Napi::TypeError::New(env, "Expected options object").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        combine = info[1].As<Napi::Object>().Get("combine").ToBoolean().Value();
+    }
+    if (!CheckDeadline(env))
+        return env.Null();
+    JobScope job(processor->priority());
+    ReleaseRawView();
+    ReleaseFrames();
+    inputBuffer.Reset();
+    processor->invalidateRenderCache();
+
+    // 合并选项只在 identify 时起作用，打开后恢复调用方的设置
+    std::string filename;
+    FrameSource source = {nullptr, nullptr, 0};
+    unsigned &options = processor->imgdata.rawparams.options;
+    const unsigned savedOptions = options;
+    if (combine)
+        options |= LIBRAW_RAWOPTIONS_PENTAX_PS_ALLFRAMES;
+    else
+        options &= ~LIBRAW_RAWOPTIONS_PENTAX_PS_ALLFRAMES;
+    int ret;
+    if (info[0].IsString())
+    {
+        filename = info[0].As<Napi::String>().Utf8Value();
+        source.filename = filename.c_str();
+        ret = processor->open_file(source.filename);
+    }
+    else
+    {
+        Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
+        source.buffer = buffer.Data();
+        source.size = buffer.Length();
+        ret = processor->open_buffer(source.buffer, source.size);
+        if (ret == LIBRAW_SUCCESS)
+            inputBuffer = Napi::Persistent(buffer);
+    }
+    options = savedOptions;
+    if (ret != LIBRAW_SUCCESS)
+        return ThrowLibRawError(env, "Failed to open file: ", ret);
+
+    int combined = -1;
+    ret = processor->unpackAllFrames(source, frames, combined);
+    if (ret != LIBRAW_SUCCESS)
+    {
+        ReleaseFrames();
+        return ThrowLibRawError(env, "Failed to unpack frames: ", ret);
+    }
+
+    isLoaded = true;
+    isUnpacked = true;
+    isProcessed = false;
+    currentFrame = combined >= 0 ? combined : (int)processor->imgdata.rawparams.shot_select;
+
+    Napi::Array list = Napi::Array::New(env, frames.size());
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        const RawSnapshot &frame = *frames[i];
+        Napi::Object item = Napi::Object::New(env);
+        item.Set("index", Napi::Number::New(env, (double)i));
+        item.Set("width", Napi::Number::New(env, frame.sizes.width));
+        item.Set("height", Napi::Number::New(env, frame.sizes.height));
+        item.Set("rawWidth", Napi::Number::New(env, frame.sizes.raw_width));
+        item.Set("rawHeight", Napi::Number::New(env, frame.sizes.raw_height));
+        item.Set("channels", Napi::Number::New(env, frame.layout == 0 ? 1 : (frame.layout == 1 ? 4 : 3)));
+        item.Set("colors", Napi::Number::New(env, frame.iparams.colors));
+        item.Set("combined", Napi::Boolean::New(env, (int)i == combined));
+        list.Set((uint32_t)i, item);
+    }
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("count", Napi::Number::New(env, (double)frames.size()));
+    result.Set("current", Napi::Number::New(env, currentFrame));
+    result.Set("combined", combined >= 0 ? Napi::Value(Napi::Number::New(env, combined)) : env.Null());
+    result.Set("frames", list);
+    return result;
+}
+
+// 切换到 loadAllFrames() 解码的一帧，之前的处理结果和 getRawData() 视图失效
+Napi::Value LibRawWrapper::SelectFrame(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (!CheckLoaded(env))
+        return env.Null();
+    if (frames.empty())
+    {
+        Napi::Error::New(env, "No frames loaded. Call loadAllFrames() first.").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (info.Length() < 1 || !info[0].IsNumber())
+    {
+        Napi::TypeError::New(env, "Expected frame index").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    double index = info[0].As<Napi::Number>().DoubleValue();
+    if (!(index >= 0 && index < frames.size()) || index != (int)index)
+    {
+        Napi::RangeError::New(env, "Frame index out of range").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    ReleaseRawView();
+    int ret = processor->selectFrame(*frames[(size_t)index]);
+    if (ret != LIBRAW_SUCCESS)
+        return ThrowLibRawError(env, "Failed to select frame: ", ret);
+
+    currentFrame = (int)index;
+    isUnpacked = true;
+    isProcessed = false;
+    return Napi::Boolean::New(env, true);
+}
+
 // ============== 扩展内存操作 ==============
 
 Napi::Value LibRawWrapper::GetMemImageFormat(const Napi::CallbackInfo &info)
@@ -1129,6 +2602,7 @@ Napi::Value LibRawWrapper::CopyMemImage(const Napi::CallbackInfo &info)
     int ret = processor->copy_mem_image(buffer.Data(), stride, bgr);
     if (ret != LIBRAW_SUCCESS)
     {
+        Metrics::instance().recordError(ret);
         std::string error = "Failed to copy memory image: ";
         error += libraw_strerror(ret);
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
@@ -1138,6 +2612,248 @@ Napi::Value LibRawWrapper::CopyMemImage(const Napi::CallbackInfo &info)
     return Napi::Boolean::New(env, true);
 }
 
+// ============== Raw 数据访问 ==============
+
+// 外部 ArrayBuffer 直接引用 LibRaw 的 raw 缓冲区。finalizer 持有包装对象的强引用，
+// 视图存活期间 LibRaw 实例不会被回收；同一缓冲区只创建一个 ArrayBuffer，重复调用共享
+Napi::ArrayBuffer LibRawWrapper::RawDataView(Napi::Env env, void *data, size_t bytes)
+{
+    if (!rawView.IsEmpty() && rawViewData == data)
+    {
+        Napi::ArrayBuffer existing = rawView.Value();
+        if (!existing.IsEmpty() && !existing.IsDetached())
+            return existing;
+    }
+    ReleaseRawView();
+
+    Napi::ObjectReference *owner = new Napi::ObjectReference(Napi::Persistent(Value()));
+    Napi::ArrayBuffer view = Napi::ArrayBuffer::New(
+        env, data, bytes, [](Napi::Env, void *, Napi::ObjectReference *ref)
+        { delete ref; },
+        owner);
+    if (view.IsEmpty())
+    {
+        delete owner;
+        return view;
+    }
+
+    rawView = Napi::Weak(view);
+    rawViewData = data;
+    return view;
+}
+
+void LibRawWrapper::ReleaseRawView()
+{
+    if (rawView.IsEmpty())
+        return;
+    Napi::ArrayBuffer view = rawView.Value();
+    if (!view.IsEmpty() && !view.IsDetached())
+        view.Detach();
+    rawView.Reset();
+    rawViewData = nullptr;
+}
+
+void LibRawWrapper::ReleaseFrames()
+{
+    std::vector<std::shared_ptr<const RawSnapshot>>().swap(frames);
+    currentFrame = -1;
+}
+
+Napi::Value LibRawWrapper::GetRawData(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (!CheckLoaded(env))
+        return env.Null();
+    if (!isUnpacked)
+    {
+        Napi::Error::New(env, "Raw data is not unpacked. Call unpack() first.").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    bool planes = false;
+    bool copy = false;
+    if (info.Length() > 0 && info[0].IsObject())
+    {
+        Napi::Object options = info[0].As<Napi::Object>();
+        Napi::Value split = options.Get("split");
+        std::string mode = split.IsString() ? split.As<Napi::String>().Utf8Value() : "";
+        if (mode == "planes")
+            planes = true;
+        else if (!split.IsUndefined() && mode != "none")
+        {
+            Napi::TypeError::New(env, "split must be 'planes' or 'none'").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        if (options.Has("copy") && options.Get("copy").IsBoolean())
+        {
+            copy = options.Get("copy").As<Napi::Boolean>().Value();
+        }
+    }
+
+    const libraw_rawdata_t &raw = processor->imgdata.rawdata;
+    const libraw_image_sizes_t &sizes = raw.sizes;
+    Napi::Object result = Napi::Object::New(env);
+
+    if (planes)
+    {
+        // 四平面拆分是新分配的缓冲区，由 JS 持有
+        RawPlaneLayout layout;
+        const char *reason = processor->rawPlaneLayout(layout);
+        if (reason)
+        {
+            std::string error = "Cannot split raw data into planes: ";
+            error += reason;
+            Napi::Error::New(env, error).ThrowAsJavaScriptException();
+            return env.Null();
+        }
+
+        size_t count = (size_t)4 * layout.width * layout.height;
+        Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(env, count * sizeof(ushort));
+        processor->splitRawPlanes(layout, static_cast<ushort *>(buffer.Data()));
+
+        Napi::Array names = Napi::Array::New(env, 4);
+        const char *planeNames[4] = {"R", "G1", "G2", "B"};
+        for (uint32_t i = 0; i < 4; i++)
+            names.Set(i, Napi::String::New(env, planeNames[i]));
+
+        result.Set("data", Napi::Uint16Array::New(env, count, buffer, 0));
+        result.Set("type", Napi::String::New(env, "uint16"));
+        result.Set("layout", Napi::String::New(env, "planes"));
+        result.Set("planes", names);
+        result.Set("width", Napi::Number::New(env, layout.width));
+        result.Set("height", Napi::Number::New(env, layout.height));
+        result.Set("channels", Napi::Number::New(env, 4));
+        result.Set("stride", Napi::Number::New(env, layout.width));
+        result.Set("blackSubtracted", Napi::Boolean::New(env, true));
+        result.Set("zeroCopy", Napi::Boolean::New(env, false));
+    }
+    else
+    {
+        // unpack 之后以下缓冲区只有一个非空
+        void *data = nullptr;
+        int channels = 1;
+        bool isFloat = false;
+        if (raw.raw_image)
+            data = raw.raw_image;
+        else if (raw.color3_image)
+            data = raw.color3_image, channels = 3;
+        else if (raw.color4_image)
+            data = raw.color4_image, channels = 4;
+        else if (raw.float_image)
+            data = raw.float_image, isFloat = true;
+        else if (raw.float3_image)
+            data = raw.float3_image, channels = 3, isFloat = true;
+        else if (raw.float4_image)
+            data = raw.float4_image, channels = 4, isFloat = true;
+
+        if (!data)
+        {
+            Napi::Error::New(env, "No raw data available").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+
+        // raw_pitch 为每行字节数，可能大于 raw_width * channels
+        size_t elementSize = isFloat ? sizeof(float) : sizeof(ushort);
+        size_t bytes = (size_t)sizes.raw_pitch * sizes.raw_height;
+        size_t count = bytes / elementSize;
+
+        bool zeroCopy = false;
+        Napi::ArrayBuffer buffer;
+        if (!copy)
+        {
+            buffer = RawDataView(env, data, bytes);
+            zeroCopy = !buffer.IsEmpty();
+            // 不允许外部缓冲区的运行时（如启用 V8 沙箱的 Electron）回退为复制
+            if (!zeroCopy && env.IsExceptionPending())
+                env.GetAndClearPendingException();
+        }
+        if (!zeroCopy)
+        {
+            buffer = Napi::ArrayBuffer::New(env, bytes);
+            memcpy(buffer.Data(), data, bytes);
+        }
+
+        if (isFloat)
+            result.Set("data", Napi::Float32Array::New(env, count, buffer, 0));
+        else
+            result.Set("data", Napi::Uint16Array::New(env, count, buffer, 0));
+        result.Set("type", Napi::String::New(env, isFloat ? "float32" : "uint16"));
+        result.Set("layout", Napi::String::New(env, channels == 1 ? "mosaic" : "interleaved"));
+        result.Set("width", Napi::Number::New(env, sizes.raw_width));
+        result.Set("height", Napi::Number::New(env, sizes.raw_height));
+        result.Set("channels", Napi::Number::New(env, channels));
+        result.Set("stride", Napi::Number::New(env, sizes.raw_pitch / elementSize));
+        result.Set("blackSubtracted", Napi::Boolean::New(env, false));
+        result.Set("zeroCopy", Napi::Boolean::New(env, zeroCopy));
+
+        // 可见区域在 raw 帧中的位置
+        Napi::Object margins = Napi::Object::New(env);
+        margins.Set("top", Napi::Number::New(env, sizes.top_margin));
+        margins.Set("left", Napi::Number::New(env, sizes.left_margin));
+        margins.Set("width", Napi::Number::New(env, sizes.width));
+        margins.Set("height", Napi::Number::New(env, sizes.height));
+        result.Set("margins", margins);
+    }
+
+    // CFA 排列，相对可见区域左上角
+    Napi::Object cfa = Napi::Object::New(env);
+    cfa.Set("filters", Napi::Number::New(env, raw.iparams.filters));
+    cfa.Set("colors", Napi::String::New(env, std::string(raw.iparams.cdesc, strnlen(raw.iparams.cdesc, 4))));
+    if (raw.iparams.filters >= 1000)
+    {
+        std::string pattern;
+        for (int p = 0; p < 4; p++)
+            pattern += raw.iparams.cdesc[processor->rawColorAt(p >> 1, p & 1)];
+        cfa.Set("pattern", Napi::String::New(env, pattern));
+    }
+    else
+    {
+        cfa.Set("pattern", env.Null());
+    }
+    if (raw.iparams.filters == 9)
+    {
+        Napi::Array xtrans = Napi::Array::New(env, 6);
+        for (uint32_t row = 0; row < 6; row++)
+        {
+            Napi::Array line = Napi::Array::New(env, 6);
+            for (uint32_t col = 0; col < 6; col++)
+                line.Set(col, Napi::Number::New(env, processor->rawColorAt(row, col)));
+            xtrans.Set(row, line);
+        }
+        cfa.Set("xtrans", xtrans);
+    }
+    result.Set("cfa", cfa);
+
+    // 黑白电平（未减去黑电平时的原始值）
+    unsigned black, channel[4];
+    bool pattern;
+    processor->rawBlackLevels(black, channel, pattern);
+    Napi::Array channelBlack = Napi::Array::New(env, 4);
+    for (uint32_t c = 0; c < 4; c++)
+        channelBlack.Set(c, Napi::Number::New(env, channel[c]));
+    result.Set("blackLevel", Napi::Number::New(env, black));
+    result.Set("channelBlack", channelBlack);
+    if (pattern)
+    {
+        unsigned rows = raw.color.cblack[4], cols = raw.color.cblack[5];
+        Napi::Object blackPattern = Napi::Object::New(env);
+        Napi::Array values = Napi::Array::New(env, rows * cols);
+        for (uint32_t i = 0; i < rows * cols; i++)
+            values.Set(i, Napi::Number::New(env, raw.color.cblack[6 + i]));
+        blackPattern.Set("rows", Napi::Number::New(env, rows));
+        blackPattern.Set("cols", Napi::Number::New(env, cols));
+        blackPattern.Set("values", values);
+        result.Set("blackPattern", blackPattern);
+    }
+    else
+    {
+        result.Set("blackPattern", env.Null());
+    }
+    result.Set("whiteLevel", Napi::Number::New(env, raw.color.maximum));
+
+    return result;
+}
+
 // ============== 颜色操作 ==============
 
 Napi::Value LibRawWrapper::GetColorAt(const Napi::CallbackInfo &info)
@@ -1261,6 +2977,69 @@ Napi::Value LibRawWrapper::ClearCancelFlag(const Napi::CallbackInfo &info)
     return Napi::Boolean::New(env, true);
 }
 
+// 从现在起 ms 毫秒后中止正在进行的解码、处理或写出。
+// 截止时间由进程级监视线程触发，在主线程同步调用期间同样生效
+Napi::Value LibRawWrapper::SetDeadline(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsNumber())
+    {
+        Napi::TypeError::New(env, "Expected deadline in milliseconds").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    double ms = info[0].As<Napi::Number>().DoubleValue();
+    if (ms < 0)
+    {
+        Napi::RangeError::New(env, "Deadline must not be negative").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    // 0 表示取消截止时间；非零值至少为 1 毫秒
+    processor->setDeadline(ms == 0 ? 0 : static_cast<unsigned>(std::max(1.0, std::min(ms, 4294967295.0))));
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value LibRawWrapper::ClearDeadline(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+
+    processor->clearDeadline();
+    return Napi::Boolean::New(env, true);
+}
+
+// ============== 优先级调度 ==============
+
+Napi::Value LibRawWrapper::SetPriority(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsString())
+    {
+        Napi::TypeError::New(env, "Expected priority name").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    std::string name = info[0].As<Napi::String>().Utf8Value();
+    JobLane lane;
+    if (!JobScheduler::parseLane(name.c_str(), &lane))
+    {
+        Napi::RangeError::New(env, "Priority must be 'interactive', 'normal' or 'background'").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    processor->setPriority(lane);
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value LibRawWrapper::GetPriority(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+
+    return Napi::String::New(env, JobScheduler::laneName(processor->priority()));
+}
+
 // ============== 版本信息（实例方法） ==============
 
 Napi::Value LibRawWrapper::Version(const Napi::CallbackInfo &info)
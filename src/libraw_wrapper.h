@@ -4,7 +4,9 @@
 #include <napi.h>
 #include <string>
 #include <memory>
+#include <vector>
 #include "libraw/libraw.h"
+#include "libraw_processor.h"
 
 class LibRawWrapper : public Napi::ObjectWrap<LibRawWrapper>
 {
@@ -14,16 +16,18 @@ public:
     ~LibRawWrapper();
 
 private:
-    static Napi::FunctionReference constructor;
-
     // 文件操作
     Napi::Value LoadFile(const Napi::CallbackInfo &info);
     Napi::Value LoadBuffer(const Napi::CallbackInfo &info);
+    Napi::Value OpenFile(const Napi::CallbackInfo &info);
+    Napi::Value OpenBuffer(const Napi::CallbackInfo &info);
     Napi::Value Close(const Napi::CallbackInfo &info);
+    Napi::Value RawCacheBusy(const Napi::CallbackInfo &info);
 
     // 元数据和信息
     Napi::Value GetMetadata(const Napi::CallbackInfo &info);
     Napi::Value GetImageSize(const Napi::CallbackInfo &info);
+    Napi::Value GetSubsampleInfo(const Napi::CallbackInfo &info);
     Napi::Value GetAdvancedMetadata(const Napi::CallbackInfo &info);
     Napi::Value GetLensInfo(const Napi::CallbackInfo &info);
     Napi::Value GetColorInfo(const Napi::CallbackInfo &info);
@@ -35,14 +39,29 @@ private:
     Napi::Value Raw2Image(const Napi::CallbackInfo &info);
     Napi::Value AdjustMaximum(const Napi::CallbackInfo &info);
 
+    // 重渲染缓存
+    Napi::Value SetRenderCache(const Napi::CallbackInfo &info);
+    Napi::Value GetRenderCacheInfo(const Napi::CallbackInfo &info);
+
+    // 校准：暗场、坏点和绿平衡，加载一次后在实例间共享
+    Napi::Value SetCalibration(const Napi::CallbackInfo &info);
+    Napi::Value GetCalibrationInfo(const Napi::CallbackInfo &info);
+
+    // 内存估算
+    Napi::Value EstimateMemory(const Napi::CallbackInfo &info);
+
     // 内存图像创建
     Napi::Value CreateMemoryImage(const Napi::CallbackInfo &info);
     Napi::Value CreateMemoryThumbnail(const Napi::CallbackInfo &info);
+    Napi::Value GetPreviewRGB(const Napi::CallbackInfo &info);
+    Napi::Value CreatePNG(const Napi::CallbackInfo &info);
+    Napi::Value ExportTilePyramid(const Napi::CallbackInfo &info);
 
     // 文件写入器
     Napi::Value WritePPM(const Napi::CallbackInfo &info);
     Napi::Value WriteTIFF(const Napi::CallbackInfo &info);
     Napi::Value WriteThumbnail(const Napi::CallbackInfo &info);
+    Napi::Value WriteStreamed(const Napi::CallbackInfo &info);
 
     // 配置和设置
     Napi::Value SetOutputParams(const Napi::CallbackInfo &info);
@@ -75,10 +94,17 @@ private:
     Napi::Value FreeImage(const Napi::CallbackInfo &info);
     Napi::Value ConvertFloatToInt(const Napi::CallbackInfo &info);
 
+    // 多帧解码：一次解码全部帧（包围曝光、像素偏移、多帧 DNG），之后切换当前帧
+    Napi::Value LoadAllFrames(const Napi::CallbackInfo &info);
+    Napi::Value SelectFrame(const Napi::CallbackInfo &info);
+
     // 扩展内存操作
     Napi::Value GetMemImageFormat(const Napi::CallbackInfo &info);
     Napi::Value CopyMemImage(const Napi::CallbackInfo &info);
 
+    // Raw 数据访问：LibRaw 持有的 raw 缓冲区的零拷贝视图
+    Napi::Value GetRawData(const Napi::CallbackInfo &info);
+
     // 颜色操作
     Napi::Value GetColorAt(const Napi::CallbackInfo &info);
 
@@ -88,6 +114,10 @@ private:
     // 取消支持
     Napi::Value SetCancelFlag(const Napi::CallbackInfo &info);
     Napi::Value ClearCancelFlag(const Napi::CallbackInfo &info);
+    Napi::Value SetDeadline(const Napi::CallbackInfo &info);
+    Napi::Value ClearDeadline(const Napi::CallbackInfo &info);
+    Napi::Value SetPriority(const Napi::CallbackInfo &info);
+    Napi::Value GetPriority(const Napi::CallbackInfo &info);
 
     // 版本信息（实例方法）
     Napi::Value Version(const Napi::CallbackInfo &info);
@@ -98,16 +128,52 @@ private:
     static Napi::Value GetCapabilities(const Napi::CallbackInfo &info);
     static Napi::Value GetCameraList(const Napi::CallbackInfo &info);
     static Napi::Value GetCameraCount(const Napi::CallbackInfo &info);
+    static Napi::Value GetSchedulerStats(const Napi::CallbackInfo &info);
+    static Napi::Value GetMetrics(const Napi::CallbackInfo &info);
+    static Napi::Value ObserveQueueWait(const Napi::CallbackInfo &info);
+    static Napi::Value GetSimdInfo(const Napi::CallbackInfo &info);
+    static Napi::Value HasNativeJpeg(const Napi::CallbackInfo &info);
+    static Napi::Value LoadCalibration(const Napi::CallbackInfo &info);
+    static Napi::Value ReleaseCalibration(const Napi::CallbackInfo &info);
+
+    // 进程级共享缓存：渲染结果和解包后的 raw 数据
+    static Napi::Value ConfigureCache(const Napi::CallbackInfo &info);
+    static Napi::Value GetCacheStats(const Napi::CallbackInfo &info);
+    static Napi::Value ClearCache(const Napi::CallbackInfo &info);
+    static Napi::Value CacheAcquire(const Napi::CallbackInfo &info);
+    static Napi::Value CacheFulfil(const Napi::CallbackInfo &info);
+    static Napi::Value CacheAbandon(const Napi::CallbackInfo &info);
 
     // 辅助方法
     Napi::Object CreateImageDataObject(Napi::Env env, libraw_processed_image_t *img);
     bool CheckLoaded(Napi::Env env);
+    bool CheckDeadline(Napi::Env env);
+    static bool ReadSubsample(Napi::Env env, const Napi::CallbackInfo &info, size_t index, int &factor);
+    Napi::Value ThrowLibRawError(Napi::Env env, const char *prefix, int ret);
+    Napi::ArrayBuffer RawDataView(Napi::Env env, void *data, size_t bytes);
+    void ReleaseRawView();
+    void ReleaseFrames();
+    static std::shared_ptr<const CalibrationData> AcquireCalibration(Napi::Env env, Napi::Object options);
+    static Napi::Object CalibrationInfo(Napi::Env env, const CalibrationData &data);
 
     // LibRaw 实例
-    std::unique_ptr<LibRaw> processor;
+    std::unique_ptr<LibRawProcessor> processor;
     bool isLoaded;
     bool isUnpacked;
     bool isProcessed;
+
+    // getRawData() 返回的外部 ArrayBuffer（弱引用）。LibRaw 释放 raw 缓冲区之前将其分离，
+    // 已返回的视图变为长度 0，而不是指向已释放的内存
+    Napi::Reference<Napi::ArrayBuffer> rawView;
+    void *rawViewData;
+
+    // openBuffer()/loadBuffer()/loadAllFrames() 传入的 Buffer。LibRaw 的数据流直接读取它（延迟解包、
+    // unpack_thumb 等），在下一次打开或 close() 之前保持引用，避免被 GC 回收
+    Napi::Reference<Napi::Buffer<uint8_t>> inputBuffer;
+
+    // loadAllFrames() 解码的各帧和当前帧的下标（-1 表示没有）
+    std::vector<std::shared_ptr<const RawSnapshot>> frames;
+    int currentFrame;
 };
 
 #endif // LIBRAW_WRAPPER_H
@@ -0,0 +1,309 @@
+#include "metrics.h"
+#include "libraw/libraw.h"
+#include <cstring>
+
+namespace
+{
+    // 秒，与 Prometheus 客户端的默认桶相近，上限覆盖整幅图像的处理时间
+    const double BUCKET_BOUNDS[METRIC_BUCKETS] = {0.001, 0.005, 0.01, 0.025, 0.05, 0.1,
+                                                  0.25,  0.5,   1,    2.5,   5,    10};
+
+    const char *const STAGE_NAMES[METRIC_STAGE_COUNT] = {"unpack", "process", "stream", "preview", "png", "tiles"};
+    const char *const QUEUE_NAMES[METRIC_QUEUE_COUNT] = {"scheduler", "pool"};
+
+    struct ErrorCode
+    {
+        int code;
+        const char *name;
+    };
+    const ErrorCode ERROR_CODES[METRIC_ERROR_CODES - 1] = {
+        {LIBRAW_UNSPECIFIED_ERROR, "LIBRAW_UNSPECIFIED_ERROR"},
+        {LIBRAW_FILE_UNSUPPORTED, "LIBRAW_FILE_UNSUPPORTED"},
+        {LIBRAW_REQUEST_FOR_NONEXISTENT_IMAGE, "LIBRAW_REQUEST_FOR_NONEXISTENT_IMAGE"},
+        {LIBRAW_OUT_OF_ORDER_CALL, "LIBRAW_OUT_OF_ORDER_CALL"},
+        {LIBRAW_NO_THUMBNAIL, "LIBRAW_NO_THUMBNAIL"},
+        {LIBRAW_UNSUPPORTED_THUMBNAIL, "LIBRAW_UNSUPPORTED_THUMBNAIL"},
+        {LIBRAW_INPUT_CLOSED, "LIBRAW_INPUT_CLOSED"},
+        {LIBRAW_NOT_IMPLEMENTED, "LIBRAW_NOT_IMPLEMENTED"},
+        {LIBRAW_REQUEST_FOR_NONEXISTENT_THUMBNAIL, "LIBRAW_REQUEST_FOR_NONEXISTENT_THUMBNAIL"},
+        {LIBRAW_UNSUFFICIENT_MEMORY, "LIBRAW_UNSUFFICIENT_MEMORY"},
+        {LIBRAW_DATA_ERROR, "LIBRAW_DATA_ERROR"},
+        {LIBRAW_IO_ERROR, "LIBRAW_IO_ERROR"},
+        {LIBRAW_CANCELLED_BY_CALLBACK, "LIBRAW_CANCELLED_BY_CALLBACK"},
+        {LIBRAW_BAD_CROP, "LIBRAW_BAD_CROP"},
+        {LIBRAW_TOO_BIG, "LIBRAW_TOO_BIG"},
+        {LIBRAW_MEMPOOL_OVERFLOW, "LIBRAW_MEMPOOL_OVERFLOW"},
+    };
+
+    struct AtomicHistogram
+    {
+        std::atomic<uint64_t> buckets[METRIC_BUCKETS + 1];
+        std::atomic<uint64_t> nanos;
+    };
+
+    // 分片只由所属线程写入，不需要读-改-写原子操作；读取方可能看到稍旧的值
+    inline void bump(std::atomic<uint64_t> &counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void observe(AtomicHistogram &histogram, double seconds)
+    {
+        int bucket = 0;
+        while (bucket < METRIC_BUCKETS && seconds > BUCKET_BOUNDS[bucket])
+            bucket++;
+        bump(histogram.buckets[bucket], 1);
+        bump(histogram.nanos, (uint64_t)(seconds * 1e9));
+    }
+
+    void addHistogram(MetricHistogram &to, const AtomicHistogram &from)
+    {
+        for (int b = 0; b <= METRIC_BUCKETS; b++)
+        {
+            uint64_t n = from.buckets[b].load(std::memory_order_relaxed);
+            to.buckets[b] += n;
+            to.count += n;
+        }
+        to.sum += from.nanos.load(std::memory_order_relaxed) / 1e9;
+    }
+
+    void mergeHistogram(AtomicHistogram &to, const AtomicHistogram &from)
+    {
+        for (int b = 0; b <= METRIC_BUCKETS; b++)
+            bump(to.buckets[b], from.buckets[b].load(std::memory_order_relaxed));
+        bump(to.nanos, from.nanos.load(std::memory_order_relaxed));
+    }
+}
+
+// 下标 METRIC_MAX_DECODERS 为超出上限的解码器
+struct Metrics::Shard
+{
+    std::atomic<uint64_t> filesOpened[METRIC_MAX_DECODERS + 1];
+    std::atomic<uint64_t> inputBytes[METRIC_MAX_DECODERS + 1];
+    std::atomic<uint64_t> stagePixels[METRIC_STAGE_COUNT];
+    AtomicHistogram stageSeconds[METRIC_STAGE_COUNT];
+    std::atomic<uint64_t> errors[METRIC_ERROR_CODES];
+    std::atomic<uint64_t> cancellations[2];
+    AtomicHistogram queueWait[METRIC_QUEUE_COUNT][JOB_LANE_COUNT];
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> allocatedBytes;
+};
+
+// 线程退出时把分片并入 retired，计数不会随线程丢失
+struct ShardHolder
+{
+    Metrics::Shard *shard = nullptr;
+    ~ShardHolder()
+    {
+        if (shard)
+            Metrics::instance().retire(shard);
+    }
+};
+
+static thread_local ShardHolder localHolder;
+
+Metrics &Metrics::instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Metrics() : retired(new Shard()), decoderCount(0), liveBytes(0), peakBytes(0)
+{
+    memset(decoderNames, 0, sizeof(decoderNames));
+}
+
+Metrics::Shard &Metrics::localShard()
+{
+    if (!localHolder.shard)
+    {
+        // 值初始化，所有计数为 0
+        Shard *shard = new Shard();
+        std::lock_guard<std::mutex> lock(mutex);
+        shards.push_back(shard);
+        localHolder.shard = shard;
+    }
+    return *localHolder.shard;
+}
+
+void Metrics::retire(Shard *shard)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int d = 0; d <= METRIC_MAX_DECODERS; d++)
+    {
+        bump(retired->filesOpened[d], shard->filesOpened[d].load(std::memory_order_relaxed));
+        bump(retired->inputBytes[d], shard->inputBytes[d].load(std::memory_order_relaxed));
+    }
+    for (int s = 0; s < METRIC_STAGE_COUNT; s++)
+    {
+        bump(retired->stagePixels[s], shard->stagePixels[s].load(std::memory_order_relaxed));
+        mergeHistogram(retired->stageSeconds[s], shard->stageSeconds[s]);
+    }
+    for (int e = 0; e < METRIC_ERROR_CODES; e++)
+        bump(retired->errors[e], shard->errors[e].load(std::memory_order_relaxed));
+    for (int c = 0; c < 2; c++)
+        bump(retired->cancellations[c], shard->cancellations[c].load(std::memory_order_relaxed));
+    for (int q = 0; q < METRIC_QUEUE_COUNT; q++)
+        for (int l = 0; l < JOB_LANE_COUNT; l++)
+            mergeHistogram(retired->queueWait[q][l], shard->queueWait[q][l]);
+    bump(retired->allocations, shard->allocations.load(std::memory_order_relaxed));
+    bump(retired->allocatedBytes, shard->allocatedBytes.load(std::memory_order_relaxed));
+
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        if (shards[i] == shard)
+        {
+            shards.erase(shards.begin() + i);
+            break;
+        }
+    }
+    delete shard;
+}
+
+// 已登记的名称只追加不修改，查找不加锁；新名称在锁内登记后再发布计数
+int Metrics::decoderIndex(const char *decoder)
+{
+    int count = decoderCount.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++)
+        if (strcmp(decoderNames[i], decoder) == 0)
+            return i;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    count = decoderCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++)
+        if (strcmp(decoderNames[i], decoder) == 0)
+            return i;
+    if (count == METRIC_MAX_DECODERS)
+        return METRIC_MAX_DECODERS;
+    strncpy(decoderNames[count], decoder, sizeof(decoderNames[count]) - 1);
+    decoderCount.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+void Metrics::recordOpen(const char *decoder, uint64_t bytes)
+{
+    Shard &shard = localShard();
+    int index = decoderIndex(decoder ? decoder : "unknown");
+    bump(shard.filesOpened[index], 1);
+    bump(shard.inputBytes[index], bytes);
+}
+
+void Metrics::recordStage(MetricStage stage, uint64_t pixels, double seconds)
+{
+    Shard &shard = localShard();
+    bump(shard.stagePixels[stage], pixels);
+    observe(shard.stageSeconds[stage], seconds);
+}
+
+void Metrics::recordError(int code)
+{
+    int index = METRIC_ERROR_CODES - 1;
+    for (int i = 0; i < METRIC_ERROR_CODES - 1; i++)
+        if (ERROR_CODES[i].code == code)
+            index = i;
+    bump(localShard().errors[index], 1);
+}
+
+void Metrics::recordCancellation(bool deadline)
+{
+    bump(localShard().cancellations[deadline ? 0 : 1], 1);
+}
+
+void Metrics::recordQueueWait(MetricQueue queue, JobLane lane, double seconds)
+{
+    observe(localShard().queueWait[queue][lane], seconds);
+}
+
+void Metrics::recordAllocation(long long delta)
+{
+    Metrics &metrics = instance();
+    int64_t live = metrics.liveBytes.fetch_add(delta, std::memory_order_relaxed) + delta;
+    if (delta <= 0)
+        return;
+
+    Shard &shard = metrics.localShard();
+    bump(shard.allocations, 1);
+    bump(shard.allocatedBytes, (uint64_t)delta);
+    int64_t peak = metrics.peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !metrics.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+}
+
+MetricsSnapshot Metrics::snapshot()
+{
+    MetricsSnapshot snap;
+    memset(snap.stagePixels, 0, sizeof(snap.stagePixels));
+    memset(snap.stageSeconds, 0, sizeof(snap.stageSeconds));
+    memset(snap.errors, 0, sizeof(snap.errors));
+    memset(snap.cancellations, 0, sizeof(snap.cancellations));
+    memset(snap.queueWait, 0, sizeof(snap.queueWait));
+    snap.allocations = 0;
+    snap.allocatedBytes = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const int decoders = decoderCount.load(std::memory_order_relaxed);
+    uint64_t opened[METRIC_MAX_DECODERS + 1] = {0};
+    uint64_t bytes[METRIC_MAX_DECODERS + 1] = {0};
+
+    std::vector<Shard *> all(shards);
+    all.push_back(retired);
+    for (Shard *shard : all)
+    {
+        for (int d = 0; d <= METRIC_MAX_DECODERS; d++)
+        {
+            opened[d] += shard->filesOpened[d].load(std::memory_order_relaxed);
+            bytes[d] += shard->inputBytes[d].load(std::memory_order_relaxed);
+        }
+        for (int s = 0; s < METRIC_STAGE_COUNT; s++)
+        {
+            snap.stagePixels[s] += shard->stagePixels[s].load(std::memory_order_relaxed);
+            addHistogram(snap.stageSeconds[s], shard->stageSeconds[s]);
+        }
+        for (int e = 0; e < METRIC_ERROR_CODES; e++)
+            snap.errors[e] += shard->errors[e].load(std::memory_order_relaxed);
+        for (int c = 0; c < 2; c++)
+            snap.cancellations[c] += shard->cancellations[c].load(std::memory_order_relaxed);
+        for (int q = 0; q < METRIC_QUEUE_COUNT; q++)
+            for (int l = 0; l < JOB_LANE_COUNT; l++)
+                addHistogram(snap.queueWait[q][l], shard->queueWait[q][l]);
+        snap.allocations += shard->allocations.load(std::memory_order_relaxed);
+        snap.allocatedBytes += shard->allocatedBytes.load(std::memory_order_relaxed);
+    }
+
+    for (int d = 0; d < decoders; d++)
+    {
+        snap.decoders.push_back(decoderNames[d]);
+        snap.filesOpened.push_back(opened[d]);
+        snap.inputBytes.push_back(bytes[d]);
+    }
+    if (opened[METRIC_MAX_DECODERS])
+    {
+        snap.decoders.push_back("other");
+        snap.filesOpened.push_back(opened[METRIC_MAX_DECODERS]);
+        snap.inputBytes.push_back(bytes[METRIC_MAX_DECODERS]);
+    }
+    snap.liveBytes = liveBytes.load(std::memory_order_relaxed);
+    snap.peakBytes = peakBytes.load(std::memory_order_relaxed);
+    return snap;
+}
+
+const double *Metrics::bucketBounds()
+{
+    return BUCKET_BOUNDS;
+}
+
+const char *Metrics::stageName(MetricStage stage)
+{
+    return STAGE_NAMES[stage];
+}
+
+const char *Metrics::queueName(MetricQueue queue)
+{
+    return QUEUE_NAMES[queue];
+}
+
+const char *Metrics::errorName(int index)
+{
+    return index < METRIC_ERROR_CODES - 1 ? ERROR_CODES[index].name : "other";
+}
@@ -0,0 +1,123 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "job_scheduler.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 计时的处理阶段
+enum MetricStage
+{
+    METRIC_STAGE_UNPACK = 0,  // raw 解码（unpack），像素为 raw_width x raw_height
+    METRIC_STAGE_PROCESS = 1, // dcraw_process 及其缓存复用路径，像素为 iwidth x iheight
+    METRIC_STAGE_STREAM = 2,  // 分段流式输出
+    METRIC_STAGE_PREVIEW = 3, // 嵌入预览解码
+    METRIC_STAGE_PNG = 4,     // 原生 PNG 编码
+    METRIC_STAGE_TILES = 5,   // 瓦片金字塔导出
+    METRIC_STAGE_COUNT = 6
+};
+
+// 等待队列：调度器在阶段边界的让出，以及 WorkerPool 中任务等待空闲 worker 的时间
+enum MetricQueue
+{
+    METRIC_QUEUE_SCHEDULER = 0,
+    METRIC_QUEUE_POOL = 1,
+    METRIC_QUEUE_COUNT = 2
+};
+
+const int METRIC_BUCKETS = 12;      // 直方图上界个数，另加一个 +Inf 桶
+const int METRIC_MAX_DECODERS = 64; // 按名称区分的解码器个数上限，之后的归入 "other"
+const int METRIC_ERROR_CODES = 17;  // LibRaw 的 16 个错误码和 "other"
+
+struct MetricHistogram
+{
+    uint64_t buckets[METRIC_BUCKETS + 1]; // 各桶的计数（不累加），最后一个为 +Inf
+    uint64_t count;
+    double sum; // 秒
+};
+
+struct MetricsSnapshot
+{
+    std::vector<std::string> decoders; // 与 filesOpened、inputBytes 一一对应
+    std::vector<uint64_t> filesOpened;
+    std::vector<uint64_t> inputBytes;
+    uint64_t stagePixels[METRIC_STAGE_COUNT];
+    MetricHistogram stageSeconds[METRIC_STAGE_COUNT];
+    uint64_t errors[METRIC_ERROR_CODES];
+    uint64_t cancellations[2]; // 0 为截止时间，1 为其他原因
+    MetricHistogram queueWait[METRIC_QUEUE_COUNT][JOB_LANE_COUNT];
+    uint64_t allocations;      // LibRaw 主要缓冲区（raw、image、缩略图）的累计分配次数
+    uint64_t allocatedBytes;   // 累计分配字节数
+    int64_t liveBytes;         // 当前未释放的字节数
+    int64_t peakBytes;         // liveBytes 的历史最大值
+};
+
+// 进程级性能计数器，所有 Node 环境（包括 worker_threads）共享。
+// 计数器和直方图按线程分片：每个线程只写自己的分片（relaxed 原子读写，不加锁），
+// 读取时汇总所有分片和已退出线程的累计值。没有事件时不产生任何开销
+class Metrics
+{
+public:
+    static Metrics &instance();
+
+    // open_file/open_buffer 成功：decoder 为 unpack_function_name，bytes 为输入大小
+    void recordOpen(const char *decoder, uint64_t bytes);
+    void recordStage(MetricStage stage, uint64_t pixels, double seconds);
+    // LibRaw 错误码（LIBRAW_* 中的负值）
+    void recordError(int code);
+    void recordCancellation(bool deadline);
+    void recordQueueWait(MetricQueue queue, JobLane lane, double seconds);
+    // LibRawProcessor 在阶段边界同步的缓冲区字节数变化：正值计为一次分配，负值为释放
+    static void recordAllocation(long long delta);
+
+    MetricsSnapshot snapshot();
+
+    static const double *bucketBounds();
+    static const char *stageName(MetricStage stage);
+    static const char *queueName(MetricQueue queue);
+    // 错误码下标对应的名称，例如 "LIBRAW_IO_ERROR"
+    static const char *errorName(int index);
+
+    struct Shard;
+
+private:
+    Metrics();
+    Metrics(const Metrics &) = delete;
+    Metrics &operator=(const Metrics &) = delete;
+
+    Shard &localShard();
+    int decoderIndex(const char *decoder);
+    void retire(Shard *shard);
+    friend struct ShardHolder;
+
+    // 只保护分片列表和解码器名称的登记，计数本身不加锁
+    std::mutex mutex;
+    std::vector<Shard *> shards;
+    Shard *retired;
+    char decoderNames[METRIC_MAX_DECODERS][48];
+    std::atomic<int> decoderCount;
+    std::atomic<int64_t> liveBytes;
+    std::atomic<int64_t> peakBytes;
+};
+
+// 记录一次阶段调用的耗时：成功时调用 done()，失败的调用不计入
+class StageTimer
+{
+public:
+    explicit StageTimer(MetricStage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+    void done(uint64_t pixels)
+    {
+        Metrics::instance().recordStage(
+            stage, pixels, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    MetricStage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,54 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// 行滤波类型，数值与 PNG 的类型字节相同；PNG_FILTER_ADAPTIVE 逐行按 libpng 的启发式选择
+enum PngFilter
+{
+    PNG_FILTER_NONE = 0,
+    PNG_FILTER_SUB = 1,
+    PNG_FILTER_UP = 2,
+    PNG_FILTER_AVERAGE = 3,
+    PNG_FILTER_PAETH = 4,
+    PNG_FILTER_ADAPTIVE = 5
+};
+
+struct PngOptions
+{
+    int level;                      // zlib 压缩级别 0-9
+    int filter;                     // PngFilter
+    int threads;                    // 压缩线程数，0 表示按 CPU 数（最多 8）
+    size_t segmentBytes;            // 每个独立压缩段的滤波后字节数，按整行向上取整
+    const unsigned char *icc;       // 写入 iCCP 的 ICC 配置文件，为空时不写
+    size_t iccSize;
+    std::string iccName;            // iCCP 中的配置文件名（1 到 79 个可打印 Latin-1 字符）
+    const std::atomic<bool> *abort; // 置位后各线程尽快停止，编码失败
+
+    PngOptions() : level(6), filter(PNG_FILTER_ADAPTIVE), threads(0), segmentBytes(1 << 20), icc(nullptr),
+                   iccSize(0), abort(nullptr) {}
+};
+
+struct PngStats
+{
+    int width;
+    int height;
+    int channels;
+    int bits;
+    int segments;           // 独立压缩的段数（每段一个 IDAT）
+    int threads;            // 实际使用的线程数
+    unsigned filterRows[5]; // 各滤波类型的行数
+    std::string iccName;    // 写入 iCCP 的配置文件名，没有写入时为空
+};
+
+// 把 width x height、每像素 channels 个样本（1 为灰度，3 为 RGB）、每样本 bits 位（8 或 16，16 位为本机字节序）
+// 紧密排列的像素编码为 PNG。图像按行分成若干段，各段的滤波和 deflate 在多个线程中进行：每段以前一段滤波结果的
+// 最后 32 KB 作为预设字典单独压缩，以同步刷新结束在字节边界上，拼接后是一个完整的 zlib 流（与 pigz 相同），
+// 校验和由各段的 adler32 合并。失败时返回 false，error 为具体原因
+bool encodePng(const void *pixels, int width, int height, int channels, int bits, const PngOptions &options,
+               std::vector<unsigned char> &out, PngStats &stats, std::string &error);
+
+#endif // PNG_WRITER_H
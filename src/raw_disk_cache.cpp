@@ -0,0 +1,539 @@
+#include "raw_disk_cache.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <sys/utime.h>
+#define utime _utime
+#else
+#include <dirent.h>
+#include <utime.h>
+#endif
+
+// 文件格式：FileHeader、key、meta、各行段的压缩长度（uint64），之后依次是各行段的数据。
+// 压缩：每个样本减去同一行中前一个同色样本（行首用上一行同一位置），差值 zigzag 后每 16 个一组，
+// 一组先写一个字节的位宽，再按该位宽紧密打包。raw 数据相邻同色样本差值小，通常压缩到一半左右，
+// 编解码都是简单的整数运算，各行段之间没有依赖，可以并行
+
+namespace
+{
+    const char FILE_MAGIC[8] = {'L', 'R', 'W', 'C', 'A', 'C', 'H', 'E'};
+    const uint32_t FILE_VERSION = 1;
+    const uint32_t BYTE_ORDER_MARK = 0x01020304;
+    const unsigned BAND_ROWS = 64;
+    const unsigned BLOCK = 16;
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t byteOrder;
+        uint32_t version;
+        uint32_t keyLength;
+        uint32_t metaLength;
+        uint32_t rowSamples;
+        uint32_t rows;
+        uint32_t stride;
+        uint32_t bandRows;
+        uint32_t bands;
+        uint32_t reserved;
+    };
+
+    std::mutex configMutex;
+    RawDiskCacheStats state = {std::string(), false, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    // 统计和清理目录时持有，多个线程同时超出预算时只扫描一次
+    std::mutex trimMutex;
+
+    void countError()
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        state.errors++;
+    }
+
+    std::string joinPath(const std::string &directory, const std::string &name)
+    {
+        const char last = directory.empty() ? '/' : directory.back();
+        return directory + (last == '/' || last == '\\' ? "" : "/") + name;
+    }
+
+    // FNV-1a 64 位哈希作为文件名，文件中保存完整 key 用于排除冲突
+    std::string cachePath(const std::string &directory, const std::string &key)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char c : key)
+        {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.lrc", (unsigned long long)hash);
+        return joinPath(directory, name);
+    }
+
+    struct CacheFile
+    {
+        std::string path;
+        uint64_t bytes;
+        int64_t modified;
+    };
+
+    // 目录中的 .lrc 文件（不含写入中的临时文件）
+    std::vector<CacheFile> listCacheFiles(const std::string &directory)
+    {
+        std::vector<CacheFile> files;
+#ifdef _WIN32
+        WIN32_FIND_DATAA found;
+        HANDLE find = FindFirstFileA(joinPath(directory, "*.lrc").c_str(), &found);
+        if (find == INVALID_HANDLE_VALUE)
+            return files;
+        do
+        {
+            if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                continue;
+            files.push_back({joinPath(directory, found.cFileName),
+                             (uint64_t)found.nFileSizeHigh << 32 | found.nFileSizeLow,
+                             (int64_t)((uint64_t)found.ftLastWriteTime.dwHighDateTime << 32 |
+                                       found.ftLastWriteTime.dwLowDateTime)});
+        } while (FindNextFileA(find, &found));
+        FindClose(find);
+#else
+        DIR *dir = opendir(directory.c_str());
+        if (!dir)
+            return files;
+        while (struct dirent *entry = readdir(dir))
+        {
+            const size_t length = strlen(entry->d_name);
+            if (length < 4 || strcmp(entry->d_name + length - 4, ".lrc") != 0)
+                continue;
+            CacheFile file = {joinPath(directory, entry->d_name), 0, 0};
+            struct stat st;
+            if (stat(file.path.c_str(), &st) != 0 || !(st.st_mode & S_IFREG))
+                continue;
+            file.bytes = (uint64_t)st.st_size;
+            file.modified = (int64_t)st.st_mtime;
+            files.push_back(file);
+        }
+        closedir(dir);
+#endif
+        return files;
+    }
+
+    // 重新统计目录中缓存文件的大小，超出 budget 时按修改时间从旧到新删除，keep 不删除
+    void trimDirectory(const std::string &directory, uint64_t budget, const std::string &keep)
+    {
+        std::lock_guard<std::mutex> trim(trimMutex);
+        std::vector<CacheFile> files = listCacheFiles(directory);
+        uint64_t total = 0;
+        for (const CacheFile &file : files)
+            total += file.bytes;
+        uint64_t removed = 0;
+        if (budget && total > budget)
+        {
+            std::sort(files.begin(), files.end(),
+                      [](const CacheFile &a, const CacheFile &b) { return a.modified < b.modified; });
+            for (const CacheFile &file : files)
+            {
+                if (total <= budget)
+                    break;
+                if (file.path == keep)
+                    continue;
+                // 删除失败（其他进程已经删除）时同样不再计入
+                remove(file.path.c_str());
+                total -= file.bytes;
+                removed++;
+            }
+        }
+        std::lock_guard<std::mutex> lock(configMutex);
+        if (state.directory == directory)
+        {
+            state.bytes = total;
+            state.evictions += removed;
+        }
+    }
+
+    // 用 threads 个线程（含调用线程）处理 [0, count) 中的各项
+    void parallelFor(unsigned count, int threads, const std::function<void(unsigned)> &fn)
+    {
+        std::atomic<unsigned> next(0);
+        auto worker = [&]() {
+            for (unsigned i = next++; i < count; i = next++)
+                fn(i);
+        };
+        const unsigned extra = (unsigned)std::max(0, std::min(threads, (int)count) - 1);
+        std::vector<std::thread> workers;
+        workers.reserve(extra);
+        for (unsigned i = 0; i < extra; i++)
+            workers.emplace_back(worker);
+        worker();
+        for (std::thread &t : workers)
+            t.join();
+    }
+
+    inline uint16_t zigzag(uint16_t diff)
+    {
+        return (uint16_t)((uint16_t)(diff << 1) ^ (uint16_t)(0 - (diff >> 15)));
+    }
+
+    inline uint16_t unzigzag(uint16_t value)
+    {
+        return (uint16_t)((value >> 1) ^ (uint16_t)(0 - (value & 1)));
+    }
+
+    void flushBlock(const uint16_t *values, std::vector<unsigned char> &out)
+    {
+        uint16_t any = 0;
+        for (unsigned i = 0; i < BLOCK; i++)
+            any |= values[i];
+        unsigned bits = 0;
+        while (any >> bits)
+            bits++;
+        out.push_back((unsigned char)bits);
+        if (bits == 0)
+            return;
+        // 16 个值正好占 2 * bits 字节
+        uint64_t acc = 0;
+        unsigned pending = 0;
+        for (unsigned i = 0; i < BLOCK; i++)
+        {
+            acc |= (uint64_t)values[i] << pending;
+            pending += bits;
+            while (pending >= 8)
+            {
+                out.push_back((unsigned char)acc);
+                acc >>= 8;
+                pending -= 8;
+            }
+        }
+    }
+
+    void encodeBand(const uint16_t *src, unsigned rowSamples, unsigned rows, unsigned stride,
+                    std::vector<unsigned char> &out)
+    {
+        uint16_t block[BLOCK];
+        unsigned filled = 0;
+        out.reserve((size_t)rowSamples * rows);
+        for (unsigned r = 0; r < rows; r++)
+        {
+            const uint16_t *row = src + (size_t)r * rowSamples;
+            for (unsigned i = 0; i < rowSamples; i++)
+            {
+                const uint16_t pred = i >= stride ? row[i - stride] : (r > 0 ? (row - rowSamples)[i] : 0);
+                block[filled++] = zigzag((uint16_t)(row[i] - pred));
+                if (filled == BLOCK)
+                {
+                    flushBlock(block, out);
+                    filled = 0;
+                }
+            }
+        }
+        if (filled)
+        {
+            std::fill(block + filled, block + BLOCK, 0);
+            flushBlock(block, out);
+        }
+    }
+
+    // 先解出整个行段的差值，再逐行累加预测值，两个循环都没有分支交错
+    bool decodeBand(const unsigned char *src, size_t length, unsigned rowSamples, unsigned rows, unsigned stride,
+                    uint16_t *dst)
+    {
+        const unsigned char *end = src + length;
+        const size_t count = (size_t)rowSamples * rows;
+        for (size_t n = 0; n < count; n += BLOCK)
+        {
+            if (src >= end)
+                return false;
+            const unsigned bits = *src++;
+            if (bits > 16 || (size_t)(end - src) < bits * 2)
+                return false;
+            uint16_t block[BLOCK];
+            if (bits == 0)
+                std::fill(block, block + BLOCK, 0);
+            else
+            {
+                uint64_t acc = 0;
+                unsigned available = 0;
+                const uint32_t mask = (1u << bits) - 1;
+                for (unsigned k = 0; k < BLOCK; k++)
+                {
+                    while (available < bits)
+                    {
+                        acc |= (uint64_t)*src++ << available;
+                        available += 8;
+                    }
+                    block[k] = (uint16_t)(acc & mask);
+                    acc >>= bits;
+                    available -= bits;
+                }
+            }
+            const size_t take = std::min((size_t)BLOCK, count - n);
+            for (size_t k = 0; k < take; k++)
+                dst[n + k] = unzigzag(block[k]);
+        }
+        if (src != end)
+            return false;
+
+        for (unsigned r = 0; r < rows; r++)
+        {
+            uint16_t *row = dst + (size_t)r * rowSamples;
+            const unsigned head = std::min(stride, rowSamples);
+            if (r > 0)
+                for (unsigned i = 0; i < head; i++)
+                    row[i] = (uint16_t)(row[i] + (row - rowSamples)[i]);
+            for (unsigned i = head; i < rowSamples; i++)
+                row[i] = (uint16_t)(row[i] + row[i - stride]);
+        }
+        return true;
+    }
+}
+
+bool setRawDiskCache(const std::string &directory, bool allDecoders, uint64_t budget)
+{
+    if (!directory.empty())
+    {
+        struct stat st;
+        if (stat(directory.c_str(), &st) != 0 || !(st.st_mode & S_IFDIR))
+            return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        state.directory = directory;
+        state.allDecoders = allDecoders;
+        state.budget = budget;
+        state.bytes = 0;
+    }
+    if (!directory.empty())
+        trimDirectory(directory, budget, std::string());
+    return true;
+}
+
+void clearRawDiskCache()
+{
+    std::string directory = rawDiskCacheStats().directory;
+    if (directory.empty())
+        return;
+    std::lock_guard<std::mutex> trim(trimMutex);
+    for (const CacheFile &file : listCacheFiles(directory))
+        remove(file.path.c_str());
+    std::lock_guard<std::mutex> lock(configMutex);
+    if (state.directory == directory)
+        state.bytes = 0;
+}
+
+RawDiskCacheStats rawDiskCacheStats()
+{
+    std::lock_guard<std::mutex> lock(configMutex);
+    return state;
+}
+
+bool rawDiskCacheEnabled()
+{
+    std::lock_guard<std::mutex> lock(configMutex);
+    return !state.directory.empty();
+}
+
+bool rawDiskCacheAccepts(const char *decoderName)
+{
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        if (state.directory.empty())
+            return false;
+        if (state.allDecoders)
+            return true;
+    }
+    // 这几种解码器每个像素都要做熵解码或小波反变换，比从缓存解压慢一个数量级以上
+    static const char *expensive[] = {"crxLoadRaw()", "fuji_compressed_load_raw()", "phase_one_load_raw_c()"};
+    for (const char *name : expensive)
+        if (decoderName && strcmp(decoderName, name) == 0)
+            return true;
+    return false;
+}
+
+bool readRawDiskCache(const std::string &key, RawCacheImage &image, int threads)
+{
+    std::string directory = rawDiskCacheStats().directory;
+    if (directory.empty())
+        return false;
+
+    const std::string path = cachePath(directory, key);
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        state.misses++;
+        return false;
+    }
+    std::vector<unsigned char> buffer;
+    bool ok = fseek(file, 0, SEEK_END) == 0;
+    const long size = ok ? ftell(file) : -1;
+    ok = size >= (long)sizeof(FileHeader) && fseek(file, 0, SEEK_SET) == 0;
+    if (ok)
+    {
+        buffer.resize((size_t)size);
+        ok = fread(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    }
+    fclose(file);
+
+    FileHeader header;
+    if (ok)
+    {
+        memcpy(&header, buffer.data(), sizeof(header));
+        ok = memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0 && header.byteOrder == BYTE_ORDER_MARK &&
+             header.version == FILE_VERSION && header.bandRows > 0 && header.stride > 0 &&
+             header.bands == (header.rows + header.bandRows - 1) / header.bandRows;
+    }
+    size_t offset = sizeof(FileHeader);
+    const size_t tableBytes = ok ? (size_t)header.bands * sizeof(uint64_t) : 0;
+    if (ok)
+        ok = buffer.size() - offset >= (size_t)header.keyLength + header.metaLength + tableBytes;
+    if (ok && (header.keyLength != key.size() || memcmp(buffer.data() + offset, key.data(), key.size()) != 0))
+    {
+        // 同名文件属于另一个 key
+        std::lock_guard<std::mutex> lock(configMutex);
+        state.misses++;
+        return false;
+    }
+    if (!ok)
+    {
+        countError();
+        return false;
+    }
+    offset += header.keyLength;
+    image.meta.assign((const char *)buffer.data() + offset, header.metaLength);
+    offset += header.metaLength;
+
+    std::vector<uint64_t> bandLength(header.bands);
+    std::vector<size_t> bandOffset(header.bands);
+    memcpy(bandLength.data(), buffer.data() + offset, tableBytes);
+    offset += tableBytes;
+    for (uint32_t b = 0; b < header.bands && ok; b++)
+    {
+        bandOffset[b] = offset;
+        ok = bandLength[b] <= buffer.size() - offset;
+        offset += ok ? (size_t)bandLength[b] : 0;
+    }
+    ok = ok && offset == buffer.size();
+    if (!ok)
+    {
+        countError();
+        return false;
+    }
+
+    image.rowSamples = header.rowSamples;
+    image.rows = header.rows;
+    image.stride = header.stride;
+    image.data.resize((size_t)header.rowSamples * header.rows * sizeof(uint16_t));
+    uint16_t *samples = (uint16_t *)image.data.data();
+    std::atomic<bool> valid(true);
+    parallelFor(header.bands, threads, [&](unsigned b) {
+        const unsigned first = b * header.bandRows;
+        const unsigned rows = std::min(header.bandRows, header.rows - first);
+        if (!decodeBand(buffer.data() + bandOffset[b], (size_t)bandLength[b], header.rowSamples, rows, header.stride,
+                        samples + (size_t)first * header.rowSamples))
+            valid = false;
+    });
+    if (!valid)
+    {
+        countError();
+        return false;
+    }
+
+    // 超出预算时按修改时间清理，读取也算作使用（atime 常被 noatime 关闭）
+    utime(path.c_str(), nullptr);
+    std::lock_guard<std::mutex> lock(configMutex);
+    state.hits++;
+    state.bytesRead += buffer.size();
+    return true;
+}
+
+bool writeRawDiskCache(const std::string &key, const RawCacheImage &image, int threads)
+{
+    std::string directory = rawDiskCacheStats().directory;
+    if (directory.empty() || image.stride == 0 || !image.samples)
+        return false;
+
+    FileHeader header;
+    memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.version = FILE_VERSION;
+    header.keyLength = (uint32_t)key.size();
+    header.metaLength = (uint32_t)image.meta.size();
+    header.rowSamples = image.rowSamples;
+    header.rows = image.rows;
+    header.stride = image.stride;
+    header.bandRows = BAND_ROWS;
+    header.bands = (image.rows + BAND_ROWS - 1) / BAND_ROWS;
+    header.reserved = 0;
+
+    std::vector<std::vector<unsigned char>> bands(header.bands);
+    const uint16_t *samples = (const uint16_t *)image.samples;
+    parallelFor(header.bands, threads, [&](unsigned b) {
+        const unsigned first = b * BAND_ROWS;
+        encodeBand(samples + (size_t)first * image.rowSamples, image.rowSamples,
+                   std::min(BAND_ROWS, image.rows - first), image.stride, bands[b]);
+    });
+    std::vector<uint64_t> bandLength(header.bands);
+    for (uint32_t b = 0; b < header.bands; b++)
+        bandLength[b] = bands[b].size();
+
+    // 临时文件名在进程和线程之间唯一，写完后改名为正式文件
+    static std::atomic<unsigned> counter(0);
+    const std::string path = cachePath(directory, key);
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".%llx.%zx.%u.tmp",
+             (unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count(),
+             std::hash<std::thread::id>()(std::this_thread::get_id()), counter++);
+    const std::string temp = path + suffix;
+
+    FILE *file = fopen(temp.c_str(), "wb");
+    bool ok = file != nullptr;
+    uint64_t written = sizeof(header) + key.size() + image.meta.size() + bandLength.size() * sizeof(uint64_t);
+    if (ok)
+    {
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(key.data(), 1, key.size(), file) == key.size() &&
+             fwrite(image.meta.data(), 1, image.meta.size(), file) == image.meta.size() &&
+             fwrite(bandLength.data(), sizeof(uint64_t), bandLength.size(), file) == bandLength.size();
+        for (uint32_t b = 0; b < header.bands && ok; b++)
+        {
+            ok = fwrite(bands[b].data(), 1, bands[b].size(), file) == bands[b].size();
+            written += bands[b].size();
+        }
+        ok = fclose(file) == 0 && ok;
+    }
+    if (ok && rename(temp.c_str(), path.c_str()) != 0)
+    {
+        // Windows 上目标已存在时 rename 失败：另一个进程已经写好了相同内容
+        remove(path.c_str());
+        ok = rename(temp.c_str(), path.c_str()) == 0;
+    }
+    if (!ok)
+    {
+        if (file)
+            remove(temp.c_str());
+        countError();
+        return false;
+    }
+
+    uint64_t budget;
+    bool over;
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        state.writes++;
+        state.bytesWritten += written;
+        state.bytes += written;
+        budget = state.budget;
+        over = budget && state.bytes > budget;
+    }
+    if (over)
+        trimDirectory(directory, budget, path);
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef RAW_DISK_CACHE_H
+#define RAW_DISK_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 磁盘 raw 缓存的配置和统计
+struct RawDiskCacheStats
+{
+    std::string directory; // 空表示禁用
+    bool allDecoders;      // false 时只缓存解码耗时的格式（CR3、富士压缩、Phase One IIQ）
+    uint64_t budget;       // 目录中缓存文件的字节上限，0 表示不限制
+    uint64_t bytes;        // 目录中缓存文件的总字节数（配置和清理时重新统计，之间按写入累加）
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writes;
+    uint64_t errors;       // 读写失败或文件损坏（按未命中处理）
+    uint64_t evictions;    // 超出 budget 时删除的文件数
+    uint64_t bytesRead;    // 读取的文件字节数
+    uint64_t bytesWritten;
+};
+
+// 缓存文件的内容：原样保存的元数据和 raw 缓冲区。
+// 缓冲区按行存放 16 位样本，stride 为同一颜色相邻样本的间隔（Bayer 为 2，四通道为 4，三通道为 3）
+struct RawCacheImage
+{
+    std::string meta;
+    const unsigned char *samples; // 写入时的数据，rowSamples * rows 个 16 位样本
+    std::vector<unsigned char> data; // 读取时解压到这里
+    unsigned rowSamples;
+    unsigned rows;
+    unsigned stride;
+};
+
+// 进程级设置。directory 为空表示禁用；目录不存在时返回 false。
+// 设置后重新统计目录中缓存文件的大小，超出 budget 时按修改时间从旧到新删除
+bool setRawDiskCache(const std::string &directory, bool allDecoders, uint64_t budget);
+RawDiskCacheStats rawDiskCacheStats();
+bool rawDiskCacheEnabled();
+// decoderName 为 libraw_decoder_info_t::decoder_name，判断是否写入磁盘缓存
+bool rawDiskCacheAccepts(const char *decoderName);
+// 删除目录中的全部缓存文件
+void clearRawDiskCache();
+
+// 按 key 读取缓存文件，key 不完全相同（哈希冲突）或文件损坏时返回 false。
+// 命中时更新文件的修改时间，超出 budget 时最近读取的文件最后删除。各行段并行解压，threads 为线程数
+bool readRawDiskCache(const std::string &key, RawCacheImage &image, int threads);
+// 压缩写入临时文件后改名，多个进程同时写同一 key 时不会读到不完整的文件。
+// 写入后目录超出 budget 时删除最旧的文件（不删除刚写入的文件）
+bool writeRawDiskCache(const std::string &key, const RawCacheImage &image, int threads);
+
+#endif // RAW_DISK_CACHE_H
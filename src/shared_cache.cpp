@@ -0,0 +1,137 @@
+#include "shared_cache.h"
+
+void SharedCache::setBudget(size_t budget)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    budgetBytes = budget;
+    evictLocked();
+}
+
+size_t SharedCache::budget() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return budgetBytes;
+}
+
+SharedCache::AcquireState SharedCache::acquire(const std::string &key, std::shared_ptr<const CacheEntry> &value,
+                                               bool waited)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (budgetBytes == 0)
+        return ACQUIRE_LEADER;
+
+    auto it = index.find(key);
+    if (it != index.end())
+    {
+        lru.splice(lru.begin(), lru, it->second);
+        value = it->second->value;
+        if (waited)
+            waits++;
+        else
+            hits++;
+        return ACQUIRE_HIT;
+    }
+
+    auto flight = inflight.find(key);
+    if (flight == inflight.end())
+    {
+        inflight[key] = std::this_thread::get_id();
+        misses++;
+        return ACQUIRE_LEADER;
+    }
+    return flight->second == std::this_thread::get_id() ? ACQUIRE_PENDING : ACQUIRE_BUSY;
+}
+
+bool SharedCache::busy(const std::string &key) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto flight = inflight.find(key);
+    return flight != inflight.end() && flight->second != std::this_thread::get_id();
+}
+
+void SharedCache::fulfil(const std::string &key, std::shared_ptr<const CacheEntry> value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (value && budgetBytes > 0)
+    {
+        auto it = index.find(key);
+        if (it != index.end())
+        {
+            usedBytes -= it->second->value->bytes();
+            lru.erase(it->second);
+            index.erase(it);
+        }
+        if (value->bytes() <= budgetBytes)
+        {
+            lru.push_front({key, value});
+            index[key] = lru.begin();
+            usedBytes += value->bytes();
+            evictLocked();
+        }
+        else
+            rejected++;
+    }
+
+    auto flight = inflight.find(key);
+    if (flight != inflight.end() && flight->second == std::this_thread::get_id())
+        inflight.erase(flight);
+}
+
+void SharedCache::abandon(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto flight = inflight.find(key);
+    if (flight != inflight.end() && flight->second == std::this_thread::get_id())
+        inflight.erase(flight);
+}
+
+bool SharedCache::erase(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it == index.end())
+        return false;
+    usedBytes -= it->second->value->bytes();
+    lru.erase(it->second);
+    index.erase(it);
+    return true;
+}
+
+void SharedCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    lru.clear();
+    index.clear();
+    usedBytes = 0;
+}
+
+SharedCacheStats SharedCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return {index.size(), usedBytes, budgetBytes, hits, misses, waits, evictions, rejected};
+}
+
+void SharedCache::evictLocked()
+{
+    // 从最久未使用的一端淘汰；已经取出的 shared_ptr 不受影响
+    while (usedBytes > budgetBytes && !lru.empty())
+    {
+        Node &victim = lru.back();
+        usedBytes -= victim.value->bytes();
+        index.erase(victim.key);
+        lru.pop_back();
+        evictions++;
+    }
+}
+
+SharedCache &outputCache()
+{
+    static SharedCache cache;
+    return cache;
+}
+
+SharedCache &rawCache()
+{
+    static SharedCache cache;
+    return cache;
+}
@@ -0,0 +1,88 @@
+#ifndef SHARED_CACHE_H
+#define SHARED_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// 缓存项：只读共享，bytes() 计入预算
+class CacheEntry
+{
+public:
+    virtual ~CacheEntry() {}
+    virtual size_t bytes() const = 0;
+};
+
+struct SharedCacheStats
+{
+    size_t entries;
+    size_t bytes;
+    size_t budget;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t waits;     // 收到 BUSY 后重试命中（单飞去重）
+    uint64_t evictions;
+    uint64_t rejected;  // 超过预算无法放入的项
+};
+
+// 进程级按字节预算的 LRU 缓存，同一进程的所有实例和 worker_threads 共享。
+// 单飞：同一 key 只有一个线程负责计算，其他线程得到 BUSY 后稍后重试，而不是重复计算。
+// 调用方都在 JS 线程上，acquire 从不阻塞，由 JS 端用定时器异步等待
+class SharedCache
+{
+public:
+    enum AcquireState
+    {
+        ACQUIRE_HIT = 0,     // value 为缓存的结果
+        ACQUIRE_LEADER = 1,  // 调用方负责计算，之后必须调用 fulfil 或 abandon
+        ACQUIRE_PENDING = 2, // 同一线程已在计算该 key（不能等待自己），也未计入统计
+        ACQUIRE_BUSY = 3     // 其他线程正在计算该 key，未计入统计
+    };
+
+    explicit SharedCache(size_t budget = 0) : budgetBytes(budget), usedBytes(0), hits(0), misses(0), waits(0), evictions(0), rejected(0) {}
+
+    // 预算为 0 表示禁用：acquire 总是返回 LEADER 且不登记进行中的请求
+    void setBudget(size_t budget);
+    size_t budget() const;
+
+    // 查找 key；不存在且没有其他线程在计算时成为负责者。waited 表示调用方此前对该 key 收到过 BUSY，
+    // 此时的命中计入 waits。等待超时后调用方可以不经 acquire 自行计算并 fulfil
+    AcquireState acquire(const std::string &key, std::shared_ptr<const CacheEntry> &value, bool waited = false);
+    // 其他线程是否正在计算 key（不登记、不计入统计）
+    bool busy(const std::string &key) const;
+    // 提交结果并结束负责者的计算。超过预算的项不缓存，重试的线程之一成为新的负责者
+    void fulfil(const std::string &key, std::shared_ptr<const CacheEntry> value);
+    // 负责者计算失败，重试的线程之一接手
+    void abandon(const std::string &key);
+
+    bool erase(const std::string &key);
+    void clear();
+    SharedCacheStats stats() const;
+
+private:
+    struct Node
+    {
+        std::string key;
+        std::shared_ptr<const CacheEntry> value;
+    };
+    void evictLocked();
+
+    mutable std::mutex mutex;
+    size_t budgetBytes;
+    size_t usedBytes;
+    std::list<Node> lru; // 头部最近使用
+    std::unordered_map<std::string, std::list<Node>::iterator> index;
+    std::unordered_map<std::string, std::thread::id> inflight; // 正在计算的 key 和负责的线程
+    uint64_t hits, misses, waits, evictions, rejected;
+};
+
+// 渲染结果缓存（编码后的图像或 RGB 数据）和解包后的 raw 数据缓存
+SharedCache &outputCache();
+SharedCache &rawCache();
+
+#endif // SHARED_CACHE_H
@@ -0,0 +1,1566 @@
+#include "simd_kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// MSVC 无需 target 属性即可生成任意指令集的内建函数
+#define SIMD_TARGET_SSE41
+#define SIMD_TARGET_AVX2
+#else
+// 只启用所需指令集，不启用 FMA，保证乘加顺序与标量版本一致
+#define SIMD_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && defined(LIBRAW_ENABLE_NEON)
+// NEON 内核尚未在 AArch64 上编译和验证，默认不编译，ARM64 使用标量实现；
+// 用 node-gyp rebuild --enable_neon=true 启用
+#define SIMD_ARM64 1
+#include <arm_neon.h>
+#endif
+
+// ============== 指令集检测 ==============
+
+#if defined(SIMD_X86)
+static bool cpuSupportsAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    // OSXSAVE 和 AVX，且操作系统保存了 YMM 寄存器
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+        return false;
+    if ((_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool cpuSupportsSse41()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 19)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.1");
+#endif
+}
+#endif
+
+static SimdLevel detectLevel()
+{
+#if defined(SIMD_X86)
+    if (cpuSupportsAvx2())
+        return SIMD_AVX2;
+    if (cpuSupportsSse41())
+        return SIMD_SSE41;
+    return SIMD_SCALAR;
+#elif defined(SIMD_ARM64)
+    // NEON 是 AArch64 的基线指令集
+    return SIMD_NEON;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+// LIBRAW_SIMD=scalar|sse4.1|avx2|neon，不能高于 CPU 支持的级别
+static SimdLevel selectLevel()
+{
+    SimdLevel detected = detectLevel();
+    const char *env = getenv("LIBRAW_SIMD");
+    if (!env || !*env)
+        return detected;
+
+    SimdLevel requested = detected;
+    if (strcmp(env, "scalar") == 0 || strcmp(env, "none") == 0)
+        requested = SIMD_SCALAR;
+    else if (strcmp(env, "sse4.1") == 0 || strcmp(env, "sse41") == 0)
+        requested = SIMD_SSE41;
+    else if (strcmp(env, "avx2") == 0)
+        requested = SIMD_AVX2;
+    else if (strcmp(env, "neon") == 0)
+        requested = SIMD_NEON;
+
+    if (requested == SIMD_SCALAR)
+        return SIMD_SCALAR;
+    // NEON 与 x86 级别互不可比，只接受与检测结果同一架构的请求
+    if ((requested == SIMD_NEON) != (detected == SIMD_NEON))
+        return detected;
+    return requested < detected ? requested : detected;
+}
+
+SimdLevel simdDetectedLevel()
+{
+    static const SimdLevel level = detectLevel();
+    return level;
+}
+
+SimdLevel simdLevel()
+{
+    static const SimdLevel level = selectLevel();
+    return level;
+}
+
+const char *simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SIMD_SSE41:
+        return "sse4.1";
+    case SIMD_AVX2:
+        return "avx2";
+    case SIMD_NEON:
+        return "neon";
+    default:
+        return "scalar";
+    }
+}
+
+// ============== 标量尾部 ==============
+// 与 LibRaw 的表达式完全相同：int 乘 float 先转换为 float 相乘，再截断为 int
+
+static inline unsigned short clip16(int value)
+{
+    return static_cast<unsigned short>(value < 0 ? 0 : (value > 65535 ? 65535 : value));
+}
+
+static void scaleColorsTail(unsigned short (*image)[4], size_t begin, size_t end, const int black[4], const float mul[4])
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            int val = image[i][c];
+            if (!val)
+                continue;
+            val -= black[c];
+            val *= mul[c];
+            image[i][c] = clip16(val);
+        }
+    }
+}
+
+static void convertTail(unsigned short (*image)[4], size_t begin, size_t end, int colors, const float out_cam[3][4])
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        unsigned short *img = image[i];
+        float out[3];
+        for (int k = 0; k < 3; k++)
+        {
+            out[k] = out_cam[k][0] * img[0] + out_cam[k][1] * img[1] + out_cam[k][2] * img[2];
+            if (colors == 4)
+                out[k] = out[k] + out_cam[k][3] * img[3];
+        }
+        for (int k = 0; k < 3; k++)
+            img[k] = clip16((int)out[k]);
+    }
+}
+
+static void splitBayerTail(const unsigned short *src, size_t begin, size_t end, unsigned short blackEven,
+                           unsigned short blackOdd, unsigned short *even, unsigned short *odd)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        unsigned short a = src[2 * i];
+        unsigned short b = src[2 * i + 1];
+        even[i] = a > blackEven ? a - blackEven : 0;
+        odd[i] = b > blackOdd ? b - blackOdd : 0;
+    }
+}
+
+static void subtractTail(const unsigned short *src, const unsigned short *dark, size_t begin, size_t end,
+                         unsigned short *out)
+{
+    for (size_t i = begin; i < end; i++)
+        out[i] = src[i] > dark[i] ? src[i] - dark[i] : 0;
+}
+
+// 浮点 DNG：与 LibRaw 的 __DNG_HalfToFloat / __DNG_FP24ToFloat 结果相同。非规格化数逐位规格化的结果
+// 等于尾数乘以最小指数（半精度 2^-24，24 位 2^-78），用一次精确的浮点乘法代替
+static const float HALF_DENORMAL_SCALE = std::ldexp(1.0f, -24);
+static const float FP24_DENORMAL_SCALE = std::ldexp(1.0f, -78);
+
+static inline uint32_t halfToFloatBits(uint32_t h)
+{
+    const uint32_t sign = (h & 0x8000) << 16;
+    const uint32_t exponent = h & 0x7c00;
+    const uint32_t mantissa = h & 0x3ff;
+    if (exponent == 0x7c00)
+        return mantissa ? 0 : sign | 0x477fe000;
+    if (exponent == 0)
+    {
+        const float value = (float)mantissa * HALF_DENORMAL_SCALE;
+        uint32_t bits;
+        memcpy(&bits, &value, 4);
+        return sign | bits;
+    }
+    return sign | (((h & 0x7fff) << 13) + 0x38000000);
+}
+
+static inline uint32_t fp24ToFloatBits(uint32_t v)
+{
+    const uint32_t sign = (v & 0x800000) << 8;
+    const uint32_t exponent = v & 0x7f0000;
+    const uint32_t mantissa = v & 0xffff;
+    if (exponent == 0x7f0000)
+        return mantissa ? 0 : sign | 0x5f7fff80;
+    if (exponent == 0)
+    {
+        const float value = (float)mantissa * FP24_DENORMAL_SCALE;
+        uint32_t bits;
+        memcpy(&bits, &value, 4);
+        return sign | bits;
+    }
+    return sign | (((v & 0x7fffff) << 7) + 0x20000000);
+}
+
+// 写入一个样本并更新最大值；NaN 的比较为假，不参与最大值
+static inline float storeFloat(float *out, size_t i, uint32_t bits, int bytesPerSample, float max)
+{
+    if (bytesPerSample == 2)
+        bits = halfToFloatBits(bits);
+    else if (bytesPerSample == 3)
+        bits = fp24ToFloatBits(bits);
+    float value;
+    memcpy(&value, &bits, 4);
+    out[i] = value;
+    return value > max ? value : max;
+}
+
+static void undoByteDeltaTail(unsigned char *bytes, size_t begin, size_t n, int stride)
+{
+    for (size_t i = begin > (size_t)stride ? begin : (size_t)stride; i < n; i++)
+        bytes[i] = (unsigned char)(bytes[i] + bytes[i - stride]);
+}
+
+static float mergeFloatPlanesTail(const unsigned char *planes, size_t count, int bytesPerSample, size_t begin,
+                                  float *out, float max)
+{
+    for (size_t i = begin; i < count; i++)
+    {
+        uint32_t bits = 0;
+        for (int b = 0; b < bytesPerSample; b++)
+            bits = (bits << 8) | planes[b * count + i];
+        max = storeFloat(out, i, bits, bytesPerSample, max);
+    }
+    return max;
+}
+
+static float expandFloatsTail(const unsigned char *src, size_t count, int bytesPerSample, bool bigEndian,
+                              size_t begin, float *out, float max)
+{
+    for (size_t i = begin; i < count; i++)
+    {
+        const unsigned char *p = src + i * bytesPerSample;
+        uint32_t bits = 0;
+        for (int b = 0; b < bytesPerSample; b++)
+            bits = (bits << 8) | p[bigEndian ? b : bytesPerSample - 1 - b];
+        max = storeFloat(out, i, bits, bytesPerSample, max);
+    }
+    return max;
+}
+
+// 与 LibRaw 的表达式相同，超出 16 位的乘积按编译器对 (ushort)float 的处理（x86 上截断为 int 后取低 16 位）
+static void floatToUshortTail(const float *src, size_t begin, size_t n, float mul, unsigned short *out)
+{
+    for (size_t i = begin; i < n; i++)
+    {
+        const float val = src[i] > 0.f ? src[i] : 0.f;
+        out[i] = (unsigned short)(val * mul);
+    }
+}
+
+// 四次曝光合并：按帧序写入，通道重复时后面的帧覆盖前面的
+static void combineFourShotTail(const unsigned short *const frames[4], const int channel[4][2], size_t begin,
+                                size_t end, unsigned short (*out)[4])
+{
+    for (int f = 0; f < 4; f++)
+    {
+        if (!frames[f])
+            continue;
+        for (size_t col = begin; col < end; col++)
+            out[col][channel[f][col & 1]] = frames[f][col];
+    }
+}
+
+// 四帧齐全且偶、奇列上各是一个排列时，source[p][c] 为输出通道 c 的来源帧
+static bool fourShotSources(const unsigned short *const frames[4], const int channel[4][2], int source[2][4])
+{
+    for (int p = 0; p < 2; p++)
+    {
+        unsigned seen = 0;
+        for (int f = 0; f < 4; f++)
+        {
+            if (!frames[f] || channel[f][p] < 0 || channel[f][p] > 3 || (seen & (1u << channel[f][p])))
+                return false;
+            seen |= 1u << channel[f][p];
+            source[p][channel[f][p]] = f;
+        }
+    }
+    return true;
+}
+
+static inline unsigned short swapBytes(unsigned short v)
+{
+    return (unsigned short)((v >> 8) | (v << 8));
+}
+
+static size_t arqPixelsTail(unsigned short (*pixels)[4], size_t begin, size_t n, bool byteSwap, bool channelSwap,
+                            unsigned short limit)
+{
+    size_t over = 0;
+    for (size_t i = begin; i < n; i++)
+    {
+        unsigned short *px = pixels[i];
+        if (byteSwap)
+            for (int c = 0; c < 4; c++)
+                px[c] = swapBytes(px[c]);
+        if (!channelSwap)
+            continue;
+        unsigned short g2 = px[2];
+        px[2] = px[3];
+        px[3] = g2;
+        unsigned short max = px[0] > px[1] ? px[0] : px[1];
+        max = max > px[2] ? max : px[2];
+        max = max > px[3] ? max : px[3];
+        if (max > limit)
+            over++;
+    }
+    return over;
+}
+
+// PNG 滤波：a、b、c 为左侧、上方和左上方的字节，左侧不足一个像素时为 0
+static inline int paethPredictor(int a, int b, int c)
+{
+    const int pa = std::abs(b - c);
+    const int pb = std::abs(a - c);
+    const int pc = std::abs(a + b - 2 * c);
+    return pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+}
+
+static inline unsigned char pngResidual(int filter, int x, int a, int b, int c)
+{
+    switch (filter)
+    {
+    case 1:
+        return (unsigned char)(x - a);
+    case 2:
+        return (unsigned char)(x - b);
+    case 3:
+        return (unsigned char)(x - ((a + b) >> 1));
+    case 4:
+        return (unsigned char)(x - paethPredictor(a, b, c));
+    default:
+        return (unsigned char)x;
+    }
+}
+
+static void pngFilterTail(const unsigned char *cur, const unsigned char *prev, size_t begin, size_t n, int bpp,
+                          int filter, unsigned char *out)
+{
+    for (size_t i = begin; i < n; i++)
+    {
+        const int a = i >= (size_t)bpp ? cur[i - bpp] : 0;
+        const int c = i >= (size_t)bpp ? prev[i - bpp] : 0;
+        out[i] = pngResidual(filter, cur[i], a, prev[i], c);
+    }
+}
+
+// libpng 的代价：结果按有符号字节取绝对值求和
+static void pngCostTail(const unsigned char *cur, const unsigned char *prev, size_t begin, size_t n, int bpp,
+                        uint64_t cost[5])
+{
+    for (size_t i = begin; i < n; i++)
+    {
+        const int a = i >= (size_t)bpp ? cur[i - bpp] : 0;
+        const int c = i >= (size_t)bpp ? prev[i - bpp] : 0;
+        for (int f = 0; f < 5; f++)
+        {
+            const int v = pngResidual(f, cur[i], a, prev[i], c);
+            cost[f] += v < 128 ? v : 256 - v;
+        }
+    }
+}
+
+// ============== SSE4.1 ==============
+
+#if defined(SIMD_X86)
+SIMD_TARGET_SSE41
+static void scaleColorsSse41(unsigned short (*image)[4], size_t pixels, const int black[4], const float mul[4])
+{
+    const __m128i vblack = _mm_loadu_si128(reinterpret_cast<const __m128i *>(black));
+    const __m128 vmul = _mm_loadu_ps(mul);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 2 <= pixels; i += 2)
+    {
+        __m128i *p = reinterpret_cast<__m128i *>(image[i]);
+        __m128i src = _mm_loadu_si128(p);
+
+        __m128i lo = _mm_sub_epi32(_mm_cvtepu16_epi32(src), vblack);
+        __m128i hi = _mm_sub_epi32(_mm_cvtepu16_epi32(_mm_srli_si128(src, 8)), vblack);
+        lo = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(lo), vmul));
+        hi = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(hi), vmul));
+
+        // 无符号饱和打包等价于 CLIP；原值为 0 的通道保持 0
+        __m128i result = _mm_packus_epi32(lo, hi);
+        result = _mm_andnot_si128(_mm_cmpeq_epi16(src, zero), result);
+        _mm_storeu_si128(p, result);
+    }
+    scaleColorsTail(image, i, pixels, black, mul);
+}
+
+SIMD_TARGET_SSE41
+static inline __m128 convertPixelSse41(__m128 px, const __m128 col[4], int colors)
+{
+    __m128 out = _mm_add_ps(_mm_mul_ps(col[0], _mm_shuffle_ps(px, px, 0x00)),
+                            _mm_mul_ps(col[1], _mm_shuffle_ps(px, px, 0x55)));
+    out = _mm_add_ps(out, _mm_mul_ps(col[2], _mm_shuffle_ps(px, px, 0xAA)));
+    if (colors == 4)
+        out = _mm_add_ps(out, _mm_mul_ps(col[3], _mm_shuffle_ps(px, px, 0xFF)));
+    return out;
+}
+
+SIMD_TARGET_SSE41
+static void convertToRgbSse41(unsigned short (*image)[4], size_t pixels, int colors, const float out_cam[3][4])
+{
+    // col[k] 为矩阵第 k 列，按输出通道排列
+    __m128 col[4];
+    for (int k = 0; k < 4; k++)
+        col[k] = _mm_setr_ps(out_cam[0][k], out_cam[1][k], out_cam[2][k], 0.0f);
+
+    size_t i = 0;
+    for (; i + 2 <= pixels; i += 2)
+    {
+        __m128i *p = reinterpret_cast<__m128i *>(image[i]);
+        __m128i src = _mm_loadu_si128(p);
+
+        __m128 a = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(src));
+        __m128 b = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(src, 8)));
+        __m128i result = _mm_packus_epi32(_mm_cvttps_epi32(convertPixelSse41(a, col, colors)),
+                                          _mm_cvttps_epi32(convertPixelSse41(b, col, colors)));
+        // 第四个通道保持原值
+        _mm_storeu_si128(p, _mm_blend_epi16(result, src, 0x88));
+    }
+    convertTail(image, i, pixels, colors, out_cam);
+}
+
+SIMD_TARGET_SSE41
+static void splitBayerSse41(const unsigned short *src, size_t pairs, unsigned short blackEven, unsigned short blackOdd,
+                            unsigned short *even, unsigned short *odd)
+{
+    // 黑电平按偶、奇列交替排列，先饱和相减再拆分
+    const __m128i vblack = _mm_set1_epi32((int)blackEven | ((int)blackOdd << 16));
+    const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+
+    size_t i = 0;
+    for (; i + 8 <= pairs; i += 8)
+    {
+        __m128i a = _mm_subs_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * i)), vblack);
+        __m128i b = _mm_subs_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * i + 8)), vblack);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(even + i),
+                         _mm_packus_epi32(_mm_and_si128(a, lowMask), _mm_and_si128(b, lowMask)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(odd + i),
+                         _mm_packus_epi32(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16)));
+    }
+    splitBayerTail(src, i, pairs, blackEven, blackOdd, even, odd);
+}
+
+SIMD_TARGET_SSE41
+static void subtractSse41(const unsigned short *src, const unsigned short *dark, size_t n, unsigned short *out)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dark + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_subs_epu16(a, d));
+    }
+    subtractTail(src, dark, i, n, out);
+}
+
+// 字节差分是前缀和：向量内按 stride、2*stride... 的移位累加，再加上前一个向量末尾 stride 个字节的结果。
+// 位置 j 的进位来自上一向量的 16 - stride + j % stride，stride 不必整除 16
+template <int S>
+SIMD_TARGET_SSE41 static size_t undoByteDeltaSse41(unsigned char *bytes, size_t n)
+{
+    unsigned char index[16];
+    for (int j = 0; j < 16; j++)
+        index[j] = (unsigned char)(16 - S + j % S);
+    const __m128i broadcast = _mm_loadu_si128(reinterpret_cast<const __m128i *>(index));
+    __m128i carry = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i));
+        if (S < 16)
+            v = _mm_add_epi8(v, _mm_slli_si128(v, S & 15));
+        if (2 * S < 16)
+            v = _mm_add_epi8(v, _mm_slli_si128(v, (2 * S) & 15));
+        if (4 * S < 16)
+            v = _mm_add_epi8(v, _mm_slli_si128(v, (4 * S) & 15));
+        if (8 * S < 16)
+            v = _mm_add_epi8(v, _mm_slli_si128(v, (8 * S) & 15));
+        v = _mm_add_epi8(v, carry);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes + i), v);
+        carry = _mm_shuffle_epi8(v, broadcast);
+    }
+    return i;
+}
+
+SIMD_TARGET_SSE41
+static void undoByteDeltaSse41(unsigned char *bytes, size_t n, int stride)
+{
+    size_t i = 0;
+    switch (stride)
+    {
+    case 1: i = undoByteDeltaSse41<1>(bytes, n); break;
+    case 2: i = undoByteDeltaSse41<2>(bytes, n); break;
+    case 3: i = undoByteDeltaSse41<3>(bytes, n); break;
+    case 4: i = undoByteDeltaSse41<4>(bytes, n); break;
+    case 6: i = undoByteDeltaSse41<6>(bytes, n); break;
+    case 8: i = undoByteDeltaSse41<8>(bytes, n); break;
+    case 12: i = undoByteDeltaSse41<12>(bytes, n); break;
+    case 16: i = undoByteDeltaSse41<16>(bytes, n); break;
+    default: break;
+    }
+    undoByteDeltaTail(bytes, i, n, stride);
+}
+
+// 4 个 32 位通道中的半精度或 24 位值转换为 float 的位模式，分支与 halfToFloatBits / fp24ToFloatBits 相同
+SIMD_TARGET_SSE41
+static inline __m128i smallFloatBitsSse41(__m128i v, int bytesPerSample)
+{
+    const bool half = bytesPerSample == 2;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i exponentMask = _mm_set1_epi32(half ? 0x7c00 : 0x7f0000);
+    const __m128i mantissa = _mm_and_si128(v, _mm_set1_epi32(half ? 0x3ff : 0xffff));
+    const __m128i exponent = _mm_and_si128(v, exponentMask);
+    const __m128i sign = half ? _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x8000)), 16)
+                              : _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x800000)), 8);
+    const __m128i normal = half ? _mm_add_epi32(_mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x7fff)), 13),
+                                                _mm_set1_epi32(0x38000000))
+                                : _mm_add_epi32(_mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x7fffff)), 7),
+                                                _mm_set1_epi32(0x20000000));
+    const __m128i denormal = _mm_castps_si128(_mm_mul_ps(_mm_cvtepi32_ps(mantissa),
+                                                         _mm_set1_ps(half ? HALF_DENORMAL_SCALE : FP24_DENORMAL_SCALE)));
+    const __m128i special = _mm_cmpeq_epi32(exponent, exponentMask);
+
+    __m128i bits = _mm_blendv_epi8(normal, denormal, _mm_cmpeq_epi32(exponent, zero));
+    bits = _mm_blendv_epi8(bits, _mm_set1_epi32(half ? 0x477fe000 : 0x5f7fff80), special);
+    bits = _mm_or_si128(bits, sign);
+    // NaN 为 0
+    return _mm_andnot_si128(_mm_andnot_si128(_mm_cmpeq_epi32(mantissa, zero), special), bits);
+}
+
+SIMD_TARGET_SSE41
+static inline __m128 storeFloatsSse41(float *out, __m128i v, int bytesPerSample, __m128 max)
+{
+    if (bytesPerSample != 4)
+        v = smallFloatBitsSse41(v, bytesPerSample);
+    const __m128 value = _mm_castsi128_ps(v);
+    _mm_storeu_ps(out, value);
+    // 第一个操作数为 NaN 时比较为假，返回 max
+    return _mm_max_ps(value, max);
+}
+
+SIMD_TARGET_SSE41
+static inline float horizontalMaxSse41(__m128 v, float max)
+{
+    float lanes[4];
+    _mm_storeu_ps(lanes, v);
+    for (int k = 0; k < 4; k++)
+        max = lanes[k] > max ? lanes[k] : max;
+    return max;
+}
+
+SIMD_TARGET_SSE41
+static float mergeFloatPlanesSse41(const unsigned char *planes, size_t count, int bytesPerSample, float *out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128 vmax = _mm_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i p[4];
+        for (int b = 0; b < bytesPerSample; b++)
+            p[b] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(planes + b * count + i));
+
+        // 低 16 位和高 16 位分别由两个平面交错得到，再交错为 32 位值
+        __m128i low[2], high[2];
+        if (bytesPerSample == 2)
+        {
+            low[0] = _mm_unpacklo_epi8(p[1], p[0]);
+            low[1] = _mm_unpackhi_epi8(p[1], p[0]);
+            high[0] = high[1] = zero;
+        }
+        else
+        {
+            const __m128i top = bytesPerSample == 3 ? zero : p[0];
+            const __m128i second = bytesPerSample == 3 ? p[0] : p[1];
+            const __m128i third = bytesPerSample == 3 ? p[1] : p[2];
+            const __m128i last = bytesPerSample == 3 ? p[2] : p[3];
+            low[0] = _mm_unpacklo_epi8(last, third);
+            low[1] = _mm_unpackhi_epi8(last, third);
+            high[0] = _mm_unpacklo_epi8(second, top);
+            high[1] = _mm_unpackhi_epi8(second, top);
+        }
+        for (int h = 0; h < 2; h++)
+        {
+            vmax = storeFloatsSse41(out + i + h * 8, _mm_unpacklo_epi16(low[h], high[h]), bytesPerSample, vmax);
+            vmax = storeFloatsSse41(out + i + h * 8 + 4, _mm_unpackhi_epi16(low[h], high[h]), bytesPerSample, vmax);
+        }
+    }
+    return mergeFloatPlanesTail(planes, count, bytesPerSample, i, out, horizontalMaxSse41(vmax, 0.f));
+}
+
+SIMD_TARGET_SSE41
+static float expandFloatsSse41(const unsigned char *src, size_t count, int bytesPerSample, bool bigEndian, float *out)
+{
+    // 每 16 字节（24 位时 12 字节）重排为 4 个 32 位值；小端主机上大端数据需要反转字节
+    static const signed char reverse32[16] = {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12};
+    static const signed char reverse16[16] = {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14};
+    static const signed char little24[16] = {0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1};
+    static const signed char big24[16] = {2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1};
+    const signed char *order = bytesPerSample == 3 ? (bigEndian ? big24 : little24)
+                                                   : (bytesPerSample == 2 ? reverse16 : reverse32);
+    const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i *>(order));
+    const bool reorder = bytesPerSample == 3 || bigEndian;
+    __m128 vmax = _mm_setzero_ps();
+
+    size_t i = 0;
+    if (bytesPerSample == 2)
+    {
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2));
+            if (reorder)
+                v = _mm_shuffle_epi8(v, shuffle);
+            vmax = storeFloatsSse41(out + i, _mm_cvtepu16_epi32(v), 2, vmax);
+            vmax = storeFloatsSse41(out + i + 4, _mm_cvtepu16_epi32(_mm_srli_si128(v, 8)), 2, vmax);
+        }
+    }
+    else
+    {
+        // 24 位每次读 16 字节、使用 12 字节，末尾留出 4 字节
+        for (; (i + 4) * bytesPerSample + (bytesPerSample == 3 ? 4 : 0) <= count * bytesPerSample; i += 4)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * bytesPerSample));
+            if (reorder)
+                v = _mm_shuffle_epi8(v, shuffle);
+            vmax = storeFloatsSse41(out + i, v, bytesPerSample, vmax);
+        }
+    }
+    return expandFloatsTail(src, count, bytesPerSample, bigEndian, i, out, horizontalMaxSse41(vmax, 0.f));
+}
+
+SIMD_TARGET_SSE41
+static void floatToUshortSse41(const float *src, size_t n, float mul, unsigned short *out)
+{
+    const __m128 vmul = _mm_set1_ps(mul);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        // max(v, 0) 与 MAX(v, 0.f) 相同，NaN 得到 0；cvttps 截断为 int 后取低 16 位
+        __m128 a = _mm_mul_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), vmul);
+        __m128 b = _mm_mul_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), zero), vmul);
+        __m128i lo = _mm_and_si128(_mm_cvttps_epi32(a), lowMask);
+        __m128i hi = _mm_and_si128(_mm_cvttps_epi32(b), lowMask);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi32(lo, hi));
+    }
+    floatToUshortTail(src, i, n, mul, out);
+}
+
+// 四帧按像素交错后，每 2 个像素（偶、奇列各一）按来源帧重排通道。begin 为偶数
+SIMD_TARGET_SSE41
+static void combineFourShotSse41(const unsigned short *const frames[4], const int channel[4][2],
+                                 const int source[2][4], size_t begin, size_t end, unsigned short (*out)[4])
+{
+    alignas(16) unsigned char order[16];
+    for (int k = 0; k < 2; k++)
+        for (int c = 0; c < 4; c++)
+        {
+            order[8 * k + 2 * c] = (unsigned char)(2 * (4 * k + source[k][c]));
+            order[8 * k + 2 * c + 1] = (unsigned char)(2 * (4 * k + source[k][c]) + 1);
+        }
+    const __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i *>(order));
+
+    size_t col = begin;
+    for (; col + 8 <= end; col += 8)
+    {
+        __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(frames[0] + col));
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(frames[1] + col));
+        __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(frames[2] + col));
+        __m128i a3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(frames[3] + col));
+        __m128i t0 = _mm_unpacklo_epi16(a0, a1);
+        __m128i t1 = _mm_unpackhi_epi16(a0, a1);
+        __m128i t2 = _mm_unpacklo_epi16(a2, a3);
+        __m128i t3 = _mm_unpackhi_epi16(a2, a3);
+        __m128i *dst = reinterpret_cast<__m128i *>(out + col);
+        _mm_storeu_si128(dst, _mm_shuffle_epi8(_mm_unpacklo_epi32(t0, t2), shuffle));
+        _mm_storeu_si128(dst + 1, _mm_shuffle_epi8(_mm_unpackhi_epi32(t0, t2), shuffle));
+        _mm_storeu_si128(dst + 2, _mm_shuffle_epi8(_mm_unpacklo_epi32(t1, t3), shuffle));
+        _mm_storeu_si128(dst + 3, _mm_shuffle_epi8(_mm_unpackhi_epi32(t1, t3), shuffle));
+    }
+    combineFourShotTail(frames, channel, col, end, out);
+}
+
+// 字节序和通道 2、3 的交换合并为一次 pshufb；超过上限的像素按 64 位（一个像素）比较计数
+SIMD_TARGET_SSE41
+static size_t arqPixelsSse41(unsigned short (*pixels)[4], size_t n, bool byteSwap, bool channelSwap,
+                             unsigned short limit)
+{
+    alignas(16) unsigned char order[16];
+    for (int k = 0; k < 2; k++)
+        for (int c = 0; c < 4; c++)
+        {
+            const int from = 4 * k + (channelSwap && c >= 2 ? 5 - c : c);
+            order[8 * k + 2 * c] = (unsigned char)(2 * from + (byteSwap ? 1 : 0));
+            order[8 * k + 2 * c + 1] = (unsigned char)(2 * from + (byteSwap ? 0 : 1));
+        }
+    const __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i *>(order));
+    const __m128i vlimit = _mm_set1_epi16((short)limit);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t over = 0;
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i *p = reinterpret_cast<__m128i *>(pixels + i);
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(p), shuffle);
+        _mm_storeu_si128(p, v);
+        if (channelSwap)
+        {
+            int within = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(_mm_subs_epu16(v, vlimit), zero)));
+            over += 2 - ((within & 1) + (within >> 1));
+        }
+    }
+    return over + arqPixelsTail(pixels, i, n, byteSwap, channelSwap, limit);
+}
+
+// 16 个字节的五种滤波结果。Paeth 的三个距离在 16 位中计算，比较结果收窄为字节掩码后按字节选择
+SIMD_TARGET_SSE41
+static inline void pngResidualsSse41(__m128i x, __m128i a, __m128i b, __m128i c, __m128i r[5])
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    r[0] = x;
+    r[1] = _mm_sub_epi8(x, a);
+    r[2] = _mm_sub_epi8(x, b);
+    // pavgb 向上取整，减去低位不同的 1 得到向下取整
+    r[3] = _mm_sub_epi8(x, _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one)));
+
+    __m128i notA[2], useC[2];
+    for (int h = 0; h < 2; h++)
+    {
+        const __m128i a16 = h ? _mm_unpackhi_epi8(a, zero) : _mm_unpacklo_epi8(a, zero);
+        const __m128i b16 = h ? _mm_unpackhi_epi8(b, zero) : _mm_unpacklo_epi8(b, zero);
+        const __m128i c16 = h ? _mm_unpackhi_epi8(c, zero) : _mm_unpacklo_epi8(c, zero);
+        const __m128i bc = _mm_sub_epi16(b16, c16);
+        const __m128i ac = _mm_sub_epi16(a16, c16);
+        const __m128i pa = _mm_abs_epi16(bc);
+        const __m128i pb = _mm_abs_epi16(ac);
+        const __m128i pc = _mm_abs_epi16(_mm_add_epi16(bc, ac));
+        notA[h] = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+        useC[h] = _mm_cmpgt_epi16(pb, pc);
+    }
+    const __m128i predBC = _mm_blendv_epi8(b, c, _mm_packs_epi16(useC[0], useC[1]));
+    r[4] = _mm_sub_epi8(x, _mm_blendv_epi8(a, predBC, _mm_packs_epi16(notA[0], notA[1])));
+}
+
+// 前 bpp 个字节（没有左侧像素）和不足 16 字节的尾部按标量处理
+SIMD_TARGET_SSE41
+static void pngCostSse41(const unsigned char *cur, const unsigned char *prev, size_t n, int bpp, uint64_t cost[5])
+{
+    pngCostTail(cur, prev, 0, std::min(n, (size_t)bpp), bpp, cost);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum[5];
+    for (int f = 0; f < 5; f++)
+        sum[f] = zero;
+    size_t i = bpp;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i r[5];
+        pngResidualsSse41(_mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + i)),
+                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + i - bpp)),
+                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(prev + i)),
+                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(prev + i - bpp)), r);
+        for (int f = 0; f < 5; f++)
+            sum[f] = _mm_add_epi64(sum[f], _mm_sad_epu8(_mm_abs_epi8(r[f]), zero));
+    }
+    for (int f = 0; f < 5; f++)
+        cost[f] += (uint64_t)_mm_cvtsi128_si64(sum[f]) + (uint64_t)_mm_extract_epi64(sum[f], 1);
+    pngCostTail(cur, prev, std::max(i, (size_t)bpp), n, bpp, cost);
+}
+
+SIMD_TARGET_SSE41
+static void pngFilterSse41(const unsigned char *cur, const unsigned char *prev, size_t n, int bpp, int filter,
+                           unsigned char *out)
+{
+    pngFilterTail(cur, prev, 0, std::min(n, (size_t)bpp), bpp, filter, out);
+    size_t i = bpp;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i r[5];
+        pngResidualsSse41(_mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + i)),
+                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + i - bpp)),
+                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(prev + i)),
+                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(prev + i - bpp)), r);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), r[filter]);
+    }
+    pngFilterTail(cur, prev, std::max(i, (size_t)bpp), n, bpp, filter, out);
+}
+
+// ============== AVX2 ==============
+
+SIMD_TARGET_AVX2
+static void scaleColorsAvx2(unsigned short (*image)[4], size_t pixels, const int black[4], const float mul[4])
+{
+    const __m256i vblack = _mm256_setr_epi32(black[0], black[1], black[2], black[3], black[0], black[1], black[2], black[3]);
+    const __m256 vmul = _mm256_setr_ps(mul[0], mul[1], mul[2], mul[3], mul[0], mul[1], mul[2], mul[3]);
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 4 <= pixels; i += 4)
+    {
+        __m256i *p = reinterpret_cast<__m256i *>(image[i]);
+        __m256i src = _mm256_loadu_si256(p);
+
+        __m256i lo = _mm256_sub_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(src)), vblack);
+        __m256i hi = _mm256_sub_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(src, 1)), vblack);
+        lo = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(lo), vmul));
+        hi = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(hi), vmul));
+
+        // packus 按 128 位分别打包，重新排列为像素顺序
+        __m256i result = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+        result = _mm256_andnot_si256(_mm256_cmpeq_epi16(src, zero), result);
+        _mm256_storeu_si256(p, result);
+    }
+    scaleColorsTail(image, i, pixels, black, mul);
+}
+
+SIMD_TARGET_AVX2
+static void convertToRgbAvx2(unsigned short (*image)[4], size_t pixels, int colors, const float out_cam[3][4])
+{
+    // 每个 128 位通道处理一个像素
+    __m256 col[4];
+    for (int k = 0; k < 4; k++)
+        col[k] = _mm256_setr_ps(out_cam[0][k], out_cam[1][k], out_cam[2][k], 0.0f,
+                                out_cam[0][k], out_cam[1][k], out_cam[2][k], 0.0f);
+
+    size_t i = 0;
+    for (; i + 4 <= pixels; i += 4)
+    {
+        __m256i *p = reinterpret_cast<__m256i *>(image[i]);
+        __m256i src = _mm256_loadu_si256(p);
+
+        __m256 px[2] = {_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(src))),
+                        _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(src, 1)))};
+        __m256i packed[2];
+        for (int h = 0; h < 2; h++)
+        {
+            __m256 out = _mm256_add_ps(_mm256_mul_ps(col[0], _mm256_permute_ps(px[h], 0x00)),
+                                       _mm256_mul_ps(col[1], _mm256_permute_ps(px[h], 0x55)));
+            out = _mm256_add_ps(out, _mm256_mul_ps(col[2], _mm256_permute_ps(px[h], 0xAA)));
+            if (colors == 4)
+                out = _mm256_add_ps(out, _mm256_mul_ps(col[3], _mm256_permute_ps(px[h], 0xFF)));
+            packed[h] = _mm256_cvttps_epi32(out);
+        }
+
+        __m256i result = _mm256_permute4x64_epi64(_mm256_packus_epi32(packed[0], packed[1]), 0xD8);
+        // 第四个通道保持原值
+        _mm256_storeu_si256(p, _mm256_blend_epi16(result, src, 0x88));
+    }
+    convertTail(image, i, pixels, colors, out_cam);
+}
+
+SIMD_TARGET_AVX2
+static void splitBayerAvx2(const unsigned short *src, size_t pairs, unsigned short blackEven, unsigned short blackOdd,
+                           unsigned short *even, unsigned short *odd)
+{
+    const __m256i vblack = _mm256_set1_epi32((int)blackEven | ((int)blackOdd << 16));
+    const __m256i lowMask = _mm256_set1_epi32(0xFFFF);
+
+    size_t i = 0;
+    for (; i + 16 <= pairs; i += 16)
+    {
+        __m256i a = _mm256_subs_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * i)), vblack);
+        __m256i b = _mm256_subs_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * i + 16)), vblack);
+        // packus 按 128 位分别打包，重新排列为列顺序
+        __m256i e = _mm256_packus_epi32(_mm256_and_si256(a, lowMask), _mm256_and_si256(b, lowMask));
+        __m256i o = _mm256_packus_epi32(_mm256_srli_epi32(a, 16), _mm256_srli_epi32(b, 16));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(even + i), _mm256_permute4x64_epi64(e, 0xD8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(odd + i), _mm256_permute4x64_epi64(o, 0xD8));
+    }
+    splitBayerTail(src, i, pairs, blackEven, blackOdd, even, odd);
+}
+
+SIMD_TARGET_AVX2
+static void subtractAvx2(const unsigned short *src, const unsigned short *dark, size_t n, unsigned short *out)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dark + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_subs_epu16(a, d));
+    }
+    subtractTail(src, dark, i, n, out);
+}
+
+SIMD_TARGET_AVX2
+static void floatToUshortAvx2(const float *src, size_t n, float mul, unsigned short *out)
+{
+    const __m256 vmul = _mm256_set1_ps(mul);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i lowMask = _mm256_set1_epi32(0xFFFF);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256 a = _mm256_mul_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), zero), vmul);
+        __m256 b = _mm256_mul_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 8), zero), vmul);
+        __m256i lo = _mm256_and_si256(_mm256_cvttps_epi32(a), lowMask);
+        __m256i hi = _mm256_and_si256(_mm256_cvttps_epi32(b), lowMask);
+        // packus 按 128 位通道交错，重排回顺序
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), packed);
+    }
+    floatToUshortTail(src, i, n, mul, out);
+}
+#endif
+
+// ============== NEON ==============
+
+#if defined(SIMD_ARM64)
+static void scaleColorsNeon(unsigned short (*image)[4], size_t pixels, const int black[4], const float mul[4])
+{
+    const int32x4_t vblack = vld1q_s32(black);
+    const float32x4_t vmul = vld1q_f32(mul);
+
+    size_t i = 0;
+    for (; i + 2 <= pixels; i += 2)
+    {
+        uint16_t *p = image[i];
+        uint16x8_t src = vld1q_u16(p);
+
+        int32x4_t lo = vsubq_s32(vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(src))), vblack);
+        int32x4_t hi = vsubq_s32(vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(src))), vblack);
+        // 单次乘法不存在乘加融合，结果与标量一致；vcvtq 向零截断
+        lo = vcvtq_s32_f32(vmulq_f32(vcvtq_f32_s32(lo), vmul));
+        hi = vcvtq_s32_f32(vmulq_f32(vcvtq_f32_s32(hi), vmul));
+
+        uint16x8_t result = vcombine_u16(vqmovun_s32(lo), vqmovun_s32(hi));
+        result = vbicq_u16(result, vceqq_u16(src, vdupq_n_u16(0)));
+        vst1q_u16(p, result);
+    }
+    scaleColorsTail(image, i, pixels, black, mul);
+}
+
+static void splitBayerNeon(const unsigned short *src, size_t pairs, unsigned short blackEven, unsigned short blackOdd,
+                           unsigned short *even, unsigned short *odd)
+{
+    const uint16x8_t vblackEven = vdupq_n_u16(blackEven);
+    const uint16x8_t vblackOdd = vdupq_n_u16(blackOdd);
+
+    size_t i = 0;
+    for (; i + 8 <= pairs; i += 8)
+    {
+        // vld2q 直接按奇偶列拆分
+        uint16x8x2_t px = vld2q_u16(src + 2 * i);
+        vst1q_u16(even + i, vqsubq_u16(px.val[0], vblackEven));
+        vst1q_u16(odd + i, vqsubq_u16(px.val[1], vblackOdd));
+    }
+    splitBayerTail(src, i, pairs, blackEven, blackOdd, even, odd);
+}
+
+static void subtractNeon(const unsigned short *src, const unsigned short *dark, size_t n, unsigned short *out)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        vst1q_u16(out + i, vqsubq_u16(vld1q_u16(src + i), vld1q_u16(dark + i)));
+    subtractTail(src, dark, i, n, out);
+}
+
+// 与 SSE4.1 版本相同的前缀和，vextq 实现按字节左移
+template <int S>
+static size_t undoByteDeltaNeon(unsigned char *bytes, size_t n)
+{
+    unsigned char index[16];
+    for (int j = 0; j < 16; j++)
+        index[j] = (unsigned char)(16 - S + j % S);
+    const uint8x16_t broadcast = vld1q_u8(index);
+    const uint8x16_t zero = vdupq_n_u8(0);
+    uint8x16_t carry = zero;
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(bytes + i);
+        if (S < 16)
+            v = vaddq_u8(v, vextq_u8(zero, v, (16 - S) & 15));
+        if (2 * S < 16)
+            v = vaddq_u8(v, vextq_u8(zero, v, (16 - 2 * S) & 15));
+        if (4 * S < 16)
+            v = vaddq_u8(v, vextq_u8(zero, v, (16 - 4 * S) & 15));
+        if (8 * S < 16)
+            v = vaddq_u8(v, vextq_u8(zero, v, (16 - 8 * S) & 15));
+        v = vaddq_u8(v, carry);
+        vst1q_u8(bytes + i, v);
+        carry = vqtbl1q_u8(v, broadcast);
+    }
+    return i;
+}
+
+static void undoByteDeltaNeon(unsigned char *bytes, size_t n, int stride)
+{
+    size_t i = 0;
+    switch (stride)
+    {
+    case 1: i = undoByteDeltaNeon<1>(bytes, n); break;
+    case 2: i = undoByteDeltaNeon<2>(bytes, n); break;
+    case 3: i = undoByteDeltaNeon<3>(bytes, n); break;
+    case 4: i = undoByteDeltaNeon<4>(bytes, n); break;
+    case 6: i = undoByteDeltaNeon<6>(bytes, n); break;
+    case 8: i = undoByteDeltaNeon<8>(bytes, n); break;
+    case 12: i = undoByteDeltaNeon<12>(bytes, n); break;
+    case 16: i = undoByteDeltaNeon<16>(bytes, n); break;
+    default: break;
+    }
+    undoByteDeltaTail(bytes, i, n, stride);
+}
+
+static inline uint32x4_t smallFloatBitsNeon(uint32x4_t v, int bytesPerSample)
+{
+    const bool half = bytesPerSample == 2;
+    const uint32x4_t zero = vdupq_n_u32(0);
+    const uint32x4_t exponentMask = vdupq_n_u32(half ? 0x7c00 : 0x7f0000);
+    const uint32x4_t mantissa = vandq_u32(v, vdupq_n_u32(half ? 0x3ff : 0xffff));
+    const uint32x4_t exponent = vandq_u32(v, exponentMask);
+    const uint32x4_t sign = half ? vshlq_n_u32(vandq_u32(v, vdupq_n_u32(0x8000)), 16)
+                                 : vshlq_n_u32(vandq_u32(v, vdupq_n_u32(0x800000)), 8);
+    const uint32x4_t normal = half ? vaddq_u32(vshlq_n_u32(vandq_u32(v, vdupq_n_u32(0x7fff)), 13), vdupq_n_u32(0x38000000))
+                                   : vaddq_u32(vshlq_n_u32(vandq_u32(v, vdupq_n_u32(0x7fffff)), 7), vdupq_n_u32(0x20000000));
+    const uint32x4_t denormal = vreinterpretq_u32_f32(
+        vmulq_f32(vcvtq_f32_u32(mantissa), vdupq_n_f32(half ? HALF_DENORMAL_SCALE : FP24_DENORMAL_SCALE)));
+    const uint32x4_t special = vceqq_u32(exponent, exponentMask);
+
+    uint32x4_t bits = vbslq_u32(vceqq_u32(exponent, zero), denormal, normal);
+    bits = vbslq_u32(special, vdupq_n_u32(half ? 0x477fe000 : 0x5f7fff80), bits);
+    bits = vorrq_u32(bits, sign);
+    // NaN 为 0
+    return vbicq_u32(bits, vbicq_u32(special, vceqq_u32(mantissa, zero)));
+}
+
+static inline float32x4_t storeFloatsNeon(float *out, uint32x4_t v, int bytesPerSample, float32x4_t max)
+{
+    if (bytesPerSample != 4)
+        v = smallFloatBitsNeon(v, bytesPerSample);
+    const float32x4_t value = vreinterpretq_f32_u32(v);
+    vst1q_f32(out, value);
+    // vmaxq 会传播 NaN，改用比较选择，NaN 不参与
+    return vbslq_f32(vcgtq_f32(value, max), value, max);
+}
+
+static inline float horizontalMaxNeon(float32x4_t v, float max)
+{
+    float lanes[4];
+    vst1q_f32(lanes, v);
+    for (int k = 0; k < 4; k++)
+        max = lanes[k] > max ? lanes[k] : max;
+    return max;
+}
+
+// p[0] 为最高字节的 16 个值，按平面顺序合并为 32 位并转换
+static inline float32x4_t mergeFloats16Neon(const uint8x16_t *p, int bytesPerSample, float *out, float32x4_t max)
+{
+    const uint8x16_t zero = vdupq_n_u8(0);
+    uint8x16x2_t low, high;
+    if (bytesPerSample == 2)
+    {
+        low = vzipq_u8(p[1], p[0]);
+        high.val[0] = high.val[1] = zero;
+    }
+    else if (bytesPerSample == 3)
+    {
+        low = vzipq_u8(p[2], p[1]);
+        high = vzipq_u8(p[0], zero);
+    }
+    else
+    {
+        low = vzipq_u8(p[3], p[2]);
+        high = vzipq_u8(p[1], p[0]);
+    }
+    for (int h = 0; h < 2; h++)
+    {
+        const uint16x8x2_t words = vzipq_u16(vreinterpretq_u16_u8(low.val[h]), vreinterpretq_u16_u8(high.val[h]));
+        max = storeFloatsNeon(out + h * 8, vreinterpretq_u32_u16(words.val[0]), bytesPerSample, max);
+        max = storeFloatsNeon(out + h * 8 + 4, vreinterpretq_u32_u16(words.val[1]), bytesPerSample, max);
+    }
+    return max;
+}
+
+static float mergeFloatPlanesNeon(const unsigned char *planes, size_t count, int bytesPerSample, float *out)
+{
+    float32x4_t vmax = vdupq_n_f32(0.f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        uint8x16_t p[4];
+        for (int b = 0; b < bytesPerSample; b++)
+            p[b] = vld1q_u8(planes + b * count + i);
+        vmax = mergeFloats16Neon(p, bytesPerSample, out + i, vmax);
+    }
+    return mergeFloatPlanesTail(planes, count, bytesPerSample, i, out, horizontalMaxNeon(vmax, 0.f));
+}
+
+static float expandFloatsNeon(const unsigned char *src, size_t count, int bytesPerSample, bool bigEndian, float *out)
+{
+    // vld2/3/4 按字节拆分为平面，小端数据的平面顺序反过来
+    float32x4_t vmax = vdupq_n_f32(0.f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const unsigned char *p = src + i * bytesPerSample;
+        uint8x16_t planes[4];
+        if (bytesPerSample == 2)
+        {
+            const uint8x16x2_t v = vld2q_u8(p);
+            for (int b = 0; b < 2; b++)
+                planes[b] = v.val[bigEndian ? b : 1 - b];
+        }
+        else if (bytesPerSample == 3)
+        {
+            const uint8x16x3_t v = vld3q_u8(p);
+            for (int b = 0; b < 3; b++)
+                planes[b] = v.val[bigEndian ? b : 2 - b];
+        }
+        else
+        {
+            const uint8x16x4_t v = vld4q_u8(p);
+            for (int b = 0; b < 4; b++)
+                planes[b] = v.val[bigEndian ? b : 3 - b];
+        }
+        vmax = mergeFloats16Neon(planes, bytesPerSample, out + i, vmax);
+    }
+    return expandFloatsTail(src, count, bytesPerSample, bigEndian, i, out, horizontalMaxNeon(vmax, 0.f));
+}
+
+static void floatToUshortNeon(const float *src, size_t n, float mul, unsigned short *out)
+{
+    const float32x4_t vmul = vdupq_n_f32(mul);
+    const float32x4_t zero = vdupq_n_f32(0.f);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        float32x4_t a = vld1q_f32(src + i);
+        float32x4_t b = vld1q_f32(src + i + 4);
+        // 与 MAX(v, 0.f) 相同，NaN 得到 0；截断为 int 后取低 16 位
+        a = vmulq_f32(vbslq_f32(vcgtq_f32(a, zero), a, zero), vmul);
+        b = vmulq_f32(vbslq_f32(vcgtq_f32(b, zero), b, zero), vmul);
+        const uint16x4_t lo = vmovn_u32(vreinterpretq_u32_s32(vcvtq_s32_f32(a)));
+        const uint16x4_t hi = vmovn_u32(vreinterpretq_u32_s32(vcvtq_s32_f32(b)));
+        vst1q_u16(out + i, vcombine_u16(lo, hi));
+    }
+    floatToUshortTail(src, i, n, mul, out);
+}
+
+// vld1q 读取四帧，偶、奇列的来源帧不同时按位选择，vst4q 交错写出
+static void combineFourShotNeon(const unsigned short *const frames[4], const int channel[4][2],
+                                const int source[2][4], size_t begin, size_t end, unsigned short (*out)[4])
+{
+    static const uint16_t oddLanes[8] = {0, 0xFFFF, 0, 0xFFFF, 0, 0xFFFF, 0, 0xFFFF};
+    const uint16x8_t odd = vld1q_u16(oddLanes);
+
+    size_t col = begin;
+    for (; col + 8 <= end; col += 8)
+    {
+        uint16x8_t a[4];
+        for (int f = 0; f < 4; f++)
+            a[f] = vld1q_u16(frames[f] + col);
+        uint16x8x4_t px;
+        for (int c = 0; c < 4; c++)
+            px.val[c] = vbslq_u16(odd, a[source[1][c]], a[source[0][c]]);
+        vst4q_u16(out[col], px);
+    }
+    combineFourShotTail(frames, channel, col, end, out);
+}
+
+static size_t arqPixelsNeon(unsigned short (*pixels)[4], size_t n, bool byteSwap, bool channelSwap,
+                            unsigned short limit)
+{
+    uint8_t order[16];
+    for (int k = 0; k < 2; k++)
+        for (int c = 0; c < 4; c++)
+        {
+            const int from = 4 * k + (channelSwap && c >= 2 ? 5 - c : c);
+            order[8 * k + 2 * c] = (uint8_t)(2 * from + (byteSwap ? 1 : 0));
+            order[8 * k + 2 * c + 1] = (uint8_t)(2 * from + (byteSwap ? 0 : 1));
+        }
+    const uint8x16_t table = vld1q_u8(order);
+    const uint16x8_t vlimit = vdupq_n_u16(limit);
+
+    size_t over = 0;
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        uint8_t *p = reinterpret_cast<uint8_t *>(pixels + i);
+        uint8x16_t v = vqtbl1q_u8(vld1q_u8(p), table);
+        vst1q_u8(p, v);
+        if (channelSwap)
+        {
+            uint64x2_t excess = vreinterpretq_u64_u16(vqsubq_u16(vreinterpretq_u16_u8(v), vlimit));
+            uint64x2_t nonzero = vtstq_u64(excess, excess);
+            over += (size_t)(vgetq_lane_u64(nonzero, 0) & 1) + (size_t)(vgetq_lane_u64(nonzero, 1) & 1);
+        }
+    }
+    return over + arqPixelsTail(pixels, i, n, byteSwap, channelSwap, limit);
+}
+
+static inline void pngResidualsNeon(uint8x16_t x, uint8x16_t a, uint8x16_t b, uint8x16_t c, uint8x16_t r[5])
+{
+    r[0] = x;
+    r[1] = vsubq_u8(x, a);
+    r[2] = vsubq_u8(x, b);
+    r[3] = vsubq_u8(x, vhaddq_u8(a, b));
+
+    const int16x8_t bcLo = vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(b), vget_low_u8(c)));
+    const int16x8_t bcHi = vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(b), vget_high_u8(c)));
+    const int16x8_t acLo = vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(a), vget_low_u8(c)));
+    const int16x8_t acHi = vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(a), vget_high_u8(c)));
+    const int16x8_t paLo = vabsq_s16(bcLo), paHi = vabsq_s16(bcHi);
+    const int16x8_t pbLo = vabsq_s16(acLo), pbHi = vabsq_s16(acHi);
+    const int16x8_t pcLo = vabsq_s16(vaddq_s16(bcLo, acLo)), pcHi = vabsq_s16(vaddq_s16(bcHi, acHi));
+    const uint8x16_t notA = vcombine_u8(vmovn_u16(vorrq_u16(vcgtq_s16(paLo, pbLo), vcgtq_s16(paLo, pcLo))),
+                                        vmovn_u16(vorrq_u16(vcgtq_s16(paHi, pbHi), vcgtq_s16(paHi, pcHi))));
+    const uint8x16_t useC = vcombine_u8(vmovn_u16(vcgtq_s16(pbLo, pcLo)), vmovn_u16(vcgtq_s16(pbHi, pcHi)));
+    r[4] = vsubq_u8(x, vbslq_u8(notA, vbslq_u8(useC, c, b), a));
+}
+
+static void pngCostNeon(const unsigned char *cur, const unsigned char *prev, size_t n, int bpp, uint64_t cost[5])
+{
+    pngCostTail(cur, prev, 0, std::min(n, (size_t)bpp), bpp, cost);
+    uint32x4_t sum[5];
+    for (int f = 0; f < 5; f++)
+        sum[f] = vdupq_n_u32(0);
+    size_t i = bpp;
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t r[5];
+        pngResidualsNeon(vld1q_u8(cur + i), vld1q_u8(cur + i - bpp), vld1q_u8(prev + i), vld1q_u8(prev + i - bpp), r);
+        // vabsq_s8(-128) 仍为 0x80，按无符号数即 128
+        for (int f = 0; f < 5; f++)
+            sum[f] = vpadalq_u16(sum[f], vpaddlq_u8(vreinterpretq_u8_s8(vabsq_s8(vreinterpretq_s8_u8(r[f])))));
+    }
+    for (int f = 0; f < 5; f++)
+        cost[f] += vaddvq_u32(sum[f]);
+    pngCostTail(cur, prev, std::max(i, (size_t)bpp), n, bpp, cost);
+}
+
+static void pngFilterNeon(const unsigned char *cur, const unsigned char *prev, size_t n, int bpp, int filter,
+                          unsigned char *out)
+{
+    pngFilterTail(cur, prev, 0, std::min(n, (size_t)bpp), bpp, filter, out);
+    size_t i = bpp;
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t r[5];
+        pngResidualsNeon(vld1q_u8(cur + i), vld1q_u8(cur + i - bpp), vld1q_u8(prev + i), vld1q_u8(prev + i - bpp), r);
+        vst1q_u8(out + i, r[filter]);
+    }
+    pngFilterTail(cur, prev, std::max(i, (size_t)bpp), n, bpp, filter, out);
+}
+#endif
+
+// ============== 分派 ==============
+
+bool simdScaleColors(unsigned short (*image)[4], size_t pixels, const int black[4], const float mul[4])
+{
+    switch (simdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX2:
+        scaleColorsAvx2(image, pixels, black, mul);
+        return true;
+    case SIMD_SSE41:
+        scaleColorsSse41(image, pixels, black, mul);
+        return true;
+#endif
+#if defined(SIMD_ARM64)
+    case SIMD_NEON:
+        scaleColorsNeon(image, pixels, black, mul);
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+bool simdConvertToRgb(unsigned short (*image)[4], size_t pixels, int colors, const float out_cam[3][4])
+{
+    if (colors != 3 && colors != 4)
+        return false;
+
+    switch (simdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX2:
+        convertToRgbAvx2(image, pixels, colors, out_cam);
+        return true;
+    case SIMD_SSE41:
+        convertToRgbSse41(image, pixels, colors, out_cam);
+        return true;
+#endif
+    // AArch64 编译器默认会把标量版本的乘加融合为 fmadd，NEON 版本无法保证逐位一致，使用 LibRaw 的实现
+    default:
+        return false;
+    }
+}
+
+void simdSplitBayerRow(const unsigned short *src, size_t pairs, unsigned short blackEven, unsigned short blackOdd,
+                       unsigned short *even, unsigned short *odd)
+{
+    switch (simdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX2:
+        splitBayerAvx2(src, pairs, blackEven, blackOdd, even, odd);
+        return;
+    case SIMD_SSE41:
+        splitBayerSse41(src, pairs, blackEven, blackOdd, even, odd);
+        return;
+#endif
+#if defined(SIMD_ARM64)
+    case SIMD_NEON:
+        splitBayerNeon(src, pairs, blackEven, blackOdd, even, odd);
+        return;
+#endif
+    default:
+        splitBayerTail(src, 0, pairs, blackEven, blackOdd, even, odd);
+    }
+}
+
+void simdSubtractRow(const unsigned short *src, const unsigned short *dark, size_t n, unsigned short *out)
+{
+    switch (simdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX2:
+        subtractAvx2(src, dark, n, out);
+        return;
+    case SIMD_SSE41:
+        subtractSse41(src, dark, n, out);
+        return;
+#endif
+#if defined(SIMD_ARM64)
+    case SIMD_NEON:
+        subtractNeon(src, dark, n, out);
+        return;
+#endif
+    default:
+        subtractTail(src, dark, 0, n, out);
+    }
+}
+
+// 浮点 DNG 的内核受内存带宽限制，AVX2 级别使用 SSE4.1 版本
+
+void simdUndoByteDelta(unsigned char *bytes, size_t n, int stride)
+{
+    switch (simdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX2:
+    case SIMD_SSE41:
+        undoByteDeltaSse41(bytes, n, stride);
+        return;
+#endif
+#if defined(SIMD_ARM64)
+    case SIMD_NEON:
+        undoByteDeltaNeon(bytes, n, stride);
+        return;
+#endif
+    default:
+        undoByteDeltaTail(bytes, 0, n, stride);
+    }
+}
+
+float simdMergeFloatPlanes(const unsigned char *planes, size_t count, int bytesPerSample, float *out)
+{
+    switch (simdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX2:
+    case SIMD_SSE41:
+        return mergeFloatPlanesSse41(planes, count, bytesPerSample, out);
+#endif
+#if defined(SIMD_ARM64)
+    case SIMD_NEON:
+        return mergeFloatPlanesNeon(planes, count, bytesPerSample, out);
+#endif
+    default:
+        return mergeFloatPlanesTail(planes, count, bytesPerSample, 0, out, 0.f);
+    }
+}
+
+float simdExpandFloats(const unsigned char *src, size_t count, int bytesPerSample, bool bigEndian, float *out)
+{
+    switch (simdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX2:
+    case SIMD_SSE41:
+        return expandFloatsSse41(src, count, bytesPerSample, bigEndian, out);
+#endif
+#if defined(SIMD_ARM64)
+    case SIMD_NEON:
+        return expandFloatsNeon(src, count, bytesPerSample, bigEndian, out);
+#endif
+    default:
+        return expandFloatsTail(src, count, bytesPerSample, bigEndian, 0, out, 0.f);
+    }
+}
+
+void simdFloatToUshort(const float *src, size_t n, float mul, unsigned short *out)
+{
+    switch (simdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX2:
+        floatToUshortAvx2(src, n, mul, out);
+        return;
+    case SIMD_SSE41:
+        floatToUshortSse41(src, n, mul, out);
+        return;
+#endif
+#if defined(SIMD_ARM64)
+    case SIMD_NEON:
+        floatToUshortNeon(src, n, mul, out);
+        return;
+#endif
+    default:
+        floatToUshortTail(src, 0, n, mul, out);
+    }
+}
+
+// 四帧合并和 ARQ 交换受内存带宽限制，AVX2 级别使用 SSE4.1 版本
+
+void simdCombineFourShot(const unsigned short *const frames[4], const int channel[4][2], size_t begin, size_t end,
+                         unsigned short (*out)[4])
+{
+    int source[2][4];
+    if (begin >= end || !fourShotSources(frames, channel, source))
+    {
+        combineFourShotTail(frames, channel, begin, end, out);
+        return;
+    }
+    // 向量内的像素从偶数列开始
+    if (begin & 1)
+    {
+        combineFourShotTail(frames, channel, begin, begin + 1, out);
+        begin++;
+    }
+    switch (simdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX2:
+    case SIMD_SSE41:
+        combineFourShotSse41(frames, channel, source, begin, end, out);
+        return;
+#endif
+#if defined(SIMD_ARM64)
+    case SIMD_NEON:
+        combineFourShotNeon(frames, channel, source, begin, end, out);
+        return;
+#endif
+    default:
+        combineFourShotTail(frames, channel, begin, end, out);
+    }
+}
+
+size_t simdArqPixels(unsigned short (*pixels)[4], size_t n, bool byteSwap, bool channelSwap, unsigned short limit)
+{
+    switch (simdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX2:
+    case SIMD_SSE41:
+        return arqPixelsSse41(pixels, n, byteSwap, channelSwap, limit);
+#endif
+#if defined(SIMD_ARM64)
+    case SIMD_NEON:
+        return arqPixelsNeon(pixels, n, byteSwap, channelSwap, limit);
+#endif
+    default:
+        return arqPixelsTail(pixels, 0, n, byteSwap, channelSwap, limit);
+    }
+}
+
+// 自适应时先用一遍计算五种结果的代价，再写出选中的一种。AVX2 级别使用 SSE4.1 版本
+int simdPngFilterRow(const unsigned char *cur, const unsigned char *prev, size_t n, int bpp, int filter,
+                     unsigned char *out)
+{
+    const SimdLevel level = simdLevel();
+    if (filter < 0 || filter > 4)
+    {
+        uint64_t cost[5] = {0, 0, 0, 0, 0};
+        switch (level)
+        {
+#if defined(SIMD_X86)
+        case SIMD_AVX2:
+        case SIMD_SSE41:
+            pngCostSse41(cur, prev, n, bpp, cost);
+            break;
+#endif
+#if defined(SIMD_ARM64)
+        case SIMD_NEON:
+            pngCostNeon(cur, prev, n, bpp, cost);
+            break;
+#endif
+        default:
+            pngCostTail(cur, prev, 0, n, bpp, cost);
+        }
+        filter = 0;
+        for (int f = 1; f < 5; f++)
+            if (cost[f] < cost[filter])
+                filter = f;
+    }
+    out[0] = (unsigned char)filter;
+    switch (level)
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX2:
+    case SIMD_SSE41:
+        pngFilterSse41(cur, prev, n, bpp, filter, out + 1);
+        break;
+#endif
+#if defined(SIMD_ARM64)
+    case SIMD_NEON:
+        pngFilterNeon(cur, prev, n, bpp, filter, out + 1);
+        break;
+#endif
+    default:
+        pngFilterTail(cur, prev, 0, n, bpp, filter, out + 1);
+    }
+    return filter;
+}
@@ -0,0 +1,69 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstddef>
+
+// 运行时选择的指令集级别。预编译的 libraw.a 只使用基线指令集，
+// 这里为 LibRaw 开放覆盖的热点循环提供多个版本，启动时按 CPU 特性选择。
+// 所有版本与 LibRaw 的标量实现逐位一致
+enum SimdLevel
+{
+    SIMD_SCALAR = 0, // 直接使用 LibRaw 的实现
+    SIMD_SSE41 = 1,
+    SIMD_AVX2 = 2,
+    SIMD_NEON = 3
+};
+
+// 当前生效的级别：检测结果，或环境变量 LIBRAW_SIMD 指定的更低级别（用于 A/B 测试）
+SimdLevel simdLevel();
+// CPU 支持的最高级别
+SimdLevel simdDetectedLevel();
+const char *simdLevelName(SimdLevel level);
+
+// 以下内核返回 false 表示当前级别没有对应实现，调用方应回退到 LibRaw 的标量版本
+
+// scale_colors_loop：非零值减去黑电平后乘以通道系数，截断并限制到 [0, 65535]
+bool simdScaleColors(unsigned short (*image)[4], size_t pixels, const int black[4], const float mul[4]);
+
+// convert_to_rgb_loop 的矩阵部分：colors 为 3 或 4，只写回前三个通道，直方图由调用方统计
+bool simdConvertToRgb(unsigned short (*image)[4], size_t pixels, int colors, const float out_cam[3][4]);
+
+// Bayer 行拆分：src 的偶数列写入 even、奇数列写入 odd，各自饱和减去黑电平（不足时为 0）。
+// LibRaw 没有对应实现，标量级别使用内置循环，因此总是完成
+void simdSplitBayerRow(const unsigned short *src, size_t pairs, unsigned short blackEven, unsigned short blackOdd,
+                       unsigned short *even, unsigned short *odd);
+
+// 暗场相减：out[i] = max(src[i] - dark[i], 0)。out 可以与 src 相同，总是完成
+void simdSubtractRow(const unsigned short *src, const unsigned short *dark, size_t n, unsigned short *out);
+
+// 浮点 DNG 预测器的字节差分还原：bytes[i] += bytes[i - stride]（i >= stride），总是完成
+void simdUndoByteDelta(unsigned char *bytes, size_t n, int stride);
+
+// 按字节平面存放的 count 个浮点样本（每个平面 count 字节，平面 0 为最高字节）合并后转换为 float。
+// bytesPerSample 为 2（半精度）、3（24 位）或 4，换算与 LibRaw 的 expandFloats 相同：非规格化数按值换算，
+// 无穷大换成最大有限值，NaN 为 0。返回 0 和所有样本中的最大值（32 位的 NaN 不参与），总是完成
+float simdMergeFloatPlanes(const unsigned char *planes, size_t count, int bytesPerSample, float *out);
+
+// 交错存放的 count 个浮点样本（未压缩浮点 DNG），bigEndian 为文件字节序，其余同 simdMergeFloatPlanes
+float simdExpandFloats(const unsigned char *src, size_t count, int bytesPerSample, bool bigEndian, float *out);
+
+// convertFloatToInt 的转换循环：out[i] = (unsigned short)(max(src[i], 0) * mul)，总是完成
+void simdFloatToUshort(const float *src, size_t n, float mul, unsigned short *out);
+
+// 四次曝光合并为每像素四通道的一段输出像素 [begin, end)：frames[f][col] 是帧 f 落在输出第 col 列的样本，
+// 写入通道 channel[f][col & 1]，frames[f] 为空表示该帧不覆盖这一段。四帧齐全且偶、奇列上的通道都各不相同时
+// 按向量交错，否则按帧序逐个写入（与 LibRaw 一样后面的帧覆盖前面的），总是完成
+void simdCombineFourShot(const unsigned short *const frames[4], const int channel[4][2], size_t begin, size_t end,
+                         unsigned short (*out)[4]);
+
+// Sony ARQ 的 n 个像素：byteSwap 时交换每个样本的字节序（read_shorts），channelSwap 时交换通道 2 和 3，
+// 并返回交换后最大通道值超过 limit 的像素数（不交换时为 0），总是完成
+size_t simdArqPixels(unsigned short (*pixels)[4], size_t n, bool byteSwap, bool channelSwap, unsigned short limit);
+
+// PNG 行滤波（编码方向）：cur 和 prev 为本行和上一行的 n 个字节（第一行的 prev 传入全零行），bpp 为每像素字节数。
+// filter 为 0 到 4 时使用该类型，其他值按 libpng 的启发式自适应选择：结果按有符号字节取绝对值求和，取和最小的类型
+// （相同时取编号小的）。out[0] 写入类型字节，之后 n 个字节为结果，返回使用的类型，总是完成
+int simdPngFilterRow(const unsigned char *cur, const unsigned char *prev, size_t n, int bpp, int filter,
+                     unsigned char *out);
+
+#endif // SIMD_KERNELS_H
@@ -0,0 +1,331 @@
+#include "tile_pyramid.h"
+#include "band_writer.h"
+#include "png_writer.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace
+{
+    // 一层图像：最高层直接引用原图，其余各层由上一层缩小得到
+    struct PyramidLevel
+    {
+        int width;
+        int height;
+        int cols;
+        int rows;
+        int firstTile; // 该层第一个瓦片的全局序号
+        const unsigned char *pixels;
+        std::vector<unsigned char> storage;
+    };
+
+    // 把 src 的第 2y、2y+1 行（y 属于 [y0, y1)）缩小为 dst 的第 y 行，结果四舍五入
+    void reduceRows(const unsigned char *src, int sw, int sh, int channels, unsigned char *dst, int y0, int y1)
+    {
+        const size_t srcStride = (size_t)sw * channels;
+        const int dw = (sw + 1) / 2;
+        const int pairs = sw / 2;
+        for (int y = y0; y < y1; y++)
+        {
+            const unsigned char *r0 = src + (size_t)(2 * y) * srcStride;
+            unsigned char *out = dst + (size_t)y * dw * channels;
+            if (2 * y + 1 < sh)
+            {
+                const unsigned char *r1 = r0 + srcStride;
+                for (int x = 0; x < pairs; x++)
+                    for (int c = 0; c < channels; c++)
+                    {
+                        const int i = 2 * x * channels + c;
+                        out[x * channels + c] =
+                            (unsigned char)((r0[i] + r0[i + channels] + r1[i] + r1[i + channels] + 2) >> 2);
+                    }
+                if (sw & 1)
+                    for (int c = 0; c < channels; c++)
+                    {
+                        const int i = 2 * pairs * channels + c;
+                        out[pairs * channels + c] = (unsigned char)((r0[i] + r1[i] + 1) >> 1);
+                    }
+            }
+            else
+            {
+                // 奇数高度的最后一行没有下一行
+                for (int x = 0; x < pairs; x++)
+                    for (int c = 0; c < channels; c++)
+                    {
+                        const int i = 2 * x * channels + c;
+                        out[x * channels + c] = (unsigned char)((r0[i] + r0[i + channels] + 1) >> 1);
+                    }
+                if (sw & 1)
+                    memcpy(out + pairs * channels, r0 + 2 * pairs * channels, channels);
+            }
+        }
+    }
+
+    // 按 64 行一段分给多个线程缩小一层
+    void reduceLevel(const PyramidLevel &src, PyramidLevel &dst, int channels, int threads)
+    {
+        const int band = 64;
+        const int bands = (dst.height + band - 1) / band;
+        threads = std::max(1, std::min(threads, bands));
+        std::atomic<int> next(0);
+        auto worker = [&]() {
+            for (int b = next++; b < bands; b = next++)
+                reduceRows(src.pixels, src.width, src.height, channels, dst.storage.data(), b * band,
+                           std::min(dst.height, (b + 1) * band));
+        };
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        for (int t = 1; t < threads; t++)
+            workers.emplace_back(worker);
+        worker();
+        for (std::thread &t : workers)
+            t.join();
+    }
+
+    bool encodeTile(const PyramidLevel &level, int channels, const TilePyramidOptions &options, PyramidTile &tile,
+                    std::string &error)
+    {
+        const size_t stride = (size_t)level.width * channels;
+        const unsigned char *origin = level.pixels + (size_t)tile.y * stride + (size_t)tile.x * channels;
+        if (options.format == TILE_FORMAT_JPEG)
+            return encodeJpegImage(origin, tile.width, tile.height, channels, stride, options.quality, tile.data,
+                                   error);
+
+        // PNG 编码器需要紧密排列的行；瓦片很小，单线程编码，并行度来自多个瓦片
+        const size_t rowBytes = (size_t)tile.width * channels;
+        std::vector<unsigned char> packed(rowBytes * tile.height);
+        for (int y = 0; y < tile.height; y++)
+            memcpy(packed.data() + y * rowBytes, origin + y * stride, rowBytes);
+        PngOptions png;
+        png.level = options.pngLevel;
+        png.filter = options.pngLevel == 0 ? PNG_FILTER_NONE : PNG_FILTER_ADAPTIVE;
+        png.threads = 1;
+        png.abort = options.abort;
+        PngStats stats;
+        return encodePng(packed.data(), tile.width, tile.height, channels, 8, png, tile.data, stats, error);
+    }
+}
+
+int tilePyramidLevels(int width, int height)
+{
+    int levels = 1;
+    while (width > 1 || height > 1)
+    {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        levels++;
+    }
+    return levels;
+}
+
+std::string tilePyramidDescriptor(int width, int height, const TilePyramidOptions &options)
+{
+    return std::string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                       "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"") +
+           (options.format == TILE_FORMAT_PNG ? "png" : "jpeg") + "\" Overlap=\"" + std::to_string(options.overlap) +
+           "\" TileSize=\"" + std::to_string(options.tileSize) + "\">\n  <Size Width=\"" + std::to_string(width) +
+           "\" Height=\"" + std::to_string(height) + "\"/>\n</Image>\n";
+}
+
+bool buildTilePyramid(const unsigned char *pixels, int width, int height, int channels,
+                      const TilePyramidOptions &options, const std::function<bool(PyramidTile &)> &sink,
+                      TilePyramidStats &stats, std::string &error)
+{
+    stats = TilePyramidStats();
+    stats.width = width;
+    stats.height = height;
+    if (!pixels || width <= 0 || height <= 0 || (channels != 1 && channels != 3))
+    {
+        error = "Unsupported image layout";
+        return false;
+    }
+    if (options.tileSize <= 0 || options.overlap < 0)
+    {
+        error = "Invalid tile size";
+        return false;
+    }
+
+    int threads = options.threads > 0 ? options.threads : (int)std::thread::hardware_concurrency();
+    threads = std::max(1, std::min(threads, 8));
+
+    const int levelCount = tilePyramidLevels(width, height);
+    std::vector<PyramidLevel> levels(levelCount);
+    try
+    {
+        int w = width;
+        int h = height;
+        for (int l = levelCount - 1; l >= 0; l--)
+        {
+            PyramidLevel &level = levels[l];
+            level.width = w;
+            level.height = h;
+            if (l == levelCount - 1)
+            {
+                level.pixels = pixels;
+            }
+            else
+            {
+                level.storage.resize((size_t)w * h * channels);
+                level.pixels = level.storage.data();
+                reduceLevel(levels[l + 1], level, channels, threads);
+            }
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+        }
+    }
+    catch (const std::bad_alloc &)
+    {
+        error = "Out of memory";
+        return false;
+    }
+
+    int total = 0;
+    for (PyramidLevel &level : levels)
+    {
+        level.cols = (level.width + options.tileSize - 1) / options.tileSize;
+        level.rows = (level.height + options.tileSize - 1) / options.tileSize;
+        level.firstTile = total;
+        total += level.cols * level.rows;
+    }
+    stats.levels = levelCount;
+    threads = std::min(threads, total);
+    stats.threads = threads;
+
+    // 编码好的瓦片在队列中等待调用线程取走；队列满时编码线程等待，限制未交付瓦片占用的内存
+    const size_t capacity = (size_t)threads * 2;
+    std::deque<PyramidTile> queue;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    bool stop = false;
+    int running = threads;
+    std::string workerError;
+    std::atomic<int> next(0);
+
+    auto fail = [&](const std::string &message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!stop && workerError.empty())
+            workerError = message;
+        stop = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    };
+
+    // 工作线程不能抛出异常：记录第一个失败，通知其余线程和调用线程停止
+    auto worker = [&]() {
+        try
+        {
+            for (int t = next++; t < total; t = next++)
+            {
+                if (options.abort && options.abort->load())
+                {
+                    fail("Operation aborted");
+                    break;
+                }
+                int l = levelCount - 1;
+                while (levels[l].firstTile > t)
+                    l--;
+                const PyramidLevel &level = levels[l];
+                const int index = t - level.firstTile;
+                PyramidTile tile;
+                tile.level = l;
+                tile.col = index % level.cols;
+                tile.row = index / level.cols;
+                tile.x = std::max(0, tile.col * options.tileSize - options.overlap);
+                tile.y = std::max(0, tile.row * options.tileSize - options.overlap);
+                tile.width = std::min(level.width, (tile.col + 1) * options.tileSize + options.overlap) - tile.x;
+                tile.height = std::min(level.height, (tile.row + 1) * options.tileSize + options.overlap) - tile.y;
+
+                std::string message;
+                if (!encodeTile(level, channels, options, tile, message))
+                {
+                    fail(message.empty() ? "Tile encoding failed" : message);
+                    break;
+                }
+
+                std::unique_lock<std::mutex> lock(mutex);
+                notFull.wait(lock, [&]() { return stop || queue.size() < capacity; });
+                if (stop)
+                    break;
+                queue.push_back(std::move(tile));
+                notEmpty.notify_one();
+            }
+        }
+        catch (const std::bad_alloc &)
+        {
+            fail("Out of memory");
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        running--;
+        notEmpty.notify_one();
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back(worker);
+
+    auto finish = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        notFull.notify_all();
+        for (std::thread &t : workers)
+            t.join();
+    };
+
+    // 调用线程只负责交付：sink 可以是 JS 回调，必须在这里调用
+    bool aborted = false;
+    try
+    {
+        for (;;)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [&]() { return stop || !queue.empty() || running == 0; });
+            if (stop || queue.empty())
+                break;
+            PyramidTile tile = std::move(queue.front());
+            queue.pop_front();
+            notFull.notify_one();
+            lock.unlock();
+
+            const size_t bytes = tile.data.size();
+            if (!sink(tile))
+            {
+                aborted = true;
+                break;
+            }
+            stats.tiles++;
+            stats.bytes += bytes;
+        }
+    }
+    catch (...)
+    {
+        finish();
+        throw;
+    }
+    finish();
+
+    if (aborted)
+    {
+        error.clear();
+        return false;
+    }
+    if (!workerError.empty())
+    {
+        error = workerError;
+        return false;
+    }
+    if (options.abort && options.abort->load())
+    {
+        error = "Operation aborted";
+        return false;
+    }
+    return true;
+}
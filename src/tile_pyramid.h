@@ -0,0 +1,68 @@
+#ifndef TILE_PYRAMID_H
+#define TILE_PYRAMID_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+enum TileFormat
+{
+    TILE_FORMAT_JPEG = 0,
+    TILE_FORMAT_PNG = 1
+};
+
+struct TilePyramidOptions
+{
+    int tileSize;                   // 不含重叠的瓦片边长
+    int overlap;                    // 瓦片每个内侧边缘多出的像素数（图像边缘不加）
+    int format;                     // TileFormat
+    int quality;                    // JPEG 质量 1-100
+    int pngLevel;                   // PNG 的 zlib 压缩级别 0-9
+    int threads;                    // 编码线程数，0 表示按 CPU 数（最多 8）
+    const std::atomic<bool> *abort; // 置位后停止编码，导出失败
+
+    TilePyramidOptions() : tileSize(256), overlap(0), format(TILE_FORMAT_JPEG), quality(90), pngLevel(6), threads(0),
+                           abort(nullptr) {}
+};
+
+// 一个编码完成的瓦片：level 为 Deep Zoom 层级（0 为 1x1，最高层为原图），(col, row) 为瓦片坐标，
+// (x, y, width, height) 为瓦片在该层图像中的像素范围（含重叠）
+struct PyramidTile
+{
+    int level;
+    int col;
+    int row;
+    int x;
+    int y;
+    int width;
+    int height;
+    std::vector<unsigned char> data;
+};
+
+struct TilePyramidStats
+{
+    int width;
+    int height;
+    int levels;   // 层数，最高层号为 levels - 1
+    int tiles;    // 交给 sink 的瓦片数
+    size_t bytes; // 编码后的总字节数
+    int threads;  // 实际使用的编码线程数
+};
+
+// Deep Zoom 的层数：边长逐层减半（向上取整）直到 1x1
+int tilePyramidLevels(int width, int height);
+
+// 由 width x height、每像素 channels 个 8 位样本（1 为灰度，3 为 RGB）紧密排列的原图生成 Deep Zoom 瓦片金字塔。
+// 各层由上一层 2x2 平均缩小得到（奇数边长时边缘只平均实际存在的像素），瓦片在多个线程中编码，
+// 编码完成的瓦片经有界队列交回调用线程，按完成顺序逐个交给 sink；sink 返回 false 时停止导出。
+// 低层级先编码，层内按行优先顺序分发。失败时返回 false，error 为具体原因（sink 中止时为空）
+bool buildTilePyramid(const unsigned char *pixels, int width, int height, int channels,
+                      const TilePyramidOptions &options, const std::function<bool(PyramidTile &)> &sink,
+                      TilePyramidStats &stats, std::string &error);
+
+// .dzi 描述文件的内容
+std::string tilePyramidDescriptor(int width, int height, const TilePyramidOptions &options);
+
+#endif // TILE_PYRAMID_H
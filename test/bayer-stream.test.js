@@ -0,0 +1,128 @@
+const LibRaw = require("../lib/index.js");
+const { assert, expectReject } = require("./file-utils.js");
+
+/**
+ * 测试连续 Bayer 帧：输出缓冲区环轮换、帧间结果确定，以及帧长度和参数校验
+ */
+
+// 合成 16 位小端 GRBG 帧：平滑渐变加上随帧号移动的亮块，边距为接近黑电平的遮挡像素
+function makeFrame(width, height, margin, index) {
+  const frame = Buffer.alloc(width * height * 2);
+  for (let y = 0; y < height; y++) {
+    for (let x = 0; x < width; x++) {
+      const masked = x < margin || x >= width - margin;
+      let value = 64 + ((x + y) % 3);
+      if (!masked) {
+        value = 200 + ((x * 7 + y * 5) % 1500);
+        if (Math.abs(x - 8 - index * 4) < 6 && Math.abs(y - height / 2) < 6) value = 3800;
+      }
+      frame.writeUInt16LE(value, (y * width + x) * 2);
+    }
+  }
+  return frame;
+}
+
+async function testBayerStream() {
+  console.log("🎞️ LibRaw BayerStream Test");
+  console.log("=".repeat(40));
+
+  const width = 96;
+  const height = 64;
+  const margin = 4;
+
+  let threw = false;
+  try {
+    new LibRaw.BayerStream({ width, height, pattern: "RGBW" });
+  } catch (error) {
+    threw = true;
+  }
+  assert(threw, "invalid pattern should throw");
+  threw = false;
+  try {
+    new LibRaw.BayerStream({ width, height, whiteBalance: [2.0, "1", 1.5, 1.0] });
+  } catch (error) {
+    threw = error instanceof TypeError;
+  }
+  assert(threw, "non-numeric whiteBalance should throw TypeError");
+  console.log("   ✅ Rejects invalid options");
+
+  const stream = new LibRaw.BayerStream({
+    width,
+    height,
+    margins: { left: margin, right: margin },
+    pattern: "GRBG",
+    blackLevel: 64,
+    whiteLevel: 4095,
+    colorMatrix: [
+      [1.6, -0.4, -0.2],
+      [-0.3, 1.5, -0.2],
+      [0, -0.5, 1.5],
+    ],
+    whiteBalance: [2.0, 1.0, 1.5, 1.0],
+    demosaic: "linear",
+    outputBps: 8,
+    ringSize: 3,
+  });
+
+  try {
+    const frames = [0, 1, 2, 3].map((i) => makeFrame(width, height, margin, i));
+    const results = [];
+    for (const frame of frames) {
+      const result = await stream.processFrame(frame);
+      results.push({ ...result, copy: Buffer.from(result.data) });
+    }
+
+    const first = results[0];
+    assert(first.width === width - 2 * margin && first.height === height, `unexpected size ${first.width}x${first.height}`);
+    assert(first.colors === 3 && first.bits === 8, "expected 8-bit RGB output");
+    assert(first.data.length === first.width * first.height * 3, "output length mismatch");
+    results.forEach((r, i) => {
+      assert(r.sequence === i, `sequence ${r.sequence} != ${i}`);
+      assert(r.slot === i % 3, `slot ${r.slot} != ${i % 3}`);
+    });
+    assert(results[3].data === results[0].data, "ring slot 0 should be reused after ringSize frames");
+    assert(!results[1].copy.equals(results[2].copy), "different frames produced identical output");
+    console.log(`   ✅ ${results.length} frames ${first.width}x${first.height}, ring slots rotate`);
+
+    // 同一帧重新处理的结果必须与第一次相同（状态不会在帧间累积）
+    const again = await stream.processFrame(frames[1]);
+    assert(again.data.equals(results[1].copy), "reprocessing a frame changed its output");
+    console.log("   ✅ Output is deterministic across frames");
+
+    await expectReject(stream.processFrame(Buffer.alloc(10)), "short frame should be rejected", /frame length/);
+    console.log("   ✅ Rejects frames of a different length");
+
+    const stats = stream.getStats();
+    assert(stats.frames === 5 && stats.frameLength === frames[0].length, "unexpected stats");
+    assert(stats.ringBytes === 3 * first.data.length, "ring should hold three output buffers");
+    console.log(`   📊 Average ${stats.averageMs.toFixed(2)} ms/frame`);
+  } finally {
+    await stream.close();
+  }
+
+  await expectReject(stream.processFrame(makeFrame(width, height, margin, 0)), "closed stream should reject", /closed/);
+  console.log("   ✅ Rejects frames after close()");
+
+  // 16 位输出和半尺寸模式
+  const half = new LibRaw.BayerStream({ width, height, pattern: "GRBG", blackLevel: 64, demosaic: "half", outputBps: 16 });
+  try {
+    const result = await half.processFrame(makeFrame(width, height, 0, 0));
+    assert(result.bits === 16 && result.width === width / 2 && result.height === height / 2, "unexpected half-size output");
+    assert(result.data.length === result.width * result.height * 6, "16-bit output length mismatch");
+    console.log(`   ✅ Half-size 16-bit output ${result.width}x${result.height}`);
+  } finally {
+    await half.close();
+  }
+
+  console.log("\n🎉 BayerStream test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testBayerStream().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testBayerStream };
@@ -0,0 +1,134 @@
+const LibRaw = require("../lib/index.js");
+const crypto = require("crypto");
+const fs = require("fs");
+const os = require("os");
+const path = require("path");
+const fileUtils = require("./file-utils.js");
+const { assert } = fileUtils;
+
+/**
+ * 测试校准数据：暗场三种来源结果一致、坏点只影响局部、注册表共享与释放
+ */
+
+// 16 位大端 PGM，与 LibRaw 的 dark_frame 格式相同
+function makeDarkFrame(width, height) {
+  const data = new Uint16Array(width * height);
+  for (let i = 0; i < data.length; i++) data[i] = 40 + (Math.imul(i, 2654435761) >>> 27);
+  const header = Buffer.from(`P5\n# dark frame\n${width} ${height}\n65535\n`);
+  const body = Buffer.alloc(data.length * 2);
+  for (let i = 0; i < data.length; i++) body.writeUInt16BE(data[i], i * 2);
+  return { data, pgm: Buffer.concat([header, body]) };
+}
+
+async function render(file, calibration) {
+  const libraw = new LibRaw();
+  try {
+    if (calibration !== undefined) await libraw.setCalibration(calibration);
+    await libraw.loadFile(file);
+    await libraw.setOutputParams({ output_bps: 16, no_auto_bright: true });
+    await libraw.processImage();
+    const image = await libraw.createMemoryImage();
+    return { data: Buffer.from(image.data), hash: crypto.createHash("sha256").update(image.data).digest("hex") };
+  } finally {
+    await libraw.close();
+  }
+}
+
+async function testCalibration() {
+  console.log("🔧 LibRaw Calibration Test");
+  console.log("=".repeat(40));
+
+  const sampleFile = fileUtils.findSampleFile();
+  if (!sampleFile) {
+    console.log("   ⚠️ No sample files found, skipping");
+    return;
+  }
+
+  const probe = new LibRaw();
+  await probe.openFile(sampleFile);
+  const { width, height } = await probe.getImageSize();
+  await probe.close();
+
+  const tmpDir = fs.mkdtempSync(path.join(os.tmpdir(), "libraw-calibration-"));
+  try {
+    const baseline = await render(sampleFile);
+
+    // 空的坏点表不改变输出
+    const empty = await render(sampleFile, { badPixels: [] });
+    assert(empty.hash === baseline.hash, "empty calibration changed the output");
+    console.log("   ✅ Empty calibration is a no-op");
+
+    // 暗场：路径、PGM 缓冲区和 Uint16Array 三种来源结果一致
+    const dark = makeDarkFrame(width, height);
+    const darkPath = path.join(tmpDir, "dark.pgm");
+    fs.writeFileSync(darkPath, dark.pgm);
+    const fromPath = await render(sampleFile, { darkFrame: darkPath });
+    const fromBuffer = await render(sampleFile, { darkFrame: dark.pgm });
+    const fromArray = await render(sampleFile, { darkFrame: { data: dark.data, width, height } });
+    assert(fromPath.hash !== baseline.hash, "dark frame had no effect");
+    assert(fromPath.hash === fromBuffer.hash && fromPath.hash === fromArray.hash, "dark frame sources disagree");
+    console.log(`   ✅ Dark frame ${width}x${height}: path, PGM buffer and Uint16Array agree`);
+
+    // 尺寸不符的暗场与 LibRaw 一样被忽略
+    const wrongSize = makeDarkFrame(width - 2, height);
+    const ignored = await render(sampleFile, { darkFrame: { data: wrongSize.data, width: width - 2, height } });
+    assert(ignored.hash === baseline.hash, "mismatched dark frame should be ignored");
+    console.log("   ✅ Mismatched dark frame is ignored");
+
+    // 坏点只影响附近的少量像素；文件和数组两种来源一致
+    const points = [
+      [Math.floor(width / 2), Math.floor(height / 2)],
+      [Math.floor(width / 3), Math.floor(height / 4)],
+    ];
+    const badPath = path.join(tmpDir, "bad.txt");
+    fs.writeFileSync(badPath, "# col row time\n" + points.map(([x, y]) => `${x} ${y} 0`).join("\n") + "\n");
+    const fixedFromFile = await render(sampleFile, { badPixels: badPath });
+    const fixedFromArray = await render(sampleFile, { badPixels: points.map(([x, y]) => ({ x, y })) });
+    assert(fixedFromFile.hash === fixedFromArray.hash, "bad pixel sources disagree");
+    let changed = 0;
+    for (let i = 0; i < baseline.data.length; i += 2) {
+      if (baseline.data.readUInt16LE(i) !== fixedFromFile.data.readUInt16LE(i)) changed++;
+    }
+    assert(changed > 0 && changed < 2000, `bad pixel fix changed ${changed} samples`);
+    console.log(`   ✅ Bad pixels: ${changed} samples changed around ${points.length} points`);
+
+    // 绿平衡
+    const green = await render(sampleFile, { greenMatching: true, threads: 4 });
+    const greenSerial = await render(sampleFile, { greenMatching: true, threads: 1 });
+    assert(green.hash !== baseline.hash, "green matching had no effect");
+    assert(green.hash === greenSerial.hash, "row-parallel green matching differs from serial");
+    console.log("   ✅ Green matching is identical with 1 and 4 threads");
+
+    // 注册表：相同路径只加载一次，实例共享同一个 key
+    const loaded = LibRaw.loadCalibration({ darkFrame: darkPath, badPixels: badPath });
+    assert(loaded.darkFrame.width === width && loaded.badPixels === points.length, "unexpected calibration info");
+    const libraw = new LibRaw();
+    const attached = await libraw.setCalibration({ darkFrame: darkPath, badPixels: badPath });
+    assert(attached.key === loaded.key, "same paths should share a registry entry");
+    assert(libraw.getCalibrationInfo().bytes === loaded.bytes, "getCalibrationInfo() mismatch");
+    await libraw.setCalibration(null);
+    assert(libraw.getCalibrationInfo() === null, "calibration should be removed");
+    assert(LibRaw.releaseCalibration(loaded.key) === true, "release should find the entry");
+    assert(LibRaw.releaseCalibration(loaded.key) === false, "second release should find nothing");
+    console.log("   ✅ Registry shares and releases calibration data");
+
+    let rejected = false;
+    await libraw.setCalibration({ darkFrame: Buffer.from("P6\n1 1\n255\n") }).catch(() => (rejected = true));
+    assert(rejected, "invalid PGM should be rejected");
+    console.log("   ✅ Rejects invalid dark frames");
+  } finally {
+    fs.rmSync(tmpDir, { recursive: true, force: true });
+  }
+
+  console.log("\n🎉 Calibration test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testCalibration().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testCalibration };
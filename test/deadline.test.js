@@ -0,0 +1,78 @@
+const LibRaw = require("../lib/index.js");
+const fileUtils = require("./file-utils.js");
+
+/**
+ * 测试截止时间：超时的处理以独立的错误码拒绝，且不影响后续任务
+ */
+
+async function testDeadline() {
+  console.log("⏱️ LibRaw Deadline Test");
+  console.log("=".repeat(40));
+
+  const sampleFile = fileUtils.findSampleFile();
+  if (!sampleFile) {
+    console.log("   ⚠️ No sample files found, skipping");
+    return;
+  }
+
+  const libraw = new LibRaw();
+
+  try {
+    // 1 毫秒内不可能完成 DCB 去马赛克
+    await libraw.loadFile(sampleFile);
+    await libraw.setOutputParams({ user_qual: 4, dcb_iterations: 4 });
+    await libraw.setDeadline(1);
+
+    const start = Date.now();
+    try {
+      await libraw.processImage();
+      throw new Error("Processing should have exceeded the deadline");
+    } catch (error) {
+      if (error.code !== "LIBRAW_DEADLINE_EXCEEDED") {
+        throw error;
+      }
+      console.log(
+        `   ✅ Rejected after ${Date.now() - start}ms: ${error.message}`
+      );
+    }
+
+    // 超时后文件被释放，清除截止时间后可以重新加载并完成处理
+    await libraw.clearDeadline();
+    await libraw.loadFile(sampleFile);
+    await libraw.setDeadline(60000);
+    await libraw.processImage();
+    const image = await libraw.createMemoryImage();
+    await libraw.clearDeadline();
+    console.log(
+      `   ✅ Reloaded and processed within deadline: ${image.width}x${image.height}`
+    );
+
+    // 线程池任务的截止时间
+    const pool = new LibRaw.WorkerPool({ size: 1 });
+    try {
+      await pool.run({ input: sampleFile, deadline: 1 });
+      throw new Error("Pool job should have exceeded the deadline");
+    } catch (error) {
+      if (error.code !== "LIBRAW_DEADLINE_EXCEEDED") {
+        throw error;
+      }
+      console.log("   ✅ Worker pool job rejected with LIBRAW_DEADLINE_EXCEEDED");
+    } finally {
+      await pool.close();
+    }
+  } finally {
+    await libraw.close();
+  }
+
+  console.log("\n🎉 Deadline test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testDeadline().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testDeadline };
@@ -65,6 +65,25 @@ class FileUtils {
         return this.findRawFiles(extList);
     }
 
+    // 每个格式目录中取第一个样本文件（跳过 .xmp），按 formats 的顺序返回路径
+    findSampleFiles(formats = ['NEF', 'ARW', 'CR2', 'RW2', 'DNG', 'PEF']) {
+        const files = [];
+
+        for (const dir of formats) {
+            const fullDir = path.join(this.rawSamplesDir, dir);
+            if (!fs.existsSync(fullDir)) continue;
+            const file = fs.readdirSync(fullDir).find(f => !f.endsWith('.xmp'));
+            if (file) files.push(path.join(fullDir, file));
+        }
+        return files;
+    }
+
+    // 第一个可用的样本文件，没有时返回 null
+    findSampleFile(formats) {
+        const files = this.findSampleFiles(formats);
+        return files.length > 0 ? files[0] : null;
+    }
+
     // 获取所有可用的 RAW 文件格式
     getAvailableFormats() {
         const files = this.findRawFiles();
@@ -99,6 +118,30 @@ class FileUtils {
         };
     }
 
+    // 测试断言：条件不成立时抛出 message
+    assert(condition, message) {
+        if (!condition) throw new Error(message);
+    }
+
+    // promise 必须被拒绝；提供 pattern 时错误消息还必须匹配
+    async expectReject(promise, message, pattern) {
+        let error = null;
+        await promise.catch(e => (error = e || new Error('rejected')));
+        if (!error || (pattern && !pattern.test(error.message))) {
+            throw new Error(error ? `${message} (got ${error.message})` : message);
+        }
+    }
+
+    // fn 必须同步抛出异常
+    expectThrow(fn, message) {
+        try {
+            fn();
+        } catch (error) {
+            return;
+        }
+        throw new Error(message);
+    }
+
     // 创建输出目录
     ensureOutputDir() {
         const outputDir = path.join(__dirname, "..", "output");
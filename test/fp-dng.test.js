@@ -0,0 +1,283 @@
+const LibRaw = require("../lib/index.js");
+const fs = require("fs");
+const os = require("os");
+const path = require("path");
+const zlib = require("zlib");
+const { assert } = require("./file-utils.js");
+
+/**
+ * 测试浮点 DNG 解码：生成 16/24/32 位、deflate 压缩（三种预测器）和未压缩、分块和条带、
+ * CFA 和 LinearRaw 的合成文件，检查解码结果与按 LibRaw 规则计算的期望值一致
+ */
+
+// 按位宽解码一个样本，规则与 LibRaw 的 expandFloats 相同：无穷大换成最大有限值，NaN 为 0
+function decodeSample(bits, bps) {
+  if (bps === 32) {
+    const buffer = Buffer.alloc(4);
+    buffer.writeUInt32BE(bits >>> 0);
+    return buffer.readFloatBE(0);
+  }
+  const mantissaBits = bps === 16 ? 10 : 16;
+  const exponentMax = bps === 16 ? 31 : 127;
+  const bias = bps === 16 ? 15 : 63;
+  const sign = bits >>> (bps - 1) ? -1 : 1;
+  const exponent = (bits >>> mantissaBits) & exponentMax;
+  const mantissa = bits & ((1 << mantissaBits) - 1);
+  if (exponent === exponentMax) return mantissa ? 0 : sign * 2 ** (exponentMax - 1 - bias) * (2 - 2 ** -mantissaBits);
+  if (exponent === 0) return sign * mantissa * 2 ** (1 - bias - mantissaBits);
+  return sign * 2 ** (exponent - bias) * (1 + mantissa / 2 ** mantissaBits);
+}
+
+// 可重复的伪随机样本：16 到 32767 之间的值，1% 为负数，少量非规格化数和 NaN。
+// 16 位时另有少量无穷大，最大值变为 65504，转换为整数时需要缩放
+function makeSamples(count, bps, seed) {
+  let state = seed;
+  const random = () => {
+    state = (Math.imul(state, 1664525) + 1013904223) >>> 0;
+    return state / 4294967296;
+  };
+  const samples = new Uint32Array(count);
+  const exponentBits = bps === 16 ? 5 : bps === 24 ? 7 : 8;
+  const mantissaBits = bps - 1 - exponentBits;
+  const bias = (1 << (exponentBits - 1)) - 1;
+  const special = (1 << exponentBits) - 1;
+  for (let i = 0; i < count; i++) {
+    const kind = random();
+    let exponent = bias + 4 + Math.floor(random() * 11);
+    let mantissa = Math.floor(random() * 2 ** mantissaBits);
+    if (kind > 0.995) exponent = 0;
+    else if (kind > 0.993) (exponent = special), (mantissa |= 1);
+    else if (kind > 0.9925 && bps === 16) (exponent = special), (mantissa = 0);
+    samples[i] = ((kind < 0.01 ? 2 ** (bps - 1) : 0) + exponent * 2 ** mantissaBits + mantissa) >>> 0;
+  }
+  return samples;
+}
+
+// 写一个最小的浮点 DNG。samples 为 width * height * channels 个按位宽编码的样本
+function writeFloatDng(file, options) {
+  const { width, height, channels, bps, compression, predictor = 3, little = true } = options;
+  const tileWidth = options.tileWidth || width;
+  const tileHeight = options.tileHeight || options.rowsPerStrip || height;
+  const tiled = Boolean(options.tileWidth);
+  const bytes = bps / 8;
+  const xFactor = predictor === 34894 ? 2 : predictor === 34895 ? 4 : 1;
+
+  // 各分块的数据：超出图像的部分补 0
+  const tilesH = tiled ? Math.ceil(width / tileWidth) : 1;
+  const tilesV = Math.ceil(height / tileHeight);
+  const blocks = [];
+  for (let ty = 0; ty < tilesV; ty++) {
+    for (let tx = 0; tx < tilesH; tx++) {
+      const rows = tiled ? tileHeight : Math.min(tileHeight, height - ty * tileHeight);
+      const rowValues = tileWidth * channels;
+      const block = Buffer.alloc(rows * rowValues * bytes);
+      for (let r = 0; r < rows; r++) {
+        const row = Buffer.alloc(rowValues * bytes);
+        for (let v = 0; v < rowValues; v++) {
+          const x = tx * tileWidth + Math.floor(v / channels);
+          const y = ty * tileHeight + r;
+          const value = x < width && y < height ? options.samples[(y * width + x) * channels + (v % channels)] : 0;
+          for (let b = 0; b < bytes; b++) {
+            const byte = (value >>> (8 * (bytes - 1 - b))) & 255;
+            if (compression === 8) row[b * rowValues + v] = byte; // 按字节平面，平面 0 为最高字节
+            else row[v * bytes + (little ? bytes - 1 - b : b)] = byte;
+          }
+        }
+        if (compression === 8) {
+          const stride = channels * xFactor;
+          for (let i = row.length - 1; i >= stride; i--) row[i] = (row[i] - row[i - stride]) & 255;
+        }
+        row.copy(block, r * row.length);
+      }
+      blocks.push(compression === 8 ? zlib.deflateSync(block) : block);
+    }
+  }
+
+  // IFD 项：[tag, type, values]，type 1 BYTE、2 ASCII、3 SHORT、4 LONG、5 RATIONAL、10 SRATIONAL
+  const entries = [
+    [254, 4, [0]],
+    [256, 4, [width]],
+    [257, 4, [height]],
+    [258, 3, new Array(channels).fill(bps)],
+    [259, 3, [compression]],
+    [262, 3, [channels === 1 ? 32803 : 34892]],
+    [271, 2, "Synthetic"],
+    [272, 2, "Float DNG"],
+    [tiled ? 324 : 273, 4, null],
+    [277, 3, [channels]],
+    [284, 3, [1]],
+    [317, 3, [compression === 8 ? predictor : 1]],
+    [339, 3, new Array(channels).fill(3)],
+    [50706, 1, [1, 4, 0, 0]],
+    [50708, 2, "Synthetic Float DNG"],
+    [50717, 4, new Array(channels).fill(1)],
+    [50721, 10, [[1, 1], [0, 1], [0, 1], [0, 1], [1, 1], [0, 1], [0, 1], [0, 1], [1, 1]]],
+    [50728, 5, [[1, 1], [1, 1], [1, 1]]],
+    [50778, 3, [21]]
+  ];
+  if (tiled) {
+    entries.push([322, 4, [tileWidth]], [323, 4, [tileHeight]], [325, 4, blocks.map((b) => b.length)]);
+  } else {
+    entries.push([278, 4, [tileHeight]], [279, 4, blocks.map((b) => b.length)]);
+  }
+  if (channels === 1) entries.push([33421, 3, [2, 2]], [33422, 1, [0, 1, 1, 2]]);
+  entries.sort((a, b) => a[0] - b[0]);
+
+  const u16 = (buffer, offset, value) => (little ? buffer.writeUInt16LE(value, offset) : buffer.writeUInt16BE(value, offset));
+  const u32 = (buffer, offset, value) => (little ? buffer.writeUInt32LE(value >>> 0, offset) : buffer.writeUInt32BE(value >>> 0, offset));
+  const i32 = (buffer, offset, value) => (little ? buffer.writeInt32LE(value, offset) : buffer.writeInt32BE(value, offset));
+  const sizes = { 1: 1, 2: 1, 3: 2, 4: 4, 5: 8, 10: 8 };
+
+  // 布局：文件头、IFD、超过 4 字节的值、分块数据
+  const ifdSize = 2 + entries.length * 12 + 4;
+  let extraOffset = 8 + ifdSize;
+  const extras = [];
+  const encoded = entries.map(([tag, type, values]) => {
+    const list = values === null ? blocks.map(() => 0) : typeof values === "string" ? Buffer.from(`${values}\0`) : values;
+    const length = list.length * sizes[type];
+    const entry = { tag, type, list, count: list.length, offset: length > 4 ? extraOffset : null };
+    if (length > 4) {
+      extras.push(entry);
+      extraOffset += length + (length & 1);
+    }
+    return entry;
+  });
+  let dataOffset = extraOffset;
+  const blockOffsets = blocks.map((block) => {
+    const offset = dataOffset;
+    dataOffset += block.length;
+    return offset;
+  });
+  encoded.find((e) => e.tag === (tiled ? 324 : 273)).list = blockOffsets;
+
+  const out = Buffer.alloc(dataOffset);
+  out.write(little ? "II" : "MM", 0, "latin1");
+  u16(out, 2, 42);
+  u32(out, 4, 8);
+  u16(out, 8, encoded.length);
+  const writeValues = (entry, at) => {
+    entry.list.forEach((value, i) => {
+      const o = at + i * sizes[entry.type];
+      if (entry.type === 1 || entry.type === 2) out[o] = value;
+      else if (entry.type === 3) u16(out, o, value);
+      else if (entry.type === 4) u32(out, o, value);
+      else if (entry.type === 5) u32(out, o, value[0]), u32(out, o + 4, value[1]);
+      else i32(out, o, value[0]), i32(out, o + 4, value[1]);
+    });
+  };
+  encoded.forEach((entry, i) => {
+    const at = 10 + i * 12;
+    u16(out, at, entry.tag);
+    u16(out, at + 2, entry.type);
+    u32(out, at + 4, entry.count);
+    if (entry.offset === null) writeValues(entry, at + 8);
+    else u32(out, at + 8, entry.offset);
+  });
+  u32(out, 10 + encoded.length * 12, 0);
+  for (const entry of extras) writeValues(entry, entry.offset);
+  blocks.forEach((block, i) => block.copy(out, blockOffsets[i]));
+  fs.writeFileSync(file, out);
+}
+
+// LibRaw 的 convertFloatToInt：数据最大值（含 WhiteLevel 1）不在 [4096, 32767] 内时缩放到 16383
+function expectedRaw(samples, bps) {
+  const values = Array.from(samples, (bits) => Math.fround(decodeSample(bits, bps)));
+  let max = 1;
+  for (const value of values) if (value > max) max = value;
+  const multip = max < 4096 || max > 32767 ? Math.fround(16383 / max) : 1;
+  return values.map((value) => {
+    const scaled = Math.fround((value > 0 ? value : 0) * multip);
+    return Math.trunc(scaled) & 0xffff;
+  });
+}
+
+const VARIANTS = [
+  { bps: 16, compression: 8, predictor: 3, tileWidth: 64, tileHeight: 48 },
+  { bps: 24, compression: 8, predictor: 34894, tileWidth: 64, tileHeight: 64 },
+  { bps: 32, compression: 8, predictor: 34895, tileWidth: 128, tileHeight: 32 },
+  { bps: 32, compression: 8, predictor: 3, rowsPerStrip: 37, little: false },
+  { bps: 16, compression: 8, predictor: 34894, channels: 3, tileWidth: 64, tileHeight: 64 },
+  { bps: 32, compression: 1, tileWidth: 96, tileHeight: 80 },
+  { bps: 16, compression: 1, rowsPerStrip: 50, little: false },
+  { bps: 24, compression: 1, little: true },
+  { bps: 32, compression: 1, channels: 3 }
+];
+
+async function testFpDng() {
+  console.log("🌊 LibRaw Floating-Point DNG Test");
+  console.log("=".repeat(40));
+
+  const directory = fs.mkdtempSync(path.join(os.tmpdir(), "libraw-fp-dng-"));
+  try {
+    for (const [index, variant] of VARIANTS.entries()) {
+      const options = { width: 250, height: 170, channels: 1, ...variant };
+      options.samples = makeSamples(options.width * options.height * options.channels, options.bps, index + 1);
+      const name = `${options.bps}-bit ${options.compression === 8 ? `deflate/${options.predictor}` : "uncompressed"} ` +
+        `${options.tileWidth ? "tiles" : options.rowsPerStrip ? "strips" : "single"} ` +
+        `${options.channels === 1 ? "CFA" : "RGB"} ${options.little === false ? "MM" : "II"}`;
+      const file = path.join(directory, `fp-${index}.dng`);
+      writeFloatDng(file, options);
+
+      const libraw = new LibRaw();
+      try {
+        await libraw.loadFile(file);
+        const info = await libraw.getDecoderInfo();
+        const expectedDecoder = options.compression === 8 ? "deflate_dng_load_raw()" : "uncompressed_fp_dng_load_raw()";
+        assert(info.decoder_name === expectedDecoder, `${name}: decoder ${info.decoder_name}`);
+
+        const raw = await libraw.getRawData({ copy: true });
+        assert(raw.type === "uint16", `${name}: float data should be converted to integers`);
+        const expected = expectedRaw(options.samples, options.bps);
+        const stride = raw.stride || options.width * options.channels;
+        for (let y = 0; y < options.height; y++) {
+          for (let x = 0; x < options.width * options.channels; x++) {
+            const actual = raw.data[y * stride + x];
+            const want = expected[y * options.width * options.channels + x];
+            assert(actual === want, `${name}: sample (${x}, ${y}) is ${actual}, expected ${want}`);
+          }
+        }
+
+        await libraw.processImage();
+        const image = await libraw.createMemoryImage();
+        assert(image.width === options.width && image.height === options.height, `${name}: processed size mismatch`);
+        console.log(`   ✅ ${name}`);
+      } finally {
+        await libraw.close();
+      }
+    }
+
+    // 损坏的压缩数据
+    const options = { width: 250, height: 170, channels: 1, bps: 16, compression: 8, tileWidth: 64, tileHeight: 64 };
+    options.samples = makeSamples(options.width * options.height, 16, 99);
+    const file = path.join(directory, "corrupt.dng");
+    writeFloatDng(file, options);
+    const data = fs.readFileSync(file);
+    data.fill(0x55, data.length - 2000, data.length - 1000);
+    fs.writeFileSync(file, data);
+    const libraw = new LibRaw();
+    let threw = false;
+    try {
+      await libraw.loadFile(file);
+    } catch (error) {
+      threw = true;
+    } finally {
+      await libraw.close();
+    }
+    assert(threw, "corrupt deflate data should fail to decode");
+    console.log("   ✅ Rejects corrupt deflate data");
+  } finally {
+    fs.rmSync(directory, { recursive: true, force: true });
+  }
+
+  console.log("\n🎉 Floating-point DNG test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testFpDng().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testFpDng, writeFloatDng, makeSamples };
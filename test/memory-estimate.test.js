@@ -0,0 +1,107 @@
+const LibRaw = require("../lib/index.js");
+const path = require("path");
+const fileUtils = require("./file-utils.js");
+
+/**
+ * 测试内存估算与按内存预算准入
+ */
+
+function mb(bytes) {
+  return `${(bytes / 1024 / 1024).toFixed(1)}MB`;
+}
+
+async function testMemoryBudget() {
+  const budget = new LibRaw.MemoryBudget(100);
+
+  await budget.acquire(60);
+  let admitted = false;
+  const pending = budget.acquire(60).then(() => {
+    admitted = true;
+  });
+  await Promise.resolve();
+  if (admitted) {
+    throw new Error("Second job should wait for budget");
+  }
+
+  budget.release(60);
+  await pending;
+  budget.release(60);
+
+  // 超出整个预算的任务在空闲时单独放行
+  if (!budget.tryAcquire(500)) {
+    throw new Error("Oversized job should run alone when budget is idle");
+  }
+  budget.release(500);
+  console.log("   ✅ Budget admission and oversized job handling");
+}
+
+async function testMemoryEstimate() {
+  console.log("📐 LibRaw Memory Estimate Test");
+  console.log("=".repeat(40));
+
+  await testMemoryBudget();
+
+  const sampleFile = fileUtils.findSampleFile();
+  if (!sampleFile) {
+    console.log("   ⚠️ No sample files found, skipping");
+    return;
+  }
+
+  const libraw = new LibRaw();
+  try {
+    // 只做 identify，不解包即可估算
+    await libraw.openFile(sampleFile);
+    const full = await libraw.estimateMemory();
+    const half = await libraw.estimateMemory({ halfSize: true });
+    const dcb = await libraw.estimateMemory({ quality: 4 });
+
+    console.log(
+      `   ✅ ${path.basename(sampleFile)}: peak ${mb(full.peak)} (raw ${mb(
+        full.raw
+      )}, image ${mb(full.image)}, scratch ${mb(full.scratch)}, output ${mb(
+        full.output
+      )})`
+    );
+
+    if (full.peak < full.raw + full.image + full.output) {
+      throw new Error("Peak must cover raw, image and output buffers");
+    }
+    if (half.peak >= full.peak) {
+      throw new Error("Half-size estimate should be smaller");
+    }
+    if (dcb.scratch <= full.scratch) {
+      throw new Error("DCB demosaic should need more scratch than default");
+    }
+    console.log(`   ✅ Half size ${mb(half.peak)}, DCB ${mb(dcb.peak)}`);
+
+    // openFile 之后可以直接处理
+    await libraw.processImage();
+    const image = await libraw.createMemoryImage();
+    const expected = full.output;
+    if (Math.abs(image.dataSize - expected) > 1024) {
+      throw new Error(
+        `Output estimate ${expected} differs from actual ${image.dataSize}`
+      );
+    }
+    console.log("   ✅ Output estimate matches processed image");
+  } finally {
+    await libraw.close();
+  }
+
+  const staticEstimate = await LibRaw.estimateMemory(sampleFile, {
+    params: { half_size: true },
+  });
+  console.log(`   ✅ Static estimate (half size): ${mb(staticEstimate.peak)}`);
+
+  console.log("\n🎉 Memory estimate test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testMemoryEstimate().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testMemoryEstimate };
@@ -0,0 +1,135 @@
+const LibRaw = require("../lib/index.js");
+const fs = require("fs");
+const path = require("path");
+const fileUtils = require("./file-utils.js");
+const { assert, expectReject } = fileUtils;
+
+/**
+ * 测试进程级性能计数器：打开文件按解码器计数、各阶段的像素数和耗时直方图、
+ * 错误计数、LibRaw 内存的当前值和峰值、WorkerPool 的排队等待和 Prometheus 文本输出
+ */
+
+function sampleValue(families, name, labels = {}, metricName = name) {
+  const family = families.find((f) => f.name === name);
+  assert(family, `missing metric family ${name}`);
+  const sample = family.values.find(
+    (v) => (v.metricName || family.name) === metricName && Object.entries(labels).every(([key, value]) => v.labels[key] === value)
+  );
+  return sample ? sample.value : 0;
+}
+
+async function testMetrics() {
+  console.log("📊 LibRaw Metrics Test");
+  console.log("=".repeat(40));
+
+  const files = fileUtils.findSampleFiles();
+  if (files.length === 0) {
+    console.log("   ⚠️ No sample files found, skipping");
+    return;
+  }
+
+  const before = LibRaw.getMetrics({ format: "raw" });
+  assert(before.bucketBounds.length === 12, "expected 12 finite histogram buckets");
+
+  const libraw = new LibRaw();
+  let decoder;
+  try {
+    await libraw.loadFile(files[0]);
+    await libraw.processImage();
+    const after = LibRaw.getMetrics({ format: "raw" });
+
+    // 打开的文件计入其解码器，字节数为文件大小
+    const size = fs.statSync(files[0]).size;
+    const opened = after.decoders.find((d) => {
+      const previous = before.decoders.find((p) => p.decoder === d.decoder);
+      return d.files - (previous ? previous.files : 0) === 1;
+    });
+    assert(opened, "opened file not counted");
+    const previous = before.decoders.find((p) => p.decoder === opened.decoder);
+    assert(opened.bytes - (previous ? previous.bytes : 0) === size, "input bytes should equal the file size");
+    decoder = opened.decoder;
+    console.log(`   ✅ ${path.basename(files[0])} counted under ${decoder} (${(size / 1048576).toFixed(1)} MB)`);
+
+    // 阶段像素数和耗时直方图
+    for (const stage of ["unpack", "process"]) {
+      const s = after.stages[stage];
+      const p = before.stages[stage];
+      assert(s.count === p.count + 1, `${stage} should be counted once`);
+      assert(s.pixels > p.pixels && s.sum > p.sum, `${stage} pixels/seconds not recorded`);
+      assert(s.buckets.reduce((a, b) => a + b, 0) === s.count, `${stage} buckets do not add up to count`);
+    }
+    const unpackMs = (after.stages.unpack.sum - before.stages.unpack.sum) * 1000;
+    const processMs = (after.stages.process.sum - before.stages.process.sum) * 1000;
+    console.log(`   ✅ Stages recorded: unpack ${unpackMs.toFixed(0)} ms, process ${processMs.toFixed(0)} ms`);
+
+    // LibRaw 内存：处理后占用大于 0，峰值不小于当前值
+    assert(after.memory.liveBytes > 0 && after.memory.peakBytes >= after.memory.liveBytes, "memory gauges not updated");
+    assert(after.memory.allocations > before.memory.allocations, "allocations not counted");
+    console.log(`   ✅ LibRaw memory: ${(after.memory.liveBytes / 1048576).toFixed(0)} MB live, ${(after.memory.peakBytes / 1048576).toFixed(0)} MB peak`);
+  } finally {
+    await libraw.close();
+  }
+
+  // 错误按错误码计数
+  const errorsBefore = LibRaw.getMetrics({ format: "raw" }).errors;
+  const broken = new LibRaw();
+  try {
+    await expectReject(broken.loadBuffer(Buffer.alloc(4096)), "garbage buffer should be rejected");
+  } finally {
+    await broken.close();
+  }
+  const errorsAfter = LibRaw.getMetrics({ format: "raw" }).errors;
+  const total = (errors) => Object.values(errors).reduce((a, b) => a + b, 0);
+  assert(total(errorsAfter) === total(errorsBefore) + 1, "error not counted");
+  console.log(`   ✅ Errors counted by code: ${JSON.stringify(errorsAfter)}`);
+
+  // 外部队列的等待时间
+  const poolBefore = LibRaw.getMetrics({ format: "raw" }).queueWait.pool.background.count;
+  LibRaw.observeQueueWait("background", 12);
+  assert(LibRaw.getMetrics({ format: "raw" }).queueWait.pool.background.count === poolBefore + 1, "queue wait not counted");
+  let threw = false;
+  try {
+    LibRaw.observeQueueWait("urgent", 1);
+  } catch (error) {
+    threw = error instanceof RangeError;
+  }
+  assert(threw, "unknown lane should throw RangeError");
+  console.log("   ✅ observeQueueWait() records pool queue waits");
+
+  // prom-client 风格的 JSON 和 Prometheus 文本
+  const families = LibRaw.getMetrics();
+  assert(sampleValue(families, "librawspeed_files_opened_total", { decoder }) >= 1, "decoder counter missing");
+  const infCount = sampleValue(
+    families,
+    "librawspeed_stage_duration_seconds",
+    { stage: "unpack", le: "+Inf" },
+    "librawspeed_stage_duration_seconds_bucket"
+  );
+  const count = sampleValue(families, "librawspeed_stage_duration_seconds", { stage: "unpack" }, "librawspeed_stage_duration_seconds_count");
+  assert(infCount === count && count >= 1, "+Inf bucket should equal _count");
+  const text = LibRaw.getMetrics({ format: "prometheus" });
+  assert(text.includes("# TYPE librawspeed_stage_duration_seconds histogram"), "missing TYPE line");
+  assert(/^librawspeed_allocated_bytes_peak \d+$/m.test(text), "missing peak gauge");
+  console.log(`   ✅ ${families.length} metric families, ${text.split("\n").length - 1} lines of Prometheus text`);
+
+  let rejected = false;
+  try {
+    LibRaw.getMetrics({ format: "xml" });
+  } catch (error) {
+    rejected = error instanceof RangeError;
+  }
+  assert(rejected, "unknown format should throw RangeError");
+  console.log("   ✅ Rejects invalid options");
+
+  console.log("\n🎉 Metrics test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testMetrics().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testMetrics };
@@ -0,0 +1,310 @@
+const LibRaw = require("../lib/index.js");
+const fs = require("fs");
+const os = require("os");
+const path = require("path");
+const { assert } = require("./file-utils.js");
+
+/**
+ * 测试多帧解码：生成多帧 DNG、Pentax 像素偏移 DNG、Sinar 四次拍摄 TIFF 和 Sony ARQ 合成文件，
+ * 检查各帧数据与写入的样本一致，Sinar 合并结果与按 LibRaw 规则计算的期望值一致
+ */
+
+// 可重复的伪随机 16 位样本，范围 [64, 64 + max)
+function makeFrame(count, seed, max = 4000) {
+  const samples = new Uint16Array(count);
+  let state = seed;
+  for (let i = 0; i < count; i++) {
+    state = (Math.imul(state, 1664525) + 1013904223) >>> 0;
+    samples[i] = 64 + ((state >>> 8) % max);
+  }
+  return samples;
+}
+
+function encodeSamples(samples, little) {
+  const buffer = Buffer.alloc(samples.length * 2);
+  samples.forEach((value, i) => (little ? buffer.writeUInt16LE(value, i * 2) : buffer.writeUInt16BE(value, i * 2)));
+  return buffer;
+}
+
+// 写一个 TIFF。ifds 为 [{ entries: [[tag, type, values]], blocks: [Buffer], blockTag }]，
+// blockTag 项的值由数据块的位置填写。type 1 BYTE、2 ASCII、3 SHORT、4 LONG、5 RATIONAL、10 SRATIONAL
+function writeTiff(file, ifds, little = true) {
+  const sizes = { 1: 1, 2: 1, 3: 2, 4: 4, 5: 8, 10: 8 };
+  const u16 = (buffer, offset, value) => (little ? buffer.writeUInt16LE(value, offset) : buffer.writeUInt16BE(value, offset));
+  const u32 = (buffer, offset, value) => (little ? buffer.writeUInt32LE(value >>> 0, offset) : buffer.writeUInt32BE(value >>> 0, offset));
+  const i32 = (buffer, offset, value) => (little ? buffer.writeInt32LE(value, offset) : buffer.writeInt32BE(value, offset));
+
+  // 布局：文件头，之后每个 IFD 依次为目录、超过 4 字节的值，最后是所有数据块
+  let offset = 8;
+  const layouts = ifds.map((ifd) => {
+    const entries = ifd.entries
+      .slice()
+      .sort((a, b) => a[0] - b[0])
+      .map(([tag, type, values]) => {
+        const list = typeof values === "string" ? Buffer.from(`${values}\0`) : values;
+        return { tag, type, list, count: list.length, offset: null };
+      });
+    const at = offset;
+    offset += 2 + entries.length * 12 + 4;
+    for (const entry of entries) {
+      const length = entry.count * sizes[entry.type];
+      if (length > 4) {
+        entry.offset = offset;
+        offset += length + (length & 1);
+      }
+    }
+    return { at, entries, ifd };
+  });
+  for (const layout of layouts) {
+    layout.blockOffsets = layout.ifd.blocks.map((block) => {
+      const at = offset;
+      offset += block.length + (block.length & 1);
+      return at;
+    });
+    layout.entries.find((entry) => entry.tag === layout.ifd.blockTag).list = layout.blockOffsets;
+  }
+
+  const out = Buffer.alloc(offset);
+  out.write(little ? "II" : "MM", 0, "latin1");
+  u16(out, 2, 42);
+  u32(out, 4, 8);
+  const writeValues = (entry, at) => {
+    entry.list.forEach((value, i) => {
+      const o = at + i * sizes[entry.type];
+      if (entry.type === 1 || entry.type === 2) out[o] = value;
+      else if (entry.type === 3) u16(out, o, value);
+      else if (entry.type === 4) u32(out, o, value);
+      else if (entry.type === 5) u32(out, o, value[0]), u32(out, o + 4, value[1]);
+      else i32(out, o, value[0]), i32(out, o + 4, value[1]);
+    });
+  };
+  layouts.forEach((layout, n) => {
+    u16(out, layout.at, layout.entries.length);
+    layout.entries.forEach((entry, i) => {
+      const at = layout.at + 2 + i * 12;
+      u16(out, at, entry.tag);
+      u16(out, at + 2, entry.type);
+      u32(out, at + 4, entry.count);
+      if (entry.offset === null) writeValues(entry, at + 8);
+      else u32(out, at + 8, entry.offset), writeValues(entry, entry.offset);
+    });
+    u32(out, layout.at + 2 + layout.entries.length * 12, n + 1 < layouts.length ? layouts[n + 1].at : 0);
+    layout.ifd.blocks.forEach((block, i) => block.copy(out, layout.blockOffsets[i]));
+  });
+  fs.writeFileSync(file, out);
+}
+
+// 每帧一个 IFD 的未压缩 CFA DNG，返回各帧的样本
+function writeMultiDng(file, make, model, frameCount, width, height, little = true) {
+  const frames = [];
+  const ifds = [];
+  for (let f = 0; f < frameCount; f++) {
+    const samples = makeFrame(width * height, 1000 + f * 77);
+    const entries = [
+      [254, 4, [0]], [256, 4, [width]], [257, 4, [height]], [258, 3, [16]], [259, 3, [1]], [262, 3, [32803]],
+      [273, 4, [0]], [277, 3, [1]], [278, 4, [height]], [279, 4, [width * height * 2]], [284, 3, [1]],
+      [33421, 3, [2, 2]], [33422, 1, [0, 1, 1, 2]], [50714, 4, [64]], [50717, 4, [4095]]
+    ];
+    if (f === 0) {
+      entries.push(
+        [271, 2, make], [272, 2, model], [50706, 1, [1, 4, 0, 0]], [50708, 2, `${make} ${model}`],
+        [50721, 10, [[1, 1], [0, 1], [0, 1], [0, 1], [1, 1], [0, 1], [0, 1], [0, 1], [1, 1]]],
+        [50728, 5, [[1, 1], [1, 1], [1, 1]]], [50778, 3, [21]]
+      );
+    }
+    frames.push(samples);
+    ifds.push({ entries, blocks: [encodeSamples(samples, little)], blockTag: 273 });
+  }
+  writeTiff(file, ifds, little);
+  return frames;
+}
+
+// Sinar 四次拍摄：一个 IFD，TileOffsets 指向四次拍摄的整幅数据
+function writeSinar(file, width, height, little = true) {
+  const shots = [0, 1, 2, 3].map((s) => makeFrame(width * height, 5000 + s * 31));
+  const blocks = shots.map((samples) => encodeSamples(samples, little));
+  const entries = [
+    [254, 4, [0]], [256, 4, [width]], [257, 4, [height]], [258, 3, [16]], [259, 3, [1]], [262, 3, [32803]],
+    [271, 2, "Sinar"], [272, 2, "Sinarback 54"], [277, 3, [1]], [322, 4, [width]], [323, 4, [height]],
+    [324, 4, [0, 0, 0, 0]], [325, 4, blocks.map((b) => b.length)]
+  ];
+  writeTiff(file, [{ entries, blocks, blockTag: 324 }], little);
+  return shots;
+}
+
+// Sony ARQ：一个 IFD，每像素 4 个 16 位样本
+function writeArq(file, width, height, little = true) {
+  const samples = makeFrame(width * height * 4, 9000, 15000);
+  const entries = [
+    [254, 4, [0]], [256, 4, [width]], [257, 4, [height]], [258, 3, [16, 16, 16, 16]], [259, 3, [1]],
+    [262, 3, [32892]], [271, 2, "SONY"], [272, 2, "ILCE-7RM3"], [273, 4, [0]], [277, 3, [4]],
+    [278, 4, [height]], [279, 4, [samples.length * 2]]
+  ];
+  writeTiff(file, [{ entries, blocks: [encodeSamples(samples, little)], blockTag: 273 }], little);
+}
+
+// LibRaw 的 sinar_4shot_load_raw：第 shot 次拍摄向右 shot & 1、向下 shot >> 1 偏移一个像素，
+// 样本写入 (row & 1) * 3 ^ (~col & 1) 通道，超出图像的部分丢弃
+function expectedSinar(shots, width, height) {
+  const image = new Uint16Array(width * height * 4);
+  shots.forEach((samples, shot) => {
+    for (let row = 0; row < height; row++) {
+      const r = row - ((shot >> 1) & 1);
+      if (r < 0 || r >= height) continue;
+      for (let col = 0; col < width; col++) {
+        const c = col - (shot & 1);
+        if (c < 0 || c >= width) continue;
+        image[(r * width + c) * 4 + (((row & 1) * 3) ^ (~col & 1))] = samples[row * width + col];
+      }
+    }
+  });
+  return image;
+}
+
+// 比较当前帧可见区域内的 raw 数据
+function compareVisible(raw, expected, width, height, channels, name) {
+  const margins = raw.margins || { top: 0, left: 0 };
+  for (let y = 0; y < height; y++) {
+    for (let x = 0; x < width * channels; x++) {
+      const actual = raw.data[(margins.top + y) * raw.stride + margins.left * channels + x];
+      const want = expected[y * width * channels + x];
+      assert(actual === want, `${name}: sample (${x}, ${y}) is ${actual}, expected ${want}`);
+    }
+  }
+}
+
+async function testMultiFrame() {
+  console.log("🎞️  LibRaw Multi-Frame Test");
+  console.log("=".repeat(40));
+
+  const directory = fs.mkdtempSync(path.join(os.tmpdir(), "libraw-multi-frame-"));
+  try {
+    // 多帧 DNG：文件和 Buffer 两种来源
+    for (const little of [true, false]) {
+      const file = path.join(directory, `multi-${little ? "II" : "MM"}.dng`);
+      const frames = writeMultiDng(file, "Synthetic", "Multi", 3, 96, 64, little);
+      for (const source of [file, fs.readFileSync(file)]) {
+        const name = `3-frame DNG ${little ? "II" : "MM"} from ${typeof source === "string" ? "file" : "buffer"}`;
+        const libraw = new LibRaw();
+        try {
+          const info = await libraw.loadAllFrames(source);
+          assert(info.count === 3 && info.current === 0 && info.combined === null, `${name}: ${JSON.stringify(info)}`);
+          for (const frame of info.frames) {
+            await libraw.selectFrame(frame.index);
+            const raw = await libraw.getRawData({ copy: true });
+            compareVisible(raw, frames[frame.index], 96, 64, 1, `${name} frame ${frame.index}`);
+          }
+          await libraw.processImage();
+          const image = await libraw.createMemoryImage();
+          assert(image.width === 96 && image.height === 64, `${name}: processed size mismatch`);
+          console.log(`   ✅ ${name}`);
+        } finally {
+          await libraw.close();
+        }
+      }
+    }
+
+    // Pentax 像素偏移：合并结果为第 5 帧
+    {
+      const file = path.join(directory, "pentax.dng");
+      const frames = writeMultiDng(file, "PENTAX", "K-1", 4, 96, 64);
+      const libraw = new LibRaw();
+      try {
+        const info = await libraw.loadAllFrames(file, { combine: true });
+        assert(info.count === 5 && info.combined === 4, `Pentax: ${JSON.stringify(info)}`);
+        assert(info.frames[4].combined && info.frames[4].channels === 4, "Pentax: combined frame should have 4 channels");
+        for (let f = 0; f < 4; f++) {
+          await libraw.selectFrame(f);
+          compareVisible(await libraw.getRawData({ copy: true }), frames[f], 96, 64, 1, `Pentax frame ${f}`);
+        }
+        await libraw.selectFrame(4);
+        await libraw.processImage();
+        console.log("   ✅ Pentax pixel shift with combine");
+      } finally {
+        await libraw.close();
+      }
+    }
+
+    // Sinar 四次拍摄：第 0 帧为合并结果
+    for (const [width, height, little] of [[96, 64, true], [100, 66, false]]) {
+      const name = `Sinar 4-shot ${width}x${height} ${little ? "II" : "MM"}`;
+      const file = path.join(directory, `sinar-${width}.tif`);
+      const shots = writeSinar(file, width, height, little);
+      const libraw = new LibRaw();
+      try {
+        const info = await libraw.loadAllFrames(file);
+        assert(info.count === 5 && info.combined === 0, `${name}: ${JSON.stringify(info)}`);
+        const raw = await libraw.getRawData({ copy: true });
+        assert(raw.channels === 4, `${name}: combined frame should have 4 channels`);
+        compareVisible(raw, expectedSinar(shots, width, height), width, height, 4, name);
+        await libraw.selectFrame(1);
+        assert((await libraw.getRawData()).channels === 1, `${name}: single shot should be a mosaic`);
+        console.log(`   ✅ ${name}`);
+      } finally {
+        await libraw.close();
+      }
+    }
+
+    // Sony ARQ 只有一帧
+    {
+      const file = path.join(directory, "arq.arq");
+      writeArq(file, 96, 64, false);
+      const libraw = new LibRaw();
+      try {
+        const info = await libraw.loadAllFrames(file);
+        assert(info.count === 1 && info.frames[0].channels === 4, `ARQ: ${JSON.stringify(info)}`);
+        console.log("   ✅ Sony ARQ");
+      } finally {
+        await libraw.close();
+      }
+    }
+
+    // 索引检查和重新加载后释放各帧
+    {
+      const file = path.join(directory, "multi-II.dng");
+      const libraw = new LibRaw();
+      try {
+        let threw = false;
+        try {
+          await libraw.selectFrame(0);
+        } catch (error) {
+          threw = true;
+        }
+        assert(threw, "selectFrame() without loadAllFrames() should fail");
+        await libraw.loadAllFrames(file);
+        threw = false;
+        try {
+          await libraw.selectFrame(3);
+        } catch (error) {
+          threw = error instanceof RangeError || /out of range/.test(error.message);
+        }
+        assert(threw, "selectFrame() should reject an out-of-range index");
+        await libraw.loadFile(file);
+        threw = false;
+        try {
+          await libraw.selectFrame(1);
+        } catch (error) {
+          threw = true;
+        }
+        assert(threw, "loadFile() should release the frames");
+        console.log("   ✅ Frame index checks");
+      } finally {
+        await libraw.close();
+      }
+    }
+  } finally {
+    fs.rmSync(directory, { recursive: true, force: true });
+  }
+
+  console.log("\n🎉 Multi-frame test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testMultiFrame().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testMultiFrame, writeTiff };
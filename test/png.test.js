@@ -0,0 +1,177 @@
+const LibRaw = require("../lib/index.js");
+const zlib = require("zlib");
+const fileUtils = require("./file-utils.js");
+const { assert, expectReject } = fileUtils;
+
+/**
+ * 测试原生 PNG 编码器：解码结果与内存图像逐像素一致、8/16 位、各滤波类型、
+ * iCCP 配置文件、线程数不影响输出、createPNGBuffer 的原生路径和参数校验
+ */
+
+const CRC_TABLE = Array.from({ length: 256 }, (_, n) => {
+  let c = n;
+  for (let k = 0; k < 8; k++) c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+  return c >>> 0;
+});
+
+function crc32(buffer) {
+  let c = 0xffffffff;
+  for (const byte of buffer) c = CRC_TABLE[(c ^ byte) & 0xff] ^ (c >>> 8);
+  return (c ^ 0xffffffff) >>> 0;
+}
+
+// 拆分数据块并校验 CRC，返回 IHDR 字段、iCCP 配置文件和还原滤波后的样本字节（16 位为大端）
+function decodePng(png) {
+  assert(png.subarray(0, 8).equals(Buffer.from([0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a])), "bad PNG signature");
+  let offset = 8;
+  let header = null;
+  let icc = null;
+  const idat = [];
+  let ended = false;
+  while (offset < png.length) {
+    const length = png.readUInt32BE(offset);
+    const type = png.toString("latin1", offset + 4, offset + 8);
+    const data = png.subarray(offset + 8, offset + 8 + length);
+    assert(crc32(png.subarray(offset + 4, offset + 8 + length)) === png.readUInt32BE(offset + 8 + length), `bad CRC in ${type}`);
+    if (type === "IHDR") {
+      header = { width: data.readUInt32BE(0), height: data.readUInt32BE(4), bits: data[8], colorType: data[9] };
+    } else if (type === "iCCP") {
+      const end = data.indexOf(0);
+      icc = { name: data.toString("latin1", 0, end), profile: zlib.inflateSync(data.subarray(end + 2)) };
+    } else if (type === "IDAT") {
+      idat.push(data);
+    } else if (type === "IEND") {
+      ended = true;
+    }
+    offset += 12 + length;
+  }
+  assert(header && ended && offset === png.length, "incomplete PNG");
+
+  const channels = header.colorType === 2 ? 3 : 1;
+  const bpp = (channels * header.bits) / 8;
+  const rowBytes = header.width * bpp;
+  const filtered = zlib.inflateSync(Buffer.concat(idat));
+  assert(filtered.length === (rowBytes + 1) * header.height, "inflated size mismatch");
+  const samples = Buffer.alloc(rowBytes * header.height);
+  const filters = [0, 0, 0, 0, 0];
+  for (let row = 0; row < header.height; row++) {
+    const type = filtered[row * (rowBytes + 1)];
+    assert(type <= 4, "bad filter type");
+    filters[type]++;
+    const src = row * (rowBytes + 1) + 1;
+    const dst = row * rowBytes;
+    for (let i = 0; i < rowBytes; i++) {
+      const a = i >= bpp ? samples[dst + i - bpp] : 0;
+      const b = row > 0 ? samples[dst - rowBytes + i] : 0;
+      const c = i >= bpp && row > 0 ? samples[dst - rowBytes + i - bpp] : 0;
+      let predictor = 0;
+      if (type === 1) predictor = a;
+      else if (type === 2) predictor = b;
+      else if (type === 3) predictor = (a + b) >> 1;
+      else if (type === 4) {
+        const pa = Math.abs(b - c);
+        const pb = Math.abs(a - c);
+        const pc = Math.abs(a + b - 2 * c);
+        predictor = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+      }
+      samples[dst + i] = (filtered[src + i] + predictor) & 0xff;
+    }
+  }
+  return { header, channels, icc, samples, filters };
+}
+
+// 内存图像的样本为本机字节序（小端），PNG 为大端
+function samePixels(decoded, image) {
+  if (image.bits === 8) return decoded.samples.equals(Buffer.from(image.data.buffer, image.data.byteOffset, image.data.length));
+  const data = Buffer.from(image.data.buffer, image.data.byteOffset, image.data.byteLength);
+  for (let i = 0; i < data.length; i += 2) {
+    if (decoded.samples[i] !== data[i + 1] || decoded.samples[i + 1] !== data[i]) return false;
+  }
+  return true;
+}
+
+async function testPng() {
+  console.log("🖼️ LibRaw PNG Encoder Test");
+  console.log("=".repeat(40));
+
+  const files = fileUtils.findSampleFiles();
+  if (files.length === 0) {
+    console.log("   ⚠️ No sample files found, skipping");
+    return;
+  }
+
+  const libraw = new LibRaw();
+  try {
+    // 降采样解包，缩短 JS 端的解码时间
+    await libraw.loadFile(files[0], { subsample: 4 });
+    await libraw.processImage();
+
+    for (const bits of [8, 16]) {
+      await libraw.setOutputParams({ output_bps: bits });
+      const image = await libraw.createMemoryImage();
+      const start = process.hrtime.bigint();
+      const png = await libraw.createPNG({ bits });
+      const ms = Number(process.hrtime.bigint() - start) / 1e6;
+      const decoded = decodePng(png.data);
+      assert(decoded.header.width === image.width && decoded.header.height === image.height, "size mismatch");
+      assert(decoded.header.bits === bits && png.bits === bits, "bit depth mismatch");
+      assert(decoded.channels === image.colors, "channel count mismatch");
+      assert(samePixels(decoded, image), `${bits}-bit pixels differ from createMemoryImage()`);
+      assert(png.segments >= 1 && png.threads >= 1, "missing stats");
+      assert(decoded.filters.every((n, f) => n === png.filterRows[["none", "sub", "up", "average", "paeth"][f]]), "filter stats mismatch");
+      // 默认输出 sRGB，配置文件与 writeTIFF 嵌入的相同，第一个字为总长度
+      assert(decoded.icc && decoded.icc.name === "sRGB" && png.iccProfile === "sRGB", "missing sRGB iCCP chunk");
+      assert(decoded.icc.profile.readUInt32BE(0) === decoded.icc.profile.length, "bad ICC profile length");
+      console.log(
+        `   ✅ ${bits}-bit ${png.width}x${png.height}: ${(png.data.length / 1024).toFixed(0)} KB, ` +
+          `${png.segments} segments on ${png.threads} threads in ${ms.toFixed(1)} ms`
+      );
+    }
+
+    // 每种滤波和压缩级别都能无损还原；线程数不影响输出
+    await libraw.setOutputParams({ output_bps: 8 });
+    const image = await libraw.createMemoryImage();
+    for (const filter of ["none", "sub", "up", "average", "paeth"]) {
+      const png = await libraw.createPNG({ filter, compressionLevel: filter === "none" ? 0 : 9 });
+      const decoded = decodePng(png.data);
+      assert(samePixels(decoded, image), `filter ${filter} does not round-trip`);
+      assert(png.filterRows[filter] === png.height, `filter ${filter} not used for every row`);
+    }
+    const single = await libraw.createPNG({ threads: 1 });
+    const multi = await libraw.createPNG({ threads: 4 });
+    assert(single.data.equals(multi.data), "output depends on thread count");
+    console.log("   ✅ All filters round-trip, output independent of thread count");
+
+    const buffer = await libraw.createPNGBuffer({ bits: 16 });
+    assert(buffer.metadata.pngOptions.encoder === "native", "createPNGBuffer should use the native encoder");
+    assert(decodePng(buffer.buffer).header.bits === 16, "createPNGBuffer ignored bits");
+    console.log(`   ✅ createPNGBuffer: native encoder, ${buffer.metadata.fileSize.compressionRatio}x`);
+
+    // raw 色彩空间没有输出配置文件
+    await libraw.setOutputParams({ output_color: 0 });
+    await libraw.processImage();
+    const raw = await libraw.createPNG();
+    assert(raw.iccProfile === null && decodePng(raw.data).icc === null, "raw color space should not have an ICC profile");
+    console.log("   ✅ No iCCP chunk for raw color space");
+
+    await expectReject(libraw.createPNG({ bits: 12 }), "bits 12 should be rejected");
+    await expectReject(libraw.createPNG({ compressionLevel: 10 }), "compressionLevel 10 should be rejected");
+    await expectReject(libraw.createPNG({ filter: "median" }), "unknown filter should be rejected");
+    await expectReject(libraw.createPNG({ threads: 0 }), "threads 0 should be rejected");
+    console.log("   ✅ Rejects invalid options");
+  } finally {
+    await libraw.close();
+  }
+
+  console.log("\n🎉 PNG encoder test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testPng().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testPng };
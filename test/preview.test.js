@@ -0,0 +1,87 @@
+const LibRaw = require("../lib/index.js");
+const path = require("path");
+const fileUtils = require("./file-utils.js");
+const { assert } = fileUtils;
+
+/**
+ * 测试缩小解码的嵌入预览：尺寸限制、方向、缩略图 JPEG 快速路径和参数校验
+ */
+
+async function testPreview() {
+  console.log("🖼️ LibRaw Preview Test");
+  console.log("=".repeat(40));
+
+  const files = fileUtils.findSampleFiles();
+  if (files.length === 0) {
+    console.log("   ⚠️ No sample files found, skipping");
+    return;
+  }
+
+  const maxDim = 256;
+  for (const file of files) {
+    const libraw = new LibRaw();
+    try {
+      await libraw.loadFile(file);
+      const start = process.hrtime.bigint();
+      let preview;
+      try {
+        preview = await libraw.getPreviewRGB(maxDim);
+      } catch (error) {
+        console.log(`   ⚠️ ${path.basename(file)}: ${error.message}`);
+        continue;
+      }
+      const ms = Number(process.hrtime.bigint() - start) / 1e6;
+
+      assert(Math.max(preview.width, preview.height) <= maxDim, "preview exceeds maxDim");
+      assert(preview.colors === 3 && preview.bits === 8, "expected 8-bit RGB");
+      assert(preview.data.length === preview.width * preview.height * 3, "data length mismatch");
+
+      // 不旋转时宽高与旋转 90 度的结果对调
+      const raw = await libraw.getPreviewRGB(maxDim, { orientation: false });
+      if (preview.flip & 4) {
+        assert(raw.width === preview.height && raw.height === preview.width, "rotation should swap dimensions");
+      } else {
+        assert(raw.width === preview.width && raw.height === preview.height, "unexpected unrotated size");
+      }
+
+      console.log(
+        `   ✅ ${path.basename(file)}: ${preview.sourceWidth}x${preview.sourceHeight} → ` +
+          `${preview.width}x${preview.height} (DCT 1/${preview.scaleDenom}, flip ${preview.flip}) in ${ms.toFixed(1)} ms`
+      );
+
+      // 默认缩略图不受影响
+      await libraw.unpackThumbnail();
+      const thumb = await libraw.createMemoryThumbnail();
+      assert(thumb && thumb.data && thumb.data.length > 0, "default thumbnail should still be available");
+
+      const jpeg = await libraw.createThumbnailJPEGBuffer({ maxSize: maxDim, quality: 80 });
+      const out = jpeg.metadata.outputDimensions;
+      assert(Math.max(out.width, out.height) <= maxDim, "thumbnail JPEG exceeds maxSize");
+    } finally {
+      await libraw.close();
+    }
+  }
+
+  const libraw = new LibRaw();
+  try {
+    await libraw.loadFile(files[0]);
+    let rejected = false;
+    await libraw.getPreviewRGB(0).catch(() => (rejected = true));
+    assert(rejected, "maxDim 0 should be rejected");
+    console.log("   ✅ Rejects invalid maximum dimension");
+  } finally {
+    await libraw.close();
+  }
+
+  console.log("\n🎉 Preview test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testPreview().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testPreview };
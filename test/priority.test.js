@@ -0,0 +1,89 @@
+const LibRaw = require("../lib/index.js");
+const fileUtils = require("./file-utils.js");
+
+/**
+ * 测试优先级通道：交互式任务先于排队的批量任务分派，并统计各通道指标
+ */
+
+async function testPriority() {
+  console.log("🚦 LibRaw Priority Lanes Test");
+  console.log("=".repeat(40));
+
+  const libraw = new LibRaw();
+  await libraw.setPriority("background");
+  if (libraw.getPriority() !== "background") {
+    throw new Error("Priority was not applied");
+  }
+  try {
+    await libraw.setPriority("urgent");
+    throw new Error("Unknown priority should be rejected");
+  } catch (error) {
+    if (!(error instanceof RangeError)) throw error;
+    console.log(`   ✅ Unknown priority rejected: ${error.message}`);
+  }
+  await libraw.close();
+
+  const sampleFile = fileUtils.findSampleFile();
+  if (!sampleFile) {
+    console.log("   ⚠️ No sample files found, skipping pool tests");
+    return;
+  }
+
+  const pool = new LibRaw.WorkerPool({ size: 1 });
+  const order = [];
+  const submit = (priority, tag) =>
+    pool
+      .run({ input: sampleFile, operation: "memoryImage", priority })
+      .then(() => order.push(tag));
+
+  try {
+    // 第一个批量任务占用唯一的 worker，其余任务排队
+    const jobs = [
+      submit("background", "background-1"),
+      submit("background", "background-2"),
+      submit("normal", "normal-1"),
+      submit("interactive", "interactive-1"),
+    ];
+    await Promise.all(jobs);
+
+    const expected = [
+      "background-1",
+      "interactive-1",
+      "normal-1",
+      "background-2",
+    ];
+    if (order.join(",") !== expected.join(",")) {
+      throw new Error(`Unexpected completion order: ${order.join(", ")}`);
+    }
+    console.log(`   ✅ Completion order: ${order.join(" → ")}`);
+
+    const stats = pool.getStats();
+    for (const [lane, laneStats] of Object.entries(stats.lanes)) {
+      console.log(
+        `   📊 ${lane}: ${laneStats.completed} done, wait p95 ${laneStats.waitMs.p95}ms, run p95 ${laneStats.runMs.p95}ms`
+      );
+    }
+    if (stats.lanes.background.completed !== 2) {
+      throw new Error("Background lane should report two completed jobs");
+    }
+
+    const scheduler = LibRaw.getSchedulerStats();
+    console.log(
+      `   📊 Native scheduler: ${scheduler.background.calls} background calls, ${scheduler.background.preemptions} preemptions`
+    );
+  } finally {
+    await pool.close();
+  }
+
+  console.log("\n🎉 Priority lanes test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testPriority().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testPriority };
@@ -0,0 +1,105 @@
+const LibRaw = require("../lib/index.js");
+const fileUtils = require("./file-utils.js");
+const { assert } = fileUtils;
+
+/**
+ * 测试 raw 数据访问：零拷贝视图、生命周期，以及四平面拆分与马赛克视图一致
+ */
+
+// 四平面在 2x2 块中的位置：R、与 R 同行的 G1、另一个 G2、B
+function planePositions(pattern) {
+  const red = pattern.indexOf("R");
+  const blue = pattern.indexOf("B");
+  const greens = [0, 1, 2, 3].filter((p) => pattern[p] === "G");
+  if ((greens[0] >> 1) !== (red >> 1)) greens.reverse();
+  return [red, greens[0], greens[1], blue];
+}
+
+async function testRawData() {
+  console.log("🧬 LibRaw Raw Data Access Test");
+  console.log("=".repeat(40));
+
+  const sampleFile = fileUtils.findSampleFile();
+  if (!sampleFile) {
+    console.log("   ⚠️ No sample files found, skipping");
+    return;
+  }
+
+  const libraw = new LibRaw();
+  try {
+    let rejected = false;
+    await libraw.getRawData().catch(() => (rejected = true));
+    assert(rejected, "getRawData() should reject before a file is loaded");
+    console.log("   ✅ Rejects before load");
+
+    await libraw.loadFile(sampleFile);
+    const raw = await libraw.getRawData();
+    assert(raw.type === "uint16" && raw.layout === "mosaic", `unexpected layout ${raw.type}/${raw.layout}`);
+    assert(raw.stride >= raw.width * raw.channels, "stride smaller than a row");
+    assert(raw.data.length >= raw.stride * raw.height, "view shorter than the raw frame");
+    assert(raw.zeroCopy, "default result should be a zero-copy view");
+    assert(typeof raw.cfa.pattern === "string" && raw.cfa.pattern.length === 4, "missing Bayer pattern");
+    assert(raw.whiteLevel > raw.blackLevel, "white level must exceed black level");
+    console.log(`   ✅ Mosaic ${raw.width}x${raw.height}, stride ${raw.stride}, CFA ${raw.cfa.pattern}`);
+
+    const again = await libraw.getRawData();
+    assert(again.data.buffer === raw.data.buffer, "repeated calls should share one buffer");
+
+    const copy = await libraw.getRawData({ copy: true });
+    assert(!copy.zeroCopy && copy.data.buffer !== raw.data.buffer, "copy should own its buffer");
+    assert(Buffer.compare(Buffer.from(copy.data.buffer), Buffer.from(raw.data.buffer)) === 0, "copy differs from view");
+    console.log("   ✅ Views are shared, copies are independent");
+
+    // 四平面与马赛克视图逐点比较
+    const planes = await libraw.getRawData({ split: "planes" });
+    const planeSize = planes.width * planes.height;
+    assert(planes.layout === "planes" && planes.blackSubtracted, "unexpected planes layout");
+    assert(planes.data.length === 4 * planeSize, "planes length mismatch");
+    assert(planes.width === Math.floor(raw.margins.width / 2), "plane width mismatch");
+
+    const positions = planePositions(raw.cfa.pattern);
+    let checked = 0;
+    for (let plane = 0; plane < 4; plane++) {
+      const pos = positions[plane];
+      const color = raw.cfa.colors.indexOf(raw.cfa.pattern[pos]);
+      // 两个绿色的颜色索引可能不同，索引不确定时只比较 R 和 B
+      if (raw.blackPattern || (color === 1 && raw.channelBlack[1] !== raw.channelBlack[3])) continue;
+      const black = raw.blackLevel + raw.channelBlack[color];
+      for (let i = 0; i < 2000; i++) {
+        const y = Math.floor((i * 7919) % planes.height);
+        const x = Math.floor((i * 104729) % planes.width);
+        const row = raw.margins.top + 2 * y + (pos >> 1);
+        const col = raw.margins.left + 2 * x + (pos & 1);
+        const expected = Math.max(0, raw.data[row * raw.stride + col] - black);
+        const actual = planes.data[plane * planeSize + y * planes.width + x];
+        assert(actual === expected, `plane ${planes.planes[plane]} (${x},${y}): ${actual} != ${expected}`);
+        checked++;
+      }
+    }
+    console.log(`   ✅ Planes ${planes.width}x${planes.height} match the mosaic (${checked} samples)`);
+
+    rejected = false;
+    await libraw.getRawData({ split: "tiles" }).catch(() => (rejected = true));
+    assert(rejected, "unknown split mode should reject");
+
+    // 释放 raw 缓冲区后视图被分离
+    await libraw.close();
+    assert(raw.data.length === 0 && raw.data.buffer.byteLength === 0, "view should be detached after close()");
+    assert(copy.data.length > 0 && planes.data.length > 0, "copies must survive close()");
+    console.log("   ✅ View detached after close(), copies kept");
+  } finally {
+    await libraw.close();
+  }
+
+  console.log("\n🎉 Raw data access test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testRawData().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testRawData };
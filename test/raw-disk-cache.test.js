@@ -0,0 +1,100 @@
+const LibRaw = require("../lib/index.js");
+const fs = require("fs");
+const os = require("os");
+const path = require("path");
+const fileUtils = require("./file-utils.js");
+const { assert, expectThrow } = fileUtils;
+
+/**
+ * 测试磁盘 raw 缓存：写入、跨实例读取、结果一致、清理和参数校验
+ */
+
+async function loadAndRender(file) {
+  const libraw = new LibRaw();
+  try {
+    const start = process.hrtime.bigint();
+    await libraw.loadFile(file);
+    const loadMs = Number(process.hrtime.bigint() - start) / 1e6;
+    await libraw.setOutputParams({ half_size: true, output_bps: 8 });
+    await libraw.processImage();
+    const image = await libraw.createMemoryImage();
+    return { image, loadMs };
+  } finally {
+    await libraw.close();
+  }
+}
+
+async function testRawDiskCache() {
+  console.log("💾 LibRaw Raw Disk Cache Test");
+  console.log("=".repeat(40));
+
+  const files = fileUtils.findSampleFiles();
+  if (files.length === 0) {
+    console.log("   ⚠️ No sample files found, skipping");
+    return;
+  }
+
+  const directory = fs.mkdtempSync(path.join(os.tmpdir(), "libraw-raw-cache-"));
+  try {
+    // 样本中没有 CR3、富士压缩或 IIQ，缓存所有格式
+    LibRaw.configureCache({ rawCacheDir: directory, rawCacheDecoders: "all" });
+    const stats = LibRaw.getCacheStats().disk;
+    assert(stats.directory === directory && stats.decoders === "all", "disk cache settings not applied");
+
+    for (const file of files) {
+      const before = LibRaw.getCacheStats().disk;
+      const first = await loadAndRender(file);
+      const middle = LibRaw.getCacheStats().disk;
+      assert(middle.writes === before.writes + 1, `${path.basename(file)}: first load should write a cache file`);
+
+      const second = await loadAndRender(file);
+      const after = LibRaw.getCacheStats().disk;
+      assert(after.hits === middle.hits + 1, `${path.basename(file)}: second load should read the cache file`);
+      assert(second.image.data.equals(first.image.data), `${path.basename(file)}: cached render differs`);
+      console.log(
+        `   ✅ ${path.basename(file)}: decode ${first.loadMs.toFixed(1)} ms, from disk ${second.loadMs.toFixed(1)} ms`
+      );
+    }
+
+    const written = fs.readdirSync(directory).filter((f) => f.endsWith(".lrc"));
+    assert(written.length === files.length, `expected ${files.length} cache files, found ${written.length}`);
+    const sizes = written.map((f) => fs.statSync(path.join(directory, f)).size);
+    const total = sizes.reduce((a, b) => a + b, 0);
+    assert(LibRaw.getCacheStats().disk.bytes === total, "disk bytes should equal the size of the cache files");
+
+    // 超出字节上限时删除最旧的文件，直到不超过上限
+    const budget = total - 1;
+    const trimmed = LibRaw.configureCache({ rawCacheBudget: budget }).disk;
+    const remaining = fs.readdirSync(directory).filter((f) => f.endsWith(".lrc"));
+    const remainingBytes = remaining.reduce((a, f) => a + fs.statSync(path.join(directory, f)).size, 0);
+    assert(trimmed.budget === budget && trimmed.evictions >= 1, "budget should evict at least one file");
+    assert(remaining.length === files.length - trimmed.evictions, "evictions do not match removed files");
+    assert(trimmed.bytes === remainingBytes && remainingBytes <= budget, "bytes should stay within the budget");
+    console.log(`   ✅ rawCacheBudget evicted ${trimmed.evictions} file(s), ${remainingBytes} of ${total} bytes left`);
+
+    LibRaw.clearCache({ disk: true });
+    assert(fs.readdirSync(directory).filter((f) => f.endsWith(".lrc")).length === 0, "clearCache({ disk }) should remove files");
+    assert(LibRaw.getCacheStats().disk.bytes === 0, "disk bytes should be 0 after clearCache({ disk })");
+    console.log("   ✅ clearCache({ disk: true }) removes cache files");
+
+    expectThrow(() => LibRaw.configureCache({ rawCacheDir: path.join(directory, "missing") }), "missing directory should throw");
+    expectThrow(() => LibRaw.configureCache({ rawCacheDecoders: "some" }), "unknown decoder mode should throw");
+    expectThrow(() => LibRaw.configureCache({ rawCacheBudget: -1 }), "negative budget should throw");
+    console.log("   ✅ Rejects invalid settings");
+  } finally {
+    LibRaw.configureCache({ rawCacheDir: null, rawCacheDecoders: "expensive", rawCacheBudget: 0 });
+    fs.rmSync(directory, { recursive: true, force: true });
+  }
+
+  console.log("\n🎉 Raw disk cache test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testRawDiskCache().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testRawDiskCache };
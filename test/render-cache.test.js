@@ -0,0 +1,96 @@
+const LibRaw = require("../lib/index.js");
+const fileUtils = require("./file-utils.js");
+
+/**
+ * 测试重渲染缓存：输出参数或白平衡变化时复用去马赛克结果
+ */
+
+async function timed(fn) {
+  const start = process.hrtime.bigint();
+  await fn();
+  return Number(process.hrtime.bigint() - start) / 1e6;
+}
+
+async function testRenderCache() {
+  console.log("♻️ LibRaw Re-render Cache Test");
+  console.log("=".repeat(40));
+
+  const sampleFile = fileUtils.findSampleFile();
+  if (!sampleFile) {
+    console.log("   ⚠️ No sample files found, skipping");
+    return;
+  }
+
+  const cached = new LibRaw();
+  const reference = new LibRaw();
+
+  try {
+    await cached.loadFile(sampleFile);
+    await reference.loadFile(sampleFile);
+    await cached.setRenderCache({ enabled: true });
+
+    const firstMs = await timed(() => cached.processImage());
+    const info = cached.getRenderCacheInfo();
+    console.log(
+      `   ✅ First render: ${firstMs.toFixed(1)}ms, cached ${(
+        info.bytes /
+        1024 /
+        1024
+      ).toFixed(1)}MB`
+    );
+    if (!info.valid || info.lastReuse !== "none") {
+      throw new Error("First render should populate the cache");
+    }
+
+    // 仅输出参数变化：结果必须与完整处理一致
+    const outputParams = { gamma: [2.4, 12.92], bright: 1.4, output_color: 2 };
+    await cached.setOutputParams(outputParams);
+    await reference.setOutputParams(outputParams);
+
+    const outputMs = await timed(() => cached.processImage());
+    await reference.processImage();
+    if (cached.getRenderCacheInfo().lastReuse !== "output") {
+      throw new Error("Output-only change should reuse the demosaiced image");
+    }
+
+    const a = await cached.createMemoryImage();
+    const b = await reference.createMemoryImage();
+    if (!a.data.equals(b.data)) {
+      throw new Error("Cached output render differs from full render");
+    }
+    console.log(
+      `   ✅ Output-only re-render: ${outputMs.toFixed(1)}ms, identical to full render`
+    );
+
+    // 白平衡变化：按通道修正
+    await cached.setOutputParams({ user_mul: [2.0, 1.0, 1.5, 1.0] });
+    const wbMs = await timed(() => cached.processImage());
+    if (cached.getRenderCacheInfo().lastReuse !== "whiteBalance") {
+      throw new Error("White balance change should use the correction path");
+    }
+    console.log(`   ✅ White balance re-render: ${wbMs.toFixed(1)}ms`);
+
+    // 影响去马赛克的参数变化：完整处理
+    await cached.setOutputParams({ highlight: 2 });
+    await cached.processImage();
+    if (cached.getRenderCacheInfo().lastReuse !== "none") {
+      throw new Error("Highlight change should trigger a full render");
+    }
+    console.log("   ✅ Pre-demosaic change triggers a full render");
+  } finally {
+    await cached.close();
+    await reference.close();
+  }
+
+  console.log("\n🎉 Re-render cache test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testRenderCache().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testRenderCache };
@@ -0,0 +1,124 @@
+const LibRaw = require("../lib/index.js");
+const fileUtils = require("./file-utils.js");
+const { assert } = fileUtils;
+
+/**
+ * 测试进程级共享缓存：命中与 key 规范化、同一线程的并发去重、预算拒绝和 raw 缓存
+ */
+
+async function render(file, request) {
+  const libraw = new LibRaw();
+  try {
+    const start = process.hrtime.bigint();
+    const result = await libraw.renderCached(file, request);
+    return { result, ms: Number(process.hrtime.bigint() - start) / 1e6 };
+  } finally {
+    await libraw.close();
+  }
+}
+
+async function testSharedCache() {
+  console.log("🗄️ LibRaw Shared Cache Test");
+  console.log("=".repeat(40));
+
+  const sampleFile = fileUtils.findSampleFile();
+  if (!sampleFile) {
+    console.log("   ⚠️ No sample files found, skipping");
+    return;
+  }
+
+  LibRaw.configureCache({ outputBudget: 256 * 1024 * 1024, rawBudget: 512 * 1024 * 1024 });
+  LibRaw.clearCache();
+
+  try {
+    const request = { params: { half_size: true, output_bps: 8, use_camera_wb: true } };
+    const first = await render(sampleFile, request);
+    assert(first.result.cached === false, "first render should miss");
+
+    // 参数顺序不同的相同请求命中同一项
+    const second = await render(sampleFile, { params: { use_camera_wb: true, output_bps: 8, half_size: true } });
+    assert(second.result.cached === true, "identical request should hit");
+    assert(second.result.data.equals(first.result.data), "cached data differs from the render");
+    assert(second.result.width === first.result.width && second.result.bits === first.result.bits, "metadata lost");
+    console.log(`   ✅ Miss ${first.ms.toFixed(1)} ms, hit ${second.ms.toFixed(1)} ms`);
+
+    // 不同的输出参数是不同的项
+    const other = await render(sampleFile, { params: { half_size: true, output_bps: 16 } });
+    assert(other.result.cached === false, "different params should miss");
+
+    // 同一线程内的并发请求只渲染一次
+    const before = LibRaw.getCacheStats().output;
+    const concurrent = await Promise.all(
+      [0, 1, 2].map(() => render(sampleFile, { params: { half_size: true, bright: 1.5 } }))
+    );
+    const after = LibRaw.getCacheStats().output;
+    assert(after.misses - before.misses === 1, `concurrent requests rendered ${after.misses - before.misses} times`);
+    assert(concurrent.filter((c) => !c.result.cached).length === 1, "exactly one request should render");
+    console.log("   ✅ Concurrent identical requests are rendered once");
+
+    // 同一实例上不同 key 的并发请求依次渲染，结果与各自单独渲染相同
+    const files = fileUtils.findSampleFiles().slice(0, 2);
+    const requests = [
+      { file: files[0], request: { params: { half_size: true, output_bps: 8, bright: 0.8 } } },
+      { file: files[files.length - 1], request: { params: { half_size: true, output_bps: 16 } } },
+      { file: files[0], request: { operation: "png", params: { half_size: true, bright: 1.2 } } },
+    ];
+    const shared = new LibRaw();
+    let together;
+    try {
+      together = await Promise.all(requests.map(({ file, request }) => shared.renderCached(file, request)));
+    } finally {
+      await shared.close();
+    }
+    LibRaw.clearCache();
+    for (let i = 0; i < requests.length; i++) {
+      const alone = await render(requests[i].file, requests[i].request);
+      const expected = alone.result.data || alone.result.buffer;
+      const actual = together[i].data || together[i].buffer;
+      assert(!together[i].cached && !alone.result.cached, `request ${i} should render`);
+      assert(actual.equals(expected), `concurrent request ${i} on one instance got another request's result`);
+    }
+    console.log("   ✅ Concurrent requests on one instance do not interleave");
+
+    // 编码操作
+    const jpeg = await render(sampleFile, { operation: "jpeg", params: { half_size: true }, options: { quality: 70 } });
+    const jpegAgain = await render(sampleFile, { operation: "jpeg", params: { half_size: true }, options: { quality: 70 } });
+    assert(jpegAgain.result.cached && jpegAgain.result.buffer.equals(jpeg.result.buffer), "cached JPEG differs");
+    console.log("   ✅ Encoded outputs are cached");
+
+    // loadFile() 命中 raw 缓存
+    const raw = LibRaw.getCacheStats().raw;
+    assert(raw.hits > 0 && raw.entries > 0, "raw cache should be hit by repeated loads");
+    console.log(`   ✅ Raw cache: ${raw.entries} entries, ${raw.hits} hits, ${raw.misses} misses`);
+
+    // 超过预算的结果不缓存
+    LibRaw.configureCache({ outputBudget: 16 });
+    const rejectedBefore = LibRaw.getCacheStats().output.rejected;
+    await render(sampleFile, { params: { half_size: true, bright: 0.7 } });
+    assert(LibRaw.getCacheStats().output.rejected === rejectedBefore + 1, "oversized entry should be rejected");
+    console.log("   ✅ Entries larger than the budget are rejected");
+
+    let threw = false;
+    try {
+      LibRaw.configureCache({ outputBudget: -1 });
+    } catch (error) {
+      threw = true;
+    }
+    assert(threw, "negative budget should throw");
+  } finally {
+    LibRaw.configureCache({ outputBudget: 0, rawBudget: 0 });
+    LibRaw.clearCache();
+  }
+
+  console.log("\n🎉 Shared cache test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testSharedCache().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testSharedCache };
@@ -0,0 +1,92 @@
+const LibRaw = require("../lib/index.js");
+const crypto = require("crypto");
+const path = require("path");
+const { execFileSync } = require("child_process");
+const fileUtils = require("./file-utils.js");
+
+/**
+ * 测试指令集分派：各指令集级别的输出必须与 LibRaw 标量实现逐位一致。
+ * 级别在进程启动时确定，所以每个级别在子进程中用 LIBRAW_SIMD 运行
+ */
+
+// 子进程：输出当前级别和每个样本 16 位图像的摘要
+async function hashOutputs(files) {
+  const result = { simd: LibRaw.getSimdInfo(), hashes: {} };
+  for (const file of files) {
+    const libraw = new LibRaw();
+    try {
+      await libraw.loadFile(file);
+      await libraw.setOutputParams({ output_bps: 16 });
+      await libraw.processImage();
+      const image = await libraw.createMemoryImage();
+      result.hashes[file] = crypto.createHash("sha256").update(image.data).digest("hex");
+    } finally {
+      await libraw.close();
+    }
+  }
+  return result;
+}
+
+function runLevel(level, files) {
+  const output = execFileSync(process.execPath, [__filename, "--hash", ...files], {
+    encoding: "utf8",
+    env: { ...process.env, LIBRAW_SIMD: level },
+  });
+  return JSON.parse(output);
+}
+
+async function testSimd() {
+  console.log("🧮 LibRaw SIMD Dispatch Test");
+  console.log("=".repeat(40));
+
+  const info = LibRaw.getSimdInfo();
+  console.log(`   📊 Active level: ${info.level}, detected: ${info.detected}`);
+
+  const files = fileUtils.findSampleFiles();
+  if (files.length === 0) {
+    console.log("   ⚠️ No sample files found, skipping output comparison");
+    return;
+  }
+
+  const reference = runLevel("scalar", files);
+  if (reference.simd.level !== "scalar") {
+    throw new Error(`LIBRAW_SIMD=scalar was not applied (got ${reference.simd.level})`);
+  }
+
+  // 依次比较不高于检测结果的各级别
+  const levels = info.detected === "neon" ? ["neon"] : ["sse4.1", "avx2"];
+  for (const level of levels) {
+    const run = runLevel(level, files);
+    if (run.simd.level !== level) {
+      console.log(`   ⚠️ ${level} not supported on this CPU (using ${run.simd.level}), skipping`);
+      continue;
+    }
+    for (const file of files) {
+      if (run.hashes[file] !== reference.hashes[file]) {
+        throw new Error(`${level} output differs from scalar for ${path.basename(file)}`);
+      }
+    }
+    console.log(`   ✅ ${level}: ${files.length} sample(s) bit-exact with scalar`);
+  }
+
+  console.log("\n🎉 SIMD dispatch test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  if (process.argv[2] === "--hash") {
+    hashOutputs(process.argv.slice(3))
+      .then((result) => process.stdout.write(JSON.stringify(result)))
+      .catch((error) => {
+        console.error(error);
+        process.exit(1);
+      });
+  } else {
+    testSimd().catch((error) => {
+      console.error(error);
+      process.exit(1);
+    });
+  }
+}
+
+module.exports = { testSimd };
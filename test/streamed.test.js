@@ -0,0 +1,145 @@
+const LibRaw = require("../lib/index.js");
+const fs = require("fs");
+const os = require("os");
+const path = require("path");
+const fileUtils = require("./file-utils.js");
+const { assert, expectReject } = fileUtils;
+
+/**
+ * 测试分段流式输出：与整幅处理的像素一致、按行解码、JPEG 输出、不支持的选项和参数校验
+ */
+
+// 读取 TIFF 的 Orientation 标签（本机字节序），换算回 LibRaw 的 flip
+function tiffFlip(tiff) {
+  const little = tiff[0] === 0x49;
+  const u16 = (o) => (little ? tiff.readUInt16LE(o) : tiff.readUInt16BE(o));
+  const u32 = (o) => (little ? tiff.readUInt32LE(o) : tiff.readUInt32BE(o));
+  const ifd = u32(4);
+  for (let i = 0; i < u16(ifd); i++) {
+    const entry = ifd + 2 + i * 12;
+    if (u16(entry) === 274) return [0, 0, 1, 3, 2, 4, 5, 7, 6][u16(entry + 8)];
+  }
+  return 0;
+}
+
+// createMemoryImage() 按 flip 旋转，流式输出不旋转：按 dcraw_make_mem_image 的索引方式比较
+function samePixels(image, pixels, width, height, flip) {
+  for (let row = 0; row < image.height; row++) {
+    for (let col = 0; col < image.width; col++) {
+      let r = row;
+      let c = col;
+      if (flip & 4) [r, c] = [c, r];
+      if (flip & 2) r = height - 1 - r;
+      if (flip & 1) c = width - 1 - c;
+      const src = (r * width + c) * 3;
+      const dst = (row * image.width + col) * 3;
+      for (let k = 0; k < 3; k++) if (pixels[src + k] !== image.data[dst + k]) return false;
+    }
+  }
+  return true;
+}
+
+// 不带自动亮度的整幅处理结果，作为比较基准
+async function renderWhole(file) {
+  const libraw = new LibRaw();
+  try {
+    await libraw.loadFile(file);
+    await libraw.setOutputParams({ output_bps: 8, no_auto_bright: true });
+    await libraw.processImage();
+    return await libraw.createMemoryImage();
+  } finally {
+    await libraw.close();
+  }
+}
+
+async function testStreamed() {
+  console.log("🧵 LibRaw Streamed Output Test");
+  console.log("=".repeat(40));
+
+  const files = fileUtils.findSampleFiles();
+  if (files.length === 0) {
+    console.log("   ⚠️ No sample files found, skipping");
+    return;
+  }
+
+  const directory = fs.mkdtempSync(path.join(os.tmpdir(), "libraw-streamed-"));
+  try {
+    for (const file of files) {
+      const name = path.basename(file);
+      const image = await renderWhole(file);
+
+      const libraw = new LibRaw();
+      try {
+        await libraw.openFile(file);
+        await libraw.setOutputParams({ output_bps: 8, no_auto_bright: true });
+        const output = path.join(directory, `${name}.tif`);
+        const stats = await libraw.writeStreamed(output, { bandRows: 100 });
+
+        assert(stats.width * stats.height === image.width * image.height, `${name}: size mismatch`);
+        assert(stats.bandRows === 112, `${name}: bandRows should round up to 112, got ${stats.bandRows}`);
+        assert(stats.bands === Math.ceil(stats.height / 112), `${name}: unexpected band count ${stats.bands}`);
+        assert(!stats.whiteEstimated, `${name}: white point should not be estimated without auto bright`);
+        assert(stats.bytesWritten === fs.statSync(output).size, `${name}: bytesWritten mismatch`);
+
+        // 像素数据紧跟在 8 字节 TIFF 文件头之后
+        const tiff = fs.readFileSync(output);
+        const pixels = tiff.subarray(8, 8 + image.data.length);
+        assert(
+          samePixels(image, pixels, stats.width, stats.height, tiffFlip(tiff)),
+          `${name}: streamed pixels differ from processImage()`
+        );
+
+        console.log(
+          `   ✅ ${name}: ${stats.bands} bands, halo ${stats.haloRows}, ` +
+            `${stats.rowDecoder ? "rows decoded per band" : "unpacked"}, ` +
+            `band ${(stats.bandBytes / 1048576).toFixed(1)} MB vs image ${(image.data.length / 1048576).toFixed(1)} MB`
+        );
+      } finally {
+        await libraw.close();
+      }
+    }
+
+    // JPEG 输出和处理后的状态
+    const libraw = new LibRaw();
+    try {
+      await libraw.loadFile(files[0]);
+      const output = path.join(directory, "streamed.jpg");
+      if (LibRaw.hasNativeJpeg()) {
+        const stats = await libraw.writeStreamed(output, { format: "jpeg", quality: 80 });
+        const jpeg = fs.readFileSync(output);
+        assert(jpeg[0] === 0xff && jpeg[1] === 0xd8, "JPEG output should start with SOI");
+        assert(stats.bytesWritten === jpeg.length, "JPEG bytesWritten mismatch");
+        console.log(`   ✅ JPEG output: ${stats.width}x${stats.height}, ${jpeg.length} bytes`);
+      } else {
+        await expectReject(libraw.writeStreamed(output, { format: "jpeg" }), "JPEG without libjpeg", /without libjpeg/);
+        console.log("   ⚠️ Built without libjpeg, JPEG output rejected");
+      }
+      await libraw.processImage();
+
+      // 需要整幅图像的选项和无效参数
+      await libraw.setOutputParams({ highlight: 5 });
+      await expectReject(libraw.writeStreamed(path.join(directory, "x.tif")), "highlight > 2 should be rejected");
+      await libraw.setOutputParams({ highlight: 0 });
+      await expectReject(libraw.writeStreamed(path.join(directory, "x.tif"), { format: "png" }), "unknown format");
+      await expectReject(libraw.writeStreamed(path.join(directory, "x.tif"), { bandRows: 8 }), "bandRows < 16");
+      await expectReject(libraw.writeStreamed(path.join(directory, "x.jpg"), { format: "jpeg", quality: 0 }), "quality 0");
+      console.log("   ✅ Rejects unsupported options and invalid arguments");
+    } finally {
+      await libraw.close();
+    }
+  } finally {
+    fs.rmSync(directory, { recursive: true, force: true });
+  }
+
+  console.log("\n🎉 Streamed output test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testStreamed().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testStreamed };
@@ -0,0 +1,95 @@
+const LibRaw = require("../lib/index.js");
+const path = require("path");
+const fileUtils = require("./file-utils.js");
+const { assert } = fileUtils;
+
+/**
+ * 测试降采样解包：尺寸按倍数缩小、解码器内降采样的格式、渲染结果和参数校验
+ */
+
+async function loadTimed(file, options) {
+  const libraw = new LibRaw();
+  const start = process.hrtime.bigint();
+  await libraw.loadFile(file, options);
+  const ms = Number(process.hrtime.bigint() - start) / 1e6;
+  return { libraw, ms };
+}
+
+async function testSubsample() {
+  console.log("🔍 LibRaw Subsampled Unpack Test");
+  console.log("=".repeat(40));
+
+  const files = fileUtils.findSampleFiles();
+  if (files.length === 0) {
+    console.log("   ⚠️ No sample files found, skipping");
+    return;
+  }
+
+  for (const file of files) {
+    const full = await loadTimed(file);
+    const reduced = await loadTimed(file, { subsample: 4 });
+    try {
+      const fullSize = await full.libraw.getImageSize();
+      const size = await reduced.libraw.getImageSize();
+      const info = await reduced.libraw.getSubsampleInfo();
+      const name = path.basename(file);
+
+      if (info.factor === 1) {
+        // 非 Bayer 或不支持的布局按完整分辨率解包
+        assert(size.width === fullSize.width, `${name}: unsupported file should keep full size`);
+        console.log(`   ⚠️ ${name}: not subsampled`);
+        continue;
+      }
+
+      assert(info.factor === 4, `${name}: factor should be 4, got ${info.factor}`);
+      assert(Math.abs(size.width - fullSize.width / 4) <= 2, `${name}: width ${size.width} vs ${fullSize.width}`);
+      assert(Math.abs(size.height - fullSize.height / 4) <= 2, `${name}: height ${size.height} vs ${fullSize.height}`);
+      assert(info.width === size.width && info.height === size.height, `${name}: info size mismatch`);
+
+      await reduced.libraw.setOutputParams({ output_bps: 8 });
+      await reduced.libraw.processImage();
+      const image = await reduced.libraw.createMemoryImage();
+      assert(image.width > 0 && image.data.length > 0, `${name}: subsampled render is empty`);
+
+      console.log(
+        `   ✅ ${name}: ${fullSize.width}x${fullSize.height} -> ${size.width}x${size.height}, ` +
+          `${info.inDecoder ? "in decoder" : "after decode"}, ${full.ms.toFixed(1)} -> ${reduced.ms.toFixed(1)} ms`
+      );
+    } finally {
+      await full.libraw.close();
+      await reduced.libraw.close();
+    }
+  }
+
+  // subsample: 1 等价于不降采样
+  const plain = new LibRaw();
+  try {
+    await plain.loadFile(files[0], { subsample: 1 });
+    assert((await plain.getSubsampleInfo()).factor === 1, "subsample 1 should be full resolution");
+
+    for (const subsample of [0, 17, 2.5, "2"]) {
+      let threw = false;
+      try {
+        await plain.loadFile(files[0], { subsample });
+      } catch (error) {
+        threw = true;
+      }
+      assert(threw, `subsample ${JSON.stringify(subsample)} should be rejected`);
+    }
+    console.log("   ✅ Rejects invalid factors");
+  } finally {
+    await plain.close();
+  }
+
+  console.log("\n🎉 Subsampled unpack test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testSubsample().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testSubsample };
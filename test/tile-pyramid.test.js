@@ -0,0 +1,233 @@
+const LibRaw = require("../lib/index.js");
+const fs = require("fs");
+const os = require("os");
+const path = require("path");
+const zlib = require("zlib");
+const fileUtils = require("./file-utils.js");
+const { assert, expectReject } = fileUtils;
+
+/**
+ * 测试 Deep Zoom 瓦片金字塔导出：层数和瓦片网格、.dzi 描述文件、目录输出、
+ * 回调输出的像素与内存图像及其 2x2 缩小结果一致、回调异常中止导出和参数校验
+ */
+
+// 与原生层相同：边长逐层减半（向上取整）直到 1x1
+function pyramidLevels(width, height) {
+  const levels = [];
+  for (let w = width, h = height; ; w = Math.ceil(w / 2), h = Math.ceil(h / 2)) {
+    levels.unshift({ width: w, height: h });
+    if (w === 1 && h === 1) return levels;
+  }
+}
+
+// 2x2 平均缩小，奇数边长时边缘只平均实际存在的像素，四舍五入
+function reduce(pixels, width, height, channels) {
+  const w = Math.ceil(width / 2);
+  const h = Math.ceil(height / 2);
+  const out = Buffer.alloc(w * h * channels);
+  for (let y = 0; y < h; y++) {
+    for (let x = 0; x < w; x++) {
+      for (let c = 0; c < channels; c++) {
+        let sum = 0;
+        let count = 0;
+        for (let dy = 0; dy < 2 && 2 * y + dy < height; dy++) {
+          for (let dx = 0; dx < 2 && 2 * x + dx < width; dx++) {
+            sum += pixels[((2 * y + dy) * width + 2 * x + dx) * channels + c];
+            count++;
+          }
+        }
+        out[(y * w + x) * channels + c] = Math.floor((sum + (count >> 1)) / count);
+      }
+    }
+  }
+  return out;
+}
+
+// 压缩级别 0 的瓦片每行都不滤波，去掉每行的类型字节即为像素
+function decodeUnfilteredPng(png) {
+  let offset = 8;
+  let width = 0;
+  let height = 0;
+  let colorType = 0;
+  const idat = [];
+  while (offset < png.length) {
+    const length = png.readUInt32BE(offset);
+    const type = png.toString("latin1", offset + 4, offset + 8);
+    const data = png.subarray(offset + 8, offset + 8 + length);
+    if (type === "IHDR") {
+      width = data.readUInt32BE(0);
+      height = data.readUInt32BE(4);
+      colorType = data[9];
+    } else if (type === "IDAT") {
+      idat.push(data);
+    }
+    offset += 12 + length;
+  }
+  const channels = colorType === 2 ? 3 : 1;
+  const rowBytes = width * channels;
+  const filtered = zlib.inflateSync(Buffer.concat(idat));
+  const pixels = Buffer.alloc(rowBytes * height);
+  for (let row = 0; row < height; row++) {
+    assert(filtered[row * (rowBytes + 1)] === 0, "unexpected PNG filter");
+    filtered.copy(pixels, row * rowBytes, row * (rowBytes + 1) + 1, (row + 1) * (rowBytes + 1));
+  }
+  return { width, height, channels, pixels };
+}
+
+// JPEG 的 SOF0 段中的尺寸
+function jpegSize(jpeg) {
+  assert(jpeg[0] === 0xff && jpeg[1] === 0xd8 && jpeg[jpeg.length - 2] === 0xff && jpeg[jpeg.length - 1] === 0xd9, "bad JPEG");
+  let offset = 2;
+  while (offset < jpeg.length) {
+    const marker = jpeg[offset + 1];
+    if (marker === 0xc0) return { height: jpeg.readUInt16BE(offset + 5), width: jpeg.readUInt16BE(offset + 7) };
+    offset += 2 + jpeg.readUInt16BE(offset + 2);
+  }
+  throw new Error("JPEG without SOF0");
+}
+
+function tileRect(level, col, row, tileSize, overlap) {
+  const x = Math.max(0, col * tileSize - overlap);
+  const y = Math.max(0, row * tileSize - overlap);
+  return {
+    x,
+    y,
+    width: Math.min(level.width, (col + 1) * tileSize + overlap) - x,
+    height: Math.min(level.height, (row + 1) * tileSize + overlap) - y,
+  };
+}
+
+// PNG 瓦片的尺寸：IHDR 紧跟在签名之后
+function pngSize(png) {
+  assert(png.readUInt32BE(12) === 0x49484452, "bad PNG");
+  return { width: png.readUInt32BE(16), height: png.readUInt32BE(20) };
+}
+
+function samePixels(tile, image, imageWidth, channels) {
+  const rowBytes = tile.width * channels;
+  for (let y = 0; y < tile.height; y++) {
+    const start = ((tile.y + y) * imageWidth + tile.x) * channels;
+    if (Buffer.compare(tile.pixels.subarray(y * rowBytes, (y + 1) * rowBytes), image.subarray(start, start + rowBytes)) !== 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+async function testTilePyramid() {
+  console.log("🖼️ LibRaw Tile Pyramid Test");
+  console.log("=".repeat(40));
+
+  const files = fileUtils.findSampleFiles();
+  if (files.length === 0) {
+    console.log("   ⚠️ No sample files found, skipping");
+    return;
+  }
+
+  const libraw = new LibRaw();
+  const outputDir = fs.mkdtempSync(path.join(os.tmpdir(), "libraw-dzi-"));
+  try {
+    // 降采样解包，缩短 JS 端的像素比较时间
+    await libraw.loadFile(files[0], { subsample: 4 });
+    await libraw.processImage();
+    await libraw.setOutputParams({ output_bps: 8 });
+    const image = await libraw.createMemoryImage();
+    const pixels = Buffer.from(image.data.buffer, image.data.byteOffset, image.data.length);
+    const levels = pyramidLevels(image.width, image.height);
+
+    // 目录输出：每层的每个瓦片都存在，尺寸含重叠。没有链接 libjpeg 时默认格式为 PNG
+    const format = LibRaw.hasNativeJpeg() ? "jpeg" : "png";
+    const tileSize = 128;
+    const overlap = 1;
+    const start = process.hrtime.bigint();
+    const result = await libraw.exportTilePyramid({ directory: outputDir, name: "photo", tileSize, overlap, quality: 85 });
+    assert(result.format === format, `default format should be ${format}`);
+    const ms = Number(process.hrtime.bigint() - start) / 1e6;
+    assert(result.width === image.width && result.height === image.height, "size mismatch");
+    assert(result.levels === levels.length, `expected ${levels.length} levels, got ${result.levels}`);
+    let expectedTiles = 0;
+    let bytes = 0;
+    levels.forEach((level, index) => {
+      const cols = Math.ceil(level.width / tileSize);
+      const rows = Math.ceil(level.height / tileSize);
+      expectedTiles += cols * rows;
+      const dir = path.join(result.tileDirectory, String(index));
+      assert(fs.readdirSync(dir).length === cols * rows, `level ${index} has the wrong number of tiles`);
+      for (let row = 0; row < rows; row++) {
+        for (let col = 0; col < cols; col++) {
+          const data = fs.readFileSync(path.join(dir, `${col}_${row}.${format}`));
+          const rect = tileRect(level, col, row, tileSize, overlap);
+          const size = format === "jpeg" ? jpegSize(data) : pngSize(data);
+          assert(size.width === rect.width && size.height === rect.height, `tile ${index}/${col}_${row} has the wrong size`);
+          bytes += data.length;
+        }
+      }
+    });
+    assert(result.tiles === expectedTiles && result.bytes === bytes, "tile statistics mismatch");
+    const dzi = fs.readFileSync(result.dziPath, "utf8");
+    assert(result.dziPath === path.join(outputDir, "photo.dzi") && dzi === result.dzi, ".dzi not written");
+    assert(dzi.includes(`Format="${format}"`) && dzi.includes(`Overlap="${overlap}"`) && dzi.includes(`TileSize="${tileSize}"`), "bad .dzi attributes");
+    assert(dzi.includes(`Width="${image.width}"`) && dzi.includes(`Height="${image.height}"`), "bad .dzi size");
+    console.log(
+      `   ✅ ${result.tiles} ${format.toUpperCase()} tiles in ${result.levels} levels: ${(result.bytes / 1024).toFixed(0)} KB ` +
+        `on ${result.threads} threads in ${ms.toFixed(1)} ms`
+    );
+
+    // 回调输出：最高层与内存图像一致，下一层与其 2x2 缩小结果一致
+    const tiles = [];
+    const streamed = await libraw.exportTilePyramid({
+      format: "png",
+      compressionLevel: 0,
+      tileSize: 256,
+      onTile: (tile) => tiles.push(tile),
+    });
+    assert(tiles.length === streamed.tiles && !streamed.dziPath, "onTile not called for every tile");
+    const top = levels.length - 1;
+    const reduced = reduce(pixels, image.width, image.height, image.colors);
+    for (const tile of tiles.filter((t) => t.level >= top - 1)) {
+      const decoded = decodeUnfilteredPng(tile.data);
+      assert(decoded.width === tile.width && decoded.height === tile.height, "PNG tile size mismatch");
+      const source = tile.level === top ? pixels : reduced;
+      const width = levels[tile.level].width;
+      assert(samePixels({ ...tile, pixels: decoded.pixels }, source, width, image.colors), `tile ${tile.level}/${tile.col}_${tile.row} pixels differ`);
+    }
+    const smallest = tiles.find((t) => t.level === 0);
+    assert(smallest && smallest.width === 1 && smallest.height === 1, "level 0 should be 1x1");
+    console.log(`   ✅ ${tiles.length} PNG tiles match the image and its 2x2 reduction`);
+
+    // 回调抛出异常时停止导出并传出该异常
+    let calls = 0;
+    await expectReject(
+      libraw.exportTilePyramid({
+        onTile: () => {
+          calls++;
+          throw new Error("stop");
+        },
+      }),
+      "exception in onTile should reject"
+    );
+    assert(calls === 1, "export should stop after onTile throws");
+    console.log("   ✅ Exception in onTile stops the export");
+
+    await expectReject(libraw.exportTilePyramid({ onTile: () => {}, tileSize: 8 }), "tileSize 8 should be rejected");
+    await expectReject(libraw.exportTilePyramid({ onTile: () => {}, tileSize: 64, overlap: 65 }), "overlap > tileSize should be rejected");
+    await expectReject(libraw.exportTilePyramid({ onTile: () => {}, format: "webp" }), "unknown format should be rejected");
+    await expectReject(libraw.exportTilePyramid({}), "missing directory and onTile should be rejected");
+    console.log("   ✅ Rejects invalid options");
+  } finally {
+    await libraw.close();
+    fs.rmSync(outputDir, { recursive: true, force: true });
+  }
+
+  console.log("\n🎉 Tile pyramid test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testTilePyramid().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testTilePyramid };
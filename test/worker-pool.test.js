@@ -0,0 +1,90 @@
+const LibRaw = require("../lib/index.js");
+const fs = require("fs");
+const path = require("path");
+const fileUtils = require("./file-utils.js");
+
+/**
+ * 测试基于 worker_threads 的并行解码线程池
+ */
+
+async function testWorkerPool() {
+  console.log("🧵 LibRaw Worker Pool Test");
+  console.log("=".repeat(40));
+
+  const pool = new LibRaw.WorkerPool({ size: 2 });
+  console.log(`   ✅ Pool created with ${pool.size} workers`);
+
+  try {
+    // 错误应以被拒绝的 Promise 返回，且不影响后续任务
+    try {
+      await pool.run({ input: Buffer.alloc(1024, 0x42) });
+      console.log("   ❌ Invalid buffer should have failed");
+    } catch (error) {
+      console.log(`   ✅ Invalid input rejected: ${error.message}`);
+    }
+
+    const files = fileUtils.findSampleFiles().slice(0, 4);
+    if (files.length === 0) {
+      console.log("   ⚠️ No sample files found, skipping decode tests");
+      return;
+    }
+
+    const startTime = Date.now();
+    const results = await Promise.all(
+      files.map((file) =>
+        pool.run({
+          input: file,
+          operation: "memoryImage",
+          params: { output_bps: 8 },
+        })
+      )
+    );
+    const elapsed = Date.now() - startTime;
+
+    for (const [index, image] of results.entries()) {
+      if (!Buffer.isBuffer(image.data)) {
+        throw new Error("Worker result data is not a Buffer");
+      }
+      if (image.data.length !== image.dataSize) {
+        throw new Error(
+          `Buffer size mismatch: ${image.data.length} != ${image.dataSize}`
+        );
+      }
+      console.log(
+        `   ✅ ${path.basename(files[index])}: ${image.width}x${image.height}, ${image.bits}-bit`
+      );
+    }
+    console.log(`   ⏱️ ${files.length} files decoded in ${elapsed}ms`);
+
+    // 缓冲区输入并移交给 worker
+    const input = fs.readFileSync(files[0]);
+    const metadata = await pool.run({
+      input,
+      operation: "metadata",
+      transferInput: true,
+    });
+    console.log(
+      `   ✅ Metadata via transferred buffer: ${metadata.metadata.make} ${metadata.metadata.model}`
+    );
+
+    const stats = pool.getStats();
+    console.log(
+      `   📊 Pool stats: ${stats.size} workers, ${stats.busy} busy, ${stats.queued} queued`
+    );
+  } finally {
+    await pool.close();
+    console.log("   ✅ Pool closed");
+  }
+
+  console.log("\n🎉 Worker pool test completed!");
+  console.log("=".repeat(40));
+}
+
+if (require.main === module) {
+  testWorkerPool().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
+
+module.exports = { testWorkerPool };
@@ -0,0 +1,633 @@
+// LibRaw 原生微基准：分别计时 open/identify、各解码器的 unpack、raw2image_ex、
+// 各去马赛克质量、convert_to_rgb 和内存图像输出，不经过 Node 和 sharp。
+//
+// 用法: libraw_bench [--repeat N] [--quality 0,1,2,3,4,11,12] [--identify-only] [--json] [文件或目录...]
+// 默认读取 raw-samples-repo 下的所有样本。--identify-only 只测量 open/identify 的吞吐量
+// （只读元数据的导入路径），每次测量为同一处理器连续 open_buffer 一批的平均值。
+// 处理器继承插件的 LibRawProcessor，热点循环按运行时指令集分派；
+// 设置 LIBRAW_SIMD=scalar 可与 LibRaw 的标量实现对比。
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <libraw/libraw.h>
+#include "libraw_processor.h"
+#include "simd_kernels.h"
+
+// ============== 分配统计 ==============
+// glibc 下拦截 malloc 系列函数，统计每个阶段分配的字节数和存活内存峰值；
+// 其他平台只报告时间
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#define BENCH_TRACK_ALLOCATIONS 1
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void __libc_free(void *ptr);
+}
+
+namespace
+{
+    std::atomic<size_t> g_allocated(0); // 累计分配
+    std::atomic<size_t> g_live(0);      // 当前存活
+    std::atomic<size_t> g_peak(0);      // 自上次重置以来的存活峰值
+
+    inline void trackAlloc(void *ptr)
+    {
+        if (!ptr)
+            return;
+        size_t size = malloc_usable_size(ptr);
+        g_allocated += size;
+        size_t live = (g_live += size);
+        size_t peak = g_peak.load();
+        while (live > peak && !g_peak.compare_exchange_weak(peak, live))
+        {
+        }
+    }
+
+    inline void trackFree(void *ptr)
+    {
+        if (ptr)
+            g_live -= malloc_usable_size(ptr);
+    }
+}
+
+extern "C"
+{
+    void *malloc(size_t size)
+    {
+        void *ptr = __libc_malloc(size);
+        trackAlloc(ptr);
+        return ptr;
+    }
+
+    void *calloc(size_t count, size_t size)
+    {
+        void *ptr = __libc_calloc(count, size);
+        trackAlloc(ptr);
+        return ptr;
+    }
+
+    void *realloc(void *ptr, size_t size)
+    {
+        trackFree(ptr);
+        void *result = __libc_realloc(ptr, size);
+        // 失败时原指针仍然有效
+        trackAlloc(result ? result : (size ? ptr : nullptr));
+        return result;
+    }
+
+    void free(void *ptr)
+    {
+        trackFree(ptr);
+        __libc_free(ptr);
+    }
+}
+#else
+#define BENCH_TRACK_ALLOCATIONS 0
+#endif
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // 阶段边界的计数快照
+    struct Mark
+    {
+        Clock::time_point time;
+        size_t allocated;
+        size_t live;
+        size_t peak; // 上一个快照以来的存活峰值
+    };
+
+    Mark mark()
+    {
+        Mark m;
+        m.time = Clock::now();
+#if BENCH_TRACK_ALLOCATIONS
+        m.allocated = g_allocated.load();
+        m.live = g_live.load();
+        m.peak = g_peak.exchange(m.live);
+#else
+        m.allocated = m.live = m.peak = 0;
+#endif
+        return m;
+    }
+
+    // 单次测量
+    struct Sample
+    {
+        double ms;
+        size_t allocated; // 阶段内分配的字节数
+        size_t peak;      // 阶段内存活内存相对开始时的最大增量
+    };
+
+    Sample since(const Mark &start)
+    {
+        Sample s;
+        s.ms = std::chrono::duration<double, std::milli>(Clock::now() - start.time).count();
+#if BENCH_TRACK_ALLOCATIONS
+        s.allocated = g_allocated.load() - start.allocated;
+        size_t peak = g_peak.load();
+        s.peak = peak > start.live ? peak - start.live : 0;
+#else
+        s.allocated = s.peak = 0;
+#endif
+        return s;
+    }
+
+    // 某个阶段的多次测量，报告中位数
+    struct StageResult
+    {
+        std::string name;
+        double megapixels;
+        std::vector<Sample> samples;
+
+        Sample median() const
+        {
+            std::vector<double> ms;
+            for (const Sample &s : samples)
+                ms.push_back(s.ms);
+            std::sort(ms.begin(), ms.end());
+            Sample m = samples.empty() ? Sample{0, 0, 0} : samples.front();
+            m.ms = ms.empty() ? 0 : (ms.size() % 2 ? ms[ms.size() / 2] : (ms[ms.size() / 2 - 1] + ms[ms.size() / 2]) / 2);
+            return m;
+        }
+    };
+
+    // ============== dcraw_process 阶段计时 ==============
+    // dcraw_process 在各阶段之间调用处理步骤回调，借此拆分 raw2image_ex、
+    // 去马赛克前处理、去马赛克和 convert_to_rgb，而不必复制其内部流程
+
+    enum ProcessStep
+    {
+        STEP_START,
+        STEP_PRE_SUBTRACT_BLACK, // raw2image_ex 结束
+        STEP_PRE_INTERPOLATE,    // 黑电平、scale_colors、pre_interpolate 结束
+        STEP_POST_INTERPOLATE,   // 去马赛克结束
+        STEP_PRE_CONVERT,        // 高光恢复、旋转等结束
+        STEP_POST_CONVERT,       // convert_to_rgb 结束
+        STEP_COUNT
+    };
+
+    class BenchProcessor : public LibRawProcessor
+    {
+    public:
+        BenchProcessor()
+        {
+            callbacks.pre_subtractblack_cb = &BenchProcessor::onPreSubtractBlack;
+            callbacks.pre_interpolate_cb = &BenchProcessor::onPreInterpolate;
+            callbacks.post_interpolate_cb = &BenchProcessor::onPostInterpolate;
+            callbacks.pre_converttorgb_cb = &BenchProcessor::onPreConvert;
+            callbacks.post_converttorgb_cb = &BenchProcessor::onPostConvert;
+        }
+
+        Mark steps[STEP_COUNT];
+
+        // 设置 post_interpolate_cb 会替代内置的中值滤波，基准中 med_passes 为 0，不受影响
+        int timedProcess()
+        {
+            steps[STEP_START] = mark();
+            // 未触发的回调（例如无需去马赛克的格式）对应零时长
+            for (int i = 1; i < STEP_COUNT; i++)
+                steps[i] = steps[STEP_START];
+            return dcraw_process();
+        }
+
+        // 与 dcraw_process 的选择逻辑一致
+        const char *demosaicName(int quality) const
+        {
+            if (!imgdata.idata.filters)
+                return "none";
+            if (quality == 0)
+                return "linear";
+            if (quality == 1 || imgdata.idata.colors > 3)
+                return "VNG";
+            if (quality == 2 && imgdata.idata.filters > 1000)
+                return "PPG";
+            if (imgdata.idata.filters == LIBRAW_XTRANS)
+                return quality > 2 ? "X-Trans 3-pass" : "X-Trans 1-pass";
+            if (quality == 4)
+                return "DCB";
+            if (quality == 11)
+                return "DHT";
+            if (quality == 12)
+                return "AAHD";
+            return "AHD";
+        }
+
+    private:
+        static void onPreSubtractBlack(void *ctx) { static_cast<BenchProcessor *>(ctx)->steps[STEP_PRE_SUBTRACT_BLACK] = mark(); }
+        static void onPreInterpolate(void *ctx) { static_cast<BenchProcessor *>(ctx)->steps[STEP_PRE_INTERPOLATE] = mark(); }
+        static void onPostInterpolate(void *ctx) { static_cast<BenchProcessor *>(ctx)->steps[STEP_POST_INTERPOLATE] = mark(); }
+        static void onPreConvert(void *ctx) { static_cast<BenchProcessor *>(ctx)->steps[STEP_PRE_CONVERT] = mark(); }
+        static void onPostConvert(void *ctx) { static_cast<BenchProcessor *>(ctx)->steps[STEP_POST_CONVERT] = mark(); }
+    };
+
+    // 两个相邻快照之间的差值
+    Sample between(const Mark &a, const Mark &b)
+    {
+        Sample s;
+        s.ms = std::chrono::duration<double, std::milli>(b.time - a.time).count();
+        s.allocated = b.allocated - a.allocated;
+        s.peak = b.peak > a.live ? b.peak - a.live : 0;
+        return s;
+    }
+
+    // ============== 参数与输入 ==============
+
+    struct Options
+    {
+        int repeat = 3;
+        std::vector<int> qualities = {0, 1, 2, 3, 4, 11, 12};
+        bool json = false;
+        bool identifyOnly = false;
+        std::vector<std::string> inputs;
+    };
+
+    bool isDirectory(const std::string &path)
+    {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    void collectFiles(const std::string &path, std::vector<std::string> &files)
+    {
+        if (!isDirectory(path))
+        {
+            files.push_back(path);
+            return;
+        }
+
+        DIR *dir = opendir(path.c_str());
+        if (!dir)
+            return;
+        std::vector<std::string> entries;
+        while (struct dirent *entry = readdir(dir))
+        {
+            std::string name = entry->d_name;
+            if (name == "." || name == ".." || name[0] == '.')
+                continue;
+            // 跳过 sidecar 元数据
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".xmp") == 0)
+                continue;
+            entries.push_back(path + "/" + name);
+        }
+        closedir(dir);
+
+        std::sort(entries.begin(), entries.end());
+        for (const std::string &entry : entries)
+            collectFiles(entry, files);
+    }
+
+    bool readFile(const std::string &path, std::vector<char> &data)
+    {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        if (!in)
+            return false;
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    std::vector<int> parseQualities(const char *list)
+    {
+        std::vector<int> result;
+        for (const char *p = list; *p;)
+        {
+            char *end;
+            long q = strtol(p, &end, 10);
+            if (end == p)
+                break;
+            result.push_back(static_cast<int>(q));
+            p = *end == ',' ? end + 1 : end;
+        }
+        return result;
+    }
+
+    bool parseArgs(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--repeat" && i + 1 < argc)
+                options.repeat = std::max(1, atoi(argv[++i]));
+            else if (arg == "--quality" && i + 1 < argc)
+                options.qualities = parseQualities(argv[++i]);
+            else if (arg == "--json")
+                options.json = true;
+            else if (arg == "--identify-only")
+                options.identifyOnly = true;
+            else if (arg == "--help" || arg == "-h")
+                return false;
+            else
+                options.inputs.push_back(arg);
+        }
+        if (options.inputs.empty())
+            options.inputs.push_back("raw-samples-repo");
+        return true;
+    }
+
+    // ============== 基准 ==============
+
+    struct FileResult
+    {
+        std::string path;
+        std::string camera;
+        std::string decoder;
+        std::vector<StageResult> stages;
+    };
+
+    StageResult &stage(FileResult &result, const std::string &name, double megapixels)
+    {
+        for (StageResult &s : result.stages)
+            if (s.name == name)
+                return s;
+        result.stages.push_back(StageResult{name, megapixels, {}});
+        return result.stages.back();
+    }
+
+    std::string demosaicStage(const BenchProcessor &proc, int quality)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "demosaic q=%d %s", quality, proc.demosaicName(quality));
+        return name;
+    }
+
+    bool benchFile(const std::string &path, const Options &options, FileResult &result)
+    {
+        std::vector<char> data;
+        if (!readFile(path, data))
+        {
+            fprintf(stderr, "[skip] %s: cannot read file\n", path.c_str());
+            return false;
+        }
+
+        result.path = path;
+
+        for (int run = 0; run < options.repeat; run++)
+        {
+            BenchProcessor proc;
+
+            // open/identify：从内存读取，排除磁盘 I/O
+            Mark start = mark();
+            int ret = proc.open_buffer(data.data(), data.size());
+            Sample openSample = since(start);
+            if (ret != LIBRAW_SUCCESS)
+            {
+                fprintf(stderr, "[skip] %s: %s\n", path.c_str(), libraw_strerror(ret));
+                return false;
+            }
+
+            libraw_decoder_info_t info;
+            proc.get_decoder_info(&info);
+            result.decoder = info.decoder_name ? info.decoder_name : "unknown";
+            result.camera = std::string(proc.imgdata.idata.make) + " " + proc.imgdata.idata.model;
+
+            double rawMp = proc.imgdata.sizes.raw_width * (double)proc.imgdata.sizes.raw_height / 1e6;
+            double imageMp = proc.imgdata.sizes.width * (double)proc.imgdata.sizes.height / 1e6;
+            // 按处理顺序登记阶段，决定报告中的行顺序
+            if (run == 0)
+            {
+                stage(result, "open/identify", rawMp);
+                stage(result, "unpack " + result.decoder, rawMp);
+                stage(result, "raw2image_ex", imageMp);
+                stage(result, "scale_colors+pre_interpolate", imageMp);
+                for (int quality : options.qualities)
+                    stage(result, demosaicStage(proc, quality), imageMp);
+                stage(result, "convert_to_rgb", imageMp);
+                stage(result, "mem_image 8-bit", imageMp);
+                stage(result, "mem_image 16-bit", imageMp);
+            }
+            stage(result, "open/identify", rawMp).samples.push_back(openSample);
+
+            start = mark();
+            ret = proc.unpack();
+            Sample unpackSample = since(start);
+            if (ret != LIBRAW_SUCCESS)
+            {
+                fprintf(stderr, "[skip] %s: unpack failed: %s\n", path.c_str(), libraw_strerror(ret));
+                return false;
+            }
+            stage(result, "unpack " + result.decoder, rawMp).samples.push_back(unpackSample);
+
+            for (size_t qi = 0; qi < options.qualities.size(); qi++)
+            {
+                int quality = options.qualities[qi];
+                proc.imgdata.params.user_qual = quality;
+                if (proc.timedProcess() != LIBRAW_SUCCESS)
+                {
+                    fprintf(stderr, "[skip] %s: dcraw_process failed at quality %d\n", path.c_str(), quality);
+                    return false;
+                }
+
+                const Mark *steps = proc.steps;
+                stage(result, demosaicStage(proc, quality), imageMp).samples.push_back(between(steps[STEP_PRE_INTERPOLATE], steps[STEP_POST_INTERPOLATE]));
+
+                // 其余阶段与去马赛克质量无关，只统计第一次处理
+                if (qi != 0)
+                    continue;
+
+                stage(result, "raw2image_ex", imageMp).samples.push_back(between(steps[STEP_START], steps[STEP_PRE_SUBTRACT_BLACK]));
+                stage(result, "scale_colors+pre_interpolate", imageMp).samples.push_back(between(steps[STEP_PRE_SUBTRACT_BLACK], steps[STEP_PRE_INTERPOLATE]));
+                stage(result, "convert_to_rgb", imageMp).samples.push_back(between(steps[STEP_PRE_CONVERT], steps[STEP_POST_CONVERT]));
+
+                for (int bps : {8, 16})
+                {
+                    proc.imgdata.params.output_bps = bps;
+                    int errcode = 0;
+                    start = mark();
+                    libraw_processed_image_t *image = proc.dcraw_make_mem_image(&errcode);
+                    Sample memSample = since(start);
+                    if (!image)
+                    {
+                        fprintf(stderr, "[skip] %s: dcraw_make_mem_image failed: %s\n", path.c_str(), libraw_strerror(errcode));
+                        return false;
+                    }
+                    LibRaw::dcraw_clear_mem(image);
+                    stage(result, bps == 8 ? "mem_image 8-bit" : "mem_image 16-bit", imageMp).samples.push_back(memSample);
+                }
+                proc.imgdata.params.output_bps = 8;
+            }
+        }
+        return true;
+    }
+
+    // 单次 identify 只需几十微秒，按批计时以减小时钟误差
+    const int IDENTIFY_BATCH = 200;
+
+    bool benchIdentify(const std::string &path, const Options &options, FileResult &result)
+    {
+        std::vector<char> data;
+        if (!readFile(path, data))
+        {
+            fprintf(stderr, "[skip] %s: cannot read file\n", path.c_str());
+            return false;
+        }
+
+        result.path = path;
+        BenchProcessor proc;
+        int ret = proc.open_buffer(data.data(), data.size());
+        if (ret != LIBRAW_SUCCESS)
+        {
+            fprintf(stderr, "[skip] %s: %s\n", path.c_str(), libraw_strerror(ret));
+            return false;
+        }
+        libraw_decoder_info_t info;
+        proc.get_decoder_info(&info);
+        result.decoder = info.decoder_name ? info.decoder_name : "unknown";
+        result.camera = std::string(proc.imgdata.idata.make) + " " + proc.imgdata.idata.model;
+
+        StageResult &identify = stage(result, "open/identify", 0);
+        for (int run = 0; run < options.repeat; run++)
+        {
+            Mark start = mark();
+            for (int i = 0; i < IDENTIFY_BATCH; i++)
+            {
+                proc.recycle();
+                proc.open_buffer(data.data(), data.size());
+            }
+            Sample sample = since(start);
+            sample.ms /= IDENTIFY_BATCH;
+            sample.allocated /= IDENTIFY_BATCH;
+            identify.samples.push_back(sample);
+        }
+        return true;
+    }
+
+    // 每个文件的单次耗时和吞吐量，以及全部文件依次打开一遍的总吞吐量
+    void printIdentifyTable(const std::vector<FileResult> &results)
+    {
+        printf("\n  %-48s %10s %10s\n", "file", "us/file", "files/s");
+        double total = 0;
+        for (const FileResult &r : results)
+        {
+            double ms = r.stages.front().median().ms;
+            total += ms;
+            printf("  %-48s %10.1f %10.0f\n", r.camera.c_str(), ms * 1000.0, ms > 0 ? 1000.0 / ms : 0.0);
+        }
+        if (!results.empty())
+            printf("  %-48s %10.1f %10.0f\n", "all files", total * 1000.0 / results.size(), total > 0 ? results.size() * 1000.0 / total : 0.0);
+    }
+
+    double mbytes(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+    void printTable(const FileResult &result)
+    {
+        printf("\n%s\n  %s, decoder %s\n", result.path.c_str(), result.camera.c_str(), result.decoder.c_str());
+        printf("  %-36s %10s %10s %12s %12s\n", "stage", "ms", "MPix/s", "alloc MB", "peak MB");
+        for (const StageResult &s : result.stages)
+        {
+            Sample m = s.median();
+            printf("  %-36s %10.2f %10.1f", s.name.c_str(), m.ms, m.ms > 0 ? s.megapixels / (m.ms / 1000.0) : 0.0);
+            if (BENCH_TRACK_ALLOCATIONS)
+                printf(" %12.1f %12.1f\n", mbytes(m.allocated), mbytes(m.peak));
+            else
+                printf(" %12s %12s\n", "n/a", "n/a");
+        }
+    }
+
+    void printJsonString(const std::string &value)
+    {
+        putchar('"');
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+                putchar('\\');
+            if (static_cast<unsigned char>(c) >= 0x20)
+                putchar(c);
+        }
+        putchar('"');
+    }
+
+    // 每个阶段输出全部样本，便于回归脚本自行计算统计量
+    void printJson(const std::vector<FileResult> &results, const Options &options)
+    {
+        printf("{\"libraw\":");
+        printJsonString(LibRaw::version());
+        printf(",\"simd\":\"%s\",\"repeat\":%d,\"trackAllocations\":%s,\"files\":[", simdLevelName(simdLevel()), options.repeat,
+               BENCH_TRACK_ALLOCATIONS ? "true" : "false");
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const FileResult &r = results[i];
+            printf("%s{\"path\":", i ? "," : "");
+            printJsonString(r.path);
+            printf(",\"camera\":");
+            printJsonString(r.camera);
+            printf(",\"decoder\":");
+            printJsonString(r.decoder);
+            printf(",\"stages\":[");
+            for (size_t j = 0; j < r.stages.size(); j++)
+            {
+                const StageResult &s = r.stages[j];
+                Sample m = s.median();
+                printf("%s{\"name\":", j ? "," : "");
+                printJsonString(s.name);
+                printf(",\"megapixels\":%.4f,\"medianMs\":%.3f,\"mpixPerSec\":%.3f,\"allocatedBytes\":%zu,\"peakBytes\":%zu,\"samplesMs\":[",
+                       s.megapixels, m.ms, m.ms > 0 ? s.megapixels / (m.ms / 1000.0) : 0.0, m.allocated, m.peak);
+                for (size_t k = 0; k < s.samples.size(); k++)
+                    printf("%s%.3f", k ? "," : "", s.samples[k].ms);
+                printf("]}");
+            }
+            printf("]}");
+        }
+        printf("]}\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArgs(argc, argv, options))
+    {
+        printf("Usage: %s [--repeat N] [--quality 0,1,2,3,4,11,12] [--identify-only] [--json] [files or directories...]\n", argv[0]);
+        return 0;
+    }
+
+    std::vector<std::string> files;
+    for (const std::string &input : options.inputs)
+        collectFiles(input, files);
+
+    if (files.empty())
+    {
+        fprintf(stderr, "No input files found\n");
+        return 1;
+    }
+
+    if (!options.json)
+        printf("LibRaw %s, SIMD %s, %d run(s) per stage, median reported\n", LibRaw::version(), simdLevelName(simdLevel()),
+               options.repeat);
+
+    std::vector<FileResult> results;
+    for (const std::string &file : files)
+    {
+        FileResult result;
+        if (!(options.identifyOnly ? benchIdentify(file, options, result) : benchFile(file, options, result)))
+            continue;
+        if (!options.json && !options.identifyOnly)
+            printTable(result);
+        results.push_back(result);
+    }
+
+    if (options.json)
+        printJson(results, options);
+    else if (options.identifyOnly)
+        printIdentifyTable(results);
+
+    return results.empty() ? 1 : 0;
+}
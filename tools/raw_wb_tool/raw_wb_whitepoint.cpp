@@ -74,6 +74,16 @@
 #include <cstdlib>
 #include <cmath>
 #include <memory>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <tuple>
 
 #include <libraw.h>
 #include <lcms2.h>
@@ -134,8 +144,15 @@ namespace WhitePointWB
         int jpeg_quality = 95;    // JPEG 质量
         bool save_linear = false; // 是否保存线性输出
         bool verbose = false;     // 详细输出
+
+        // 批处理设置（输入为目录时）
+        std::string output_dir; // 输出目录（默认与输入相同）
+        int threads = 0;        // 工作线程数，0 = CPU 核数
     };
 
+    // 多线程时按整段输出日志，避免不同文件的行交错
+    std::mutex g_log_mutex;
+
     // 色温转换函数现在由 color_temperature.h 提供
 
     // ========== LibRaw 白平衡系数处理 ==========
@@ -160,83 +177,79 @@ namespace WhitePointWB
     // ========== 色彩适应变换（CAT）==========
 
     /**
-     * @brief 使用 LittleCMS 创建色彩适应变换
+     * @brief sRGB 原色（CAT 前后的线性配置文件与 sRGB 输出共用）
+     */
+    cmsCIExyYTRIPLE srgbPrimaries()
+    {
+        cmsCIExyYTRIPLE primaries;
+        primaries.Red.x = 0.6400;
+        primaries.Red.y = 0.3300;
+        primaries.Red.Y = 1.0;
+        primaries.Green.x = 0.3000;
+        primaries.Green.y = 0.6000;
+        primaries.Green.Y = 1.0;
+        primaries.Blue.x = 0.1500;
+        primaries.Blue.y = 0.0600;
+        primaries.Blue.Y = 1.0;
+        return primaries;
+    }
+
+    cmsCIExyY toCmsXYY(const ColorXYZ &wp)
+    {
+        ChromaticityXY xy = wp.toXY();
+        cmsCIExyY xyY;
+        xyY.x = xy.x;
+        xyY.y = xy.y;
+        xyY.Y = wp.Y;
+        return xyY;
+    }
+
+    /**
+     * @brief 使用 LittleCMS 创建"色彩适应 + sRGB 伽马编码"的融合变换
+     *
+     * 源配置文件：sRGB 原色、源白点、线性 TRC
+     * 目标配置文件：sRGB 原色、目标白点、sRGB 参数化 TRC
      *
-     * 创建从源白点到目标白点的色彩适应变换
-     * 使用 Bradford 或其他 CAT 算法
+     * 绝对色度意图把源白点映射到目标白点（CAT），随后的目标 TRC 即 sRGB OETF，
+     * 因此一次 cmsDoTransform 同时完成原来的 CAT 变换和单独的伽马变换，
+     * 中间不需要线性目标白点的临时图像
      *
      * @param source_wp 源白点 XYZ
      * @param target_wp 目标白点 XYZ
      * @param method CAT 方法
-     * @return LittleCMS 变换句柄
+     * @return LittleCMS 变换句柄（浮点变换，无缓存，可在多个线程中同时使用）
      */
-    cmsHTRANSFORM createChromaticAdaptationTransform(
+    cmsHTRANSFORM createFusedTransform(
         const ColorXYZ &source_wp,
         const ColorXYZ &target_wp,
         WhiteBalanceConfig::CATMethod method)
     {
+        cmsCIExyY source_xyY = toCmsXYY(source_wp);
+        cmsCIExyY target_xyY = toCmsXYY(target_wp);
+        cmsCIExyYTRIPLE primaries = srgbPrimaries();
 
-        // 转换到 LittleCMS 的 xyY 格式
-        cmsCIExyY source_xyY, target_xyY;
-        ChromaticityXY source_xy = source_wp.toXY();
-        ChromaticityXY target_xy = target_wp.toXY();
-
-        source_xyY.x = source_xy.x;
-        source_xyY.y = source_xy.y;
-        source_xyY.Y = source_wp.Y;
-
-        target_xyY.x = target_xy.x;
-        target_xyY.y = target_xy.y;
-        target_xyY.Y = target_wp.Y;
-
-        // 创建线性 RGB 配置文件（使用 sRGB 原色）
-        cmsCIExyYTRIPLE srgb_primaries;
-        srgb_primaries.Red.x = 0.6400;
-        srgb_primaries.Red.y = 0.3300;
-        srgb_primaries.Red.Y = 1.0;
-        srgb_primaries.Green.x = 0.3000;
-        srgb_primaries.Green.y = 0.6000;
-        srgb_primaries.Green.Y = 1.0;
-        srgb_primaries.Blue.x = 0.1500;
-        srgb_primaries.Blue.y = 0.0600;
-        srgb_primaries.Blue.Y = 1.0;
-
-        // 线性传输曲线
+        // 线性传输曲线（源）和 sRGB 传输曲线（目标，IEC 61966-2.1 参数）
         cmsToneCurve *linear_curve = cmsBuildGamma(nullptr, 1.0);
-        cmsToneCurve *linear_rgb[3] = {linear_curve, linear_curve, linear_curve};
+        cmsToneCurve *linear_trc[3] = {linear_curve, linear_curve, linear_curve};
+        const cmsFloat64Number srgb_params[5] = {2.4, 1.0 / 1.055, 0.055 / 1.055, 1.0 / 12.92, 0.04045};
+        cmsToneCurve *srgb_curve = cmsBuildParametricToneCurve(nullptr, 4, srgb_params);
+        cmsToneCurve *srgb_trc[3] = {srgb_curve, srgb_curve, srgb_curve};
 
-        // 创建源和目标配置文件
-        cmsHPROFILE source_profile = cmsCreateRGBProfile(&source_xyY, &srgb_primaries, linear_rgb);
-        cmsHPROFILE target_profile = cmsCreateRGBProfile(&target_xyY, &srgb_primaries, linear_rgb);
+        cmsHPROFILE source_profile = cmsCreateRGBProfile(&source_xyY, &primaries, linear_trc);
+        cmsHPROFILE target_profile = cmsCreateRGBProfile(&target_xyY, &primaries, srgb_trc);
 
-        // 设置适应算法
-        cmsUInt32Number adaptation_state = 1; // 完全适应
-        switch (method)
-        {
-        case WhiteBalanceConfig::BRADFORD:
-            cmsSetAdaptationState(adaptation_state);
-            break;
-        case WhiteBalanceConfig::CAT02:
-            // LittleCMS 默认使用 Bradford，CAT02 需要特殊处理
-            // 这里简化处理，实际应用中可能需要自定义插件
-            cmsSetAdaptationState(adaptation_state);
-            break;
-        case WhiteBalanceConfig::VON_KRIES:
-            // von Kries 是最简单的对角矩阵变换
-            cmsSetAdaptationState(adaptation_state);
-            break;
-        }
+        // LittleCMS 内置的适应算法是 Bradford；CAT02 / von Kries 需要自定义插件，这里同样使用完全适应
+        (void)method;
+        cmsSetAdaptationState(1.0);
 
-        // 创建变换
         cmsHTRANSFORM transform = cmsCreateTransform(
             source_profile, TYPE_RGB_FLT,
             target_profile, TYPE_RGB_FLT,
-            INTENT_ABSOLUTE_COLORIMETRIC, // 使用绝对色度以保持白点
-            cmsFLAGS_NOOPTIMIZE           // 不优化，保持精度
-        );
+            INTENT_ABSOLUTE_COLORIMETRIC,            // 使用绝对色度以保持白点
+            cmsFLAGS_NOOPTIMIZE | cmsFLAGS_NOCACHE); // 不优化，保持精度
 
-        // 清理
         cmsFreeToneCurve(linear_curve);
+        cmsFreeToneCurve(srgb_curve);
         cmsCloseProfile(source_profile);
         cmsCloseProfile(target_profile);
 
@@ -244,42 +257,80 @@ namespace WhitePointWB
     }
 
     /**
-     * @brief 应用白点变换到图像
+     * @brief 融合变换缓存
      *
-     * @param input 输入图像（线性 RGB，浮点）
-     * @param transform LittleCMS 变换
-     * @return 变换后的图像
+     * 同一台相机、同一白平衡设置的文件源白点相同，批处理中只需创建一次变换。
+     * 白点按 1e-5 量化作为键；所有变换在缓存析构时释放
      */
-    cv::Mat applyWhitePointTransform(const cv::Mat &input, cmsHTRANSFORM transform)
+    class TransformCache
     {
-        CV_Assert(input.type() == CV_32FC3);
-
-        cv::Mat output(input.size(), CV_32FC3);
-
-        // LittleCMS 期望的是连续内存布局
-        if (input.isContinuous() && output.isContinuous())
+    public:
+        ~TransformCache()
         {
-            // 直接变换整个图像
-            cmsDoTransform(transform,
-                           input.ptr<float>(),
-                           output.ptr<float>(),
-                           static_cast<cmsUInt32Number>(input.total()));
+            for (auto &entry : transforms_)
+                cmsDeleteTransform(entry.second);
         }
-        else
+
+        cmsHTRANSFORM get(const ChromaticityXY &source_xy,
+                          const ChromaticityXY &target_xy,
+                          WhiteBalanceConfig::CATMethod method)
         {
-            // 逐行变换
-            for (int y = 0; y < input.rows; ++y)
+            Key key{quantize(source_xy.x), quantize(source_xy.y),
+                    quantize(target_xy.x), quantize(target_xy.y), static_cast<int>(method)};
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = transforms_.find(key);
+            if (it != transforms_.end())
             {
-                const float *src_row = input.ptr<float>(y);
-                float *dst_row = output.ptr<float>(y);
-                cmsDoTransform(transform,
-                               const_cast<float *>(src_row),
-                               dst_row,
-                               static_cast<cmsUInt32Number>(input.cols));
+                hits_++;
+                return it->second;
             }
+
+            cmsHTRANSFORM transform = createFusedTransform(
+                ColorXYZ::fromXY(source_xy), ColorXYZ::fromXY(target_xy), method);
+            if (transform)
+                transforms_.emplace(key, transform);
+            return transform;
         }
 
-        return output;
+        size_t size() const { return transforms_.size(); }
+        size_t hits() const { return hits_; }
+
+    private:
+        using Key = std::tuple<long, long, long, long, int>;
+
+        static long quantize(double v) { return std::lround(v * 100000.0); }
+
+        std::mutex mutex_;
+        std::map<Key, cmsHTRANSFORM> transforms_;
+        size_t hits_ = 0;
+    };
+
+    /**
+     * @brief 按行带并行应用变换
+     *
+     * 输入和输出都是连续的 CV_32FC3（RGB 顺序），每个行带调用一次 cmsDoTransform
+     *
+     * @param input 输入图像（线性 RGB，浮点）
+     * @param output 输出图像（按需分配，可复用）
+     * @param transform LittleCMS 变换
+     */
+    void applyTransformInBands(const cv::Mat &input, cv::Mat &output, cmsHTRANSFORM transform)
+    {
+        CV_Assert(input.type() == CV_32FC3);
+        output.create(input.size(), CV_32FC3);
+
+        // 行带至少 16 行，避免调度开销超过变换本身
+        const int stripes = std::max(1, input.rows / 16);
+        cv::parallel_for_(cv::Range(0, input.rows), [&](const cv::Range &rows)
+                          {
+            for (int y = rows.start; y < rows.end; ++y)
+            {
+                cmsDoTransform(transform,
+                               input.ptr<float>(y),
+                               output.ptr<float>(y),
+                               static_cast<cmsUInt32Number>(input.cols));
+            } }, stripes);
     }
 
     // ========== 主处理流程 ==========
@@ -291,15 +342,41 @@ namespace WhitePointWB
     {
     private:
         WhiteBalanceConfig config_;
+        TransformCache &transforms_;
         std::unique_ptr<LibRaw> processor_;
 
+        // 按工作线程复用的缓冲区，同尺寸的后续文件不再分配
+        cv::Mat rgb_;     // LibRaw 输出（8/16 位 RGB）
+        cv::Mat linear_;  // 线性浮点 RGB
+        cv::Mat encoded_; // CAT + sRGB 编码后的浮点 RGB
+        cv::Mat rgb_u8_;
+        cv::Mat bgr_u8_;
+
     public:
-        explicit WhitePointProcessor(const WhiteBalanceConfig &config)
-            : config_(config), processor_(std::make_unique<LibRaw>())
+        WhitePointProcessor(const WhiteBalanceConfig &config, TransformCache &transforms)
+            : config_(config), transforms_(transforms), processor_(std::make_unique<LibRaw>())
         {
         }
 
-        bool process()
+        /**
+         * @brief 处理单个文件；同一实例可顺序处理多个文件（每个工作线程一个 LibRaw）
+         */
+        bool process(const std::string &input_path, const std::string &output_path)
+        {
+            config_.input_path = input_path;
+            config_.output_path = output_path;
+            processor_->recycle();
+
+            std::ostringstream log;
+            bool ok = processFile(log);
+
+            std::lock_guard<std::mutex> lock(g_log_mutex);
+            std::cout << log.str() << std::flush;
+            return ok;
+        }
+
+    private:
+        bool processFile(std::ostringstream &log)
         {
             // 1. 打开和解包 RAW 文件
             if (!loadRawFile())
@@ -311,15 +388,15 @@ namespace WhitePointWB
 
             if (config_.verbose)
             {
-                std::cout << "\n========== 白平衡信息 ==========\n";
-                std::cout << "📷 源白点（相机捕获）:\n";
-                std::cout << "   xy坐标: (" << std::fixed << std::setprecision(4)
+                log << "\n========== 白平衡信息 ==========\n";
+                log << "📷 源白点（相机捕获）:\n";
+                log << "   xy坐标: (" << std::fixed << std::setprecision(4)
                           << source_xy.x << ", " << source_xy.y << ")\n";
-                std::cout << "   物理色温: " << std::fixed << std::setprecision(0)
+                log << "   物理色温: " << std::fixed << std::setprecision(0)
                           << source_kelvin << "K\n";
                 double source_duv = calculateDuv(source_xy);
-                std::cout << "   Duv: " << std::fixed << std::setprecision(4) << source_duv << "\n";
-                std::cout << "   " << (source_kelvin < 4000 ? "🔥 暖光场景" : source_kelvin < 6000 ? "☀️ 中性光"
+                log << "   Duv: " << std::fixed << std::setprecision(4) << source_duv << "\n";
+                log << "   " << (source_kelvin < 4000 ? "🔥 暖光场景" : source_kelvin < 6000 ? "☀️ 中性光"
                                                                                                    : "❄️ 冷光场景")
                           << "\n\n";
             }
@@ -330,68 +407,62 @@ namespace WhitePointWB
             {
                 double target_kelvin = xyToKelvin(target_xy);
                 double target_duv = calculateDuv(target_xy);
-                std::cout << "🎯 目标白点（补偿后）:\n";
-                std::cout << "   xy坐标: (" << std::fixed << std::setprecision(4)
+                log << "🎯 目标白点（补偿后）:\n";
+                log << "   xy坐标: (" << std::fixed << std::setprecision(4)
                           << target_xy.x << ", " << target_xy.y << ")\n";
-                std::cout << "   目标色温: " << std::fixed << std::setprecision(0)
+                log << "   目标色温: " << std::fixed << std::setprecision(0)
                           << target_kelvin << "K\n";
 
                 if (std::abs(target_duv) > 0.0001)
                 {
-                    std::cout << "   色调(Duv): " << std::fixed << std::setprecision(4)
+                    log << "   色调(Duv): " << std::fixed << std::setprecision(4)
                               << target_duv;
                     if (target_duv > 0)
                     {
-                        std::cout << " (洋红偏移)";
+                        log << " (洋红偏移)";
                     }
                     else
                     {
-                        std::cout << " (绿色偏移)";
+                        log << " (绿色偏移)";
                     }
-                    std::cout << "\n";
+                    log << "\n";
                 }
 
                 // 显示补偿方向
-                std::cout << "\n💡 补偿说明:\n";
+                log << "\n💡 补偿说明:\n";
                 if (source_kelvin < target_kelvin)
                 {
-                    std::cout << "   场景偏暖(" << source_kelvin << "K) → 加冷色补偿 → ";
+                    log << "   场景偏暖(" << source_kelvin << "K) → 加冷色补偿 → ";
                 }
                 else if (source_kelvin > target_kelvin)
                 {
-                    std::cout << "   场景偏冷(" << source_kelvin << "K) → 加暖色补偿 → ";
+                    log << "   场景偏冷(" << source_kelvin << "K) → 加暖色补偿 → ";
                 }
                 else
                 {
-                    std::cout << "   场景中性 → 无需补偿 → ";
+                    log << "   场景中性 → 无需补偿 → ";
                 }
-                std::cout << "目标(" << target_kelvin << "K)\n";
-                std::cout << "==================================\n\n";
+                log << "目标(" << target_kelvin << "K)\n";
+                log << "==================================\n\n";
             }
 
             // 4. 处理图像到线性 RGB
-            cv::Mat linear_rgb = processToLinearRGB();
-            if (linear_rgb.empty())
+            if (!processToLinearRGB())
                 return false;
 
-            // 5. 创建并应用色彩适应变换
-            ColorXYZ source_wp = ColorXYZ::fromXY(source_xy);
-            ColorXYZ target_wp = ColorXYZ::fromXY(target_xy);
-
-            cmsHTRANSFORM cat_transform = createChromaticAdaptationTransform(
-                source_wp, target_wp, config_.cat_method);
-
-            cv::Mat adapted_rgb = applyWhitePointTransform(linear_rgb, cat_transform);
-            cmsDeleteTransform(cat_transform);
-
-            // 6. 应用 sRGB 色调映射曲线
-            cv::Mat srgb_encoded = applyGammaEncoding(adapted_rgb);
+            // 5. 色彩适应和 sRGB 编码（缓存的融合变换，按行带并行）
+            cmsHTRANSFORM transform = transforms_.get(source_xy, target_xy, config_.cat_method);
+            if (!transform)
+            {
+                std::cerr << "错误：创建色彩变换失败" << std::endl;
+                return false;
+            }
+            applyTransformInBands(linear_, encoded_, transform);
 
-            // 7. 保存结果
-            return saveOutput(srgb_encoded, linear_rgb);
+            // 6. 保存结果
+            return saveOutput(log);
         }
 
-    private:
         bool loadRawFile()
         {
             int ret = processor_->open_file(config_.input_path.c_str());
@@ -458,111 +529,48 @@ namespace WhitePointWB
             }
         }
 
-        cv::Mat processToLinearRGB()
+        bool processToLinearRGB()
         {
             // 让 LibRaw 处理去马赛克等操作
             int ret = processor_->dcraw_process();
             if (ret != LIBRAW_SUCCESS)
             {
                 std::cerr << "错误：处理失败: " << libraw_strerror(ret) << std::endl;
-                return cv::Mat();
-            }
-
-            // 获取处理后的图像
-            int err = 0;
-            libraw_processed_image_t *img = processor_->dcraw_make_mem_image(&err);
-            if (!img || err != LIBRAW_SUCCESS)
-            {
-                std::cerr << "错误：创建内存图像失败" << std::endl;
-                if (img)
-                    LibRaw::dcraw_clear_mem(img);
-                return cv::Mat();
+                return false;
             }
 
-            // 转换到 OpenCV Mat
-            cv::Mat linear;
-            if (img->colors != 3 || (img->bits != 8 && img->bits != 16))
+            int width = 0, height = 0, colors = 0, bps = 0;
+            processor_->get_mem_image_format(&width, &height, &colors, &bps);
+            if (colors != 3 || (bps != 8 && bps != 16))
             {
                 std::cerr << "错误：不支持的图像格式" << std::endl;
-                LibRaw::dcraw_clear_mem(img);
-                return cv::Mat();
+                return false;
             }
 
-            if (img->bits == 16)
-            {
-                cv::Mat temp(img->height, img->width, CV_16UC3, img->data);
-                // 保持为 RGB 顺序，方便直接传给 LCMS（TYPE_RGB_FLT）
-                cv::Mat rgb = temp.clone();
-                rgb.convertTo(linear, CV_32FC3, 1.0 / 65535.0);
-            }
-            else
+            // 直接写入复用的 Mat（RGB 顺序，方便直接传给 LCMS 的 TYPE_RGB_FLT），
+            // 不经过 dcraw_make_mem_image 的中间副本
+            rgb_.create(height, width, bps == 16 ? CV_16UC3 : CV_8UC3);
+            ret = processor_->copy_mem_image(rgb_.data, static_cast<int>(rgb_.step), 0);
+            if (ret != LIBRAW_SUCCESS)
             {
-                cv::Mat temp(img->height, img->width, CV_8UC3, img->data);
-                cv::Mat rgb = temp.clone();
-                rgb.convertTo(linear, CV_32FC3, 1.0 / 255.0);
+                std::cerr << "错误：创建内存图像失败: " << libraw_strerror(ret) << std::endl;
+                return false;
             }
 
-            LibRaw::dcraw_clear_mem(img);
-            return linear;
-        }
-
-        cv::Mat applyGammaEncoding(const cv::Mat &linear_rgb)
-        {
-            // 将线性 sRGB（原色为 sRGB，TRC=1.0）编码为标准 sRGB OETF
-            cmsCIExyYTRIPLE srgb_primaries;
-            srgb_primaries.Red.x = 0.6400;
-            srgb_primaries.Red.y = 0.3300;
-            srgb_primaries.Red.Y = 1.0;
-            srgb_primaries.Green.x = 0.3000;
-            srgb_primaries.Green.y = 0.6000;
-            srgb_primaries.Green.Y = 1.0;
-            srgb_primaries.Blue.x = 0.1500;
-            srgb_primaries.Blue.y = 0.0600;
-            srgb_primaries.Blue.Y = 1.0;
-
-            // 使用 D65 白点（与 sRGB 一致）
-            cmsCIExyY d65;
-            d65.x = 0.31271;
-            d65.y = 0.32902;
-            d65.Y = 1.0;
-
-            cmsToneCurve *linear_curve = cmsBuildGamma(nullptr, 1.0);
-            // 避免与函数参数名 linear_rgb 冲突，使用不同变量名
-            cmsToneCurve *linear_trc[3] = {linear_curve, linear_curve, linear_curve};
-
-            cmsHPROFILE linear_srgb_profile = cmsCreateRGBProfile(&d65, &srgb_primaries, linear_trc);
-            cmsHPROFILE srgb_profile = cmsCreate_sRGBProfile();
-
-            cmsHTRANSFORM gamma_transform = cmsCreateTransform(
-                linear_srgb_profile, TYPE_RGB_FLT,
-                srgb_profile, TYPE_RGB_FLT,
-                INTENT_PERCEPTUAL, 0);
-
-            cv::Mat encoded = applyWhitePointTransform(linear_rgb, gamma_transform);
-
-            cmsDeleteTransform(gamma_transform);
-            cmsFreeToneCurve(linear_curve);
-            cmsCloseProfile(linear_srgb_profile);
-            cmsCloseProfile(srgb_profile);
-            return encoded;
+            // uint16/uint8 → float 一次完成
+            rgb_.convertTo(linear_, CV_32FC3, bps == 16 ? 1.0 / 65535.0 : 1.0 / 255.0);
+            return true;
         }
 
-        bool saveOutput(const cv::Mat &srgb, const cv::Mat &linear)
+        bool saveOutput(std::ostringstream &log)
         {
-            // 裁剪到 [0,1] 范围
-            cv::Mat clipped;
-            cv::min(srgb, 1.0, clipped);
-            cv::max(clipped, 0.0, clipped);
-
-            // 转换到 8 位，并从 RGB 转回 BGR 以匹配 OpenCV 保存
-            cv::Mat rgb_u8;
-            clipped.convertTo(rgb_u8, CV_8UC3, 255.0);
-            cv::Mat bgr_u8;
-            cv::cvtColor(rgb_u8, bgr_u8, cv::COLOR_RGB2BGR);
+            // 转换到 8 位（convertTo 饱和截断，等价于先裁剪到 [0,1]），并从 RGB 转回 BGR 以匹配 OpenCV 保存
+            encoded_.convertTo(rgb_u8_, CV_8UC3, 255.0);
+            cv::cvtColor(rgb_u8_, bgr_u8_, cv::COLOR_RGB2BGR);
 
             // 保存 JPEG
             std::vector<int> jpeg_params = {cv::IMWRITE_JPEG_QUALITY, config_.jpeg_quality};
-            bool success = cv::imwrite(config_.output_path, bgr_u8, jpeg_params);
+            bool success = cv::imwrite(config_.output_path, bgr_u8_, jpeg_params);
 
             if (!success)
             {
@@ -570,22 +578,113 @@ namespace WhitePointWB
                 return false;
             }
 
-            std::cout << "✓ 已保存: " << config_.output_path << std::endl;
+            log << "✓ 已保存: " << config_.output_path << std::endl;
 
             // 可选：保存线性输出
             if (config_.save_linear)
             {
                 std::string linear_path = config_.output_path + ".linear.tiff";
                 cv::Mat linear_u16;
-                linear.convertTo(linear_u16, CV_16UC3, 65535.0);
+                linear_.convertTo(linear_u16, CV_16UC3, 65535.0);
                 cv::imwrite(linear_path, linear_u16);
-                std::cout << "✓ 线性输出: " << linear_path << std::endl;
+                log << "✓ 线性输出: " << linear_path << std::endl;
             }
 
             return true;
         }
     };
 
+    // ========== 批处理 ==========
+
+    bool isRawFile(const std::filesystem::path &path)
+    {
+        static const char *extensions[] = {".arw", ".cr2", ".cr3", ".crw", ".nef", ".nrw", ".dng", ".raf",
+                                           ".rw2", ".orf", ".pef", ".srw", ".raw", ".rwl", ".3fr", ".iiq",
+                                           ".erf", ".mef", ".mos", ".mrw", ".x3f", ".kdc", ".dcr", ".srf"};
+        std::string ext = path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c)
+                       { return static_cast<char>(std::tolower(c)); });
+        for (const char *candidate : extensions)
+        {
+            if (ext == candidate)
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief 处理目录中的所有 RAW 文件
+     *
+     * 每个工作线程持有一个 WhitePointProcessor（一个 LibRaw 实例和一组复用的缓冲区），
+     * 从共享的文件列表中依次领取任务；融合变换在线程间共享
+     *
+     * @return 失败的文件数
+     */
+    int runBatch(const WhiteBalanceConfig &config, const std::string &input_dir)
+    {
+        namespace fs = std::filesystem;
+
+        std::vector<fs::path> files;
+        for (const auto &entry : fs::directory_iterator(input_dir))
+        {
+            if (entry.is_regular_file() && isRawFile(entry.path()))
+                files.push_back(entry.path());
+        }
+        std::sort(files.begin(), files.end());
+
+        if (files.empty())
+        {
+            std::cerr << "错误：目录中没有 RAW 文件: " << input_dir << std::endl;
+            return 1;
+        }
+
+        fs::path output_dir = config.output_dir.empty() ? fs::path(input_dir) : fs::path(config.output_dir);
+        fs::create_directories(output_dir);
+
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        size_t thread_count = config.threads > 0 ? static_cast<size_t>(config.threads) : cores;
+        thread_count = std::min(thread_count, files.size());
+
+        // 文件级已经并行，剩余的核心留给行带并行
+        cv::setNumThreads(static_cast<int>(std::max<size_t>(1, cores / thread_count)));
+
+        std::cout << "📂 批处理 " << files.size() << " 个文件，" << thread_count << " 个线程\n";
+
+        TransformCache transforms;
+        std::atomic<size_t> next{0};
+        std::atomic<int> failed{0};
+        auto started = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < thread_count; ++t)
+        {
+            workers.emplace_back([&]()
+                                 {
+                WhitePointProcessor processor(config, transforms);
+                for (size_t i = next++; i < files.size(); i = next++)
+                {
+                    const fs::path &input = files[i];
+                    fs::path output = output_dir / (input.filename().string() + "_whitepoint.jpg");
+                    if (!processor.process(input.string(), output.string()))
+                    {
+                        failed++;
+                        std::lock_guard<std::mutex> lock(g_log_mutex);
+                        std::cerr << "✗ 失败: " << input.string() << std::endl;
+                    }
+                } });
+        }
+        for (auto &worker : workers)
+            worker.join();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::cout << "\n📊 完成 " << (files.size() - failed) << "/" << files.size() << " 个文件，用时 "
+                  << std::fixed << std::setprecision(2) << seconds << "s（"
+                  << std::setprecision(2) << files.size() / seconds << " 个/秒），"
+                  << transforms.size() << " 个色彩变换，复用 " << transforms.hits() << " 次\n";
+
+        return failed.load();
+    }
+
 } // namespace WhitePointWB
 
 // ========== 主函数 ==========
@@ -593,7 +692,7 @@ namespace WhitePointWB
 void printUsage(const char *prog)
 {
     std::cout << "\n基于白点的白平衡调节工具\n\n";
-    std::cout << "用法: " << prog << " [选项] <RAW文件>\n\n";
+    std::cout << "用法: " << prog << " [选项] <RAW文件|目录>\n\n";
     std::cout << "选项:\n";
     std::cout << "  --out <path>          输出 JPEG 路径\n";
     std::cout << "  --mode <mode>         白平衡模式:\n";
@@ -607,11 +706,14 @@ void printUsage(const char *prog)
     std::cout << "  --cat <method>        CAT 方法: bradford|cat02|vonkries\n";
     std::cout << "  --quality <1-100>     JPEG 质量（默认 95）\n";
     std::cout << "  --save-linear         同时保存线性 TIFF\n";
+    std::cout << "  --threads <n>         批处理线程数（输入为目录时，默认 CPU 核数）\n";
+    std::cout << "  --out-dir <dir>       批处理输出目录（默认与输入目录相同）\n";
     std::cout << "  --verbose             详细输出\n";
     std::cout << "  --help                显示帮助\n\n";
     std::cout << "示例:\n";
     std::cout << "  " << prog << " --mode kelvin --kelvin 5500 --duv -0.01 input.raw\n";
-    std::cout << "  " << prog << " --mode xy --xy 0.3127,0.3290 input.raw\n\n";
+    std::cout << "  " << prog << " --mode xy --xy 0.3127,0.3290 input.raw\n";
+    std::cout << "  " << prog << " --threads 8 --out-dir out/ raw_dir/\n\n";
 }
 
 int main(int argc, char *argv[])
@@ -683,6 +785,14 @@ int main(int argc, char *argv[])
         {
             config.jpeg_quality = std::atoi(argv[++i]);
         }
+        else if (arg == "--threads" && i + 1 < argc)
+        {
+            config.threads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--out-dir" && i + 1 < argc)
+        {
+            config.output_dir = argv[++i];
+        }
         else if (arg == "--save-linear")
         {
             config.save_linear = true;
@@ -703,6 +813,12 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    // 目录输入：批处理模式
+    if (std::filesystem::is_directory(positional[0]))
+    {
+        return WhitePointWB::runBatch(config, positional[0]) == 0 ? 0 : 1;
+    }
+
     config.input_path = positional[0];
     if (config.output_path.empty())
     {
@@ -710,6 +826,7 @@ int main(int argc, char *argv[])
     }
 
     // 执行处理
-    WhitePointWB::WhitePointProcessor processor(config);
-    return processor.process() ? 0 : 1;
+    WhitePointWB::TransformCache transforms;
+    WhitePointWB::WhitePointProcessor processor(config, transforms);
+    return processor.process(config.input_path, config.output_path) ? 0 : 1;
 }